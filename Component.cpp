@@ -277,10 +277,7 @@ void Component::MoveCursor(int r, int c)
 	cursCol = c;
 	cursVisible = true;
 
-	if (Active()) {
-		move(ScreenRow() + ClientRow() + r, ScreenColumn() + ClientColumn() + c);
-		curs_set(TRUE);
-	}
+	if (Active()) wm.UpdateCursor();
 }
 
 
@@ -291,9 +288,7 @@ void Component::HideCursor(void)
 {
 	cursVisible = false;
 
-	if (Active()) {
-		curs_set(FALSE);
-	}
+	if (Active()) wm.UpdateCursor();
 }
 
 
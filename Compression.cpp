@@ -0,0 +1,510 @@
+/*
+ * Compression.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stdafx.h"
+#include "Compression.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+
+
+/**
+ * Determine whether a file is compressed with gzip
+ *
+ * @param fd the file descriptor, positioned at the beginning of the file
+ *           (the position is not changed)
+ * @return true if it starts with the gzip magic number
+ */
+bool IsGzip(int fd)
+{
+	unsigned char magic[2];
+	ssize_t n;
+
+	do {
+		n = pread(fd, magic, sizeof(magic), 0);
+	}
+	while (n < 0 && errno == EINTR);
+
+	return n == 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+}
+
+
+/**
+ * Create an instance of class FileReader
+ */
+FileReader::FileReader(void)
+{
+	fd = -1;
+	compressed = false;
+	size = 0;
+	position = 0;
+	finished = false;
+	cancelled = false;
+	result = ReturnExt(true);
+	trailingGarbage = 0;
+}
+
+
+/**
+ * Destroy the object, closing the file
+ */
+FileReader::~FileReader(void)
+{
+	Close();
+}
+
+
+/**
+ * Open a file, and start decompressing it if it is compressed
+ *
+ * @param file the file name
+ * @return a ReturnExt
+ */
+ReturnExt FileReader::Open(const char* file)
+{
+	Close();
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return ReturnExt(false, "Cannot open the file", errno);
+	}
+
+	struct stat st;
+	size = fstat(fd, &st) == 0 && S_ISREG(st.st_mode) ? st.st_size : 0;
+	position = 0;
+
+	compressed = IsGzip(fd);
+	if (!compressed) return ReturnExt(true);
+
+
+	// Decompress on a separate thread
+
+	finished = false;
+	cancelled = false;
+	result = ReturnExt(true);
+	trailingGarbage = 0;
+
+	try {
+		inflater = std::thread(&FileReader::Inflate, this);
+	}
+	catch (std::system_error& e) {
+		Close();
+		return ReturnExt(false, "Cannot start the decompression thread",
+				e.code().value());
+	}
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Close the file, and stop decompressing it
+ */
+void FileReader::Close(void)
+{
+	if (inflater.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			cancelled = true;
+		}
+		changed.notify_all();
+		inflater.join();
+	}
+
+	blocks.clear();
+
+	if (fd >= 0) {
+		close(fd);
+		fd = -1;
+	}
+}
+
+
+/**
+ * Read the next block of the (decompressed) contents
+ *
+ * @param block where to store the block, which is empty at the end
+ * @return a ReturnExt
+ */
+ReturnExt FileReader::Read(std::vector<char>& block)
+{
+	block.clear();
+
+	if (fd < 0) {
+		return ReturnExt(false, "The file is not open", EBADF);
+	}
+
+
+	// Read a plain file directly
+
+	if (!compressed) {
+		block.resize(APE_READ_BLOCK_SIZE);
+
+		ssize_t n;
+		do {
+			n = read(fd, &block[0], block.size());
+		}
+		while (n < 0 && errno == EINTR);
+
+		if (n < 0) {
+			int e = errno;
+			block.clear();
+			return ReturnExt(false, "Error while reading", e);
+		}
+
+		block.resize(n);
+		position += n;
+		return ReturnExt(true);
+	}
+
+
+	// Take the next decompressed block
+
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() { return !blocks.empty() || finished; });
+
+	if (blocks.empty()) return result;
+
+	block.swap(blocks.front().data);
+	position = blocks.front().position;
+	blocks.pop_front();
+
+	lock.unlock();
+	changed.notify_all();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Decompress the file, and queue the decompressed blocks (runs on
+ * the inflater thread)
+ */
+void FileReader::Inflate(void)
+{
+	ReturnExt r = InflateAll();
+
+	std::lock_guard<std::mutex> lock(mutex);
+	result = r;
+	finished = true;
+	changed.notify_all();
+}
+
+
+/**
+ * Decompress the file (runs on the inflater thread)
+ *
+ * @return a ReturnExt
+ */
+ReturnExt FileReader::InflateAll(void)
+{
+	z_stream z;
+	memset(&z, 0, sizeof(z));
+
+	if (inflateInit2(&z, 15 + 32) != Z_OK) {
+		return ReturnExt(false, "Cannot initialize the decompression", ENOMEM);
+	}
+
+	std::vector<unsigned char> input(APE_READ_BLOCK_SIZE);
+	uint64_t consumed = 0;
+	bool inputEnded = false;
+	bool memberEnded = false;	// At the end of a gzip member
+	bool anyMember = false;		// At least one member was complete
+	uint64_t memberStart = 0;	// The position of the current member
+	unsigned char magic[2];		// The first bytes of the current member
+	size_t magicLength = 0;
+	bool garbage = false;		// In the trailing garbage
+	uint64_t garbageBytes = 0;
+
+	Block block;
+	size_t used = 0;
+	ReturnExt r(true);
+
+	while (true) {
+
+
+		// Read more compressed data
+
+		if (z.avail_in == 0 && !inputEnded) {
+			ssize_t n;
+			do {
+				n = read(fd, &input[0], input.size());
+			}
+			while (n < 0 && errno == EINTR);
+
+			if (n < 0) {
+				r = ReturnExt(false, "Error while reading", errno);
+				break;
+			}
+
+			consumed += n;
+			inputEnded = n == 0;
+			z.next_in = &input[0];
+			z.avail_in = n;
+		}
+
+
+		// Skip the trailing garbage, only counting it
+
+		if (garbage) {
+			garbageBytes += z.avail_in;
+			z.avail_in = 0;
+			if (inputEnded) break;
+			continue;
+		}
+
+		if (z.avail_in == 0 && inputEnded) {
+			if (!memberEnded) {
+				r = ReturnExt(false, "The compressed file is truncated", EIO);
+			}
+			break;
+		}
+
+
+		// A file can consist of several concatenated gzip members
+
+		if (memberEnded) {
+			inflateReset(&z);
+			memberEnded = false;
+			memberStart = consumed - z.avail_in;
+			magicLength = 0;
+		}
+
+
+		// Remember how the member starts, which can be split between two
+		// reads, to tell a damaged member from the trailing garbage
+
+		for (uInt i = 0; magicLength < sizeof(magic) && i < z.avail_in; i++) {
+			magic[magicLength++] = z.next_in[i];
+		}
+
+
+		// Decompress to the current block
+
+		if (block.data.empty()) block.data.resize(APE_READ_BLOCK_SIZE);
+
+		z.next_out = (Bytef*) &block.data[used];
+		z.avail_out = block.data.size() - used;
+
+		size_t before = used;
+		int ret = inflate(&z, Z_NO_FLUSH);
+		used = block.data.size() - z.avail_out;
+
+		if (ret == Z_STREAM_END) {
+			memberEnded = true;
+			anyMember = true;
+		}
+		else if (ret == Z_DATA_ERROR && anyMember && used == before
+				&& !(magicLength == sizeof(magic)
+					&& magic[0] == 0x1f && magic[1] == 0x8b)) {
+
+			// Ignore the trailing garbage after the last member, as gzip
+			// does, but count it, so that the user can be warned about it
+
+			garbage = true;
+			garbageBytes = consumed - memberStart;
+			z.avail_in = 0;
+			continue;
+		}
+		else if (ret != Z_OK && ret != Z_BUF_ERROR) {
+			r = ReturnExt(false, z.msg != NULL ? z.msg
+					: "The compressed file is corrupted", EIO);
+			break;
+		}
+
+
+		// Pass on the full blocks
+
+		if (z.avail_out == 0) {
+			block.position = consumed - z.avail_in;
+			if (!Queue(block)) break;
+			block.data.clear();
+			used = 0;
+		}
+	}
+
+	if (r && used > 0) {
+		block.data.resize(used);
+		block.position = consumed;
+		Queue(block);
+	}
+
+	if (r) {
+		std::lock_guard<std::mutex> lock(mutex);
+		trailingGarbage = garbageBytes;
+	}
+
+	inflateEnd(&z);
+	return r;
+}
+
+
+/**
+ * Queue a decompressed block, waiting while the queue is full (runs on
+ * the inflater thread)
+ *
+ * @param block the block, which will be moved out
+ * @return true if queued, false if the reader was closed
+ */
+bool FileReader::Queue(Block& block)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this]() {
+		return cancelled || blocks.size() < APE_INFLATE_QUEUE_BLOCKS;
+	});
+	if (cancelled) return false;
+
+	blocks.push_back(std::move(block));
+	lock.unlock();
+	changed.notify_all();
+
+	return true;
+}
+
+
+/**
+ * Create an instance of class GzipWriter
+ *
+ * @param fd the file descriptor to write to (it will not be closed)
+ */
+GzipWriter::GzipWriter(int fd)
+{
+	this->fd = fd;
+	written = 0;
+
+	memset(&stream, 0, sizeof(stream));
+	initialized = deflateInit2(&stream, APE_GZIP_LEVEL, Z_DEFLATED, 15 + 16,
+			8, Z_DEFAULT_STRATEGY) == Z_OK;
+
+	buffer.resize(APE_READ_BLOCK_SIZE);
+	stream.next_out = (Bytef*) &buffer[0];
+	stream.avail_out = buffer.size();
+}
+
+
+/**
+ * Destroy the object
+ */
+GzipWriter::~GzipWriter(void)
+{
+	if (initialized) deflateEnd(&stream);
+}
+
+
+/**
+ * Compress the pending input, and write out the full output buffer
+ *
+ * @param flush the zlib flush mode
+ * @return true on success, false on error (with errno set)
+ */
+bool GzipWriter::Deflate(int flush)
+{
+	while (true) {
+		int ret = deflate(&stream, flush);
+		if (ret == Z_STREAM_ERROR) {
+			errno = EIO;
+			return false;
+		}
+
+
+		// Write out the output buffer when it is full, or at the end
+
+		bool end = ret == Z_STREAM_END;
+		if (stream.avail_out == 0 || end) {
+			const char* p = &buffer[0];
+			size_t left = buffer.size() - stream.avail_out;
+
+			while (left > 0) {
+				ssize_t n = write(fd, p, left);
+				if (n < 0) {
+					if (errno == EINTR) continue;
+					return false;
+				}
+				p += n;
+				left -= n;
+				written += n;
+			}
+
+			stream.next_out = (Bytef*) &buffer[0];
+			stream.avail_out = buffer.size();
+		}
+
+		if (end) return true;
+		if (flush == Z_NO_FLUSH && stream.avail_in == 0) return true;
+	}
+}
+
+
+/**
+ * Compress and write the data described by an array of buffers
+ *
+ * @param iov the buffers
+ * @param count the number of buffers
+ * @return true on success, false on error (with errno set)
+ */
+bool GzipWriter::Write(const struct iovec* iov, int count)
+{
+	if (!initialized) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	for (int i = 0; i < count; i++) {
+		stream.next_in = (Bytef*) iov[i].iov_base;
+		stream.avail_in = iov[i].iov_len;
+		if (!Deflate(Z_NO_FLUSH)) return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Finish the compressed stream
+ *
+ * @return true on success, false on error (with errno set)
+ */
+bool GzipWriter::Finish(void)
+{
+	if (!initialized) {
+		errno = ENOMEM;
+		return false;
+	}
+
+	stream.next_in = NULL;
+	stream.avail_in = 0;
+	return Deflate(Z_FINISH);
+}
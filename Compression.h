@@ -0,0 +1,267 @@
+/*
+ * Compression.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __COMPRESSION_H
+#define __COMPRESSION_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdint.h>
+#include <sys/uio.h>
+#include <thread>
+#include <vector>
+#include <zlib.h>
+
+#include "util.h"
+
+
+/**
+ * The size of the blocks read from a file, and of the decompressed blocks
+ */
+#define APE_READ_BLOCK_SIZE			(256 * 1024)
+
+/**
+ * The maximum number of decompressed blocks that wait for the reader
+ */
+#define APE_INFLATE_QUEUE_BLOCKS	4
+
+/**
+ * The gzip compression level used when saving
+ */
+#define APE_GZIP_LEVEL				6
+
+
+/**
+ * Determine whether a file is compressed with gzip
+ *
+ * @param fd the file descriptor, positioned at the beginning of the file
+ *           (the position is not changed)
+ * @return true if it starts with the gzip magic number
+ */
+bool IsGzip(int fd);
+
+
+/**
+ * A reader of the contents of a file in large blocks, which transparently
+ * decompresses gzip files. The decompression runs on a separate thread
+ * a few blocks ahead of the reader, so that it overlaps with processing
+ * the blocks, such as splitting them to lines.
+ *
+ * @author Peter Macko
+ */
+class FileReader
+{
+	/**
+	 * A decompressed block
+	 */
+	struct Block
+	{
+		std::vector<char> data;
+		uint64_t position;		// The position in the file after the block
+	};
+
+	int fd;
+	bool compressed;
+	uint64_t size;
+	uint64_t position;
+
+	std::thread inflater;
+	std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Block> blocks;
+	bool finished;
+	bool cancelled;
+	ReturnExt result;
+	uint64_t trailingGarbage;
+
+
+	/**
+	 * Decompress the file, and queue the decompressed blocks (runs on
+	 * the inflater thread)
+	 */
+	void Inflate(void);
+
+	/**
+	 * Decompress the file (runs on the inflater thread)
+	 *
+	 * @return a ReturnExt
+	 */
+	ReturnExt InflateAll(void);
+
+	/**
+	 * Queue a decompressed block, waiting while the queue is full (runs on
+	 * the inflater thread)
+	 *
+	 * @param block the block, which will be moved out
+	 * @return true if queued, false if the reader was closed
+	 */
+	bool Queue(Block& block);
+
+
+public:
+
+	/**
+	 * Create an instance of class FileReader
+	 */
+	FileReader(void);
+
+	/**
+	 * Destroy the object, closing the file
+	 */
+	virtual ~FileReader(void);
+
+	/**
+	 * Open a file, and start decompressing it if it is compressed
+	 *
+	 * @param file the file name
+	 * @return a ReturnExt
+	 */
+	ReturnExt Open(const char* file);
+
+	/**
+	 * Close the file, and stop decompressing it
+	 */
+	void Close(void);
+
+	/**
+	 * Read the next block of the (decompressed) contents
+	 *
+	 * @param block where to store the block, which is empty at the end
+	 * @return a ReturnExt
+	 */
+	ReturnExt Read(std::vector<char>& block);
+
+	/**
+	 * Get the file descriptor of the open file
+	 *
+	 * @return the file descriptor, or -1 if not open
+	 */
+	inline int Descriptor(void) { return fd; }
+
+	/**
+	 * Determine whether the file is compressed
+	 *
+	 * @return true if it is compressed with gzip
+	 */
+	inline bool Compressed(void) { return compressed; }
+
+	/**
+	 * Get the size of the file on disk
+	 *
+	 * @return the size in bytes, or 0 if unknown
+	 */
+	inline uint64_t Size(void) { return size; }
+
+	/**
+	 * Get the number of bytes of the file on disk consumed by the blocks
+	 * read so far, which is suitable for reporting the progress
+	 *
+	 * @return the number of bytes
+	 */
+	inline uint64_t Position(void) { return position; }
+
+	/**
+	 * Get the number of bytes after the last gzip member that were not
+	 * compressed data and thus were ignored, which is known once all
+	 * blocks have been read
+	 *
+	 * @return the number of bytes
+	 */
+	inline uint64_t TrailingGarbage(void) { return trailingGarbage; }
+};
+
+
+/**
+ * A writer of a gzip-compressed file
+ *
+ * @author Peter Macko
+ */
+class GzipWriter
+{
+	int fd;
+	z_stream stream;
+	bool initialized;
+	std::vector<char> buffer;
+	uint64_t written;
+
+
+	/**
+	 * Compress the pending input, and write out the full output buffer
+	 *
+	 * @param flush the zlib flush mode
+	 * @return true on success, false on error (with errno set)
+	 */
+	bool Deflate(int flush);
+
+
+public:
+
+	/**
+	 * Create an instance of class GzipWriter
+	 *
+	 * @param fd the file descriptor to write to (it will not be closed)
+	 */
+	GzipWriter(int fd);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~GzipWriter(void);
+
+	/**
+	 * Compress and write the data described by an array of buffers
+	 *
+	 * @param iov the buffers
+	 * @param count the number of buffers
+	 * @return true on success, false on error (with errno set)
+	 */
+	bool Write(const struct iovec* iov, int count);
+
+	/**
+	 * Finish the compressed stream
+	 *
+	 * @return true on success, false on error (with errno set)
+	 */
+	bool Finish(void);
+
+	/**
+	 * Get the number of compressed bytes written
+	 *
+	 * @return the number of bytes
+	 */
+	inline uint64_t Written(void) { return written; }
+};
+
+#endif
@@ -165,6 +165,13 @@ protected:
 	 */
 	void AddScrollBar(bool horiz, int start, int end);
 
+	/**
+	 * Return the leadway space to the left of the horizontal scroll bar
+	 *
+	 * @return the number of columns
+	 */
+	inline int HorizScrollStart(void) { return horizScrollStart; }
+
 	/**
 	 * Find the component index
 	 *
@@ -0,0 +1,592 @@
+/*
+ * CursesBackend.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "CursesBackend.h"
+
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <csignal>
+#include <clocale>
+#include <cmath>
+#include <cerrno>
+#include <poll.h>
+
+#ifdef _MAC
+#include <util.h>
+#endif
+
+// Include last, since it defines macros that clash with common identifiers
+#include <term.h>
+
+
+/**
+ * Set by the SIGWINCH handler when the terminal is resized
+ */
+static volatile sig_atomic_t resizePending = 0;
+
+
+/**
+ * Handle the SIGWINCH signal
+ *
+ * @param sig the signal code
+ */
+static void SigWinChHandler(int /* sig */)
+{
+	resizePending = 1;
+}
+
+
+/**
+ * Create an instance of class CursesBackend
+ */
+CursesBackend::CursesBackend(void)
+{
+	win = NULL;
+	cursorVisible = true;
+	syncOutput = false;
+
+	terminalFd = -1;
+	cursesFd = -1;
+	frameFd = -1;
+}
+
+
+/**
+ * Destroy the object
+ */
+CursesBackend::~CursesBackend(void)
+{
+}
+
+
+/**
+ * Initialize the backend
+ *
+ * @param rows where to store the number of rows of the screen
+ * @param cols where to store the number of columns of the screen
+ */
+void CursesBackend::Initialize(int& rows, int& cols)
+{
+	// Configure the input decoder, honoring ESCDELAY (in milliseconds) the
+	// same way as curses does
+
+	const char* escDelay = getenv("ESCDELAY");
+	if (escDelay != NULL && *escDelay != '\0') {
+		decoder.SetEscapeTimeout(atoi(escDelay) / 1000.0);
+	}
+
+	
+	// Initialize the Curses, using the character encoding of the locale for
+	// the output
+
+	setlocale(LC_CTYPE, "");
+
+
+	// Let curses write to its own copy of the terminal file descriptor,
+	// which can then be pointed to the frame file while outputting a frame
+
+	terminalFd = fileno(stdout);
+	cursesFd = dup(terminalFd);
+
+	FILE* out = cursesFd >= 0 ? fdopen(cursesFd, "w") : NULL;
+	if (out == NULL) {
+		if (cursesFd >= 0) close(cursesFd);
+		cursesFd = -1;
+		initscr();
+	}
+	else if (newterm(NULL, out, stdin) == NULL) {
+		fprintf(stderr, "Error opening terminal: %s.\n", getenv("TERM"));
+		exit(1);
+	}
+
+	noecho();
+
+
+	// Initialize keyboard. The input is read and decoded directly from the
+	// standard input, so that partial escape sequences, pasted text, and
+	// the modifier keys are handled consistently across terminals. Keep the
+	// keypad mode on, so that the terminal is in the application mode that
+	// the terminfo entry expects.
+
+	raw();
+	keypad(stdscr, TRUE);
+	nodelay(stdscr, TRUE);
+	
+	
+	// Initialize mouse: report button presses and drags in the SGR format,
+	// and enable the bracketed paste
+	
+	printf("\033[?1002h\033[?1006h\033[?2004h");
+	fflush(stdout);
+
+
+	// Get the screen size
+
+	getmaxyx(stdscr, rows, cols);
+
+
+	// Initialize colors
+
+	if (has_colors()) {
+		start_color();
+		for (int i = 0; i < 8; i++) for (int j = 0; j < 8; j++) {
+			init_pair(j*8+7-i, i, j);
+		}
+	}
+
+
+	// Initialize the main window
+
+	win = newwin(rows, cols, 0, 0);
+
+
+	// Initialize signals
+
+	signal(SIGWINCH, SigWinChHandler);
+
+
+	// Initialize the output
+
+	DetectSynchronizedOutput();
+	CreateFrameFile();
+
+
+	// Flush the initial state of stdscr, so that reading the input does not
+	// cause curses to refresh it, which would be a problem when the frames
+	// are output from a different thread
+
+	refresh();
+}
+
+
+/**
+ * Determine whether the terminal supports synchronized output (DEC private
+ * mode 2026), and if so, prepare the escape sequences
+ */
+void CursesBackend::DetectSynchronizedOutput(void)
+{
+	syncOutput = false;
+	syncBegin = "";
+	syncEnd = "";
+
+
+	// Prefer the "Sync" extended terminfo capability, which takes a single
+	// parameter: 1 to begin the update and 2 to end it
+
+	char* sync = tigetstr((char*) "Sync");
+	if (sync != NULL && sync != (char*) -1) {
+		const char* s = tiparm(sync, 1);
+		if (s != NULL) syncBegin = s;
+		s = tiparm(sync, 2);
+		if (s != NULL) syncEnd = s;
+		syncOutput = syncBegin != "" && syncEnd != "";
+		return;
+	}
+
+
+	// Otherwise recognize the terminals that are known to support the mode,
+	// but whose terminfo entries might not advertise it
+
+	const char* term = getenv("TERM");
+	const char* program = getenv("TERM_PROGRAM");
+
+	static const char* KNOWN_TERMS[] = {
+		"xterm-kitty", "foot", "alacritty", "wezterm", "contour",
+		"xterm-ghostty", NULL
+	};
+
+	static const char* KNOWN_PROGRAMS[] = {
+		"WezTerm", "iTerm.app", "vscode", "ghostty", NULL
+	};
+
+	if (term != NULL) {
+		for (int i = 0; KNOWN_TERMS[i] != NULL; i++) {
+			if (strncmp(term, KNOWN_TERMS[i], strlen(KNOWN_TERMS[i])) == 0) {
+				syncOutput = true;
+			}
+		}
+	}
+
+	if (program != NULL) {
+		for (int i = 0; KNOWN_PROGRAMS[i] != NULL; i++) {
+			if (strcmp(program, KNOWN_PROGRAMS[i]) == 0) syncOutput = true;
+		}
+	}
+
+	if (syncOutput) {
+		syncBegin = "\033[?2026h";
+		syncEnd = "\033[?2026l";
+	}
+}
+
+
+/**
+ * Create the file in memory that curses writes each frame to, so that
+ * the frame can be sent to the terminal in a single write
+ */
+void CursesBackend::CreateFrameFile(void)
+{
+	frameFd = -1;
+	if (cursesFd < 0) return;
+
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+	frameFd = memfd_create("ape-frame", MFD_CLOEXEC);
+#endif
+
+	if (frameFd < 0) {
+		FILE* f = tmpfile();
+		if (f != NULL) {
+			frameFd = dup(fileno(f));
+			fclose(f);
+		}
+	}
+}
+
+
+/**
+ * Shutdown the backend
+ */
+void CursesBackend::Shutdown(void)
+{
+	signal(SIGWINCH, SIG_DFL);
+
+	delwin(win);
+	win = NULL;
+
+	if (frameFd >= 0) {
+		close(frameFd);
+		frameFd = -1;
+	}
+
+	// Configure the terminal to stop reporting mouse events and to stop
+	// bracketing pasted text
+
+	printf("\033[?2004l\033[?1006l\033[?1003l\033[?1002l");
+	fflush(stdout);
+
+	endwin();
+}
+
+
+/**
+ * Read the next key, if available
+ *
+ * @return the key code, KEY_MOUSE for a mouse event, KEY_RESIZE if the
+ *         screen was resized, or ERR if there are no more events
+ */
+int CursesBackend::ReadKey(void)
+{
+	if (resizePending) {
+		resizePending = 0;
+		return KEY_RESIZE;
+	}
+
+
+	// Read all available input
+
+	char buf[4096];
+
+	while (true) {
+		struct pollfd p;
+		p.fd = 0;
+		p.events = POLLIN;
+		p.revents = 0;
+
+		if (poll(&p, 1, 0) <= 0 || (p.revents & POLLIN) == 0) break;
+
+		ssize_t n = read(0, buf, sizeof(buf));
+		if (n <= 0) break;
+
+		decoder.Feed(buf, n, Time());
+		if ((size_t) n < sizeof(buf)) break;
+	}
+
+
+	// Decode the next key
+
+	return decoder.Next(Time());
+}
+
+
+/**
+ * Read the mouse event after ReadKey() returned KEY_MOUSE
+ *
+ * @param event where to store the mouse event
+ * @return true on success
+ */
+bool CursesBackend::ReadMouse(MEVENT& event)
+{
+	event = decoder.Mouse();
+	return true;
+}
+
+
+/**
+ * Read the pasted text after ReadKey() returned KEY_PASTE
+ *
+ * @param text where to store the text
+ * @return true on success
+ */
+bool CursesBackend::ReadPaste(std::string& text)
+{
+	text = decoder.PastedText();
+	return true;
+}
+
+
+/**
+ * Discard all pending input
+ */
+void CursesBackend::DiscardInput(void)
+{
+	while (ReadKey() != ERR);
+	decoder.Reset();
+}
+
+
+/**
+ * Wait until there is input to read, the given file descriptor becomes
+ * readable, or the timeout expires
+ *
+ * @param fd the additional file descriptor to wait for, or -1
+ * @param timeout the timeout in seconds
+ */
+void CursesBackend::WaitForInput(int fd, double timeout)
+{
+	if (resizePending) return;
+
+
+	// Wake up in time to resolve an incomplete escape sequence
+
+	if (decoder.Pending() && timeout > APE_ESCAPE_TIMEOUT) {
+		timeout = APE_ESCAPE_TIMEOUT;
+	}
+
+
+	// Wait; SIGWINCH interrupts the wait
+
+	struct pollfd p[2];
+	int n = 0;
+
+	p[n].fd = 0;
+	p[n].events = POLLIN;
+	p[n].revents = 0;
+	n++;
+
+	if (fd >= 0) {
+		p[n].fd = fd;
+		p[n].events = POLLIN;
+		p[n].revents = 0;
+		n++;
+	}
+
+	poll(p, n, (int) ceil(timeout * 1000));
+}
+
+
+/**
+ * Get the current size of the screen
+ *
+ * @param rows where to store the number of rows
+ * @param cols where to store the number of columns
+ * @return true if the size is known
+ */
+bool CursesBackend::QuerySize(int& rows, int& cols)
+{
+	struct winsize size;
+	size.ws_row = size.ws_col = 0;
+
+	ioctl(0, TIOCGWINSZ, &size);
+	if (size.ws_row && size.ws_col) {
+		rows = size.ws_row;
+		cols = size.ws_col;
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Resize the screen
+ *
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+void CursesBackend::Resize(int rows, int cols)
+{
+	resizeterm(rows, cols);
+	wresize(win, rows, cols);
+
+
+	// Resizing touches stdscr, so flush it here, or otherwise reading the
+	// input would refresh it and wipe out the next frame. Then make sure
+	// that the next frame gets output in full.
+
+	wnoutrefresh(stdscr);
+	touchwin(win);
+}
+
+
+/**
+ * Update the terminal, and show or hide the cursor
+ *
+ * @param frame the frame
+ */
+void CursesBackend::Update(const Frame* frame)
+{
+	// Hide the cursor before and show it after the update, so that it does
+	// not jump around
+
+	if (!frame->showCursor && cursorVisible) {
+		curs_set(FALSE);
+		cursorVisible = false;
+	}
+
+	doupdate();
+
+	if (frame->showCursor && !cursorVisible) {
+		curs_set(TRUE);
+		cursorVisible = true;
+	}
+}
+
+
+/**
+ * Let curses write the frame to the frame file, and then send it to
+ * the terminal, wrapped in the synchronized update sequences if
+ * the terminal supports them, in a single write
+ *
+ * @param frame the frame
+ * @return true on success, false if the frame was not written
+ */
+bool CursesBackend::OutputBuffered(const Frame* frame)
+{
+	if (frameFd < 0) return false;
+
+	if (lseek(frameFd, 0, SEEK_SET) != 0 || ftruncate(frameFd, 0) != 0) {
+		return false;
+	}
+
+	if (dup2(frameFd, cursesFd) < 0) return false;
+	Update(frame);
+	off_t size = lseek(frameFd, 0, SEEK_CUR);
+	dup2(terminalFd, cursesFd);
+
+	if (size <= 0) return true;
+
+
+	// Curses already considers the frame written, so send whatever it wrote
+
+	frameBuffer = syncOutput ? syncBegin : "";
+	size_t start = frameBuffer.length();
+	frameBuffer.resize(start + size);
+
+	ssize_t n = pread(frameFd, &frameBuffer[start], size, 0);
+	frameBuffer.resize(start + (n > 0 ? n : 0));
+	if (syncOutput) frameBuffer += syncEnd;
+
+	const char* p = frameBuffer.data();
+	size_t remaining = frameBuffer.length();
+
+	while (remaining > 0) {
+		ssize_t w = write(terminalFd, p, remaining);
+		if (w < 0) {
+			if (errno == EINTR) continue;
+			break;
+		}
+		p += w;
+		remaining -= w;
+	}
+
+	return true;
+}
+
+
+/**
+ * Output a frame
+ *
+ * @param frame the frame
+ */
+void CursesBackend::Output(const Frame* frame)
+{
+	frame->screen->Paint(win);
+	wmove(win, frame->cursorRow, frame->cursorColumn);
+	wnoutrefresh(win);
+
+
+	// Send the frame to the terminal in a single write, wrapped in
+	// the synchronized update sequences if the terminal supports them: The
+	// terminal then holds the display until it receives the end sequence,
+	// so that it never shows a partially drawn frame. Curses would split
+	// a large frame into several writes, so it writes to a file in memory,
+	// from which the frame is then sent.
+
+	if (OutputBuffered(frame)) return;
+
+
+	// Otherwise let curses write the frame directly. putp() goes through
+	// stdio, so flush it explicitly to keep the sequences in order.
+
+	if (syncOutput) {
+		putp(syncBegin.c_str());
+		fflush(stdout);
+	}
+
+	Update(frame);
+
+	if (syncOutput) {
+		putp(syncEnd.c_str());
+		fflush(stdout);
+	}
+}
+
+
+/**
+ * Get the number of bytes of the previous output that the terminal has not
+ * yet processed
+ *
+ * @return the number of bytes, or 0 if unknown
+ */
+int CursesBackend::OutputQueue(void)
+{
+#ifdef TIOCOUTQ
+	int n = 0;
+	if (ioctl(fileno(stdout), TIOCOUTQ, &n) == 0) return n;
+#endif
+	return 0;
+}
+
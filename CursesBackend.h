@@ -0,0 +1,209 @@
+/*
+ * CursesBackend.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __CURSES_BACKEND_H
+#define __CURSES_BACKEND_H
+
+#include <string>
+
+#include "InputDecoder.h"
+#include "TerminalBackend.h"
+
+
+/**
+ * The terminal backend that uses curses to drive a real terminal
+ *
+ * @author Peter Macko
+ */
+class CursesBackend : public TerminalBackend
+{
+	WINDOW* win;
+	bool cursorVisible;
+
+	InputDecoder decoder;
+
+	bool syncOutput;
+	std::string syncBegin;
+	std::string syncEnd;
+
+	int terminalFd;
+	int cursesFd;
+	int frameFd;
+	std::string frameBuffer;
+
+
+	/**
+	 * Determine whether the terminal supports synchronized output (DEC
+	 * private mode 2026), and if so, prepare the escape sequences
+	 */
+	void DetectSynchronizedOutput(void);
+
+	/**
+	 * Create the file in memory that curses writes each frame to, so that
+	 * the frame can be sent to the terminal in a single write
+	 */
+	void CreateFrameFile(void);
+
+	/**
+	 * Let curses write the frame to the frame file, and then send it to
+	 * the terminal, wrapped in the synchronized update sequences if
+	 * the terminal supports them, in a single write
+	 *
+	 * @param frame the frame
+	 * @return true on success, false if the frame was not written
+	 */
+	bool OutputBuffered(const Frame* frame);
+
+	/**
+	 * Update the terminal, and show or hide the cursor
+	 *
+	 * @param frame the frame
+	 */
+	void Update(const Frame* frame);
+
+
+public:
+
+	/**
+	 * Create an instance of class CursesBackend
+	 */
+	CursesBackend(void);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~CursesBackend(void);
+
+	/**
+	 * Initialize the backend
+	 *
+	 * @param rows where to store the number of rows of the screen
+	 * @param cols where to store the number of columns of the screen
+	 */
+	virtual void Initialize(int& rows, int& cols);
+
+	/**
+	 * Shutdown the backend
+	 */
+	virtual void Shutdown(void);
+
+	/**
+	 * Determine whether the frames should be output from a dedicated render
+	 * thread, so that slow output does not delay processing the input
+	 *
+	 * @return true to use a render thread
+	 */
+	virtual bool RenderInBackground(void) { return true; }
+
+	/**
+	 * Read the next key, if available
+	 *
+	 * @return the key code, KEY_MOUSE for a mouse event, KEY_RESIZE if the
+	 *         screen was resized, or ERR if there are no more events
+	 */
+	virtual int ReadKey(void);
+
+	/**
+	 * Read the mouse event after ReadKey() returned KEY_MOUSE
+	 *
+	 * @param event where to store the mouse event
+	 * @return true on success
+	 */
+	virtual bool ReadMouse(MEVENT& event);
+
+	/**
+	 * Read the pasted text after ReadKey() returned KEY_PASTE
+	 *
+	 * @param text where to store the text
+	 * @return true on success
+	 */
+	virtual bool ReadPaste(std::string& text);
+
+	/**
+	 * Discard all pending input
+	 */
+	virtual void DiscardInput(void);
+
+	/**
+	 * Wait until there is input to read, the given file descriptor becomes
+	 * readable, or the timeout expires
+	 *
+	 * @param fd the additional file descriptor to wait for, or -1
+	 * @param timeout the timeout in seconds
+	 */
+	virtual void WaitForInput(int fd, double timeout);
+
+	/**
+	 * Get the current size of the screen
+	 *
+	 * @param rows where to store the number of rows
+	 * @param cols where to store the number of columns
+	 * @return true if the size is known
+	 */
+	virtual bool QuerySize(int& rows, int& cols);
+
+	/**
+	 * Resize the screen
+	 *
+	 * @param rows the number of rows
+	 * @param cols the number of columns
+	 */
+	virtual void Resize(int rows, int cols);
+
+	/**
+	 * Output a frame
+	 *
+	 * @param frame the frame
+	 */
+	virtual void Output(const Frame* frame);
+
+	/**
+	 * Get the number of bytes of the previous output that the terminal has
+	 * not yet processed
+	 *
+	 * @return the number of bytes, or 0 if unknown
+	 */
+	virtual int OutputQueue(void);
+
+	/**
+	 * Determine whether the terminal output is wrapped in synchronized
+	 * update sequences
+	 *
+	 * @return true if the synchronized output mode is used
+	 */
+	inline bool SynchronizedOutput(void) { return syncOutput; }
+};
+
+#endif
@@ -92,6 +92,19 @@ void DialogWindow::Center(void)
 }
 
 
+/**
+ * Display the dialog window. The dialog runs as a part of the main event
+ * loop, and the handler is called once it is closed.
+ *
+ * @param handler the close handler, or NULL
+ */
+void DialogWindow::Show(const std::function<void(void)>& handler)
+{
+	closeHandler = handler;
+	wm.Add(this);
+}
+
+
 /**
  * Cancel the dialog
  */
@@ -101,6 +114,21 @@ void DialogWindow::Cancel(void)
 }
 
 
+/**
+ * An event handler for closing the window
+ */
+void DialogWindow::OnClose(void)
+{
+	// Release the handler before calling it, since it might show this
+	// dialog again
+
+	std::function<void(void)> handler = closeHandler;
+	closeHandler = NULL;
+
+	if (handler) handler();
+}
+
+
 /**
  * An event handler for pressing a key
  *
@@ -250,27 +278,19 @@ const char* SimpleDialogWindow::ButtonText(DialogButton button)
 
 
 /**
- * Display and run the dialog window
+ * Display and run the dialog window. This returns immediately, and the
+ * handler is called from the main event loop once the dialog is closed.
  *
- * @return the clicked button, or DIALOG_BUTTON_CANCEL if the window was
- *         closed
+ * @param handler the handler that receives the clicked button, or
+ *                DIALOG_BUTTON_CANCEL if the window was closed
  */
-DialogButton SimpleDialogWindow::Run(void)
+void SimpleDialogWindow::Run(const std::function<void(DialogButton)>& handler)
 {
 	returnCode = DIALOG_BUTTON_CANCEL;
-	wm.Add(this);
-
-	// TODO What if we have two dialogs at the same time??? I really need to
-	// handle this differently -- either have at most one outstanding Run(),
-	// I need to go multi-threaded, or I need to use continuations. That's a
-	// lot of work.
-
-	while (Mode() != WM_CLOSED) {
-		usleep(20 * 1000);
-		wm.ProcessMessages();
-	}
 
-	return returnCode;
+	Show([this, handler]() {
+		if (handler) handler(returnCode);
+	});
 }
 
 
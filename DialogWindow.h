@@ -35,6 +35,7 @@
 #ifndef __DIALOG_WINDOW_H
 #define __DIALOG_WINDOW_H
 
+#include <functional>
 #include <vector>
 
 #include "Button.h"
@@ -71,6 +72,7 @@ enum DialogButton
 class DialogWindow : public Window
 {
 	Window* parentWindow;
+	std::function<void(void)> closeHandler;
 
 
 protected:
@@ -120,12 +122,25 @@ public:
 
 protected:
 
+	/**
+	 * Display the dialog window. The dialog runs as a part of the main event
+	 * loop, and the handler is called once it is closed.
+	 *
+	 * @param handler the close handler, or NULL
+	 */
+	void Show(const std::function<void(void)>& handler);
+
 	/**
 	 * Center the window relative to the parent (or to the screen if there is
 	 * no parent)
 	 */
 	virtual void Center(void);
 
+	/**
+	 * An event handler for closing the window
+	 */
+	virtual void OnClose(void);
+
 	/**
 	 * An event handler for pressing a key
 	 *
@@ -168,12 +183,13 @@ public:
 	virtual ~SimpleDialogWindow(void);
 
 	/**
-	 * Display and run the dialog window
+	 * Display and run the dialog window. This returns immediately, and the
+	 * handler is called from the main event loop once the dialog is closed.
 	 *
-	 * @return the clicked button, or DIALOG_BUTTON_CANCEL if the window was
-	 *         closed
+	 * @param handler the handler that receives the clicked button, or
+	 *                DIALOG_BUTTON_CANCEL if the window was closed
 	 */
-	DialogButton Run(void);
+	void Run(const std::function<void(DialogButton)>& handler = NULL);
 
 	/**
 	 * Cancel the dialog
@@ -0,0 +1,284 @@
+/*
+ * Diff.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stdafx.h"
+#include "Diff.h"
+
+#include <algorithm>
+
+
+/**
+ * Create an instance of class Diff
+ *
+ * @param a the old sequence
+ * @param b the new sequence
+ */
+Diff::Diff(const std::vector<int64_t>& a, const std::vector<int64_t>& b)
+	: aChanged(a.size(), 0), bChanged(b.size(), 0)
+{
+	this->a = a.data();
+	this->b = b.data();
+}
+
+
+/**
+ * Compute the differences between two sequences
+ *
+ * @param a the old sequence
+ * @param b the new sequence
+ * @return the ranges that differ, in the increasing order
+ */
+std::vector<DiffHunk> Diff::Compute(const std::vector<int64_t>& a,
+		const std::vector<int64_t>& b)
+{
+	Diff diff(a, b);
+	diff.Compare(0, (int64_t) a.size(), 0, (int64_t) b.size());
+
+
+	// Collect the runs of the changed lines
+
+	std::vector<DiffHunk> hunks;
+	int64_t i = 0;
+	int64_t j = 0;
+	int64_t n = (int64_t) a.size();
+	int64_t m = (int64_t) b.size();
+
+	while (i < n || j < m) {
+		if (i < n && j < m && !diff.aChanged[i] && !diff.bChanged[j]) {
+			i++;
+			j++;
+			continue;
+		}
+
+		DiffHunk h;
+		h.oldStart = i;
+		h.newStart = j;
+
+		while (i < n && diff.aChanged[i]) i++;
+		while (j < m && diff.bChanged[j]) j++;
+
+		h.oldCount = i - h.oldStart;
+		h.newCount = j - h.newStart;
+		hunks.push_back(h);
+	}
+
+	return hunks;
+}
+
+
+/**
+ * Find the differences within a range, and mark the changed lines
+ *
+ * @param aLo the start of the old range
+ * @param aHi the end of the old range (exclusive)
+ * @param bLo the start of the new range
+ * @param bHi the end of the new range (exclusive)
+ */
+void Diff::Compare(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi)
+{
+	// Skip the common prefix and suffix, which for typical changes leaves
+	// just a small range to search
+
+	while (aLo < aHi && bLo < bHi && a[aLo] == b[bLo]) {
+		aLo++;
+		bLo++;
+	}
+
+	while (aLo < aHi && bLo < bHi && a[aHi - 1] == b[bHi - 1]) {
+		aHi--;
+		bHi--;
+	}
+
+	if (aLo == aHi || bLo == bHi) {
+		MarkChanged(aLo, aHi, bLo, bHi);
+		return;
+	}
+
+
+	// Split the range, and compare the two parts separately
+
+	int64_t x, y;
+	if (!Bisect(aLo, aHi, bLo, bHi, x, y)
+			|| (x == aLo && y == bLo) || (x == aHi && y == bHi)) {
+		MarkChanged(aLo, aHi, bLo, bHi);
+		return;
+	}
+
+	Compare(aLo, x, bLo, y);
+	Compare(x, aHi, y, bHi);
+}
+
+
+/**
+ * Find a point on the shortest edit script for a range, where the
+ * forward and the backward searches meet
+ *
+ * @param aLo the start of the old range
+ * @param aHi the end of the old range (exclusive)
+ * @param bLo the start of the new range
+ * @param bHi the end of the new range (exclusive)
+ * @param x where to store the old line at which to split the range
+ * @param y where to store the new line at which to split the range
+ * @return true if found, or false if the edit distance exceeds
+ *         APE_DIFF_MAX_COST
+ */
+bool Diff::Bisect(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi,
+		int64_t& x, int64_t& y)
+{
+	int64_t n = aHi - aLo;
+	int64_t m = bHi - bLo;
+	int maxD = (int) std::min<int64_t>((n + m + 1) / 2, APE_DIFF_MAX_COST);
+
+	int offset = maxD;
+	int length = 2 * maxD + 2;
+
+	forward.assign(length, -1);
+	backward.assign(length, -1);
+	forward[offset + 1] = 0;
+	backward[offset + 1] = 0;
+
+	int64_t delta = n - m;
+	bool odd = (delta & 1) != 0;
+
+
+	// The diagonals that ran off the edges of the edit graph are skipped
+	// in the subsequent steps
+
+	int k1start = 0;
+	int k1end = 0;
+	int k2start = 0;
+	int k2end = 0;
+
+	for (int d = 0; d < maxD; d++) {
+
+
+		// Extend the forward paths
+
+		for (int k = -d + k1start; k <= d - k1end; k += 2) {
+			int i = offset + k;
+			int64_t px;
+
+			if (k == -d || (k != d && forward[i - 1] < forward[i + 1])) {
+				px = forward[i + 1];
+			}
+			else {
+				px = forward[i - 1] + 1;
+			}
+
+			int64_t py = px - k;
+			while (px < n && py < m && a[aLo + px] == b[bLo + py]) {
+				px++;
+				py++;
+			}
+
+			forward[i] = px;
+
+			if (px > n) {
+				k1end += 2;
+			}
+			else if (py > m) {
+				k1start += 2;
+			}
+			else if (odd) {
+				int64_t j = offset + delta - k;
+				if (j >= 0 && j < length && backward[j] != -1
+						&& px >= n - backward[j]) {
+					x = aLo + px;
+					y = bLo + py;
+					return true;
+				}
+			}
+		}
+
+
+		// Extend the backward paths, which start at the ends of the ranges
+
+		for (int k = -d + k2start; k <= d - k2end; k += 2) {
+			int i = offset + k;
+			int64_t px;
+
+			if (k == -d || (k != d && backward[i - 1] < backward[i + 1])) {
+				px = backward[i + 1];
+			}
+			else {
+				px = backward[i - 1] + 1;
+			}
+
+			int64_t py = px - k;
+			while (px < n && py < m
+					&& a[aHi - 1 - px] == b[bHi - 1 - py]) {
+				px++;
+				py++;
+			}
+
+			backward[i] = px;
+
+			if (px > n) {
+				k2end += 2;
+			}
+			else if (py > m) {
+				k2start += 2;
+			}
+			else if (!odd) {
+				int64_t j = offset + delta - k;
+				if (j >= 0 && j < length && forward[j] != -1) {
+					int64_t fx = forward[j];
+					int64_t fy = fx - (delta - k);
+					if (fx >= n - px) {
+						x = aLo + fx;
+						y = bLo + fy;
+						return true;
+					}
+				}
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * Mark the whole range as changed
+ *
+ * @param aLo the start of the old range
+ * @param aHi the end of the old range (exclusive)
+ * @param bLo the start of the new range
+ * @param bHi the end of the new range (exclusive)
+ */
+void Diff::MarkChanged(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi)
+{
+	for (int64_t i = aLo; i < aHi; i++) aChanged[i] = 1;
+	for (int64_t j = bLo; j < bHi; j++) bChanged[j] = 1;
+}
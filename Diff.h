@@ -0,0 +1,140 @@
+/*
+ * Diff.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __DIFF_H
+#define __DIFF_H
+
+#include <stdint.h>
+#include <vector>
+
+
+/**
+ * The maximum edit distance searched for within a range before the whole
+ * range is reported as changed
+ */
+#define APE_DIFF_MAX_COST		4096
+
+
+/**
+ * A range of lines that differ between two sequences: the old lines are
+ * replaced by the new lines
+ */
+struct DiffHunk
+{
+	int64_t oldStart;
+	int64_t oldCount;
+	int64_t newStart;
+	int64_t newCount;
+};
+
+
+/**
+ * The line-level difference between two sequences, using the linear-space
+ * variant of the Myers O(ND) algorithm. The lines are given as integers,
+ * which are equal if and only if the lines are equal, so that they need
+ * to be hashed and compared just once.
+ *
+ * @author Peter Macko
+ */
+class Diff
+{
+	const int64_t* a;
+	const int64_t* b;
+
+	std::vector<char> aChanged;
+	std::vector<char> bChanged;
+
+	std::vector<int64_t> forward;
+	std::vector<int64_t> backward;
+
+
+	/**
+	 * Create an instance of class Diff
+	 *
+	 * @param a the old sequence
+	 * @param b the new sequence
+	 */
+	Diff(const std::vector<int64_t>& a, const std::vector<int64_t>& b);
+
+	/**
+	 * Find the differences within a range, and mark the changed lines
+	 *
+	 * @param aLo the start of the old range
+	 * @param aHi the end of the old range (exclusive)
+	 * @param bLo the start of the new range
+	 * @param bHi the end of the new range (exclusive)
+	 */
+	void Compare(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi);
+
+	/**
+	 * Find a point on the shortest edit script for a range, where the
+	 * forward and the backward searches meet
+	 *
+	 * @param aLo the start of the old range
+	 * @param aHi the end of the old range (exclusive)
+	 * @param bLo the start of the new range
+	 * @param bHi the end of the new range (exclusive)
+	 * @param x where to store the old line at which to split the range
+	 * @param y where to store the new line at which to split the range
+	 * @return true if found, or false if the edit distance exceeds
+	 *         APE_DIFF_MAX_COST
+	 */
+	bool Bisect(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi,
+			int64_t& x, int64_t& y);
+
+	/**
+	 * Mark the whole range as changed
+	 *
+	 * @param aLo the start of the old range
+	 * @param aHi the end of the old range (exclusive)
+	 * @param bLo the start of the new range
+	 * @param bHi the end of the new range (exclusive)
+	 */
+	void MarkChanged(int64_t aLo, int64_t aHi, int64_t bLo, int64_t bHi);
+
+
+public:
+
+	/**
+	 * Compute the differences between two sequences
+	 *
+	 * @param a the old sequence
+	 * @param b the new sequence
+	 * @return the ranges that differ, in the increasing order
+	 */
+	static std::vector<DiffHunk> Compute(const std::vector<int64_t>& a,
+			const std::vector<int64_t>& b);
+};
+
+#endif
@@ -35,206 +35,2299 @@
 #include "stdafx.h"
 #include "Document.h"
 
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <fcntl.h>
+#include <libgen.h>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <system_error>
+#include <thread>
 #include <unistd.h>
+#include <unordered_map>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "Compression.h"
+#include "Manager.h"
+#include "Operation.h"
+#include "ThreadPool.h"
+#include "UTF8.h"
+
+
+/**
+ * The number of saves that run in the background
+ */
+static int backgroundSaves = 0;
+static std::mutex backgroundSavesMutex;
+static std::condition_variable backgroundSavesDone;
+
+SaveDurability EditorDocument::saveDurability = SAVE_DURABILITY_DATA;
+uint64_t EditorDocument::streamLimit = APE_STREAM_DEFAULT_LIMIT;
+
+
+/**
+ * Get the file mode creation mask of the process
+ *
+ * @return the mask
+ */
+static mode_t ProcessUmask(void)
+{
+	mode_t mask = umask(0);
+	umask(mask);
+	return mask;
+}
+
+
+/**
+ * The file mode creation mask, read during the static initialization, since
+ * umask() cannot be read without changing it, which is not thread-safe
+ */
+static mode_t processUmask = ProcessUmask();
+
+
+/**
+ * Get the name of a file without the directory
+ *
+ * @param file the file path
+ * @return the file name
+ */
+static const char* FileBaseName(const char* file)
+{
+	const char* s = strrchr(file, '/');
+	return s == NULL ? file : s + 1;
+}
+
+
+/**
+ * Get the number of bytes needed to save a snapshot in UTF-8
+ *
+ * @param snapshot the snapshot
+ * @param format the format of the file
+ * @return the number of bytes
+ */
+static uint64_t SnapshotSize(const DocumentSnapshot& snapshot,
+		const TextFormat& format)
+{
+	int64_t numLines = snapshot.NumLines();
+	uint64_t total = 0;
+
+	for (int64_t i = 0; i < numLines; i++) {
+		total += snapshot.LineObject(i).Length();
+	}
+	if (numLines > 0) total += (numLines - 1) * strlen(format.Newline());
+	if (format.bom) total += 3;
+
+	return total;
+}
+
+
+/**
+ * Determine whether a line has the given text
+ *
+ * @param line the line
+ * @param text the text
+ * @return true if they are the same
+ */
+static bool SameText(const DocumentLine& line, const std::string& text)
+{
+	return line.Length() == text.length()
+		&& memcmp(line.Text(), text.data(), text.length()) == 0;
+}
+
+
+/**
+ * Compute the differences between the lines of a snapshot and the given
+ * lines. The lines are compared by their hash-consed classes, and only
+ * the range between the common prefix and suffix is hashed at all.
+ *
+ * @param snapshot the snapshot
+ * @param text the new lines
+ * @return the ranges of lines that differ
+ */
+static std::vector<DiffHunk> DiffLines(const DocumentSnapshot& snapshot,
+		const std::vector<std::string>& text)
+{
+	int64_t n = snapshot.NumLines();
+	int64_t m = (int64_t) text.size();
+
+	int64_t prefix = 0;
+	while (prefix < n && prefix < m
+			&& SameText(snapshot.LineObject(prefix), text[prefix])) {
+		prefix++;
+	}
+
+	int64_t suffix = 0;
+	while (suffix < n - prefix && suffix < m - prefix
+			&& SameText(snapshot.LineObject(n - 1 - suffix),
+				text[m - 1 - suffix])) {
+		suffix++;
+	}
+
+
+	// Assign the same number to the equal lines, copying only the old lines
+	// between the common prefix and suffix
+
+	std::vector<std::string> old(n - prefix - suffix);
+	for (size_t i = 0; i < old.size(); i++) {
+		old[i] = snapshot.LineObject(prefix + i).String();
+	}
+
+	std::unordered_map<std::reference_wrapper<const std::string>, int64_t,
+		std::hash<std::string>, std::equal_to<std::string>> classes;
+
+	std::vector<int64_t> a(n - prefix - suffix);
+	std::vector<int64_t> b(m - prefix - suffix);
+
+	for (size_t i = 0; i < a.size(); i++) {
+		a[i] = classes.insert(std::make_pair(std::cref(old[i]),
+					(int64_t) classes.size())).first->second;
+	}
+
+	for (size_t i = 0; i < b.size(); i++) {
+		b[i] = classes.insert(std::make_pair(std::cref(text[prefix + i]),
+					(int64_t) classes.size())).first->second;
+	}
+
+
+	// Compare them
+
+	std::vector<DiffHunk> hunks = Diff::Compute(a, b);
+
+	for (size_t i = 0; i < hunks.size(); i++) {
+		hunks[i].oldStart += prefix;
+		hunks[i].newStart += prefix;
+	}
+
+	return hunks;
+}
+
+
+/**
+ * Write all data described by an array of buffers, resuming after partial
+ * writes
+ *
+ * @param fd the file descriptor
+ * @param iov the buffers (will be modified)
+ * @param count the number of buffers
+ * @return true on success, false on error (with errno set)
+ */
+static bool WriteVector(int fd, struct iovec* iov, int count)
+{
+	while (count > 0) {
+		ssize_t n = writev(fd, iov, count);
+		if (n < 0) {
+			if (errno == EINTR) continue;
+			return false;
+		}
+
+		while (count > 0 && (size_t) n >= iov->iov_len) {
+			n -= iov->iov_len;
+			iov++;
+			count--;
+		}
+
+		if (count > 0) {
+			iov->iov_base = (char*) iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Write a snapshot to a file. The contents are written to a temporary file
+ * in the same directory, which then atomically replaces the target, so that
+ * the target is never left partially written.
+ *
+ * @param snapshot the snapshot
+ * @param format the format of the file
+ * @param file the file name
+ * @param size the number of UTF-8 bytes to write
+ * @param durability the durability guarantees
+ * @param progress the function to call with the number of UTF-8 bytes
+ *                 written so far, which returns false to cancel the save
+ * @return a ReturnExt
+ */
+static ReturnExt WriteSnapshot(const DocumentSnapshot& snapshot,
+		const TextFormat& format, const char* file, uint64_t size,
+		SaveDurability durability,
+		const std::function<bool(uint64_t)>& progress)
+{
+	// Resolve symbolic links, so that we replace the file and not the link
+
+	std::string target = file;
+	char* real = realpath(file, NULL);
+	if (real != NULL) {
+		target = real;
+		free(real);
+	}
+
+	struct stat st;
+	bool exists = stat(target.c_str(), &st) == 0;
+
+
+	// Create the temporary file in the same directory as the target, so that
+	// the rename does not cross file systems
+
+	size_t slash = target.rfind('/');
+	std::string dir = slash == std::string::npos ? "." : target.substr(0, slash);
+	if (dir.empty()) dir = "/";
+
+	std::string tmpName = dir + "/." + FileBaseName(target.c_str()) + ".XXXXXX";
+	std::vector<char> tmp(tmpName.begin(), tmpName.end());
+	tmp.push_back('\0');
+
+	int fd = mkstemp(&tmp[0]);
+	if (fd < 0) {
+		return ReturnExt(false, "Cannot create a temporary file", errno);
+	}
+
+
+	// Preserve the permissions and the ownership of the original file, or
+	// use the default permissions for a new file
+
+	if (exists) {
+		fchmod(fd, st.st_mode & 07777);
+		if (fchown(fd, st.st_uid, st.st_gid) != 0) {
+			// Only privileged users can give the file away; keep our own
+		}
+	}
+	else {
+		fchmod(fd, 0666 & ~processUmask);
+	}
+
+
+	// A file in another encoding is converted back from UTF-8 one batch
+	// at a time
+
+	bool convert = format.encoding != TEXT_ENCODING_UTF8
+		&& format.encoding != TEXT_ENCODING_AUTO;
+
+
+	// Preallocate the file, which reduces the fragmentation and reports
+	// running out of disk space before anything gets written (the size is
+	// counted in UTF-8 bytes, so it is not known in advance for a compressed
+	// or a converted file)
+
+#if defined(__linux__)
+	if (size > 0 && !format.gzip && !convert && fallocate(fd, 0, 0, size) != 0
+			&& errno == ENOSPC) {
+		close(fd);
+		unlink(&tmp[0]);
+		return ReturnExt(false, "There is not enough disk space", ENOSPC);
+	}
+#endif
+
+
+	// Write the lines in large batches, checking for cancellation between
+	// the batches
+
+	static const char bom[] = "\xEF\xBB\xBF";
+	const char* newline = format.Newline();
+	size_t newlineLength = strlen(newline);
+
+	struct iovec iov[APE_SAVE_BATCH_LINES * 2];
+	GzipWriter gzip(fd);
+
+
+	std::unique_ptr<TextConverter> converter;
+	std::string converted;
+	if (convert) {
+		converter.reset(new TextConverter(TEXT_ENCODING_UTF8, format.encoding));
+	}
+
+	int64_t numLines = snapshot.NumLines();
+	uint64_t written = 0;
+	uint64_t processed = 0;
+
+	for (int64_t i = 0; i < numLines; ) {
+		int count = 0;
+		uint64_t batch = 0;
+
+		if (i == 0 && format.bom) {
+			iov[count].iov_base = (void*) bom;
+			iov[count].iov_len = 3;
+			count++;
+			batch += 3;
+		}
+
+		// Each line takes up to two buffers, so the BOM takes the place of
+		// one line, which keeps the batch within IOV_MAX
+
+		int batchLines = APE_SAVE_BATCH_LINES - count;
+
+		for (int b = 0; b < batchLines && i < numLines; b++, i++) {
+			const DocumentLine& l = snapshot.LineObject(i);
+			if (l.Length() > 0) {
+				iov[count].iov_base = (void*) l.Text();
+				iov[count].iov_len = l.Length();
+				count++;
+				batch += l.Length();
+			}
+			if (i + 1 < numLines) {
+				iov[count].iov_base = (void*) newline;
+				iov[count].iov_len = newlineLength;
+				count++;
+				batch += newlineLength;
+			}
+		}
+
+		processed += batch;
+
+		if (convert) {
+			converted.clear();
+			for (int k = 0; k < count; k++) {
+				if (!converter->Convert((const char*) iov[k].iov_base,
+							iov[k].iov_len, converted)) {
+					close(fd);
+					unlink(&tmp[0]);
+					std::string message = "The text cannot be saved in ";
+					message += TextFormat::EncodingName(format.encoding);
+					return ReturnExt(false, message.c_str(), EILSEQ);
+				}
+			}
+
+			iov[0].iov_base = (void*) converted.data();
+			iov[0].iov_len = converted.length();
+			count = converted.empty() ? 0 : 1;
+			batch = converted.length();
+		}
+
+		written += batch;
+
+		if (!(format.gzip ? gzip.Write(iov, count)
+					: WriteVector(fd, iov, count))) {
+			int e = errno;
+			close(fd);
+			unlink(&tmp[0]);
+			return ReturnExt(false, "Error while writing", e);
+		}
+
+		if (!progress(processed)) {
+			close(fd);
+			unlink(&tmp[0]);
+			return ReturnExt(false, "Saving was cancelled", ECANCELED);
+		}
+	}
+
+
+	if (convert && !converter->Complete()) {
+		close(fd);
+		unlink(&tmp[0]);
+		std::string message = "The text cannot be saved in ";
+		message += TextFormat::EncodingName(format.encoding);
+		return ReturnExt(false, message.c_str(), EILSEQ);
+	}
+
+	if (format.gzip) {
+		if (!gzip.Finish()) {
+			int e = errno;
+			close(fd);
+			unlink(&tmp[0]);
+			return ReturnExt(false, "Error while writing", e);
+		}
+		written = gzip.Written();
+	}
+
+
+	// Trim the preallocated space in case the size estimate was too large,
+	// and make the data durable before the rename
+
+	bool ok = ftruncate(fd, written) == 0;
+
+	if (ok && durability == SAVE_DURABILITY_FULL) {
+		ok = fsync(fd) == 0;
+	}
+	else if (ok && durability == SAVE_DURABILITY_DATA) {
+#if defined(_MAC)
+		ok = fsync(fd) == 0;
+#else
+		ok = fdatasync(fd) == 0;
+#endif
+	}
+
+	if (!ok) {
+		int e = errno;
+		close(fd);
+		unlink(&tmp[0]);
+		return ReturnExt(false, "Error while writing", e);
+	}
+
+	if (close(fd) != 0) {
+		int e = errno;
+		unlink(&tmp[0]);
+		return ReturnExt(false, "Error while writing", e);
+	}
+
+
+	// Replace the target
+
+	if (rename(&tmp[0], target.c_str()) != 0) {
+		int e = errno;
+		unlink(&tmp[0]);
+		return ReturnExt(false, "Error while saving", e);
+	}
+
+
+	// Flush the directory, so that the rename itself survives a crash
+
+	if (durability == SAVE_DURABILITY_FULL) {
+		int dfd = open(dir.c_str(), O_RDONLY);
+		if (dfd < 0 || fsync(dfd) != 0) {
+			int e = errno;
+			if (dfd >= 0) close(dfd);
+			return ReturnExt(false, "The file was saved, but the directory "
+					"could not be flushed", e);
+		}
+		close(dfd);
+	}
+
+	return ReturnExt(true);
+}
+
+
+std::atomic<int> DocumentLine::tabSize(4);
+const std::vector<std::pair<size_t, ParserState>> DocumentLine::noParserStates;
 
 
 /**
  * Create a new instance of DocumentLine
  */
-DocumentLine::DocumentLine()
+DocumentLine::DocumentLine(void)
 {
-	str = "";
+	block = NULL;
+	offset = 0;
+	length = 0;
 	displayLength = 0;
-	parserStates.clear();
+	plain = true;
 	validParse = false;
-	processedLine.reset();
 }
 
 
-/**
- * Destroy the line
- */
-DocumentLine::~DocumentLine()
-{
+/**
+ * Create a copy of a line, sharing its text block, except for the column map
+ *
+ * @param l the line to copy
+ */
+DocumentLine::DocumentLine(const DocumentLine& l)
+	: block(l.block), offset(l.offset), length(l.length),
+	  displayLength(l.displayLength), plain(l.plain),
+	  validParse(l.validParse)
+{
+	if (block != NULL) block->Retain();
+
+	if (l.extras) {
+		extras.reset(new Extras());
+		extras->parserStates = l.extras->parserStates;
+		extras->initialParserState = l.extras->initialParserState;
+		extras->length = l.extras->length;
+		extras->displayLength = l.extras->displayLength;
+	}
+}
+
+
+/**
+ * Move a line
+ *
+ * @param l the line to move, which becomes empty
+ */
+DocumentLine::DocumentLine(DocumentLine&& l) noexcept
+	: block(l.block), offset(l.offset), length(l.length),
+	  displayLength(l.displayLength), plain(l.plain),
+	  validParse(l.validParse), extras(std::move(l.extras))
+{
+	l.block = NULL;
+	l.length = 0;
+	l.displayLength = 0;
+}
+
+
+/**
+ * Move a line
+ *
+ * @param l the line to move, which becomes empty
+ * @return this line
+ */
+DocumentLine& DocumentLine::operator=(DocumentLine&& l) noexcept
+{
+	if (this == &l) return *this;
+	if (block != NULL) block->Release();
+
+	block = l.block;
+	offset = l.offset;
+	length = l.length;
+	displayLength = l.displayLength;
+	plain = l.plain;
+	validParse = l.validParse;
+	extras = std::move(l.extras);
+
+	l.block = NULL;
+	l.length = 0;
+	l.displayLength = 0;
+
+	return *this;
+}
+
+
+/**
+ * Destroy the line
+ */
+DocumentLine::~DocumentLine(void)
+{
+	if (block != NULL) block->Release();
+}
+
+
+/**
+ * Get the extras, allocating them if necessary
+ *
+ * @return the extras
+ */
+DocumentLine::Extras& DocumentLine::MutableExtras(void)
+{
+	if (!extras) {
+		extras.reset(new Extras());
+		extras->length = 0;
+		extras->displayLength = 0;
+	}
+	return *extras;
+}
+
+
+/**
+ * Free the extras if they are no longer needed
+ */
+void DocumentLine::TrimExtras(void)
+{
+	if (extras && extras->parserStates.empty() && !extras->columnMap
+			&& length != APE_LINE_LONG && displayLength != APE_LINE_LONG) {
+		extras.reset();
+	}
+}
+
+
+/**
+ * Replace the text block
+ *
+ * @param block the new block, whose reference the line takes over
+ * @param offset the offset of the text within the block
+ * @param length the length of the text
+ */
+void DocumentLine::Assign(TextBlock* block, uint32_t offset, size_t length)
+{
+	if (DocumentLine::block != NULL) DocumentLine::block->Release();
+
+	DocumentLine::block = block;
+	DocumentLine::offset = offset;
+
+	if (length < APE_LINE_LONG) {
+		DocumentLine::length = (uint32_t) length;
+	}
+	else {
+		DocumentLine::length = APE_LINE_LONG;
+		MutableExtras().length = length;
+	}
+
+	LineUpdated();
+}
+
+
+/**
+ * Set the text of the line
+ *
+ * @param text the text
+ * @param length the length of the text
+ */
+void DocumentLine::SetText(const char* text, size_t length)
+{
+	TextBlock* b = NULL;
+
+	if (length > 0) {
+		b = TextBlock::Create(length + 1);
+		memcpy(b->Data(), text, length);
+		b->Data()[length] = '\0';
+	}
+
+	Assign(b, 0, length);
+}
+
+
+/**
+ * Set the text of the line, packing it into a shared block
+ *
+ * @param arena the arena that provides the block
+ * @param text the text
+ * @param length the length of the text
+ */
+void DocumentLine::SetText(TextArena& arena, const char* text, size_t length)
+{
+	uint32_t offset = 0;
+	TextBlock* b = length > 0 ? arena.Add(text, length, offset) : NULL;
+
+	Assign(b, offset, length);
+}
+
+
+/**
+ * Set the display length
+ *
+ * @param length the display length
+ */
+void DocumentLine::SetDisplayLength(int64_t length)
+{
+	if (length < APE_LINE_LONG) {
+		displayLength = (uint32_t) length;
+	}
+	else {
+		displayLength = APE_LINE_LONG;
+		MutableExtras().displayLength = length;
+	}
+}
+
+
+/**
+ * Perform actions after updating the line
+ */
+void DocumentLine::LineUpdated(void)
+{
+	// Invalidate the parsing
+
+	validParse = false;
+
+
+	// Update the display length
+
+	UpdateLayout();
+}
+
+
+/**
+ * Recompute the display length, for example after the tab size changed
+ */
+void DocumentLine::UpdateLayout(void)
+{
+	if (extras) extras->columnMap.reset();
+
+
+	// Most lines have only one-column characters, so that the offsets and
+	// the columns are the same, and they do not need a column map
+
+	const char* str = Text();
+	size_t n = PlainASCIIPrefix(str, Length());
+	char c = str[n];
+
+	plain = c == '\0' || c == '\n' || c == '\r';
+	SetDisplayLength(plain ? (int64_t) n
+			: DisplayWidth(str, Length(), tabSize));
+
+	TrimExtras();
+}
+
+
+/**
+ * Find the byte offset of the character at the given display column
+ *
+ * @param column the display column
+ * @param actual the display column at the returned offset (output, optional)
+ * @return the byte offset
+ */
+size_t DocumentLine::ColumnToOffset(int64_t column, int64_t* actual)
+{
+	if (plain) {
+		if (column < 0) column = 0;
+		if (column > DisplayLength()) column = DisplayLength();
+		if (actual != NULL) *actual = column;
+		return column;
+	}
+
+	Extras& x = MutableExtras();
+	if (!x.columnMap) {
+		x.columnMap.reset(new ColumnMap(Text(), Length(), tabSize));
+	}
+
+	return x.columnMap->ColumnToOffset(column, actual);
+}
+
+
+/**
+ * Find the display column of the given byte offset
+ *
+ * @param offset the byte offset
+ * @return the display column
+ */
+int64_t DocumentLine::OffsetToColumn(size_t offset)
+{
+	if (plain) {
+		return std::min<int64_t>(offset, DisplayLength());
+	}
+
+	Extras& x = MutableExtras();
+	if (!x.columnMap) {
+		x.columnMap.reset(new ColumnMap(Text(), Length(), tabSize));
+	}
+
+	return x.columnMap->OffsetToColumn(offset);
+}
+
+
+/**
+ * Set the tab size. The documents lay out their lines again the next time
+ * they are painted.
+ *
+ * @param size the tab size
+ */
+void DocumentLine::SetTabSize(int size)
+{
+	if (size < 1) size = 1;
+	tabSize = size;
+}
+
+
+/**
+ * Create an empty store
+ */
+DocumentLineStore::DocumentLineStore(void)
+{
+	index = std::make_shared<Index>();
+	index->numLines = 0;
+	revision = 0;
+	hint = 0;
+}
+
+
+/**
+ * Destroy the store
+ */
+DocumentLineStore::~DocumentLineStore(void)
+{
+}
+
+
+/**
+ * Find the chunk that contains the given line
+ *
+ * @param index the index
+ * @param line the line number (must be within the bounds)
+ * @param hint the chunk to try first, which is updated to the result
+ * @return the chunk number
+ */
+int DocumentLineStore::FindChunk(const Index& index, int64_t line, int& hint)
+{
+	int n = (int) index.chunks.size();
+	
+	
+	// Try the last used chunk and the chunk after it first, which makes the
+	// sequential access O(1)
+
+	for (int c = hint; c < n && c <= hint + 1; c++) {
+		if (line >= index.starts[c]
+				&& line < index.starts[c] + (int64_t) index.chunks[c]->size()) {
+			hint = c;
+			return c;
+		}
+	}
+
+
+	// Otherwise do a binary search
+
+	int c = (int) (std::upper_bound(index.starts.begin(), index.starts.end(),
+				line) - index.starts.begin() - 1);
+	assert(c >= 0 && c < n);
+
+	hint = c;
+	return c;
+}
+
+
+/**
+ * Get the index for writing, copying it first if it is shared
+ *
+ * @return the index
+ */
+DocumentLineStore::Index& DocumentLineStore::MutableIndex(void)
+{
+	if (index.use_count() > 1) {
+		index = std::make_shared<Index>(*index);
+	}
+	else {
+		
+		// Make sure that all reads by the threads that just released their
+		// snapshots happen before our writes
+		
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	return *index;
+}
+
+
+/**
+ * Get a chunk for writing, copying it first if it is shared
+ *
+ * @param chunk the chunk number
+ * @return the chunk
+ */
+DocumentLineStore::Chunk& DocumentLineStore::MutableChunk(int chunk)
+{
+	Index& x = MutableIndex();
+	std::shared_ptr<Chunk>& c = x.chunks[chunk];
+
+	if (c.use_count() > 1) {
+		c = std::make_shared<Chunk>(*c);
+	}
+	else {
+		std::atomic_thread_fence(std::memory_order_acquire);
+	}
+
+	return *c;
+}
+
+
+/**
+ * Get a line for reading
+ *
+ * @param line the line number
+ * @return the line
+ */
+const DocumentLine& DocumentLineStore::operator[](int64_t line) const
+{
+	int c = FindChunk(*index, line, hint);
+	return (*index->chunks[c])[line - index->starts[c]];
+}
+
+
+/**
+ * Get a line for updating its meta-data, such as the parser states,
+ * without changing the revision
+ *
+ * @param line the line number
+ * @return the line
+ */
+DocumentLine& DocumentLineStore::Mutable(int64_t line)
+{
+	int c = FindChunk(*index, line, hint);
+	return MutableChunk(c)[line - index->starts[c]];
+}
+
+
+/**
+ * Update the meta-data of all lines in parallel, without changing the
+ * revision
+ *
+ * @param f the function to apply to each line
+ */
+void DocumentLineStore::UpdateAll(const std::function<void(DocumentLine&)>& f)
+{
+	// Copy the shared chunks first, since the store may be accessed only
+	// from the main thread
+
+	std::vector<Chunk*> chunks;
+	chunks.reserve(index->chunks.size());
+	for (size_t c = 0; c < index->chunks.size(); c++) {
+		chunks.push_back(&MutableChunk((int) c));
+	}
+
+	pool.ParallelFor(0, chunks.size(), 16, [&chunks, &f](size_t b, size_t e) {
+		for (size_t c = b; c < e; c++) {
+			for (DocumentLine& l : *chunks[c]) f(l);
+		}
+	});
+}
+
+
+/**
+ * Insert a line
+ *
+ * @param pos the line before which to insert
+ * @param line the line
+ */
+void DocumentLineStore::Insert(int64_t pos, DocumentLine&& line)
+{
+	assert(pos >= 0 && pos <= Size());
+
+	Index& x = MutableIndex();
+	int n = (int) x.chunks.size();
+	revision++;
+
+
+	// Append a new chunk if the line goes to the end and the last chunk is
+	// full, so that the chunks of a sequentially built store are full
+
+	if (pos == x.numLines && (n == 0
+				|| x.chunks[n-1]->size() >= APE_DOCUMENT_CHUNK_SIZE)) {
+		std::shared_ptr<Chunk> chunk = std::make_shared<Chunk>();
+		chunk->reserve(APE_DOCUMENT_CHUNK_SIZE);
+		chunk->push_back(std::move(line));
+		x.chunks.push_back(chunk);
+		x.starts.push_back(x.numLines);
+		x.numLines++;
+		return;
+	}
+
+
+	// Insert the line to the appropriate chunk
+
+	int c = pos == x.numLines ? n - 1 : FindChunk(x, pos, hint);
+	Chunk& chunk = MutableChunk(c);
+	chunk.insert(chunk.begin() + (pos - x.starts[c]), std::move(line));
+
+	for (int i = c + 1; i < n; i++) x.starts[i]++;
+	x.numLines++;
+
+
+	// Split the chunk if it is too large
+
+	if (chunk.size() > APE_DOCUMENT_CHUNK_SIZE) {
+		size_t half = chunk.size() / 2;
+
+		std::shared_ptr<Chunk> second = std::make_shared<Chunk>();
+		second->reserve(APE_DOCUMENT_CHUNK_SIZE);
+		for (size_t i = half; i < chunk.size(); i++) {
+			second->push_back(std::move(chunk[i]));
+		}
+		chunk.resize(half);
+
+		x.chunks.insert(x.chunks.begin() + c + 1, second);
+		x.starts.insert(x.starts.begin() + c + 1, x.starts[c] + (int64_t) half);
+	}
+}
+
+
+/**
+ * Erase a range of lines
+ *
+ * @param first the first line to erase
+ * @param last the line after the last line to erase
+ */
+void DocumentLineStore::Erase(int64_t first, int64_t last)
+{
+	assert(first >= 0 && last <= Size());
+	if (first >= last) return;
+
+	Index& x = MutableIndex();
+	revision++;
+
+	int c = FindChunk(x, first, hint);
+	int64_t start = x.starts[c];
+	int64_t remaining = last - first;
+
+
+	// Erase the lines chunk by chunk, dropping the chunks that become empty
+
+	while (remaining > 0) {
+		int64_t offset = first - start;
+		int64_t count = std::min(remaining,
+				(int64_t) x.chunks[c]->size() - offset);
+
+		if (offset == 0 && count == (int64_t) x.chunks[c]->size()) {
+			x.chunks.erase(x.chunks.begin() + c);
+			x.starts.erase(x.starts.begin() + c);
+		}
+		else {
+			Chunk& chunk = MutableChunk(c);
+			chunk.erase(chunk.begin() + offset, chunk.begin() + offset + count);
+			x.starts[c] = start;
+			start += chunk.size();
+			c++;
+		}
+
+		remaining -= count;
+	}
+
+
+	// Update the start lines of the following chunks
+
+	x.numLines -= last - first;
+	for (int i = c; i < (int) x.chunks.size(); i++) {
+		x.starts[i] -= last - first;
+	}
+
+	hint = 0;
+}
+
+
+/**
+ * Remove all lines
+ */
+void DocumentLineStore::Clear(void)
+{
+	index = std::make_shared<Index>();
+	index->numLines = 0;
+	revision++;
+	hint = 0;
+}
+
+
+/**
+ * Exchange the contents with another store
+ *
+ * @param other the other store
+ */
+void DocumentLineStore::Swap(DocumentLineStore& other)
+{
+	index.swap(other.index);
+	revision++;
+	other.revision++;
+	hint = 0;
+	other.hint = 0;
+}
+
+
+/**
+ * Take an immutable snapshot of the lines
+ *
+ * @return the snapshot
+ */
+DocumentSnapshot DocumentLineStore::Snapshot(void) const
+{
+	return DocumentSnapshot(index, revision);
+}
+
+
+/**
+ * Create an empty snapshot
+ */
+DocumentSnapshot::DocumentSnapshot(void)
+{
+	revision = 0;
+	hint = 0;
+}
+
+
+/**
+ * Create a snapshot
+ *
+ * @param index the index of the chunks
+ * @param revision the revision number
+ */
+DocumentSnapshot::DocumentSnapshot(
+		const std::shared_ptr<const DocumentLineStore::Index>& index,
+		uint64_t revision)
+	: index(index), revision(revision)
+{
+	hint = 0;
+}
+
+
+/**
+ * Return a line object
+ *
+ * @param line the line number
+ * @return the line
+ */
+const DocumentLine& DocumentSnapshot::LineObject(int64_t line) const
+{
+	int c = DocumentLineStore::FindChunk(*index, line, hint);
+	return (*index->chunks[c])[line - index->starts[c]];
+}
+
+
+/**
+ * Create an instance of class EditorDocument
+ */
+EditorDocument::EditorDocument(void)
+{
+	currentUndo = NULL;
+	layoutTabSize = DocumentLine::TabSize();
+	parser = NULL;
+	streamedBytes = 0;
+	following = false;
+	watch = -1;
+	
+	Clear();
+}
+
+
+/**
+ * Destroy the object
+ */
+EditorDocument::~EditorDocument(void)
+{
+	if (currentUndo != NULL) delete currentUndo;
+	while (!undo.empty()) { delete undo.back(); undo.pop_back(); }
+	while (!redo.empty()) { delete redo.back(); redo.pop_back(); }
+	
+	if (parser != NULL) delete parser;
+	
+	if (backgroundSave) {
+		backgroundSave->document = NULL;
+		backgroundSave->token.Cancel();
+	}
+	
+	StopStream();
+	UnwatchFile();
+}
+
+
+/**
+ * Set the parser
+ *
+ * @param parser the parser, or NULL to clear (this will transfer ownership)
+ */
+void EditorDocument::SetParser(Parser* parser)
+{
+	if (EditorDocument::parser != NULL) delete EditorDocument::parser;
+	EditorDocument::parser = parser;
+	
+	int64_t numLines = NumLines();
+	for (int64_t i = 0; i < numLines; i++) {
+		lines.Mutable(i).ClearParsing();
+	}
+}
+
+
+/**
+ * Turn a feature on or off. The whole file can be loaded only by
+ * opening it again, so that feature is left as it is.
+ *
+ * @param feature the feature
+ * @param on true to turn it on
+ */
+void EditorDocument::SetFeature(DocumentFeature feature, bool on)
+{
+	if (feature == DOCUMENT_FEATURE_FULL_LOAD || HasFeature(feature) == on) {
+		return;
+	}
+
+	features ^= DOCUMENT_FEATURE_BIT(feature);
+
+
+	// Keep only the maximum width without the exact widths, and count all
+	// lines again when they are turned back on
+
+	if (feature == DOCUMENT_FEATURE_WIDTHS) {
+		if (on) {
+			int64_t numLines = lines.Size();
+			for (int64_t i = 0; i < numLines; i++) {
+				displayLengths.Increment(lines[i].DisplayLength());
+			}
+		}
+		else {
+			widestLine = displayLengths.MaxKey();
+			displayLengths.Clear();
+		}
+	}
+
+
+	// Forget the oldest undo steps right away
+
+	if (feature == DOCUMENT_FEATURE_UNDO && !on) {
+		while (undo.size() > APE_LIMITED_UNDO_DEPTH) {
+			delete undo.front();
+			undo.pop_front();
+		}
+	}
+}
+
+
+/**
+ * Clear the text document
+ */
+void EditorDocument::Clear(void)
+{
+	StopStream();
+	UnwatchFile();
+
+	features = DOCUMENT_FEATURES_ALL;
+	truncated = false;
+	ClearLines();
+
+	fileName = "";
+	format = TextFormat();
+	pageStart = 0;
+}
+
+
+/**
+ * Clear the lines, and the undo and redo history
+ */
+void EditorDocument::ClearLines(void)
+{
+	lines.Clear();
+	displayLengths.Clear();
+	widestLine = 0;
+
+	DocumentLine l;
+	AddDisplayLength(l.DisplayLength());
+	lines.PushBack(std::move(l));
+
+	modified = false;
+	
+	cursorRow = 0;
+	cursorColumn = 0;
+	
+	while (!undo.empty()) { delete undo.back(); undo.pop_back(); }
+	while (!redo.empty()) { delete redo.back(); redo.pop_back(); }
+	
+	if (currentUndo != NULL) delete currentUndo;
+	currentUndo = NULL;
+}
+
+
+/**
+ * Load from file, and set the associated document file name
+ *
+ * @param file the file name
+ * @param bytesRead the number of bytes read (output, optional)
+ * @return a ReturnExt
+ */
+ReturnExt EditorDocument::LoadFromFile(const char* file, uint64_t* bytesRead)
+{
+	// Open the file, which starts decompressing it on a separate thread if
+	// it is compressed
+
+	FileReader reader;
+	ReturnExt r = reader.Open(file);
+	if (!r) return r;
+
+	FileStamp stamp;
+	stamp.Read(reader.Descriptor());
+
+	std::string description = "Loading ";
+	description += FileBaseName(file);
+	Operation op(description.c_str(), reader.Size());
+
+
+	// Load the lines into new containers, so that the document stays intact
+	// if the operation fails or gets cancelled
+
+	DocumentLineStore newLines;
+	Histogram newDisplayLengths;
+
+	TextArena arena;
+	TextDecoder decoder([&newLines, &arena](std::string& text) {
+		DocumentLine l;
+		l.SetText(arena, text.data(), text.length());
+		newLines.PushBack(std::move(l));
+	});
+
+	std::vector<char> block;
+	uint64_t size = 0;
+
+	while (true) {
+		r = reader.Read(block);
+		if (!r) return r;
+		if (block.empty()) break;
+
+		if (!decoder.Decode(&block[0], block.size())) {
+			return ReturnExt(false, decoder.Error().c_str(), EILSEQ);
+		}
+		size += block.size();
+
+		if (!op.Update(reader.Position())) {
+			return ReturnExt(false, "Loading was cancelled", ECANCELED);
+		}
+	}
+
+	TextFormat newFormat = decoder.Finish();
+	newFormat.gzip = reader.Compressed();
+	newFormat.trailingGarbage = reader.TrailingGarbage();
+
+	if (decoder.Failed()) {
+		return ReturnExt(false, decoder.Error().c_str(), EILSEQ);
+	}
+
+
+	// With mixed line endings, the CRLF lines keep their CR, so that they
+	// are saved as they were
+
+	int64_t numLines = newLines.Size();
+	if (newFormat.lineEnding == LINE_ENDING_MIXED) {
+		for (int64_t i = 0; i < numLines; i++) {
+			if (!decoder.EndsWithCR(i)) continue;
+			DocumentLine& l = newLines.Mutable(i);
+			l.SetText(l.String() + "\r");
+		}
+	}
+
+	// Pick the features by the size of the contents, since for example
+	// the width histogram of a very large file takes long to build
+
+	unsigned newFeatures = FeaturePolicy::Features(size)
+		| DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_FULL_LOAD);
+	bool widths = newFeatures & DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_WIDTHS);
+	int64_t newWidestLine = 0;
+
+	for (int64_t i = 0; i < numLines; i++) {
+		int64_t length = newLines[i].DisplayLength();
+		if (length > newWidestLine) newWidestLine = length;
+		if (widths) newDisplayLengths.Increment(length);
+	}
+
+
+	// Replace the contents of the document
+
+	Clear();
+	lines.Swap(newLines);
+	displayLengths = newDisplayLengths;
+	widestLine = newWidestLine;
+	features = newFeatures;
+
+	modified = false;
+	fileName = file;
+	format = newFormat;
+
+	diskStamp = stamp;
+	WatchFile();
+
+	if (bytesRead != NULL) *bytesRead = reader.Position();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Start reading the document from a stream, such as the standard input,
+ * on a background thread. The lines are appended to the document as they
+ * arrive, without marking it as modified, so that it can be viewed and
+ * edited right away.
+ *
+ * @param fd the file descriptor, which will be closed when done
+ * @param name the name of the stream for the status messages
+ * @return a ReturnExt
+ */
+ReturnExt EditorDocument::LoadFromStream(int fd, const char* name)
+{
+	Clear();
+	std::shared_ptr<BackgroundStream> s = StartStream();
+
+	std::string description = "Reading ";
+	description += name;
+
+
+	// Read on a dedicated thread rather than on the thread pool, since the
+	// reader can wait for the input indefinitely
+
+	try {
+		std::thread(ReadStream, s, fd, description).detach();
+	}
+	catch (std::system_error& e) {
+		StopStream();
+		return ReturnExt(false, "Cannot start the reader thread",
+				e.code().value());
+	}
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Load a file, and then keep appending the lines that are written to it,
+ * like "tail -F". The file is read again from the beginning if it gets
+ * truncated, and the new file is followed if it gets replaced.
+ *
+ * @param file the file name
+ * @return a ReturnExt
+ */
+ReturnExt EditorDocument::Follow(const char* file)
+{
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return ReturnExt(false, "Cannot open the file", errno);
+	}
+
+
+	// Load the file as any other, so that its format is known, and then
+	// decode the appended data in the same format
+
+	uint64_t offset = 0;
+	ReturnExt r = LoadFromFile(file, &offset);
+	if (!r) {
+		close(fd);
+		return r;
+	}
+
+	if (format.gzip) {
+		close(fd);
+		std::string status = FileBaseName(file);
+		status += " is compressed, so it is not followed";
+		wm.SetStatus(status.c_str());
+		return ReturnExt(true);
+	}
+
+	UnwatchFile();
+	std::shared_ptr<BackgroundStream> s = StartStream(offset);
+	following = true;
+
+	try {
+		std::thread(FollowFile, s, fd, fileName, format, offset).detach();
+	}
+	catch (std::system_error& e) {
+		close(fd);
+		StopStream();
+		return ReturnExt(false, "Cannot start the reader thread",
+				e.code().value());
+	}
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Create the state shared with the reader thread
+ *
+ * @param loaded the number of bytes that were already loaded
+ * @return the new state
+ */
+std::shared_ptr<EditorDocument::BackgroundStream> EditorDocument::StartStream(
+		uint64_t loaded)
+{
+	std::shared_ptr<BackgroundStream> s = std::make_shared<BackgroundStream>();
+	s->document = this;
+	s->pendingBytes = 0;
+	s->finished = false;
+	s->truncated = false;
+	s->posted = false;
+
+	stream = s;
+	streamedBytes = loaded;
+	return s;
+}
+
+
+/**
+ * Read a stream and queue its lines for the document (runs on
+ * the reader thread)
+ *
+ * @param stream the shared state
+ * @param fd the file descriptor, which will be closed
+ * @param description the description of the operation
+ */
+void EditorDocument::ReadStream(std::shared_ptr<BackgroundStream> stream,
+		int fd, std::string description)
+{
+	BackgroundOperation op(description.c_str(), 0, OPERATION_UNIT_BYTES,
+			stream->token);
+
+	char buffer[64 * 1024];
+	uint64_t bytesRead = 0;
+	bool cr = false;
+	ReturnExt r(true);
+
+	while (!stream->token.Cancelled()) {
+
+
+		// Stop reading at the limit, so that the document does not fill
+		// the memory. The stream is closed, so that the producer does not
+		// block on the full pipe, and the document becomes read-only, since
+		// it does not have all of the input.
+
+		if (bytesRead >= streamLimit) {
+			{
+				std::lock_guard<std::mutex> lock(stream->mutex);
+				stream->truncated = true;
+			}
+
+			char amount[64];
+			char buf[256];
+			snprintf(buf, sizeof(buf), "%s: Discarded the input after %s, "
+					"now read-only",
+					description.c_str(), Operation::Format(amount,
+						sizeof(amount), streamLimit, OPERATION_UNIT_BYTES));
+			r = ReturnExt(false, buf, EFBIG);
+			break;
+		}
+
+
+		// Wait for the input, checking for cancellation from time to time
+
+		struct pollfd pfd;
+		pfd.fd = fd;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		int k = poll(&pfd, 1, (int) (APE_OPERATION_PROGRESS_INTERVAL * 1000));
+		if (k == 0 || (k < 0 && errno == EINTR)) continue;
+
+		size_t room = std::min<uint64_t>(sizeof(buffer),
+				streamLimit - bytesRead);
+		ssize_t n = read(fd, buffer, room);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN) continue;
+			r = ReturnExt(false, "Error while reading", errno);
+			break;
+		}
+		if (n == 0) break;
+		bytesRead += n;
+
+		QueueStreamed(stream, buffer, n, false, cr);
+		if (!op.Update(bytesRead)) break;
+	}
+
+	close(fd);
+	op.Finish();
+
+	FinishStream(stream, r);
+}
+
+
+/**
+ * Read the data appended to a file, and queue its lines for the document
+ * (runs on the reader thread)
+ *
+ * @param stream the shared state
+ * @param fd the file descriptor, which will be closed
+ * @param path the file name
+ * @param format the format of the file, in which the appended data is
+ *               decoded
+ * @param offset the number of bytes that were already loaded
+ */
+void EditorDocument::FollowFile(std::shared_ptr<BackgroundStream> stream,
+		int fd, std::string path, TextFormat format, uint64_t offset)
+{
+	const char* name = FileBaseName(path.c_str());
+	struct stat st;
+
+
+	// Decode the data as it was decoded when loading the file; the CR of
+	// the CRLF lines is kept unless all lines end with it, and the BOM is
+	// removed when the file is read from the beginning again
+
+	bool convert = format.encoding != TEXT_ENCODING_UTF8
+		&& format.encoding != TEXT_ENCODING_AUTO;
+	bool keepCR = format.lineEnding != LINE_ENDING_CRLF;
+
+	std::unique_ptr<TextConverter> converter;
+	if (convert) {
+		converter.reset(new TextConverter(format.encoding, TEXT_ENCODING_UTF8));
+	}
+
+	std::string converted;
+	bool start = offset == 0;
+	bool cr = false;
+
+	std::function<bool(const char*, size_t)> queue
+		= [&](const char* data, size_t length) {
+			if (convert) {
+				converted.clear();
+				if (!converter->Convert(data, length, converted)) return false;
+				data = converted.data();
+				length = converted.length();
+			}
+
+			if (start && length >= 3 && memcmp(data, "\xEF\xBB\xBF", 3) == 0) {
+				data += 3;
+				length -= 3;
+			}
+			start = false;
+
+			if (length > 0) QueueStreamed(stream, data, length, keepCR, cr);
+			return true;
+		};
+
+	std::function<void(void)> restart = [&]() {
+		if (convert) {
+			converter.reset(new TextConverter(format.encoding,
+						TEXT_ENCODING_UTF8));
+		}
+		start = true;
+		cr = false;
+	};
+
+
+	// Watch the file for changes, and its directory for a new file that
+	// replaces it; without inotify, just check the file periodically
+
+	int watcher = -1;
+	int fileWatch = -1;
+
+#if defined(__linux__)
+	watcher = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (watcher >= 0) {
+		char* s = strdup(path.c_str());
+		int dirWatch = inotify_add_watch(watcher, dirname(s),
+				IN_CREATE | IN_MOVED_TO);
+		free(s);
+
+		fileWatch = inotify_add_watch(watcher, path.c_str(),
+				IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF);
+
+		if (dirWatch < 0 || fileWatch < 0) {
+			close(watcher);
+			watcher = -1;
+		}
+	}
+#endif
+
+	char buffer[64 * 1024];
+	bool partial = false;
+	bool check = true;
+	ReturnExt r(true);
+
+	while (!stream->token.Cancelled()) {
+
+		if (check) {
+
+
+			// Read the data appended since the last time
+
+			ssize_t n;
+			bool decoded = true;
+			while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0) {
+				offset += n;
+				partial = buffer[n - 1] != '\n';
+				decoded = queue(buffer, n);
+				if (!decoded) break;
+			}
+
+			if (!decoded) {
+				std::string message = "The appended data is not valid ";
+				message += TextFormat::EncodingName(format.encoding);
+				r = ReturnExt(false, message.c_str(), EILSEQ);
+				break;
+			}
+
+			if (n < 0 && errno != EINTR) {
+				r = ReturnExt(false, "Error while reading", errno);
+				break;
+			}
+
+
+			// Reload the file if it was truncated
+
+			if (fstat(fd, &st) == 0 && (uint64_t) st.st_size < offset) {
+				QueueReset(stream);
+				restart();
+				offset = 0;
+				partial = false;
+				continue;
+			}
+
+
+			// Switch to the new file if the file was replaced, such as by
+			// log rotation, after reading the rest of the old one
+
+			struct stat ps;
+			if (stat(path.c_str(), &ps) == 0
+					&& (ps.st_ino != st.st_ino || ps.st_dev != st.st_dev)) {
+
+				int newFd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+				if (newFd >= 0) {
+					while ((n = pread(fd, buffer, sizeof(buffer), offset)) > 0
+							&& queue(buffer, n)) {
+						offset += n;
+						partial = buffer[n - 1] != '\n';
+					}
+
+					if (partial) QueueStreamed(stream, "\n", 1, keepCR, cr);
+
+					close(fd);
+					fd = newFd;
+					restart();
+					offset = 0;
+					partial = false;
+
+#if defined(__linux__)
+					if (watcher >= 0) {
+						inotify_rm_watch(watcher, fileWatch);
+						fileWatch = inotify_add_watch(watcher, path.c_str(),
+								IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF
+								| IN_DELETE_SELF);
+					}
+#endif
+
+					std::string status = name;
+					status += " was replaced; following the new file";
+					PostStatus(status.c_str());
+					continue;
+				}
+			}
+		}
+
+
+		// Wait for a change, checking for cancellation from time to time
+
+		if (watcher < 0) {
+			usleep((useconds_t) (APE_OPERATION_PROGRESS_INTERVAL * 1e6));
+			check = true;
+			continue;
+		}
+
+		struct pollfd pfd;
+		pfd.fd = watcher;
+		pfd.events = POLLIN;
+		pfd.revents = 0;
+
+		int k = poll(&pfd, 1, (int) (APE_OPERATION_PROGRESS_INTERVAL * 1000));
+		check = k > 0;
+
+		while (check && read(watcher, buffer, sizeof(buffer)) > 0);
+	}
+
+	close(fd);
+	if (watcher >= 0) close(watcher);
+
+	FinishStream(stream, r);
+}
+
+
+/**
+ * Split the data read from a stream to lines, and pass them to the main
+ * thread in batches, waiting while too many are pending (runs on the reader
+ * thread). The first line continues the last line of the document, and
+ * the incomplete line at the end is shown right away.
+ *
+ * @param stream the shared state
+ * @param data the data
+ * @param length the number of bytes
+ * @param keepCR whether to keep the CR at the end of the CRLF lines
+ * @param cr whether the previous data ended with a CR, which is held back
+ *           until it is known whether an LF follows (updated)
+ */
+void EditorDocument::QueueStreamed(
+		const std::shared_ptr<BackgroundStream>& stream, const char* data,
+		size_t length, bool keepCR, bool& cr)
+{
+	BackgroundStream::Batch batch;
+	batch.lines.reserve(APE_STREAM_BATCH_LINES);
+	batch.bytes = 0;
+	batch.reset = false;
+
+	TextArena arena;
+	std::string text;
+	const char* p = data;
+	const char* end = data + length;
+
+	bool heldCR = cr;
+	cr = false;
+
+	while (p < end) {
+		const char* nl = (const char*) memchr(p, '\n', end - p);
+		if (nl == NULL) break;
+
+
+		// The editor cannot display a CR in the middle of a line
+
+		bool crlf = nl > p ? nl[-1] == '\r' : p == data && heldCR;
+
+		text.assign(p, nl - p);
+		text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+		if (keepCR && crlf) text += '\r';
+
+		DocumentLine l;
+		l.SetText(arena, text.data(), text.length());
+		batch.lines.push_back(std::move(l));
+		batch.bytes += text.length() + 1;
+
+		p = nl + 1;
+
+		if (batch.lines.size() >= APE_STREAM_BATCH_LINES) {
+			QueueBatch(stream, batch);
+			batch.lines.reserve(APE_STREAM_BATCH_LINES);
+		}
+	}
+
+	if (p < end && end[-1] == '\r') {
+		cr = true;
+		end--;
+	}
+
+	batch.tail.assign(p, end - p);
+	batch.tail.erase(std::remove(batch.tail.begin(), batch.tail.end(), '\r'),
+			batch.tail.end());
+	batch.bytes += batch.tail.length();
+
+	if (!batch.lines.empty() || !batch.tail.empty()) QueueBatch(stream, batch);
+}
+
+
+/**
+ * Ask the main thread to discard the lines read from a stream so far
+ * (runs on the reader thread)
+ *
+ * @param stream the shared state
+ */
+void EditorDocument::QueueReset(const std::shared_ptr<BackgroundStream>& stream)
+{
+	BackgroundStream::Batch batch;
+	batch.bytes = 0;
+	batch.reset = true;
+
+	QueueBatch(stream, batch);
+}
+
+
+/**
+ * Pass a batch to the main thread, waiting while too many lines are pending
+ * (runs on the reader thread)
+ *
+ * @param stream the shared state
+ * @param batch the batch, which will be moved out and cleared
+ */
+void EditorDocument::QueueBatch(
+		const std::shared_ptr<BackgroundStream>& stream,
+		BackgroundStream::Batch& batch)
+{
+	std::unique_lock<std::mutex> lock(stream->mutex);
+
+	while (stream->pendingBytes >= APE_STREAM_PENDING_BYTES
+			&& !stream->token.Cancelled()) {
+		stream->drained.wait_for(lock, std::chrono::milliseconds(
+					(int) (APE_OPERATION_PROGRESS_INTERVAL * 1000)));
+	}
+
+	stream->pending.push_back(std::move(batch));
+	stream->pendingBytes += stream->pending.back().bytes;
+
+	batch.lines.clear();
+	batch.tail.clear();
+	batch.bytes = 0;
+	batch.reset = false;
+
+	if (!stream->posted) {
+		stream->posted = true;
+		std::shared_ptr<BackgroundStream> s = stream;
+		wm.Post([s]() {
+			if (s->document != NULL) s->document->AppendStreamed();
+		});
+	}
+}
+
+
+/**
+ * Tell the main thread that the reader has finished (runs on the reader
+ * thread)
+ *
+ * @param stream the shared state
+ * @param result the result of reading
+ */
+void EditorDocument::FinishStream(
+		const std::shared_ptr<BackgroundStream>& stream,
+		const ReturnExt& result)
+{
+	{
+		std::lock_guard<std::mutex> lock(stream->mutex);
+		stream->finished = true;
+	}
+
+	std::shared_ptr<BackgroundStream> s = stream;
+	ReturnExt r = result;
+
+	wm.Post([s, r]() {
+		EditorDocument* d = s->document;
+		if (d == NULL) return;
+
+		d->AppendStreamed();
+		if (!r) {
+			wm.SetStatus(r.Message());
+			wm.Refresh();
+		}
+	});
+}
+
+
+/**
+ * Show a message in the status bar (can be called from any thread)
+ *
+ * @param message the message
+ */
+void EditorDocument::PostStatus(const char* message)
+{
+	std::string status = message;
+	wm.Post([status]() {
+		wm.SetStatus(status.c_str());
+		wm.Refresh();
+	});
+}
+
+
+/**
+ * Append the lines that were read from the stream since the last call
+ */
+void EditorDocument::AppendStreamed(void)
+{
+	std::shared_ptr<BackgroundStream> s = stream;
+	if (!s) return;
+
+	std::vector<BackgroundStream::Batch> batches;
+	bool finished = false;
+	bool more;
+
+	{
+		std::lock_guard<std::mutex> lock(s->mutex);
+
+		while (!s->pending.empty()
+				&& batches.size() < APE_STREAM_APPEND_BATCHES) {
+			batches.push_back(std::move(s->pending.front()));
+			s->pendingBytes -= batches.back().bytes;
+			s->pending.pop_front();
+		}
+
+		more = !s->pending.empty();
+		if (!more) {
+			finished = s->finished;
+			if (s->truncated) truncated = true;
+			s->posted = false;
+		}
+	}
+	s->drained.notify_one();
+
+
+	// The first line of a batch completes the last line of the document,
+	// which has the incomplete line from before, or the text that the user
+	// typed there, and each line then starts a new one. The earlier lines
+	// are not touched, so that their parser states remain valid.
+
+	int64_t oldNumLines = lines.Size();
+	uint64_t oldBytes = streamedBytes;
+
+	for (size_t b = 0; b < batches.size(); b++) {
+		BackgroundStream::Batch& batch = batches[b];
+
+		if (batch.reset) {
+			ClearLines();
+			oldNumLines = 0;
+			streamedBytes = 0;
+		}
+
+		streamedBytes += batch.bytes;
+
+		for (size_t i = 0; i < batch.lines.size(); i++) {
+			if (i == 0) {
+				DocumentLine& l = lines.Edit(lines.Size() - 1);
+				RemoveDisplayLength(l.DisplayLength());
+
+				if (l.Length() == 0) {
+					l = std::move(batch.lines[0]);
+				}
+				else {
+					l.SetText(l.String() + batch.lines[0].Text());
+				}
+
+				AddDisplayLength(l.DisplayLength());
+			}
+			else {
+				AddDisplayLength(batch.lines[i].DisplayLength());
+				lines.PushBack(std::move(batch.lines[i]));
+			}
+		}
+
+		if (!batch.lines.empty()) {
+			DocumentLine n;
+			AddDisplayLength(n.DisplayLength());
+			lines.PushBack(std::move(n));
+		}
+
+		if (!batch.tail.empty()) {
+			DocumentLine& l = lines.Edit(lines.Size() - 1);
+			RemoveDisplayLength(l.DisplayLength());
+			l.SetText(l.String() + batch.tail);
+			AddDisplayLength(l.DisplayLength());
+		}
+	}
+
+	if (streamedBytes > oldBytes) ApplyFeaturePolicy(oldBytes, streamedBytes);
+
+	if (finished) {
+		s->document = NULL;
+		stream.reset();
+		following = false;
+	}
+
+
+	// Continue with the rest of the lines after handling the input
+
+	if (more) {
+		wm.Post([s]() {
+			if (s->document != NULL) s->document->AppendStreamed();
+		});
+	}
+
+	if (!batches.empty()) NotifyChanged(std::max<int64_t>(oldNumLines - 1, 0));
 }
 
 
 /**
- * Perform actions after updating the line
+ * Turn off the features that the FeaturePolicy turns off for the size
+ * that the streamed data just grew to
+ *
+ * @param oldSize the previous size in bytes
+ * @param newSize the new size in bytes
  */
-void DocumentLine::LineUpdated()
+void EditorDocument::ApplyFeaturePolicy(uint64_t oldSize, uint64_t newSize)
 {
-	// Invalidate the parsing
-
-	validParse = false;
+	// Only the features whose threshold was just crossed are turned off,
+	// so that a feature that the user turned back on stays on
 
+	unsigned dropped = FeaturePolicy::Features(oldSize)
+		& ~FeaturePolicy::Features(newSize)
+		& ~DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_FULL_LOAD);
+	if (dropped == 0) return;
 
-	// Update the display length
-	
-	// XXX
-	int tabSize = 4;
-	
-	int pos = 0;
-	const char* p = str.c_str();
-	
-	while (*p != '\0' && *p != '\n' && *p != '\r') {
-		char c = *p;
-		
-		if (c == '\t') {
-			pos = (pos / tabSize) * tabSize + tabSize;
-			p++;
-		}
-		else {
-			pos++;
-			p++;
+	for (int f = 0; f < DOCUMENT_FEATURE_COUNT; f++) {
+		if ((dropped & DOCUMENT_FEATURE_BIT(f)) != 0) {
+			SetFeature((DocumentFeature) f, false);
 		}
 	}
-	
-	displayLength = pos;
+
+	std::string status = FeaturePolicy::Description(features);
+	if (!status.empty()) {
+		status += " - Ctrl+E to change";
+		wm.SetStatus(status.c_str());
+	}
 }
 
 
 /**
- * Create an instance of class EditorDocument
+ * Stop reading from the stream, if any
  */
-EditorDocument::EditorDocument(void)
+void EditorDocument::StopStream(void)
 {
-	currentUndo = NULL;
-	tabSize = 4;
-	parser = NULL;
-	
-	Clear();
+	following = false;
+	if (!stream) return;
+
+	stream->document = NULL;
+	stream->token.Cancel();
+	stream->drained.notify_one();
+	stream.reset();
 }
 
 
 /**
- * Destroy the object
+ * Start watching the associated file for changes made outside of
+ * the editor
  */
-EditorDocument::~EditorDocument(void)
+void EditorDocument::WatchFile(void)
 {
-	if (currentUndo != NULL) delete currentUndo;
-	while (!undo.empty()) { delete undo.back(); undo.pop_back(); }
-	while (!redo.empty()) { delete redo.back(); redo.pop_back(); }
-	
-	if (parser != NULL) delete parser;
+	fileWatcher.Remove(watch);
+	watch = fileWatcher.Add(fileName.c_str(), [this]() { CheckFile(); });
 }
 
 
 /**
- * Set the parser
- *
- * @param parser the parser, or NULL to clear (this will transfer ownership)
+ * Stop watching the associated file, and cancel a reload in progress
  */
-void EditorDocument::SetParser(Parser* parser)
+void EditorDocument::UnwatchFile(void)
 {
-	if (EditorDocument::parser != NULL) delete EditorDocument::parser;
-	EditorDocument::parser = parser;
-	
-	int numLines = NumLines();
-	for (int i = 0; i < numLines; i++) {
-		lines[i].ClearParsing();
+	fileWatcher.Remove(watch);
+	watch = -1;
+
+	if (reload) {
+		reload->document = NULL;
+		reload->token.Cancel();
+		reload.reset();
 	}
 }
 
 
 /**
- * Clear the text document
+ * Check whether the associated file changed on disk, and if so, reload
+ * it in the background
  */
-void EditorDocument::Clear(void)
+void EditorDocument::CheckFile(void)
 {
-	lines.clear();
-	displayLengths.Clear();
+	// Our own saves update the stamp when they finish, and a reload that
+	// is already running checks the file again after it is done
 
-	DocumentLine l;
-	displayLengths.Increment(l.DisplayLength());
-	lines.push_back(std::move(l));
+	if (FileName() == NULL || Saving() || Streaming() || reload) return;
 
-	fileName = "";
-	
-	pageStart = 0;
-	modified = false;
-	
-	cursorRow = 0;
-	cursorColumn = 0;
-	
-	while (!undo.empty()) { delete undo.back(); undo.pop_back(); }
-	while (!redo.empty()) { delete redo.back(); redo.pop_back(); }
-	
-	if (currentUndo != NULL) delete currentUndo;
-	currentUndo = NULL;
+	FileStamp stamp;
+	if (!stamp.Read(fileName.c_str()) || stamp == diskStamp) return;
+
+	if (modified) {
+		diskStamp = stamp;
+
+		std::string status = FileBaseName(fileName.c_str());
+		status += " was changed on disk, but it has unsaved changes";
+		wm.SetStatus(status.c_str());
+		wm.Refresh();
+		return;
+	}
+
+
+	// Read the file and compare it with a snapshot on a worker thread, and
+	// then apply the differences on the main thread, unless the document
+	// was edited in the meantime
+
+	std::shared_ptr<BackgroundReload> job
+		= std::make_shared<BackgroundReload>();
+	job->document = this;
+	job->revision = Revision();
+	reload = job;
+
+	DocumentSnapshot snapshot = Snapshot();
+	std::string path = fileName;
+
+	pool.Submit([job, snapshot, path]() {
+
+		std::string description = "Reloading ";
+		description += FileBaseName(path.c_str());
+		BackgroundOperation op(description.c_str(), 0, OPERATION_UNIT_BYTES,
+				job->token);
+
+		ReturnExt r = ReadLines(path.c_str(), job->text, job->format,
+				job->stamp,
+				[&op, &job](uint64_t done) {
+			op.SetTotal(job->stamp.size);
+			return op.Update(done);
+		});
+		if (r) job->hunks = DiffLines(snapshot, job->text);
+		op.Finish();
+
+		wm.Post([job, path, r]() {
+			EditorDocument* d = job->document;
+			if (d == NULL) return;
+
+			d->reload.reset();
+
+			if (!r) {
+				std::string status = "Cannot reload ";
+				status += FileBaseName(path.c_str());
+				status += ": ";
+				status += r.Message();
+				wm.SetStatus(status.c_str());
+				wm.Refresh();
+				return;
+			}
+
+			if (d->Revision() == job->revision && !d->modified) {
+				d->ApplyReload(job->text, job->hunks);
+				d->format = job->format;
+				d->diskStamp = job->stamp;
+			}
+
+			d->CheckFile();
+		});
+
+	}, TASK_PRIORITY_BACKGROUND, job->token);
 }
 
 
 /**
- * Load from file, and set the associated document file name
+ * Read a file to lines in the same way as LoadFromFile() (runs on
+ * a worker thread)
  *
  * @param file the file name
+ * @param text where to store the lines
+ * @param format where to store the format of the file
+ * @param stamp where to store the stamp of the file that was read
+ * @param progress the function to call with the number of bytes read,
+ *                 which returns false to cancel
  * @return a ReturnExt
  */
-ReturnExt EditorDocument::LoadFromFile(const char* file)
+ReturnExt EditorDocument::ReadLines(const char* file,
+		std::vector<std::string>& text, TextFormat& format, FileStamp& stamp,
+		const std::function<bool(uint64_t)>& progress)
 {
-	// Open the file
+	FileReader reader;
+	ReturnExt r = reader.Open(file);
+	if (!r) return r;
 
-	FILE* f = fopen(file, "rt");
-	if (f == NULL) {
-		return ReturnExt(false, "Cannot open the file", errno);
+	if (!stamp.Read(reader.Descriptor())) {
+		return ReturnExt(false, "Cannot read the file status", errno);
 	}
 
+	TextDecoder decoder([&text](std::string& line) {
+		text.push_back(std::move(line));
+	});
 
-	// Load the lines
+	std::vector<char> block;
+	uint64_t size = 0;
 
-	Clear();
-	lines.clear();
+	while (true) {
+		r = reader.Read(block);
+		if (!r) return r;
+		if (block.empty()) break;
 
-	ssize_t buffer_length = 1024;
-	ssize_t buffer_pos = 0;
-	char* buffer = (char*) malloc(buffer_length + 4);
-	char c;
+		if (!decoder.Decode(&block[0], block.size())) {
+			return ReturnExt(false, decoder.Error().c_str(), EILSEQ);
+		}
+		size += block.size();
 
-	while ((c = fgetc(f)) != EOF) {
-	
-		if (c == '\r') continue;
-		
-		if (c == '\n') {
-			buffer[buffer_pos++] = '\0';
-			buffer_pos = 0;
+		if (!progress(reader.Position())) {
+			return ReturnExt(false, "Reloading was cancelled", ECANCELED);
+		}
+	}
 
-			DocumentLine l;
-			l.SetText(buffer);
-			displayLengths.Increment(l.DisplayLength());
-			lines.push_back(std::move(l));
+	format = decoder.Finish();
+	format.gzip = reader.Compressed();
+	format.trailingGarbage = reader.TrailingGarbage();
 
-			continue;
-		}
+	if (decoder.Failed()) {
+		return ReturnExt(false, decoder.Error().c_str(), EILSEQ);
+	}
 
-		if (buffer_pos >= buffer_length) {
-			char* new_buffer = (char*) malloc(2 * buffer_length + 4);
-			memcpy(new_buffer, (const char*) buffer, buffer_length);
-			buffer_length *= 2;
-			
-			free(buffer);
-			buffer = new_buffer;
+	if (format.lineEnding == LINE_ENDING_MIXED) {
+		for (size_t i = 0; i < text.size(); i++) {
+			if (decoder.EndsWithCR(i)) text[i] += '\r';
 		}
-		
-		buffer[buffer_pos++] = c;
 	}
 
-	buffer[buffer_pos++] = '\0';
+	return ReturnExt(true);
+}
 
-	DocumentLine l;
-	l.SetText(buffer);
-	displayLengths.Increment(l.DisplayLength());
-	lines.push_back(std::move(l));
 
+/**
+ * Apply the changes of the reloaded file as a single edit action
+ *
+ * @param text the lines of the file
+ * @param hunks the differences from the document
+ */
+void EditorDocument::ApplyReload(const std::vector<std::string>& text,
+		const std::vector<DiffHunk>& hunks)
+{
+	if (hunks.empty()) return;
+
+
+	// Apply the hunks from the end, so that the line numbers of the earlier
+	// hunks stay the same. The unchanged lines are not touched at all, so
+	// they keep their parser states.
+
+	FinalizeEditAction();
+	PrepareEdit();
+
+	int64_t changed = 0;
 
-	// Finish
+	for (int64_t i = (int64_t) hunks.size() - 1; i >= 0; i--) {
+		const DiffHunk& h = hunks[i];
+		int64_t common = std::min(h.oldCount, h.newCount);
+
+		for (int64_t k = 0; k < common; k++) {
+			Replace(h.oldStart + k, text[h.newStart + k]);
+		}
+
+		for (int64_t k = h.oldCount - 1; k >= common; k--) {
+			Delete(h.oldStart + k);
+		}
+
+		for (int64_t k = common; k < h.newCount; k++) {
+			Insert(h.oldStart + k, text[h.newStart + k]);
+		}
+
+		changed += std::max(h.oldCount, h.newCount);
+	}
 
-	fclose(f);
 
+	// The document now matches the file, while none of the previous undo
+	// states do
+
+	for (std::deque<UndoEntry*>::iterator it = undo.begin();
+	    it != undo.end();
+	    it++) {
+		(*it)->modified = true;
+		(*it)->redo_modified = true;
+	}
+
+	currentUndo->modified = true;
 	modified = false;
-	fileName = file;
+	FinalizeEditAction();
 
-	return ReturnExt(true);
+	char status[256];
+	snprintf(status, sizeof(status), "Reloaded %s (%lld %s changed on disk)",
+			FileBaseName(fileName.c_str()), (long long) changed,
+			changed == 1 ? "line" : "lines");
+	wm.SetStatus(status);
+
+	NotifyChanged(hunks[0].oldStart);
 }
 
 
@@ -248,74 +2341,210 @@ ReturnExt EditorDocument::LoadFromFile(const char* file)
  */
 ReturnExt EditorDocument::SaveToFile(const char* file, bool switchFile)
 {
-	// Open the temporary file
+	if (ReadOnly()) {
+		return ReturnExt(false, "The document is read-only", EROFS);
+	}
+
+	if (Saving()) {
+		return ReturnExt(false, "The document is already being saved", EBUSY);
+	}
+
+	DocumentSnapshot snapshot = Snapshot();
+
+	std::string description = "Saving ";
+	description += FileBaseName(file);
+	uint64_t size = SnapshotSize(snapshot, format);
+	Operation op(description.c_str(), size);
+
+	ReturnExt r = WriteSnapshot(snapshot, format, file, size, saveDurability,
+			[&op](uint64_t written) { return op.Update(written); });
+	if (!r) return r;
+
+
+	// Switch the associated file and clear the modified flag
 	
-	char tmp[L_tmpnam];
-	if (tmpnam(tmp) == NULL) {
-		return ReturnExt(false, "Cannot generate a name for a new "
-				"temporary file", errno);
+	if (switchFile) Saved(file, snapshot.Revision());
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Save to file on a worker thread, writing a snapshot of the document,
+ * so that the document can be edited while it is being saved
+ *
+ * @param file the file name
+ * @param switchFile whether to set the associated file name and clear
+ *                   the modified flag
+ * @param done the function to call on the main thread when finished
+ * @return a ReturnExt (whether the save has started)
+ */
+ReturnExt EditorDocument::SaveToFileInBackground(const char* file,
+		bool switchFile, const std::function<void(const ReturnExt&)>& done)
+{
+	if (ReadOnly()) {
+		return ReturnExt(false, "The document is read-only", EROFS);
 	}
 
-	FILE* f = fopen(tmp, "wt");
-	if (f == NULL) {
-		return ReturnExt(false, "Error while saving", errno);
+	if (Saving()) {
+		return ReturnExt(false, "The document is already being saved", EBUSY);
 	}
 
-	int numLines = NumLines();
-	for (int i = 0; i < numLines; i++) {
-		const char* l = lines[i].Text().c_str();
-		if (fputs(l, f) == EOF) {
-			fclose(f);
-			unlink(tmp);
-			return ReturnExt(false, "Error while writing", errno);
-		}
-		if (i + 1 < numLines) fputc('\n', f);
+	std::shared_ptr<BackgroundSave> job = std::make_shared<BackgroundSave>();
+	job->document = this;
+	backgroundSave = job;
+
+	DocumentSnapshot snapshot = Snapshot();
+	uint64_t revision = snapshot.Revision();
+	TextFormat fileFormat = format;
+	std::string path = file;
+	SaveDurability durability = saveDurability;
+
+	{
+		std::lock_guard<std::mutex> lock(backgroundSavesMutex);
+		backgroundSaves++;
 	}
 
-	fclose(f);
 
-	if (rename(tmp, file) != 0) {
-		unlink(tmp);
-		return ReturnExt(false, "Error while saving", errno);
+	// Write the snapshot on a worker thread, and then finish the save on
+	// the main thread, unless the document has been destroyed in the meantime
+
+	pool.Submit([job, snapshot, revision, fileFormat, path, durability,
+				switchFile, done]() {
+
+		std::string description = "Saving ";
+		description += FileBaseName(path.c_str());
+		uint64_t size = SnapshotSize(snapshot, fileFormat);
+		BackgroundOperation op(description.c_str(), size,
+				OPERATION_UNIT_BYTES, job->token);
+
+		ReturnExt r = WriteSnapshot(snapshot, fileFormat, path.c_str(), size,
+				durability,
+				[&op](uint64_t written) { return op.Update(written); });
+		op.Finish();
+
+		wm.Post([job, revision, path, switchFile, done, r]() {
+			EditorDocument* d = job->document;
+			if (d == NULL) return;
+
+			d->backgroundSave.reset();
+			if (r && switchFile) d->Saved(path.c_str(), revision);
+			if (done) done(r);
+		});
+
+		std::lock_guard<std::mutex> lock(backgroundSavesMutex);
+		backgroundSaves--;
+		backgroundSavesDone.notify_all();
+
+	}, TASK_PRIORITY_BACKGROUND);
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Save to the current file on a worker thread
+ *
+ * @param done the function to call on the main thread when finished
+ * @return a ReturnExt (whether the save has started)
+ */
+ReturnExt EditorDocument::SaveInBackground(
+		const std::function<void(const ReturnExt&)>& done)
+{
+	if (FileName() == NULL) {
+		return ReturnExt(false, "There is no associated file name");
 	}
 
+	return SaveToFileInBackground(fileName.c_str(), true, done);
+}
 
-	// Switch the associated file and clear the modified flag
-	
-	if (switchFile) {
-		fileName = file;
 
-		if (modified) {
-			modified = false;
-			
-			for (std::deque<UndoEntry*>::iterator it = undo.begin();
-			    it != undo.end();
-			    it++) {
-				(*it)->modified = true;
-				(*it)->redo_modified = true;
-			}
-			
-			for (std::deque<UndoEntry*>::iterator it = redo.begin();
-			    it != redo.end();
-			    it++) {
-				(*it)->modified = true;
-				(*it)->redo_modified = true;
-			}
-			
-			if (!undo.empty()) {
-				undo.back()->redo_modified = false;
-			}
-			
-			if (!redo.empty()) {
-				redo.back()->modified = false;
-			}
-			
-			if (currentUndo != NULL) delete currentUndo;
-			currentUndo = NULL;
+/**
+ * Wait until all saves that run in the background finish
+ */
+void EditorDocument::WaitForBackgroundSaves(void)
+{
+	std::unique_lock<std::mutex> lock(backgroundSavesMutex);
+	backgroundSavesDone.wait(lock, []() { return backgroundSaves == 0; });
+}
+
+
+/**
+ * Switch the associated file after a successful save, and clear the
+ * modified flag if the document has not changed since the snapshot
+ * was taken
+ *
+ * @param file the file name
+ * @param revision the revision of the saved snapshot
+ */
+void EditorDocument::Saved(const char* file, uint64_t revision)
+{
+	fileName = file;
+
+	diskStamp.Read(file);
+	WatchFile();
+
+
+	// If the document was edited while it was being saved, it stays
+	// modified, and since we do not know which undo state matches the file,
+	// all of them are considered modified
+
+	if (revision != Revision()) {
+		modified = true;
+
+		for (std::deque<UndoEntry*>::iterator it = undo.begin();
+		    it != undo.end();
+		    it++) {
+			(*it)->modified = true;
+			(*it)->redo_modified = true;
+		}
+		
+		for (std::deque<UndoEntry*>::iterator it = redo.begin();
+		    it != redo.end();
+		    it++) {
+			(*it)->modified = true;
+			(*it)->redo_modified = true;
+		}
+
+		if (currentUndo != NULL) {
+			currentUndo->modified = true;
+			currentUndo->redo_modified = true;
 		}
+
+		return;
 	}
 
-	return ReturnExt(true);
+
+	// Otherwise clear the modified flag
+
+	if (modified) {
+		modified = false;
+		
+		for (std::deque<UndoEntry*>::iterator it = undo.begin();
+		    it != undo.end();
+		    it++) {
+			(*it)->modified = true;
+			(*it)->redo_modified = true;
+		}
+		
+		for (std::deque<UndoEntry*>::iterator it = redo.begin();
+		    it != redo.end();
+		    it++) {
+			(*it)->modified = true;
+			(*it)->redo_modified = true;
+		}
+		
+		if (!undo.empty()) {
+			undo.back()->redo_modified = false;
+		}
+		
+		if (!redo.empty()) {
+			redo.back()->modified = false;
+		}
+		
+		if (currentUndo != NULL) delete currentUndo;
+		currentUndo = NULL;
+	}
 }
 
 
@@ -330,8 +2559,7 @@ ReturnExt EditorDocument::Save(void)
 		return ReturnExt(false, "There is no associated file name");
 	}
 
-	SaveToFile(fileName.c_str(), true);
-	return ReturnExt(true);
+	return SaveToFile(fileName.c_str(), true);
 }
 
 
@@ -340,7 +2568,7 @@ ReturnExt EditorDocument::Save(void)
  * 
  * @param start the page start line
  */
-void EditorDocument::SetPageStart(int start)
+void EditorDocument::SetPageStart(int64_t start)
 {
 	if (start >= NumLines()) start = NumLines() - 1;
 	if (start < 0) start = 0;
@@ -354,39 +2582,59 @@ void EditorDocument::SetPageStart(int start)
  * 
  * @return the maximum display length
  */
-int EditorDocument::MaxDisplayLength(void)
+int64_t EditorDocument::MaxDisplayLength(void)
 {
+	if (!HasFeature(DOCUMENT_FEATURE_WIDTHS)) return widestLine;
 	return displayLengths.MaxKey();
 }
 
 
+/**
+ * Lay out the lines again if the tab size changed since the last time
+ * 
+ * @return true if the display lengths changed
+ */
+bool EditorDocument::UpdateLayout(void)
+{
+	if (layoutTabSize == DocumentLine::TabSize()) return false;
+	layoutTabSize = DocumentLine::TabSize();
+
+
+	// Recompute the widths in parallel, and then count them again
+
+	lines.UpdateAll([](DocumentLine& l) { l.UpdateLayout(); });
+
+	int64_t numLines = lines.Size();
+	displayLengths.Clear();
+	widestLine = 0;
+
+	for (int64_t i = 0; i < numLines; i++) {
+		AddDisplayLength(lines[i].DisplayLength());
+	}
+
+	return true;
+}
+
+
 /**
  * Return the string position corresponding to the given cursor position
  * 
  * @param line the line number
  * @param cursor the cursor position
+ * @param actual the cursor position at the returned string position
+ *               (output, optional)
  * @return the string position index
  */
-int EditorDocument::StringPosition(int line, int cursor)
+int64_t EditorDocument::StringPosition(int64_t line, int64_t cursor,
+		int64_t* actual)
 {
-	int pos = 0, index = 0;
-	const char* p = Line(line);
-	
-	while (*p != '\0' && *p != '\n' && *p != '\r' && pos < cursor) {
-		char c = *p;
-		
-		if (c == '\t') {
-			pos = (pos / tabSize) * tabSize + tabSize;
-		}
-		else {
-			pos++;
-		}
-		
-		p++;
-		if (pos <= cursor) index++;
+	DocumentLine* l = LineObject(line);
+	if (l == NULL) {
+		if (actual != NULL) *actual = 0;
+		return 0;
 	}
-	
-	return index;
+
+	return l->ColumnToOffset(cursor, actual);
 }
 
 
@@ -397,27 +2645,10 @@ int EditorDocument::StringPosition(int line, int cursor)
  * @param cursor the cursor position
  * @return the cursor position, or the maximum position if out of bounds
  */
-int EditorDocument::CursorPosition(int line, size_t offset)
+int64_t EditorDocument::CursorPosition(int64_t line, size_t offset)
 {
-	int pos = 0;
-	size_t index = 0;
-	const char* p = Line(line);
-	
-	while (*p != '\0' && *p != '\n' && *p != '\r' && index < offset) {
-		char c = *p;
-		
-		if (c == '\t') {
-			pos = (pos / tabSize) * tabSize + tabSize;
-		}
-		else {
-			pos++;
-		}
-		
-		p++;
-		index++;
-	}
-	
-	return pos;
+	DocumentLine* l = LineObject(line);
+	return l == NULL ? 0 : l->OffsetToColumn(offset);
 }
 
 
@@ -427,7 +2658,7 @@ int EditorDocument::CursorPosition(int line, size_t offset)
  * @param row the row
  * @param column the column
  */
-void EditorDocument::SetCursorLocation(int row, int column)
+void EditorDocument::SetCursorLocation(int64_t row, int64_t column)
 {
 	cursorRow = row;
 	cursorColumn = column;
@@ -459,8 +2690,8 @@ void EditorDocument::Append(const char* line)
 	
 	l.SetText(line);
 	
-	displayLengths.Increment(l.DisplayLength());
-	lines.push_back(std::move(l));
+	AddDisplayLength(l.DisplayLength());
+	lines.PushBack(std::move(l));
 	
 	modified = true;
 }
@@ -472,15 +2703,15 @@ void EditorDocument::Append(const char* line)
  * @param pos the line before which to insert
  * @param line the new line
  */
-void EditorDocument::Insert(int pos, const char* line)
+void EditorDocument::Insert(int64_t pos, const std::string& line)
 {
 	PrepareEdit();
 	DocumentLine l;
 	
 	l.SetText(line);
 	
-	displayLengths.Increment(l.DisplayLength());
-	lines.insert(lines.begin() + pos, std::move(l));
+	AddDisplayLength(l.DisplayLength());
+	lines.Insert(pos, std::move(l));
 	
 	modified = true;
 	
@@ -494,20 +2725,40 @@ void EditorDocument::Insert(int pos, const char* line)
  * @param pos the line to replace
  * @param line the new contents of the line
  */
-void EditorDocument::Replace(int pos, const char* line)
+void EditorDocument::Replace(int64_t pos, const std::string& line)
 {
 	PrepareEdit();
-	DocumentLine& l = lines[pos];
-	displayLengths.Decrement(l.DisplayLength());
+	DocumentLine& l = lines.Edit(pos);
+	RemoveDisplayLength(l.DisplayLength());
 	
-	std::string org = l.Text();
+	std::string org = l.String();
 	l.SetText(line);
 	
-	displayLengths.Increment(l.DisplayLength());
+	AddDisplayLength(l.DisplayLength());
+	
+	modified = true;
+	
+	currentUndo->Add(new EA_ReplaceLine(pos, org, line));
+}
+
+
+/**
+ * Delete a line
+ * 
+ * @param pos the line to delete
+ */
+void EditorDocument::Delete(int64_t pos)
+{
+	PrepareEdit();
+	const DocumentLine& l = lines[pos];
+	RemoveDisplayLength(l.DisplayLength());
+	
+	std::string org = l.String();
+	lines.Erase(pos, pos + 1);
 	
 	modified = true;
 	
-	currentUndo->Add(new EA_ReplaceLine(pos, org.c_str(), line));
+	currentUndo->Add(new EA_DeleteLine(pos, org));
 }
 
 
@@ -518,20 +2769,20 @@ void EditorDocument::Replace(int pos, const char* line)
  * @param ch the character to insert
  * @param pos the string position
  */
-void EditorDocument::InsertCharToLine(int line, char ch, int pos)
+void EditorDocument::InsertCharToLine(int64_t line, char ch, int64_t pos)
 {
 	PrepareEdit();
-	DocumentLine& l = lines[line];
-	displayLengths.Decrement(l.DisplayLength());
+	DocumentLine& l = lines.Edit(line);
+	RemoveDisplayLength(l.DisplayLength());
 	
 	if (pos < 0) pos = 0;
-	if (pos > l.Text().length()) pos = l.Text().length();
+	if (pos > (int64_t) l.Length()) pos = l.Length();
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	s.insert(pos, 1, ch);
 	l.SetText(s);
 	
-	displayLengths.Increment(l.DisplayLength());
+	AddDisplayLength(l.DisplayLength());
 	
 	modified = true;
 	
@@ -545,22 +2796,22 @@ void EditorDocument::InsertCharToLine(int line, char ch, int pos)
  * @param line the line
  * @param pos the string position
  */
-void EditorDocument::DeleteCharFromLine(int line, int pos)
+void EditorDocument::DeleteCharFromLine(int64_t line, int64_t pos)
 {
 	PrepareEdit();
-	DocumentLine& l = lines[line];
-	if (l.Text().length() == 0) return;
-	displayLengths.Decrement(l.DisplayLength());
+	DocumentLine& l = lines.Edit(line);
+	if (l.Length() == 0) return;
+	RemoveDisplayLength(l.DisplayLength());
 
-	if (pos >= l.Text().length()) pos = l.Text().length() - 1;
+	if (pos >= (int64_t) l.Length()) pos = l.Length() - 1;
 	if (pos < 0) pos = 0;
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	char ch = s[pos];
 	
 	s.erase(pos, 1);
 	l.SetText(s);
-	displayLengths.Increment(l.DisplayLength());
+	AddDisplayLength(l.DisplayLength());
 	
 	modified = true;
 	
@@ -573,26 +2824,32 @@ void EditorDocument::DeleteCharFromLine(int line, int pos)
  * 
  * @param line the first line to join
  */
-void EditorDocument::JoinTwoLines(int line)
+void EditorDocument::JoinTwoLines(int64_t line)
 {
 	PrepareEdit();
-	DocumentLine& l = lines[line];
-	DocumentLine& l2 = lines[line + 1];
-	displayLengths.Decrement(l.DisplayLength());
-	displayLengths.Decrement(l2.DisplayLength());
+	DocumentLine& l = lines.Edit(line);
+	DocumentLine& l2 = lines.Edit(line + 1);
+	RemoveDisplayLength(l.DisplayLength());
+	RemoveDisplayLength(l2.DisplayLength());
+	
+	std::string org1 = l.String();
+	std::string org2 = l2.String();
 	
-	std::string org1 = l.Text();
-	std::string org2 = l2.Text();
 	
-	l.SetText(org1 + org2);
+	// The joined line ends as the second line did, so drop the CR that
+	// marks a CRLF line in a document with mixed line endings
 	
-	lines.erase(lines.begin() + line + 1);
-	displayLengths.Increment(l.DisplayLength());
+	std::string s = org1;
+	if (!s.empty() && s[s.length() - 1] == '\r') s.erase(s.length() - 1);
+	l.SetText(s + org2);
+	
+	lines.Erase(line + 1, line + 2);
+	AddDisplayLength(l.DisplayLength());
 	
 	modified = true;
 
-	currentUndo->Add(new EA_ReplaceLine(line, org1.c_str(), l.Text().c_str()));
-	currentUndo->Add(new EA_DeleteLine(line + 1, org2.c_str()));
+	currentUndo->Add(new EA_ReplaceLine(line, org1, l.String()));
+	currentUndo->Add(new EA_DeleteLine(line + 1, org2));
 }
 
 
@@ -603,29 +2860,34 @@ void EditorDocument::JoinTwoLines(int line)
  * @param pos the string position
  * @param str the string to insert
  */
-void EditorDocument::InsertStringEx(int line, int pos, const char* str)
+void EditorDocument::InsertStringEx(int64_t line, int64_t pos,
+		const char* str)
 {
-	DocumentLine& l = lines[line];
-	displayLengths.Decrement(l.DisplayLength());
+	DocumentLine& l = lines.Edit(line);
+	RemoveDisplayLength(l.DisplayLength());
 	
 	if (pos < 0) pos = 0;
-	if (pos > l.Text().length()) pos = l.Text().length();
+	if (pos > (int64_t) l.Length()) pos = l.Length();
 	
 	const char* linebreak = std::strchr(str, '\n');
 	if (linebreak == NULL) {
 		
-		l.SetText(l.Text().substr(0, pos) + std::string(str) + l.Text().substr(pos));
-		displayLengths.Increment(l.DisplayLength());
+		l.SetText(l.String().substr(0, pos) + std::string(str) + l.String().substr(pos));
+		AddDisplayLength(l.DisplayLength());
 	}
 	else {
 		
-		char* buf = (char*) alloca(std::strlen(str) + 1);
-		int bi = 0, li = -1;
+		// The buffer is on the heap, since the pasted text can be large
+		
+		std::vector<char> buffer(std::strlen(str) + 1);
+		char* buf = &buffer[0];
+		size_t bi = 0;
+		int64_t li = -1;
 		
 		const char* start = str;
 		const char* end = start;
 		
-		std::string rest = l.Text().substr(pos);
+		std::string rest = l.String().substr(pos);
 		
 		while (true) {
 			
@@ -636,21 +2898,21 @@ void EditorDocument::InsertStringEx(int line, int pos, const char* str)
 				start = end + 1;
 				
 				if (li == 0) {
-					l.SetText(l.Text().substr(0, pos) + std::string(buf));
-					displayLengths.Increment(l.DisplayLength());
+					l.SetText(l.String().substr(0, pos) + std::string(buf));
+					AddDisplayLength(l.DisplayLength());
 				}
 				else if (*end == '\0') {
 					DocumentLine nl;
 					nl.SetText(std::string(buf) + rest);
-					displayLengths.Increment(nl.DisplayLength());
-					lines.insert(lines.begin() + line + li, std::move(nl));
+					AddDisplayLength(nl.DisplayLength());
+					lines.Insert(line + li, std::move(nl));
 					break;
 				}
 				else {
 					DocumentLine nl;
 					nl.SetText(std::string(buf));
-					displayLengths.Increment(nl.DisplayLength());
-					lines.insert(lines.begin() + line + li, std::move(nl));
+					AddDisplayLength(nl.DisplayLength());
+					lines.Insert(line + li, std::move(nl));
 				}
 			}
 			else {
@@ -670,7 +2932,8 @@ void EditorDocument::InsertStringEx(int line, int pos, const char* str)
  * @param pos the string position
  * @param str the string to insert
  */
-void EditorDocument::InsertString(int line, int pos, const char* str)
+void EditorDocument::InsertString(int64_t line, int64_t pos,
+		const char* str)
 {
 	PrepareEdit();
 	
@@ -689,67 +2952,67 @@ void EditorDocument::InsertString(int line, int pos, const char* str)
  * @param toline the last line
  * @param topos the position within the last line
  */
-void EditorDocument::DeleteStringEx(int line, int pos, int toline, int topos)
+void EditorDocument::DeleteStringEx(int64_t line, int64_t pos,
+		int64_t toline, int64_t topos)
 {
 	if (toline < line) {
-		int t = toline; toline = line; line = t;
+		int64_t t = toline; toline = line; line = t;
 		t = topos; topos = pos; pos = t;
 	}
 	
 	if (toline == line) {
 		
 		if (topos < pos) {
-			int t = topos; topos = pos; pos = t;
+			int64_t t = topos; topos = pos; pos = t;
 		}
 		
 		if (topos == pos) return;
 		
-		DocumentLine& l = lines[line];
-		displayLengths.Decrement(l.DisplayLength());
+		DocumentLine& l = lines.Edit(line);
+		RemoveDisplayLength(l.DisplayLength());
 		
-		std::string s = l.Text();
-		if (pos >= s.length()) pos = s.length();
+		std::string s = l.String();
+		if (pos >= (int64_t) s.length()) pos = s.length();
 		if (pos < 0) pos = 0;
-		if (topos >= s.length()) topos = s.length();
+		if (topos >= (int64_t) s.length()) topos = s.length();
 		if (topos < 0) topos = 0;
 		
 		s.erase(pos, topos - pos);
 		l.SetText(s);
 		
-		displayLengths.Increment(l.DisplayLength());
+		AddDisplayLength(l.DisplayLength());
 	}
 	
 	if (toline > line) {
 		
 		// Get the last line
 		
-		DocumentLine& ll = lines[toline];
-		displayLengths.Decrement(ll.DisplayLength());
+		DocumentLine& ll = lines.Edit(toline);
+		RemoveDisplayLength(ll.DisplayLength());
 		
-		if (topos >= ll.Text().length()) topos = ll.Text().length();
+		if (topos >= (int64_t) ll.Length()) topos = ll.Length();
 		if (topos < 0) topos = 0;
 		
 		
 		// Update the first line
 		
-		DocumentLine& l = lines[line];
-		displayLengths.Decrement(l.DisplayLength());
+		DocumentLine& l = lines.Edit(line);
+		RemoveDisplayLength(l.DisplayLength());
 		
-		if (pos >= l.Text().length()) pos = l.Text().length();
+		if (pos >= (int64_t) l.Length()) pos = l.Length();
 		if (pos < 0) pos = 0;
 		
-		l.SetText(l.Text().substr(0, pos) + ll.Text().substr(topos));
+		l.SetText(l.String().substr(0, pos) + ll.String().substr(topos));
 		
-		displayLengths.Increment(l.DisplayLength());
+		AddDisplayLength(l.DisplayLength());
 		
 		
 		// Delete the other lines
 		
-		for (int i = line; i < toline; i++) {
-			DocumentLine& nl = lines[line];
-			displayLengths.Decrement(nl.DisplayLength());
-			lines.erase(lines.begin() + line + 1);
+		for (int64_t i = line; i < toline; i++) {
+			RemoveDisplayLength(lines[line].DisplayLength());
 		}
+		lines.Erase(line + 1, toline + 1);
 	}
 }
 
@@ -762,15 +3025,16 @@ void EditorDocument::DeleteStringEx(int line, int pos, int toline, int topos)
  * @param toline the last line
  * @param topos the position within the last line
  */
-void EditorDocument::DeleteString(int line, int pos, int toline, int topos)
+void EditorDocument::DeleteString(int64_t line, int64_t pos,
+		int64_t toline, int64_t topos)
 {
 	if (toline < line) {
-		int t = toline; toline = line; line = t;
+		int64_t t = toline; toline = line; line = t;
 		t = topos; topos = pos; pos = t;
 	}
 	
 	if (toline == line && topos < pos) {
-		int t = topos; topos = pos; pos = t;
+		int64_t t = topos; topos = pos; pos = t;
 	}
 	
 	
@@ -793,60 +3057,61 @@ void EditorDocument::DeleteString(int line, int pos, int toline, int topos)
  * @param toline the last line
  * @param topos the position within the last line
  */
-std::string EditorDocument::Get(int line, int pos, int toline, int topos)
+std::string EditorDocument::Get(int64_t line, int64_t pos,
+		int64_t toline, int64_t topos)
 {
 	if (toline < line) {
-		int t = toline; toline = line; line = t;
+		int64_t t = toline; toline = line; line = t;
 		t = topos; topos = pos; pos = t;
 	}
 	
 	if (toline == line) {
 		
 		if (topos < pos) {
-			int t = topos; topos = pos; pos = t;
+			int64_t t = topos; topos = pos; pos = t;
 		}
 		
 		if (topos == pos) return "";
 		
-		DocumentLine& l = lines[line];
+		std::string l = Line(line);
 		
-		if (pos >= l.Text().length()) pos = l.Text().length();
+		if (pos >= (int64_t) l.length()) pos = l.length();
 		if (pos < 0) pos = 0;
 		
-		if (topos >= l.Text().length()) topos = l.Text().length();
+		if (topos >= (int64_t) l.length()) topos = l.length();
 		if (topos < 0) topos = 0;
 		
-		return l.Text().substr(pos, topos - pos);
+		return l.substr(pos, topos - pos);
 	}
 	
 	if (toline > line) {
 		
 		// Get the first line
 		
-		DocumentLine& l = lines[line];
+		std::string l = Line(line);
 		
-		if (pos >= l.Text().length()) pos = l.Text().length();
+		if (pos >= (int64_t) l.length()) pos = l.length();
 		if (pos < 0) pos = 0;
 		
-		std::string s = l.Text().substr(pos);
+		std::string s = l.substr(pos);
 		
 		
 		// Get the other lines
 		
-		for (int i = line + 1; i < toline; i++) {
-			DocumentLine& nl = lines[i];
-			s += "\n" + nl.Text();
+		for (int64_t i = line + 1; i < toline; i++) {
+			s += "\n";
+			s += Line(i);
 		}
 		
 		
 		// Get the last line
 		
-		DocumentLine& ll = lines[toline];
+		std::string ll = Line(toline);
 		
-		if (topos >= ll.Text().length()) topos = ll.Text().length();
+		if (topos >= (int64_t) ll.length()) topos = ll.length();
 		if (topos < 0) topos = 0;
 		
-		return s + "\n" + ll.Text().substr(0, topos);
+		return s + "\n" + ll.substr(0, topos);
 	}
 	
 	assert(0);
@@ -861,7 +3126,8 @@ std::string EditorDocument::Get(int line, int pos, int toline, int topos)
  * @param _cursorColumn the cursor column
  * @param _modified the modification status of a document
  */
-UndoEntry::UndoEntry(EditorDocument* _document, int _cursorRow, int _cursorColumn, bool _modified)
+UndoEntry::UndoEntry(EditorDocument* _document, int64_t _cursorRow,
+		int64_t _cursorColumn, bool _modified)
 {
 	action = new CompoundEditAction();
 	
@@ -951,6 +3217,17 @@ void EditorDocument::Redo(void)
 	
 	undo.push_back(currentUndo);
 	currentUndo = NULL;
+	
+	
+	// Without the full undo history, forget the oldest steps, which for
+	// large files can hold a lot of deleted text
+	
+	if (!HasFeature(DOCUMENT_FEATURE_UNDO)) {
+		while (undo.size() > APE_LIMITED_UNDO_DEPTH) {
+			delete undo.front();
+			undo.pop_front();
+		}
+	}
 }
 
 
@@ -967,6 +3244,17 @@ void EditorDocument::FinalizeEditAction(void)
 	
 	undo.push_back(currentUndo);
 	currentUndo = NULL;
+	
+	
+	// Without the full undo history, forget the oldest steps, which for
+	// large files can hold a lot of deleted text
+	
+	if (!HasFeature(DOCUMENT_FEATURE_UNDO)) {
+		while (undo.size() > APE_LIMITED_UNDO_DEPTH) {
+			delete undo.front();
+			undo.pop_front();
+		}
+	}
 }
 
 
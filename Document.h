@@ -35,43 +35,154 @@
 #ifndef __DOCUMENT_H
 #define __DOCUMENT_H
 
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <stdint.h>
 #include <string>
 #include <vector>
 
+#include "Diff.h"
 #include "EditAction.h"
+#include "FeaturePolicy.h"
+#include "FileWatcher.h"
 #include "Histogram.h"
 #include "Parser.h"
+#include "TextFormat.h"
+#include "TextStorage.h"
+#include "ThreadPool.h"
+#include "UTF8.h"
 
+class DocumentSnapshot;
 class EditorDocument;
 class Parser;
 
 
 /**
- * A line in the document
+ * The maximum number of lines in a chunk of the document line store
+ */
+#define APE_DOCUMENT_CHUNK_SIZE		512
+
+/**
+ * The maximum number of lines written by a single writev() call when saving,
+ * which takes up to two buffers per line (must be at most IOV_MAX / 2)
+ */
+#define APE_SAVE_BATCH_LINES		512
+
+/**
+ * The number of lines read from a stream that are passed to the document
+ * together
+ */
+#define APE_STREAM_BATCH_LINES		1024
+
+/**
+ * The maximum number of batches of lines appended to the document at once,
+ * so that the main thread stays responsive while it catches up
+ */
+#define APE_STREAM_APPEND_BATCHES	16
+
+/**
+ * The maximum number of bytes read from a stream that can wait to be
+ * appended to the document, before the reader stops reading
+ */
+#define APE_STREAM_PENDING_BYTES	(4 * 1024 * 1024)
+
+/**
+ * The default maximum number of bytes read from a stream to a document
+ */
+#define APE_STREAM_DEFAULT_LIMIT	(1024ull * 1024 * 1024)
+
+
+/**
+ * The durability guarantees of saving a file
+ */
+enum SaveDurability
+{
+	SAVE_DURABILITY_NONE,		// Just rename the written file
+	SAVE_DURABILITY_DATA,		// Flush the file data before the rename
+	SAVE_DURABILITY_FULL,		// Flush the file, and the directory after it
+};
+
+
+/**
+ * The value of the 32-bit length fields of a line that means that the actual
+ * value is stored in the extras
+ */
+#define APE_LINE_LONG				UINT32_MAX
+
+
+/**
+ * A line in the document. The record itself is kept small, since large files
+ * have many lines: The text lives in shared blocks, and the data that most
+ * lines do not need, such as the parser states, lives in a separate record
+ * that is allocated only when needed.
  */
 class DocumentLine
 {
-	friend class Parser;	// XXX
-	
-	std::string str;
-	int displayLength;
+	friend class Parser;
 	
-	// Key: Character offset, Value: The parser state
-	std::vector<std::pair<unsigned, ParserState>> parserStates;
-	ParserState initialParserState;
+	/**
+	 * The optional data of a line
+	 */
+	struct Extras
+	{
+		// Key: Character offset, Value: The parser state
+		std::vector<std::pair<size_t, ParserState>> parserStates;
+		ParserState initialParserState;
+		
+		std::unique_ptr<ColumnMap> columnMap;	// Built on demand
+		
+		int64_t length;				// If it does not fit in 32 bits
+		int64_t displayLength;
+	};
+	
+	TextBlock* block;				// NULL for an empty line
+	uint32_t offset;
+	uint32_t length;
+	uint32_t displayLength;
+	bool plain;						// Only one-column characters, no tabs
 	bool validParse;
+	std::unique_ptr<Extras> extras;
+	
+	static std::atomic<int> tabSize;	// Read also by the loader threads
+	static const std::vector<std::pair<size_t, ParserState>> noParserStates;
+	
+	
+	/**
+	 * Get the extras, allocating them if necessary
+	 *
+	 * @return the extras
+	 */
+	Extras& MutableExtras(void);
+	
+	/**
+	 * Free the extras if they are no longer needed
+	 */
+	void TrimExtras(void);
+	
+	/**
+	 * Replace the text block
+	 *
+	 * @param block the new block, whose reference the line takes over
+	 * @param offset the offset of the text within the block
+	 * @param length the length of the text
+	 */
+	void Assign(TextBlock* block, uint32_t offset, size_t length);
+	
+	/**
+	 * Set the display length
+	 *
+	 * @param length the display length
+	 */
+	void SetDisplayLength(int64_t length);
 	
-	std::unique_ptr<DocumentLine> processedLine;
-
-
-protected:
-
 	/**
 	 * Perform actions after updating the line
 	 */
-	virtual void LineUpdated();
+	void LineUpdated(void);
 
 
 public:
@@ -79,34 +190,77 @@ public:
 	/**
 	 * Create a new instance of DocumentLine
 	 */
-	DocumentLine();
+	DocumentLine(void);
 	
 	/**
 	 * Destroy the line
 	 */
-	virtual ~DocumentLine();
+	~DocumentLine(void);
 	
 	
-	// Default move constructor and operator, but no copying
+	// Move construction and assignment, and copy construction for the
+	// copy-on-write line chunks (which shares the text block and does not
+	// copy the column map)
 	
-	DocumentLine(const DocumentLine& l) = delete;
-	DocumentLine(DocumentLine&& l) = default;
+	DocumentLine(const DocumentLine& l);
+	DocumentLine(DocumentLine&& l) noexcept;
 	
 	DocumentLine& operator=(const DocumentLine& l) = delete;
-	DocumentLine& operator=(DocumentLine&& l) = default;
+	DocumentLine& operator=(DocumentLine&& l) noexcept;
 	
 	
 	/**
 	 * Get the text of the line
 	 *
+	 * @return the NUL-terminated text
+	 */
+	inline const char* Text() const
+	{
+		return block == NULL ? "" : block->Data() + offset;
+	}
+	
+	
+	/**
+	 * Get the length of the text in bytes
+	 *
+	 * @return the length
+	 */
+	inline size_t Length() const
+	{
+		return length != APE_LINE_LONG ? length : extras->length;
+	}
+	
+	
+	/**
+	 * Get a copy of the text of the line
+	 *
 	 * @return the text
 	 */
-	inline const std::string& Text() const
+	inline std::string String() const
 	{
-		return str;
+		return std::string(Text(), Length());
 	}
 	
 	
+	/**
+	 * Set the text of the line
+	 *
+	 * @param text the text
+	 * @param length the length of the text
+	 */
+	void SetText(const char* text, size_t length);
+	
+	
+	/**
+	 * Set the text of the line, packing it into a shared block
+	 *
+	 * @param arena the arena that provides the block
+	 * @param text the text
+	 * @param length the length of the text
+	 */
+	void SetText(TextArena& arena, const char* text, size_t length);
+	
+	
 	/**
 	 * Set the text of the line
 	 *
@@ -114,8 +268,7 @@ public:
 	 */
 	inline void SetText(const std::string& text)
 	{
-		str = text;
-		LineUpdated();
+		SetText(text.data(), text.length());
 	}
 	
 	
@@ -126,8 +279,7 @@ public:
 	 */
 	inline void SetText(const char* text)
 	{
-		str = text;
-		LineUpdated();
+		SetText(text, strlen(text));
 	}
 	
 	
@@ -136,18 +288,65 @@ public:
 	 *
 	 * @return the display length
 	 */
-	inline int DisplayLength()
+	inline int64_t DisplayLength() const
 	{
-		return displayLength;
+		return displayLength != APE_LINE_LONG ? displayLength
+			: extras->displayLength;
 	}
 	
 	
+	/**
+	 * Recompute the display length, for example after the tab size changed
+	 */
+	void UpdateLayout(void);
+	
+	
+	/**
+	 * Find the byte offset of the character at the given display column
+	 *
+	 * @param column the display column
+	 * @param actual the display column at the returned offset (output,
+	 *               optional)
+	 * @return the byte offset
+	 */
+	size_t ColumnToOffset(int64_t column, int64_t* actual = NULL);
+	
+	
+	/**
+	 * Find the display column of the given byte offset
+	 *
+	 * @param offset the byte offset
+	 * @return the display column
+	 */
+	int64_t OffsetToColumn(size_t offset);
+	
+	
+	/**
+	 * Get the tab size
+	 *
+	 * @return the tab size
+	 */
+	static inline int TabSize(void) { return tabSize; }
+	
+	
+	/**
+	 * Set the tab size. The documents lay out their lines again the next
+	 * time they are painted.
+	 *
+	 * @param size the tab size
+	 */
+	static void SetTabSize(int size);
+	
+	
 	/**
 	 * Clear parsing
 	 */
 	void ClearParsing(void)
 	{
-		parserStates.clear();
+		if (extras) {
+			extras->parserStates.clear();
+			TrimExtras();
+		}
 		validParse = false;
 	}
 	
@@ -165,9 +364,9 @@ public:
 	 *
 	 * @return the parser states (key: character offset, value: the parser state)
 	 */
-	inline const std::vector<std::pair<unsigned, ParserState>>& ParserStates() const
+	inline const std::vector<std::pair<size_t, ParserState>>& ParserStates() const
 	{
-		return parserStates;
+		return extras ? extras->parserStates : noParserStates;
 	}
 	
 	
@@ -180,15 +379,241 @@ public:
 	 */
 	inline bool ParserStateFollows(const DocumentLine* other) const {
 		if (other == NULL) return false;
-		if (parserStates.empty()) return false;
-		if (other->parserStates.empty()) return false;
-		return initialParserState
-			== other->parserStates[other->parserStates.size()-1].second;
+		if (ParserStates().empty()) return false;
+		if (other->ParserStates().empty()) return false;
+		return extras->initialParserState
+			== other->extras->parserStates.back().second;
 	}
 	
 };
 
 
+/**
+ * A sequence of lines stored in reference-counted chunks, which are shared
+ * with the document snapshots. A shared chunk is copied before it is modified,
+ * so taking a snapshot is O(1) and the first edit afterwards copies only the
+ * chunk index and the affected chunk.
+ *
+ * The store itself must be accessed only from a single (the main) thread.
+ *
+ * @author Peter Macko
+ */
+class DocumentLineStore
+{
+	friend class DocumentSnapshot;
+
+	typedef std::vector<DocumentLine> Chunk;
+
+	/**
+	 * The index of the chunks
+	 */
+	struct Index
+	{
+		std::vector<std::shared_ptr<Chunk>> chunks;
+		std::vector<int64_t> starts;
+		int64_t numLines;
+	};
+
+	std::shared_ptr<Index> index;
+	uint64_t revision;
+	mutable int hint;
+
+
+	/**
+	 * Find the chunk that contains the given line
+	 *
+	 * @param index the index
+	 * @param line the line number (must be within the bounds)
+	 * @param hint the chunk to try first, which is updated to the result
+	 * @return the chunk number
+	 */
+	static int FindChunk(const Index& index, int64_t line, int& hint);
+
+	/**
+	 * Get the index for writing, copying it first if it is shared
+	 *
+	 * @return the index
+	 */
+	Index& MutableIndex(void);
+
+	/**
+	 * Get a chunk for writing, copying it first if it is shared
+	 *
+	 * @param chunk the chunk number
+	 * @return the chunk
+	 */
+	Chunk& MutableChunk(int chunk);
+
+
+public:
+
+	/**
+	 * Create an empty store
+	 */
+	DocumentLineStore(void);
+
+	/**
+	 * Destroy the store
+	 */
+	virtual ~DocumentLineStore(void);
+
+	/**
+	 * Get the number of lines
+	 *
+	 * @return the number of lines
+	 */
+	inline int64_t Size(void) const { return index->numLines; }
+
+	/**
+	 * Get the revision number, which changes with every edit
+	 *
+	 * @return the revision number
+	 */
+	inline uint64_t Revision(void) const { return revision; }
+
+	/**
+	 * Get a line for reading
+	 *
+	 * @param line the line number
+	 * @return the line
+	 */
+	const DocumentLine& operator[](int64_t line) const;
+
+	/**
+	 * Get a line for updating its meta-data, such as the parser states,
+	 * without changing the revision
+	 *
+	 * @param line the line number
+	 * @return the line
+	 */
+	DocumentLine& Mutable(int64_t line);
+
+	/**
+	 * Get a line for editing its text
+	 *
+	 * @param line the line number
+	 * @return the line
+	 */
+	inline DocumentLine& Edit(int64_t line) { revision++; return Mutable(line); }
+
+	/**
+	 * Update the meta-data of all lines in parallel, without changing the
+	 * revision
+	 *
+	 * @param f the function to apply to each line
+	 */
+	void UpdateAll(const std::function<void(DocumentLine&)>& f);
+
+	/**
+	 * Insert a line
+	 *
+	 * @param pos the line before which to insert
+	 * @param line the line
+	 */
+	void Insert(int64_t pos, DocumentLine&& line);
+
+	/**
+	 * Append a line
+	 *
+	 * @param line the line
+	 */
+	inline void PushBack(DocumentLine&& line) { Insert(Size(), std::move(line)); }
+
+	/**
+	 * Erase a range of lines
+	 *
+	 * @param first the first line to erase
+	 * @param last the line after the last line to erase
+	 */
+	void Erase(int64_t first, int64_t last);
+
+	/**
+	 * Remove all lines
+	 */
+	void Clear(void);
+
+	/**
+	 * Exchange the contents with another store
+	 *
+	 * @param other the other store
+	 */
+	void Swap(DocumentLineStore& other);
+
+	/**
+	 * Take an immutable snapshot of the lines
+	 *
+	 * @return the snapshot
+	 */
+	DocumentSnapshot Snapshot(void) const;
+};
+
+
+/**
+ * An immutable snapshot of the document lines, which can be read from
+ * another thread without locking while the document is being edited.
+ * A single snapshot object should be used by only one thread at a time,
+ * but it can be freely copied.
+ *
+ * @author Peter Macko
+ */
+class DocumentSnapshot
+{
+	std::shared_ptr<const DocumentLineStore::Index> index;
+	uint64_t revision;
+	mutable int hint;
+
+
+public:
+
+	/**
+	 * Create an empty snapshot
+	 */
+	DocumentSnapshot(void);
+
+	/**
+	 * Create a snapshot
+	 *
+	 * @param index the index of the chunks
+	 * @param revision the revision number
+	 */
+	DocumentSnapshot(const std::shared_ptr<const DocumentLineStore::Index>& index,
+			uint64_t revision);
+
+	/**
+	 * Get the number of lines
+	 *
+	 * @return the number of lines
+	 */
+	inline int64_t NumLines(void) const { return index ? index->numLines : 0; }
+
+	/**
+	 * Get the revision of the document captured by the snapshot
+	 *
+	 * @return the revision number
+	 */
+	inline uint64_t Revision(void) const { return revision; }
+
+	/**
+	 * Return a line object
+	 *
+	 * @param line the line number
+	 * @return the line
+	 */
+	const DocumentLine& LineObject(int64_t line) const;
+
+	/**
+	 * Return a line
+	 *
+	 * @param line the line number
+	 * @return the line string, or an empty string if out of bounds
+	 */
+	inline const char* Line(int64_t line) const
+	{
+		return line < 0 || line >= NumLines() ? "" : LineObject(line).Text();
+	}
+};
+
+
 /**
  * An undo entry
  */
@@ -199,12 +624,12 @@ class UndoEntry
 	EditorDocument* document;
 	CompoundEditAction* action;
 	
-	int cursorRow;
-	int cursorColumn;
+	int64_t cursorRow;
+	int64_t cursorColumn;
 	bool modified;
 	
-	int redo_cursorRow;
-	int redo_cursorColumn;
+	int64_t redo_cursorRow;
+	int64_t redo_cursorColumn;
 	bool redo_modified;
 	
 	
@@ -218,7 +643,8 @@ public:
 	 * @param cursorColumn the cursor column
 	 * @param modified the modification status of a document
 	 */
-	UndoEntry(EditorDocument* document, int cursorRow, int cursorColumn, bool modified);
+	UndoEntry(EditorDocument* document, int64_t cursorRow, int64_t cursorColumn,
+			bool modified);
 	
 	/**
 	 * Destroy the object
@@ -269,7 +695,7 @@ public:
 	 * 
 	 * @return the number of lines
 	 */
-	virtual int NumLines(void) = 0;
+	virtual int64_t NumLines(void) = 0;
 	
 	/**
 	 * Return a line
@@ -277,7 +703,7 @@ public:
 	 * @param line the line number
 	 * @return the line string
 	 */
-	virtual const char* Line(int line) = 0;
+	virtual const char* Line(int64_t line) = 0;
 	
 	/**
 	 * Return the line object
@@ -285,7 +711,7 @@ public:
 	 * @param line the line number
 	 * @return the line
 	 */
-	virtual DocumentLine* LineObject(int line) = 0;
+	virtual DocumentLine* LineObject(int64_t line) = 0;
 	
 	/**
 	 * Return the line object
@@ -293,7 +719,7 @@ public:
 	 * @param line the line number
 	 * @return the line
 	 */
-	DocumentLine& operator[](int line) { return *LineObject(line); }
+	DocumentLine& operator[](int64_t line) { return *LineObject(line); }
 };
 
 
@@ -308,16 +734,19 @@ class EditorDocument : public DocumentLineCollection
 	friend class UndoEntry;
 
 	std::string fileName;
+	TextFormat format;
 	
-	std::vector<DocumentLine> lines;
+	DocumentLineStore lines;
 	Histogram displayLengths;
+	int64_t widestLine;			// Never decreases without the exact widths
+	unsigned features;
 	
-	int pageStart;
+	int64_t pageStart;
 	bool modified;
-	int tabSize;
+	int layoutTabSize;			// The tab size of the display lengths
 	
-	int cursorRow;
-	int cursorColumn;
+	int64_t cursorRow;
+	int64_t cursorColumn;
 	
 	UndoEntry* currentUndo;
 	std::deque<UndoEntry*> undo;
@@ -326,11 +755,270 @@ class EditorDocument : public DocumentLineCollection
 	Parser* parser;
 	
 	
+	/**
+	 * The state of a save that runs in the background
+	 */
+	struct BackgroundSave
+	{
+		EditorDocument* document;
+		CancellationToken token;
+	};
+	
+	std::shared_ptr<BackgroundSave> backgroundSave;
+	
+	static SaveDurability saveDurability;
+	
+	
+	/**
+	 * The lines read from a stream on the reader thread, which wait to be
+	 * appended to the document
+	 */
+	struct BackgroundStream
+	{
+		/**
+		 * The complete lines, followed by the start of an incomplete line
+		 */
+		struct Batch
+		{
+			std::vector<DocumentLine> lines;
+			std::string tail;
+			size_t bytes;
+			bool reset;		// Discard the document lines first
+		};
+		
+		EditorDocument* document;
+		CancellationToken token;
+		
+		std::mutex mutex;
+		std::condition_variable drained;
+		std::deque<Batch> pending;
+		size_t pendingBytes;
+		bool finished;
+		bool truncated;		// Stopped at the stream limit
+		bool posted;
+	};
+	
+	std::shared_ptr<BackgroundStream> stream;
+	uint64_t streamedBytes;
+	bool following;
+	bool truncated;
+	
+	static uint64_t streamLimit;
+	
+	std::function<void(int64_t)> changeHandler;
+	
+	
+	/**
+	 * The state of a reload after the file was changed on disk, which runs
+	 * in the background
+	 */
+	struct BackgroundReload
+	{
+		EditorDocument* document;
+		CancellationToken token;
+		
+		uint64_t revision;			// The revision that was compared
+		std::vector<std::string> text;
+		std::vector<DiffHunk> hunks;
+		FileStamp stamp;
+		TextFormat format;
+	};
+	
+	std::shared_ptr<BackgroundReload> reload;
+	
+	int watch;
+	FileStamp diskStamp;
+	
+	
+	/**
+	 * Count the display length of a line that was added to the document
+	 *
+	 * @param length the display length
+	 */
+	inline void AddDisplayLength(int64_t length)
+	{
+		if (length > widestLine) widestLine = length;
+		if (features & DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_WIDTHS)) {
+			displayLengths.Increment(length);
+		}
+	}
+	
+	/**
+	 * Stop counting the display length of a line that was removed from
+	 * the document
+	 *
+	 * @param length the display length
+	 */
+	inline void RemoveDisplayLength(int64_t length)
+	{
+		if (features & DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_WIDTHS)) {
+			displayLengths.Decrement(length);
+		}
+	}
+	
 	/**
 	 * Prepare the document for an edit
 	 */
 	void PrepareEdit(void);
 	
+	/**
+	 * Switch the associated file after a successful save, and clear the
+	 * modified flag if the document has not changed since the snapshot
+	 * was taken
+	 *
+	 * @param file the file name
+	 * @param revision the revision of the saved snapshot
+	 */
+	void Saved(const char* file, uint64_t revision);
+	
+	/**
+	 * Clear the lines, and the undo and redo history
+	 */
+	void ClearLines(void);
+	
+	/**
+	 * Create the state shared with the reader thread
+	 *
+	 * @param loaded the number of bytes that were already loaded
+	 * @return the new state
+	 */
+	std::shared_ptr<BackgroundStream> StartStream(uint64_t loaded = 0);
+	
+	/**
+	 * Turn off the features that the FeaturePolicy turns off for the size
+	 * that the streamed data just grew to
+	 *
+	 * @param oldSize the previous size in bytes
+	 * @param newSize the new size in bytes
+	 */
+	void ApplyFeaturePolicy(uint64_t oldSize, uint64_t newSize);
+	
+	/**
+	 * Read a stream and queue its lines for the document (runs on
+	 * the reader thread)
+	 *
+	 * @param stream the shared state
+	 * @param fd the file descriptor, which will be closed
+	 * @param description the description of the operation
+	 */
+	static void ReadStream(std::shared_ptr<BackgroundStream> stream, int fd,
+			std::string description);
+	
+	/**
+	 * Read a file, and then the data appended to it, and queue its lines for
+	 * the document (runs on the reader thread)
+	 *
+	 * @param stream the shared state
+	 * @param fd the file descriptor, which will be closed
+	 * @param path the file name
+	 * @param format the format of the file, in which the appended data is
+	 *               decoded
+	 * @param offset the number of bytes that were already loaded
+	 */
+	static void FollowFile(std::shared_ptr<BackgroundStream> stream, int fd,
+			std::string path, TextFormat format, uint64_t offset);
+	
+	/**
+	 * Split the data read from a stream to lines, and pass them to the main
+	 * thread in batches (runs on the reader thread)
+	 *
+	 * @param stream the shared state
+	 * @param data the data
+	 * @param length the number of bytes
+	 * @param keepCR whether to keep the CR at the end of the CRLF lines
+	 * @param cr whether the previous data ended with a CR, which is held
+	 *           back until it is known whether an LF follows (updated)
+	 */
+	static void QueueStreamed(const std::shared_ptr<BackgroundStream>& stream,
+			const char* data, size_t length, bool keepCR, bool& cr);
+	
+	/**
+	 * Ask the main thread to discard the lines read from a stream so far
+	 * (runs on the reader thread)
+	 *
+	 * @param stream the shared state
+	 */
+	static void QueueReset(const std::shared_ptr<BackgroundStream>& stream);
+	
+	/**
+	 * Pass a batch to the main thread, waiting while too many lines are
+	 * pending (runs on the reader thread)
+	 *
+	 * @param stream the shared state
+	 * @param batch the batch, which will be moved out and cleared
+	 */
+	static void QueueBatch(const std::shared_ptr<BackgroundStream>& stream,
+			BackgroundStream::Batch& batch);
+	
+	/**
+	 * Tell the main thread that the reader has finished (runs on the reader
+	 * thread)
+	 *
+	 * @param stream the shared state
+	 * @param result the result of reading
+	 */
+	static void FinishStream(const std::shared_ptr<BackgroundStream>& stream,
+			const ReturnExt& result);
+	
+	/**
+	 * Show a message in the status bar (can be called from any thread)
+	 *
+	 * @param message the message
+	 */
+	static void PostStatus(const char* message);
+	
+	/**
+	 * Append the lines that were read from the stream since the last call
+	 */
+	void AppendStreamed(void);
+	
+	/**
+	 * Start watching the associated file for changes made outside of
+	 * the editor
+	 */
+	void WatchFile(void);
+	
+	/**
+	 * Stop watching the associated file, and cancel a reload in progress
+	 */
+	void UnwatchFile(void);
+	
+	/**
+	 * Check whether the associated file changed on disk, and if so, reload
+	 * it in the background
+	 */
+	void CheckFile(void);
+	
+	/**
+	 * Read a file to lines in the same way as LoadFromFile() (runs on
+	 * a worker thread)
+	 *
+	 * @param file the file name
+	 * @param text where to store the lines
+	 * @param format where to store the format of the file
+	 * @param stamp where to store the stamp of the file that was read
+	 * @param progress the function to call with the number of bytes read,
+	 *                 which returns false to cancel
+	 * @return a ReturnExt
+	 */
+	static ReturnExt ReadLines(const char* file, std::vector<std::string>& text,
+			TextFormat& format, FileStamp& stamp,
+			const std::function<bool(uint64_t)>& progress);
+	
+	/**
+	 * Apply the changes of the reloaded file as a single edit action
+	 *
+	 * @param text the lines of the file
+	 * @param hunks the differences from the document
+	 */
+	void ApplyReload(const std::vector<std::string>& text,
+			const std::vector<DiffHunk>& hunks);
+	
+	/**
+	 * Stop reading from the stream, if any
+	 */
+	void StopStream(void);
+	
 	/**
 	 * Just insert a string
 	 * 
@@ -338,7 +1026,7 @@ class EditorDocument : public DocumentLineCollection
 	 * @param pos the string position
 	 * @param str the string to insert
 	 */
-	void InsertStringEx(int line, int pos, const char* str);
+	void InsertStringEx(int64_t line, int64_t pos, const char* str);
 	
 	/**
 	 * Just delete a string
@@ -348,7 +1036,37 @@ class EditorDocument : public DocumentLineCollection
 	 * @param toline the last line
 	 * @param topos the position within the last line
 	 */
-	void DeleteStringEx(int line, int pos, int toline, int topos);
+	void DeleteStringEx(int64_t line, int64_t pos, int64_t toline,
+			int64_t topos);
+	
+	
+protected:
+	
+	/**
+	 * Set the associated file name
+	 * 
+	 * @param file the file name
+	 */
+	inline void SetFileName(const char* file) { fileName = file; }
+	
+	/**
+	 * Set the features of the document
+	 *
+	 * @param features the set of features
+	 */
+	inline void SetFeatures(unsigned features) { this->features = features; }
+	
+	/**
+	 * Notify the handler that lines were changed from outside of the editor,
+	 * such as by a background reader or a reload. This must be called from
+	 * the main thread.
+	 * 
+	 * @param firstLine the first line that changed
+	 */
+	inline void NotifyChanged(int64_t firstLine)
+	{
+		if (changeHandler) changeHandler(firstLine);
+	}
 	
 	
 public:
@@ -372,9 +1090,10 @@ public:
 	 * Load from file, and set the associated document file name
 	 *
 	 * @param file the file name
+	 * @param bytesRead the number of bytes read (output, optional)
 	 * @return a ReturnExt
 	 */
-	ReturnExt LoadFromFile(const char* file);
+	ReturnExt LoadFromFile(const char* file, uint64_t* bytesRead = NULL);
 
 	/**
 	 * Save to file
@@ -393,6 +1112,129 @@ public:
 	 */
 	ReturnExt Save(void);
 
+	/**
+	 * Save to file on a worker thread, writing a snapshot of the document,
+	 * so that the document can be edited while it is being saved
+	 *
+	 * @param file the file name
+	 * @param switchFile whether to set the associated file name and clear
+	 *                   the modified flag
+	 * @param done the function to call on the main thread when finished
+	 * @return a ReturnExt (whether the save has started)
+	 */
+	ReturnExt SaveToFileInBackground(const char* file, bool switchFile=false,
+			const std::function<void(const ReturnExt&)>& done = NULL);
+
+	/**
+	 * Save to the current file on a worker thread
+	 *
+	 * @param done the function to call on the main thread when finished
+	 * @return a ReturnExt (whether the save has started)
+	 */
+	ReturnExt SaveInBackground(
+			const std::function<void(const ReturnExt&)>& done = NULL);
+
+	/**
+	 * Determine whether the document is being saved in the background
+	 *
+	 * @return true if it is being saved
+	 */
+	inline bool Saving(void) { return (bool) backgroundSave; }
+
+	/**
+	 * Wait until all saves that run in the background finish
+	 */
+	static void WaitForBackgroundSaves(void);
+
+	/**
+	 * Start reading the document from a stream, such as the standard input,
+	 * on a background thread. The lines are appended to the document as they
+	 * arrive, without marking it as modified, so that it can be viewed and
+	 * edited right away.
+	 *
+	 * @param fd the file descriptor, which will be closed when done
+	 * @param name the name of the stream for the status messages
+	 * @return a ReturnExt
+	 */
+	ReturnExt LoadFromStream(int fd, const char* name);
+
+	/**
+	 * Load a file, and then keep appending the lines that are written to it,
+	 * like "tail -F". The file is read again from the beginning if it gets
+	 * truncated, and the new file is followed if it gets replaced. The data
+	 * is decoded in the format detected when loading the file, and
+	 * a compressed file is just loaded.
+	 *
+	 * @param file the file name
+	 * @return a ReturnExt
+	 */
+	ReturnExt Follow(const char* file);
+
+	/**
+	 * Determine whether the document is being read from a stream
+	 *
+	 * @return true if it is being read
+	 */
+	inline bool Streaming(void) { return (bool) stream; }
+
+	/**
+	 * Determine whether the document follows the changes of its file
+	 *
+	 * @return true if it follows the file
+	 */
+	inline bool Following(void) { return following; }
+
+	/**
+	 * Get the maximum number of bytes read from a stream; the reader stops
+	 * reading when it reaches it, so that a fast producer blocks instead of
+	 * filling the memory
+	 *
+	 * @return the limit in bytes
+	 */
+	static uint64_t StreamLimit(void) { return streamLimit; }
+
+	/**
+	 * Set the maximum number of bytes read from a stream
+	 *
+	 * @param limit the limit in bytes
+	 */
+	static void SetStreamLimit(uint64_t limit) { streamLimit = limit; }
+
+	/**
+	 * Get the durability guarantees of saving files
+	 *
+	 * @return the durability mode
+	 */
+	static SaveDurability Durability(void) { return saveDurability; }
+
+	/**
+	 * Set the durability guarantees of saving files
+	 *
+	 * @param durability the durability mode
+	 */
+	static void SetDurability(SaveDurability durability)
+	{
+		saveDurability = durability;
+	}
+
+	/**
+	 * Get the format of the file, which is used to save the document
+	 * the same way as it was loaded
+	 *
+	 * @return the format
+	 */
+	inline const TextFormat& Format(void) { return format; }
+
+	/**
+	 * Set the line endings used to save the document
+	 *
+	 * @param lineEnding the line endings
+	 */
+	inline void SetLineEnding(LineEnding lineEnding)
+	{
+		format.lineEnding = lineEnding;
+	}
+
 	/**
 	 * Get the associated file name
 	 *
@@ -408,21 +1250,21 @@ public:
 	 * 
 	 * @param start the page start line
 	 */
-	void SetPageStart(int start);
+	void SetPageStart(int64_t start);
 	
 	/**
 	 * Return the line that is the first on the current page
 	 * 
 	 * @return the number of the first line of the page (screen)
 	 */
-	inline int PageStart(void) { return pageStart; }
+	inline int64_t PageStart(void) { return pageStart; }
 	
 	/**
 	 * Get the number of lines
 	 * 
 	 * @return the number of lines
 	 */
-	virtual int NumLines(void) { return lines.size(); }
+	virtual int64_t NumLines(void) { return lines.Size(); }
 	
 	/**
 	 * Return a line
@@ -430,9 +1272,10 @@ public:
 	 * @param line the line number
 	 * @return the line string
 	 */
-	virtual const char* Line(int line)
+	virtual const char* Line(int64_t line)
 	{
-		return line >= lines.size() ? "" : lines[line].Text().c_str();
+		return line < 0 || line >= lines.Size() ? ""
+				: lines[line].Text();
 	}
 	
 	/**
@@ -441,9 +1284,9 @@ public:
 	 * @param line the line number
 	 * @return the line
 	 */
-	virtual DocumentLine* LineObject(int line)
+	virtual DocumentLine* LineObject(int64_t line)
 	{
-		return line >= lines.size() ? NULL : &lines[line];
+		return line < 0 || line >= lines.Size() ? NULL : &lines.Mutable(line);
 	}
 	
 	/**
@@ -452,7 +1295,7 @@ public:
 	 * @param line the line number relative to the page start
 	 * @return the line string
 	 */
-	inline const char* LineRel(int line) { return Line(pageStart + line); }
+	inline const char* LineRel(int64_t line) { return Line(pageStart + line); }
 	
 	/**
 	 * Determine whether the document was modified since the last save
@@ -461,15 +1304,31 @@ public:
 	 */
 	inline bool Modified(void) { return modified; }
 	
+	/**
+	 * Get the revision number of the document, which changes with every edit
+	 * 
+	 * @return the revision number
+	 */
+	inline uint64_t Revision(void) { return lines.Revision(); }
+	
+	/**
+	 * Take an immutable snapshot of the document lines, which can be read
+	 * from another thread while the document is being edited
+	 * 
+	 * @return the snapshot
+	 */
+	inline DocumentSnapshot Snapshot(void) { return lines.Snapshot(); }
+	
 	/**
 	 * Return the display length of a line
 	 * 
 	 * @param line the line number
 	 * @return the display length
 	 */
-	inline int DisplayLength(int line)
+	virtual int64_t DisplayLength(int64_t line)
 	{
-		return line >= lines.size() ? 0 : lines[line].DisplayLength();
+		return line < 0 || line >= lines.Size() ? 0
+				: lines[line].DisplayLength();
 	}
 	
 	/**
@@ -477,16 +1336,34 @@ public:
 	 * 
 	 * @return the maximum display length
 	 */
-	int MaxDisplayLength(void);
+	virtual int64_t MaxDisplayLength(void);
+	
+	/**
+	 * Determine whether the document is read-only, which is the case if
+	 * reading a stream stopped at the stream limit
+	 * 
+	 * @return true if the document cannot be edited
+	 */
+	virtual bool ReadOnly(void) { return truncated; }
+	
+	/**
+	 * Lay out the lines again if the tab size changed since the last time
+	 * 
+	 * @return true if the display lengths changed
+	 */
+	virtual bool UpdateLayout(void);
 	
 	/**
 	 * Return the string position corresponding to the given cursor position
 	 * 
 	 * @param line the line number
 	 * @param cursor the cursor position
+	 * @param actual the cursor position at the returned string position
+	 *               (output, optional)
 	 * @return the string position index
 	 */
-	int StringPosition(int line, int cursor);
+	int64_t StringPosition(int64_t line, int64_t cursor,
+			int64_t* actual = NULL);
 
 	/**
 	 * Return the cursor position corresponding to the given string offset
@@ -495,7 +1372,7 @@ public:
 	 * @param cursor the cursor position
 	 * @return the cursor position, or the maximum position if out of bounds
 	 */
-	int CursorPosition(int line, size_t offset);
+	int64_t CursorPosition(int64_t line, size_t offset);
 	
 	/**
 	 * Set the cursor location (used for undo logging)
@@ -503,21 +1380,21 @@ public:
 	 * @param row the row
 	 * @param column the column
 	 */
-	void SetCursorLocation(int row, int column);
+	void SetCursorLocation(int64_t row, int64_t column);
 	
 	/**
 	 * Return the cursor row
 	 * 
 	 * @param the row
 	 */
-	inline int CursorRow(void) { return cursorRow; }
+	inline int64_t CursorRow(void) { return cursorRow; }
 	
 	/**
 	 * Return the cursor column
 	 * 
 	 * @param the column
 	 */
-	inline int CursorColumn(void) { return cursorColumn; }
+	inline int64_t CursorColumn(void) { return cursorColumn; }
 	
 	/**
 	 * Append a line
@@ -532,7 +1409,7 @@ public:
 	 * @param pos the line before which to insert
 	 * @param line the new line
 	 */
-	void Insert(int pos, const char* line);
+	void Insert(int64_t pos, const std::string& line);
 	
 	/**
 	 * Replace a line
@@ -540,7 +1417,14 @@ public:
 	 * @param pos the line to replace
 	 * @param line the new contents of the line
 	 */
-	void Replace(int pos, const char* line);
+	void Replace(int64_t pos, const std::string& line);
+	
+	/**
+	 * Delete a line
+	 * 
+	 * @param pos the line to delete
+	 */
+	void Delete(int64_t pos);
 	
 	/**
 	 * Insert a character to a line
@@ -549,7 +1433,7 @@ public:
 	 * @param ch the character to insert
 	 * @param pos the string position
 	 */
-	void InsertCharToLine(int line, char ch, int pos);
+	void InsertCharToLine(int64_t line, char ch, int64_t pos);
 	
 	/**
 	 * Delete a character from line
@@ -557,14 +1441,14 @@ public:
 	 * @param line the line
 	 * @param pos the string position
 	 */
-	void DeleteCharFromLine(int line, int pos);
+	void DeleteCharFromLine(int64_t line, int64_t pos);
 
 	/**
 	 * Join two subsequent lines
 	 * 
 	 * @param line the first line to join
 	 */
-	void JoinTwoLines(int line);
+	void JoinTwoLines(int64_t line);
 	
 	/**
 	 * Insert a string
@@ -573,7 +1457,7 @@ public:
 	 * @param pos the string position
 	 * @param str the string to insert
 	 */
-	void InsertString(int line, int pos, const char* str);
+	void InsertString(int64_t line, int64_t pos, const char* str);
 	
 	/**
 	 * Delete a string
@@ -583,7 +1467,7 @@ public:
 	 * @param toline the last line
 	 * @param topos the position within the last line
 	 */
-	void DeleteString(int line, int pos, int toline, int topos);
+	void DeleteString(int64_t line, int64_t pos, int64_t toline, int64_t topos);
 	
 	/**
 	 * Perform an undo
@@ -603,13 +1487,41 @@ public:
 	 * @param toline the last line
 	 * @param topos the position within the last line
 	 */
-	std::string Get(int line, int pos, int toline, int topos);
+	std::string Get(int64_t line, int64_t pos, int64_t toline, int64_t topos);
 	
 	/**
 	 * Finalize an edit action (for undo purposes)
 	 */
 	void FinalizeEditAction(void);
 	
+	/**
+	 * Get the features of the document, which are picked by the size of
+	 * its file
+	 *
+	 * @return the set of features
+	 */
+	inline unsigned Features(void) { return features; }
+	
+	/**
+	 * Determine whether a feature is turned on
+	 *
+	 * @param feature the feature
+	 * @return true if it is on
+	 */
+	inline bool HasFeature(DocumentFeature feature)
+	{
+		return (features & DOCUMENT_FEATURE_BIT(feature)) != 0;
+	}
+	
+	/**
+	 * Turn a feature on or off. The whole file can be loaded only by
+	 * opening it again, so that feature is left as it is.
+	 *
+	 * @param feature the feature
+	 * @param on true to turn it on
+	 */
+	void SetFeature(DocumentFeature feature, bool on);
+	
 	/**
 	 * Get the associated parser
 	 *
@@ -623,6 +1535,18 @@ public:
 	 * @param parser the parser, or NULL to clear (this will transfer ownership)
 	 */
 	void SetParser(Parser* parser);
+	
+	/**
+	 * Set the function to call on the main thread after lines are changed
+	 * from outside of the editor, such as when they are appended or when
+	 * the file is reloaded
+	 *
+	 * @param handler the handler, which gets the first changed line
+	 */
+	inline void SetChangeHandler(const std::function<void(int64_t)>& handler)
+	{
+		changeHandler = handler;
+	}
 };
 
 #endif
@@ -60,15 +60,15 @@ EditAction::~EditAction(void)
 
 
 /**
- * Return a line from a document
+ * Return a line from a document for editing
  * 
  * @param doc the document
  * @param row the row
  * @return the line
  */
-DocumentLine& EditAction::Line(EditorDocument* doc, int row)
+DocumentLine& EditAction::Line(EditorDocument* doc, int64_t row)
 {
-	return doc->lines[row];
+	return doc->lines.Edit(row);
 }
 
 
@@ -91,14 +91,15 @@ Histogram& EditAction::DisplayLengths(EditorDocument* doc)
  * @param row the row before which to insert
  * @param contents the line contents
  */
-void EditAction::InsertLine(EditorDocument* doc, int row, const char* contents)
+void EditAction::InsertLine(EditorDocument* doc, int64_t row,
+		const std::string& contents)
 {
 	DocumentLine l;
 	l.SetText(contents);
 	
 	doc->displayLengths.Increment(l.DisplayLength());
 	
-	doc->lines.insert(doc->lines.begin() + row, std::move(l));
+	doc->lines.Insert(row, std::move(l));
 }
 
 
@@ -108,12 +109,12 @@ void EditAction::InsertLine(EditorDocument* doc, int row, const char* contents)
  * @param doc the document
  * @param row the row
  */
-void EditAction::DeleteLine(EditorDocument* doc, int row)
+void EditAction::DeleteLine(EditorDocument* doc, int64_t row)
 {
 	DocumentLine& l = Line(doc, row);
 	doc->displayLengths.Decrement(l.DisplayLength());
 	
-	doc->lines.erase(doc->lines.begin() + row);
+	doc->lines.Erase(row, row + 1);
 }
 
 
@@ -125,7 +126,7 @@ void EditAction::DeleteLine(EditorDocument* doc, int row)
  * @param pos the string position
  * @param str the string to insert
  */
-void EditAction::InsertString(EditorDocument* doc, int line, int pos, const char* str)
+void EditAction::InsertString(EditorDocument* doc, int64_t line, int64_t pos, const char* str)
 {
 	doc->InsertStringEx(line, pos, str);
 }
@@ -140,7 +141,7 @@ void EditAction::InsertString(EditorDocument* doc, int line, int pos, const char
  * @param toline the last line
  * @param topos the position within the last line
  */
-void EditAction::DeleteString(EditorDocument* doc, int line, int pos, int toline, int topos)
+void EditAction::DeleteString(EditorDocument* doc, int64_t line, int64_t pos, int64_t toline, int64_t topos)
 {
 	doc->DeleteStringEx(line, pos, toline, topos);
 }
@@ -154,7 +155,7 @@ void EditAction::DeleteString(EditorDocument* doc, int line, int pos, int toline
  * @param _pos the string position
  * @param _ch the character
  */
-CharacterEditAction::CharacterEditAction(EditActionType actionType, int _row, int _pos, char _ch) : EditAction(actionType)
+CharacterEditAction::CharacterEditAction(EditActionType actionType, int64_t _row, int64_t _pos, char _ch) : EditAction(actionType)
 {
 	row = _row;
 	pos = _pos;
@@ -178,10 +179,11 @@ CharacterEditAction::~CharacterEditAction(void)
  * @param _row the row
  * @param _contents the line contents
  */
-LineEditAction::LineEditAction(EditActionType actionType, int _row, const char* _contents) : EditAction(actionType)
+LineEditAction::LineEditAction(EditActionType actionType, int64_t _row,
+		const std::string& _contents) : EditAction(actionType)
 {
 	row = _row;
-	contents = strdup(_contents);
+	contents = _contents;
 }
 
 
@@ -190,7 +192,7 @@ LineEditAction::LineEditAction(EditActionType actionType, int _row, const char*
  */
 LineEditAction::~LineEditAction(void)
 {
-	std::free(contents);
+	// Nothing to do
 }
 
 
@@ -202,7 +204,7 @@ LineEditAction::~LineEditAction(void)
  * @param _pos the position
  * @param _contents the line contents
  */
-StringEditAction::StringEditAction(EditActionType actionType, int _row, int _pos, const char* _contents) : EditAction(actionType)
+StringEditAction::StringEditAction(EditActionType actionType, int64_t _row, int64_t _pos, const char* _contents) : EditAction(actionType)
 {
 	row = _row;
 	pos = _pos;
@@ -234,7 +236,7 @@ StringEditAction::~StringEditAction(void)
  * @param pos the string position
  * @param ch the character
  */
-EA_InsertChar::EA_InsertChar(int row, int pos, char ch) : CharacterEditAction(EAT_InsertChar, row, pos, ch)
+EA_InsertChar::EA_InsertChar(int64_t row, int64_t pos, char ch) : CharacterEditAction(EAT_InsertChar, row, pos, ch)
 {
 	// Nothing to do
 }
@@ -259,7 +261,7 @@ void EA_InsertChar::Undo(EditorDocument* doc)
 	DocumentLine& l = Line(doc, row);
 	DisplayLengths(doc).Decrement(l.DisplayLength());
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	s.erase(pos, 1);
 	l.SetText(s);
 	
@@ -277,7 +279,7 @@ void EA_InsertChar::Redo(EditorDocument* doc)
 	DocumentLine& l = Line(doc, row);
 	DisplayLengths(doc).Decrement(l.DisplayLength());
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	s.insert(pos, 1, ch);
 	l.SetText(s);
 	
@@ -293,7 +295,7 @@ void EA_InsertChar::Redo(EditorDocument* doc)
  * @param pos the string position
  * @param ch the character
  */
-EA_DeleteChar::EA_DeleteChar(int row, int pos, char ch) : CharacterEditAction(EAT_DeleteChar, row, pos, ch)
+EA_DeleteChar::EA_DeleteChar(int64_t row, int64_t pos, char ch) : CharacterEditAction(EAT_DeleteChar, row, pos, ch)
 {
 	// Nothing to do
 }
@@ -318,7 +320,7 @@ void EA_DeleteChar::Undo(EditorDocument* doc)
 	DocumentLine& l = Line(doc, row);
 	DisplayLengths(doc).Decrement(l.DisplayLength());
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	s.insert(pos, 1, ch);
 	l.SetText(s);
 	
@@ -336,7 +338,7 @@ void EA_DeleteChar::Redo(EditorDocument* doc)
 	DocumentLine& l = Line(doc, row);
 	DisplayLengths(doc).Decrement(l.DisplayLength());
 	
-	std::string s = l.Text();
+	std::string s = l.String();
 	s.erase(pos, 1);
 	l.SetText(s);
 	
@@ -350,7 +352,8 @@ void EA_DeleteChar::Redo(EditorDocument* doc)
  * @param row the row
  * @param contents the line contents
  */
-EA_InsertLine::EA_InsertLine(int row, const char* contents) : LineEditAction(EAT_InsertLine, row, contents)
+EA_InsertLine::EA_InsertLine(int64_t row, const std::string& contents)
+	: LineEditAction(EAT_InsertLine, row, contents)
 {
 	// Nothing to do
 }
@@ -393,7 +396,8 @@ void EA_InsertLine::Redo(EditorDocument* doc)
  * @param row the row
  * @param contents the line contents
  */
-EA_DeleteLine::EA_DeleteLine(int row, const char* contents) : LineEditAction(EAT_DeleteLine, row, contents)
+EA_DeleteLine::EA_DeleteLine(int64_t row, const std::string& contents)
+	: LineEditAction(EAT_DeleteLine, row, contents)
 {
 	// Nothing to do
 }
@@ -437,9 +441,11 @@ void EA_DeleteLine::Redo(EditorDocument* doc)
  * @param _original the original line contents
  * @param contents the new line contents
  */
-EA_ReplaceLine::EA_ReplaceLine(int row, const char* _original, const char* contents) : LineEditAction(EAT_ReplaceLine, row, contents)
+EA_ReplaceLine::EA_ReplaceLine(int64_t row, const std::string& _original,
+		const std::string& contents)
+	: LineEditAction(EAT_ReplaceLine, row, contents)
 {
-	original = strdup(_original);
+	original = _original;
 }
 
 
@@ -448,7 +454,7 @@ EA_ReplaceLine::EA_ReplaceLine(int row, const char* _original, const char* conte
  */
 EA_ReplaceLine::~EA_ReplaceLine(void)
 {
-	std::free(original);
+	// Nothing to do
 }
 
 
@@ -492,7 +498,7 @@ void EA_ReplaceLine::Redo(EditorDocument* doc)
  * @param pos the string position
  * @param contents the contents
  */
-EA_InsertString::EA_InsertString(int row, int pos, const char* contents) : StringEditAction(EAT_InsertString, row, pos, contents)
+EA_InsertString::EA_InsertString(int64_t row, int64_t pos, const char* contents) : StringEditAction(EAT_InsertString, row, pos, contents)
 {
 	// Nothing to do
 }
@@ -537,7 +543,7 @@ void EA_InsertString::Redo(EditorDocument* doc)
  * @param pos the string position
  * @param contents the contents
  */
-EA_DeleteString::EA_DeleteString(int row, int pos, const char* contents) : StringEditAction(EAT_DeleteString, row, pos, contents)
+EA_DeleteString::EA_DeleteString(int64_t row, int64_t pos, const char* contents) : StringEditAction(EAT_DeleteString, row, pos, contents)
 {
 	// Nothing to do
 }
@@ -588,7 +594,7 @@ CompoundEditAction::CompoundEditAction(void) : EditAction(EAT_Compound)
  */
 CompoundEditAction::~CompoundEditAction(void)
 {
-	for (int i = 0; i < actions.size(); i++) delete actions[i];
+	for (size_t i = 0; i < actions.size(); i++) delete actions[i];
 }
 
 
@@ -623,7 +629,7 @@ void CompoundEditAction::Undo(EditorDocument* doc)
 void CompoundEditAction::Redo(EditorDocument* doc)
 {
 	if (actions.empty()) return;
-	for (int i = 0; i < actions.size(); i++) actions[i]->Redo(doc);
+	for (size_t i = 0; i < actions.size(); i++) actions[i]->Redo(doc);
 }
 
 
@@ -35,6 +35,8 @@
 #ifndef __EDIT_ACTION_H
 #define __EDIT_ACTION_H
 
+#include <stdint.h>
+#include <string>
 #include <vector>
 
 class DocumentLine;
@@ -67,9 +69,6 @@ class EditAction
 {
 	EditActionType type;
 	
-	int afterCurRow;
-	int afterCurColumn;
-	
 
 protected:
 	
@@ -81,13 +80,13 @@ protected:
 	EditAction(EditActionType actionType);
 	
 	/**
-	 * Return a line from a document
+	 * Return a line from a document for editing
 	 * 
 	 * @param doc the document
 	 * @param row the row
 	 * @return the line
 	 */
-	DocumentLine& Line(EditorDocument* doc, int row);
+	DocumentLine& Line(EditorDocument* doc, int64_t row);
 	
 	/**
 	 * Return the line display lengths
@@ -104,7 +103,8 @@ protected:
 	 * @param row the row before which to insert
 	 * @param contents the line contents
 	 */
-	void InsertLine(EditorDocument* doc, int row, const char* contents);
+	void InsertLine(EditorDocument* doc, int64_t row,
+			const std::string& contents);
 	
 	/**
 	 * Delete a line and update the appropriate meta-data
@@ -112,7 +112,7 @@ protected:
 	 * @param doc the document
 	 * @param row the row
 	 */
-	void DeleteLine(EditorDocument* doc, int row);
+	void DeleteLine(EditorDocument* doc, int64_t row);
 	
 	/**
 	 * Insert a string
@@ -122,7 +122,7 @@ protected:
 	 * @param pos the string position
 	 * @param str the string to insert
 	 */
-	void InsertString(EditorDocument* doc, int line, int pos, const char* str);
+	void InsertString(EditorDocument* doc, int64_t line, int64_t pos, const char* str);
 	
 	/**
 	 * Delete a string
@@ -133,7 +133,7 @@ protected:
 	 * @param toline the last line
 	 * @param topos the position within the last line
 	 */
-	void DeleteString(EditorDocument* doc, int line, int pos, int toline, int topos);
+	void DeleteString(EditorDocument* doc, int64_t line, int64_t pos, int64_t toline, int64_t topos);
 	
 	
 public:
@@ -176,8 +176,8 @@ class LineEditAction : public EditAction
 
 protected:
 	
-	char* contents;
-	int row;
+	std::string contents;
+	int64_t row;
 	
 	
 	/**
@@ -187,7 +187,8 @@ protected:
 	 * @param row the row
 	 * @param contents the line contents
 	 */
-	LineEditAction(EditActionType actionType, int row, const char* contents);
+	LineEditAction(EditActionType actionType, int64_t row,
+			const std::string& contents);
 
 
 public:
@@ -210,8 +211,8 @@ class CharacterEditAction : public EditAction
 protected:
 	
 	char ch;
-	int row;
-	int pos;
+	int64_t row;
+	int64_t pos;
 	
 	
 	/**
@@ -222,7 +223,7 @@ protected:
 	 * @param pos the string position
 	 * @param ch the character
 	 */
-	CharacterEditAction(EditActionType actionType, int row, int pos, char ch);
+	CharacterEditAction(EditActionType actionType, int64_t row, int64_t pos, char ch);
 
 
 public:
@@ -245,12 +246,12 @@ class StringEditAction : public EditAction
 protected:
 	
 	char* contents;
-	int row;
-	int pos;
+	int64_t row;
+	int64_t pos;
 	
-	int newlines;
+	int64_t newlines;
 	char* last;
-	int lastlength;
+	int64_t lastlength;
 	
 	
 	/**
@@ -261,7 +262,7 @@ protected:
 	 * @param pos the position
 	 * @param contents the line contents
 	 */
-	StringEditAction(EditActionType actionType, int row, int pos, const char* contents);
+	StringEditAction(EditActionType actionType, int64_t row, int64_t pos, const char* contents);
 
 
 public:
@@ -290,7 +291,7 @@ public:
 	 * @param pos the string position
 	 * @param ch the character
 	 */
-	EA_InsertChar(int row, int pos, char ch);
+	EA_InsertChar(int64_t row, int64_t pos, char ch);
 	
 	/**
 	 * Destroy the object
@@ -330,7 +331,7 @@ public:
 	 * @param pos the string position
 	 * @param ch the character
 	 */
-	EA_DeleteChar(int row, int pos, char ch);
+	EA_DeleteChar(int64_t row, int64_t pos, char ch);
 	
 	/**
 	 * Destroy the object
@@ -369,7 +370,7 @@ public:
 	 * @param row the row
 	 * @param contents the line contents
 	 */
-	EA_InsertLine(int row, const char* cotents);
+	EA_InsertLine(int64_t row, const std::string& contents);
 	
 	/**
 	 * Destroy the object
@@ -408,7 +409,7 @@ public:
 	 * @param row the row
 	 * @param contents the line contents
 	 */
-	EA_DeleteLine(int row, const char* cotents);
+	EA_DeleteLine(int64_t row, const std::string& contents);
 	
 	/**
 	 * Destroy the object
@@ -438,7 +439,7 @@ public:
  */
 class EA_ReplaceLine : public LineEditAction
 {
-	char* original;
+	std::string original;
 	
 	
 public:
@@ -450,7 +451,8 @@ public:
 	 * @param original the original line contents
 	 * @param contents the new line contents
 	 */
-	EA_ReplaceLine(int row, const char* original, const char* cotents);
+	EA_ReplaceLine(int64_t row, const std::string& original,
+			const std::string& contents);
 	
 	/**
 	 * Destroy the object
@@ -490,7 +492,7 @@ public:
 	 * @param pos the string position
 	 * @param contents the contents
 	 */
-	EA_InsertString(int row, int pos, const char* contents);
+	EA_InsertString(int64_t row, int64_t pos, const char* contents);
 	
 	/**
 	 * Destroy the object
@@ -530,7 +532,7 @@ public:
 	 * @param pos the string position
 	 * @param contents the contents
 	 */
-	EA_DeleteString(int row, int pos, const char* contents);
+	EA_DeleteString(int64_t row, int64_t pos, const char* contents);
 	
 	/**
 	 * Destroy the object
@@ -35,38 +35,23 @@
 #include "stdafx.h"
 #include "Editor.h"
 
+#include <algorithm>
+
 #include "Container.h"
 #include "Manager.h"
+#include "Operation.h"
+#include "Pager.h"
+#include "UTF8.h"
 #include "Window.h"
 
 
 /**
- * Create an instance of class Editor
+ * Create the parser for syntax highlighting
  *
- * @param parent the parent container
- * @param _multiline true for a multiline editor
- * @param row the initial row
- * @param col the initial column
- * @param rows the number of rows
- * @param cols the number of columns
- * @param anchor set the anchor
+ * @return the parser
  */
-Editor::Editor(Container* parent, bool _multiline, int _row, int _col, int rows,
-		int cols, int anchor)
-	: Component(parent, true, _row, _col, rows, cols, anchor)
+static Parser* CreateParser(void)
 {
-
-	multiline = _multiline;
-	canHandleMultiClicks = true;
-
-
-	// Create an empty document
-	
-	doc = new EditorDocument();
-
-	
-	// TODO Move the parser creation somewhere else
-	
 	Parser* parser = new Parser();
 	ParserRule* r;
 	
@@ -244,12 +229,35 @@ Editor::Editor(Container* parent, bool _multiline, int _row, int _col, int rows,
 		global->AddRule(r);
 	}
 	
-	if (_multiline) {
-		doc->SetParser(parser);
-	}
-	else {
-		delete parser;
-	}
+	return parser;
+}
+
+
+/**
+ * Create an instance of class Editor
+ *
+ * @param parent the parent container
+ * @param _multiline true for a multiline editor
+ * @param row the initial row
+ * @param col the initial column
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @param anchor set the anchor
+ */
+Editor::Editor(Container* parent, bool _multiline, int _row, int _col, int rows,
+		int cols, int anchor)
+	: Component(parent, true, _row, _col, rows, cols, anchor)
+{
+
+	multiline = _multiline;
+	canHandleMultiClicks = true;
+
+
+	// Create an empty document
+	
+	doc = NULL;
+	SetDocument(new EditorDocument());
+	if (_multiline) doc->SetParser(CreateParser());
 
 	
 	// Configure the editor
@@ -257,7 +265,7 @@ Editor::Editor(Container* parent, bool _multiline, int _row, int _col, int rows,
 	bg = 6;
 	fg = 0;
 	
-	tabSize = 4;
+	tabSize = DocumentLine::TabSize();
 	displayTabs = true;
 	
 	wheelSpeed = 3;
@@ -353,9 +361,172 @@ void Editor::SetScrollBars(ScrollBar* horiz, ScrollBar* vert)
  */
 ReturnExt Editor::LoadFromFile(const char* file)
 {
+	// The pager cannot hold the whole file, so load it to a new document
+
+	if (!doc->HasFeature(DOCUMENT_FEATURE_FULL_LOAD)) {
+		EditorDocument* d = new EditorDocument();
+		ReturnExt r = d->LoadFromFile(file);
+		if (!r) {
+			delete d;
+			return r;
+		}
+
+		if (multiline) d->SetParser(CreateParser());
+		SetDocument(d);
+		ResetView();
+
+		return ReturnExt(true);
+	}
+
 	ReturnExt r = doc->LoadFromFile(file);
 	if (!r) return r;
 
+	ResetView();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Open a file read-only in the pager, which pages in the lines on demand
+ * instead of loading the whole file to the memory
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt Editor::OpenPager(const char* file)
+{
+	PagerDocument* pager = new PagerDocument();
+	ReturnExt r = pager->Open(file);
+	if (!r) {
+		delete pager;
+		return r;
+	}
+
+	SetDocument(pager);
+	ResetView();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Read the document from a stream in the background, showing the lines
+ * as they arrive
+ *
+ * @param fd the file descriptor, which will be closed when done
+ * @param name the name of the stream
+ * @param a ReturnExt
+ */
+ReturnExt Editor::LoadFromStream(int fd, const char* name)
+{
+	ReturnExt r = doc->LoadFromStream(fd, name);
+	if (!r) return r;
+
+	ResetView();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Load a file, and then keep appending the lines that are written to it
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt Editor::Follow(const char* file)
+{
+	ReturnExt r = doc->Follow(file);
+	if (!r) return r;
+
+	ResetView();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Turn a feature of the document on or off
+ *
+ * @param feature the feature
+ * @param on true to turn it on
+ */
+void Editor::SetDocumentFeature(DocumentFeature feature, bool on)
+{
+	doc->SetFeature(feature, on);
+
+	if (horizScroll != NULL) {
+		horizScroll->SetRange(0, doc->MaxDisplayLength());
+	}
+
+	Paint();
+}
+
+
+/**
+ * Set the document, and start listening to its changes
+ * 
+ * @param document the document (will be destroyed with the editor)
+ */
+void Editor::SetDocument(EditorDocument* document)
+{
+	if (doc != NULL) delete doc;
+
+	doc = document;
+	doc->SetChangeHandler([this](int64_t firstLine) {
+		OnLinesChanged(firstLine);
+	});
+}
+
+
+/**
+ * Handle lines that were changed from outside of the editor, such as
+ * when they were appended or when the file was reloaded
+ * 
+ * @param firstLine the first line that changed
+ */
+void Editor::OnLinesChanged(int64_t firstLine)
+{
+	// Keep the cursor at the end of a followed file if it was on the last
+	// line, and within the document if the file got shorter
+
+	int64_t numLines = doc->NumLines();
+
+	if (doc->PageStart() >= numLines) {
+		doc->SetPageStart(std::max<int64_t>(numLines - Rows(), 0));
+	}
+
+	if (selection && selRow >= numLines) {
+		selRow = numLines - 1;
+		selCol = doc->DisplayLength(selRow);
+	}
+
+	if (doc->Following() && row >= firstLine && !selection) {
+		MoveDocumentCursor(numLines - 1, col, false);
+	}
+	else if (row >= numLines || col > doc->DisplayLength(row)) {
+		MoveDocumentCursor(row, col, selection);
+	}
+
+	if (horizScroll != NULL) {
+		horizScroll->SetRange(0, doc->MaxDisplayLength());
+	}
+	if (vertScroll != NULL) {
+		vertScroll->SetRange(0, doc->NumLines() - 1);
+	}
+
+	if (firstLine < doc->PageStart() + Rows()) Paint();
+	wm.Refresh();
+}
+
+
+/**
+ * Reset the cursor, the scrolling, and the scroll bars after a new
+ * document was loaded
+ */
+void Editor::ResetView(void)
+{
 	col = 0;
 	row = 0;
 	actualCol = 0;
@@ -393,8 +564,6 @@ ReturnExt Editor::LoadFromFile(const char* file)
 
 	UpdateCursor();
 	Paint();
-
-	return ReturnExt(true);
 }
 
 
@@ -428,7 +597,7 @@ ReturnExt Editor::Save()
  * 
  * @param line the line number
  */
-void Editor::PaintLine(int line)
+void Editor::PaintLine(int64_t line)
 {
 	int left = 0;
 	int top = 0;
@@ -442,17 +611,17 @@ void Editor::PaintLine(int line)
 
 	DocumentLine* objLine = doc->LineObject(line);
 	const char* strLine = doc->Line(line);
-	size_t lineLength = strlen(strLine);
-	tcw->SetCursor(top + line - doc->PageStart(), left);
+	tcw->SetCursor(top + (int) (line - doc->PageStart()), left);
 	
 	
 	// Initialize
 	
-	int pos = 0;
-	int offset = 0;
+	int64_t pos = 0;
+	int64_t offset = 0;
 	int length = ncols;
-	int start = colStart;
+	int64_t start = colStart;
 	const char* p = strLine;
+	const char* end = strLine + strlen(strLine);
 	int bg = BGColor();
 	int fg = FGColor();
 
@@ -475,16 +644,17 @@ void Editor::PaintLine(int line)
 	
 	// Make sure that the line is parsed, so that we can do syntax highlighting
 
-	Parser* parser = doc->DocumentParser();
+	Parser* parser = doc->HasFeature(DOCUMENT_FEATURE_SYNTAX)
+		? doc->DocumentParser() : NULL;
 	if (parser != NULL && objLine != NULL) {
 	
 		// Make sure all of the previous lines are also parsed
 		// TODO Make more efficient
 		
-		for (int l = 0; l <= line; l++) {
+		for (int64_t l = 0; l <= line; l++) {
 			if (!doc->LineObject(l)->ValidParse()
 				|| (l > 0 && !doc->LineObject(l)->ParserStateFollows(doc->LineObject(l-1)))) {
-				for (int i = l; i <= line; i++) {
+				for (int64_t i = l; i <= line; i++) {
 					parser->Parse(*doc->LineObject(i),
 						i == 0 ? NULL : doc->LineObject(i-1));
 				}
@@ -499,42 +669,45 @@ void Editor::PaintLine(int line)
 	}
 
 
-	// Figure out the highlighting
-	
-	std::vector< std::pair<int, int> > charColors(lineLength);
-	for (size_t i = 0; i < lineLength; i++) {
-		charColors[i].first = BGColor();
-		charColors[i].second = FGColor();
-	}
-	
+	// Figure out the highlighting of the characters as they are painted,
+	// since the line can be much longer than the screen
+
+	const std::vector<std::pair<size_t, ParserState>>* states = NULL;
 	if (parser != NULL && objLine != NULL && !objLine->ParserStates().empty()) {
-		size_t stateIndex = 0;
-		for (size_t i = 0; i < lineLength; i++) {
-			while (stateIndex + 1 < objLine->ParserStates().size()
-			    && objLine->ParserStates()[stateIndex + 1].first <= i) stateIndex++;
-			ParserEnvironment* env = objLine->ParserStates()[stateIndex].second.Environment();
-			if (env != NULL) {
-				charColors[i].second = env->Color();
-			}
-		}
+		states = &objLine->ParserStates();
 	}
 
-	if (highlightPattern != "") {
-		size_t l = highlightPattern.length();
-		for (const char* s = strstr(p, highlightPattern.c_str());
-		     s != NULL;
-		     s = strstr(s + l, highlightPattern.c_str())) {
-			int offset = s - p;
-			bool active = offsetWithinLine >= offset
-			           && offsetWithinLine <  offset + l
+	size_t stateIndex = 0;
+	size_t patternLength = doc->HasFeature(DOCUMENT_FEATURE_MATCHES)
+		? highlightPattern.length() : 0;
+	const char* match = patternLength == 0 ? NULL
+		: strstr(strLine, highlightPattern.c_str());
+
+	auto charColors = [&](size_t offset, int& cbg, int& cfg) {
+		cbg = BGColor();
+		cfg = FGColor();
+
+		if (states != NULL) {
+			while (stateIndex + 1 < states->size()
+			    && (*states)[stateIndex + 1].first <= offset) stateIndex++;
+			ParserEnvironment* env = (*states)[stateIndex].second.Environment();
+			if (env != NULL) cfg = env->Color();
+		}
+
+		while (match != NULL
+				&& (size_t) (match - strLine) + patternLength <= offset) {
+			match = strstr(match + patternLength, highlightPattern.c_str());
+		}
+
+		if (match != NULL && (size_t) (match - strLine) <= offset) {
+			int64_t m = match - strLine;
+			bool active = offsetWithinLine >= m
+			           && offsetWithinLine <  m + (int64_t) patternLength
 			           && row    == line;
-			for (int i = 0; i < l; i++) {
-				size_t x = i + offset;
-				charColors[x].first = active ? 5 : 6;
-				charColors[x].second = 4;
-			}
+			cbg = active ? 5 : 6;
+			cfg = 4;
 		}
-	}
+	};
 
 
 	// Find the place in the string to start displaying
@@ -576,42 +749,48 @@ void Editor::PaintLine(int line)
 			fg = 4;
 		}
 		else {
-			bg = charColors[offset].first;
-			fg = charColors[offset].second;
+			charColors(offset, bg, fg);
 		}
 		
 		
 		// Paint
 		
 		char c = *p;
+		size_t n = 1;
 		tcw->SetColor(bg, fg);
 		
 		if (c == '\t') {
 			pos = (pos / tabSize) * tabSize + tabSize;
-			if (pos > start) {
-				int d = pos - start;
-				length -= d;
-				while (d --> 0) {
-					tcw->PutChar(' ');
-				}
-			}
+		}
+		else if ((unsigned char) c >= 0x80) {
+			uint32_t cp;
+			n = DecodeUTF8Sequence(p, end, cp);
+			pos += CodePointWidth(cp);
 		}
 		else {
 			pos++;
 		}
+		
+		if (pos > start) {
+			int d = (int) (pos - start);
+			length -= d;
+			while (d --> 0) {
+				tcw->PutChar(' ');
+			}
+		}
 
-		p++;
-		offset++;
+		p += n;
+		offset += n;
 	}
 	
 	
 	// Display from that position on
 	
 	int bytes = 0;
-	int pd = pos - start;
 	
 	while (*p != '\0' && *p != '\n' && *p != '\r' && bytes < length) {
 		unsigned char c = *p;
+		size_t n = 1;
 		
 		
 		// Determine whether we are inside a selection
@@ -649,15 +828,14 @@ void Editor::PaintLine(int line)
 			fg = 4;
 		}
 		else {
-			bg = charColors[offset].first;
-			fg = charColors[offset].second;
+			charColors(offset, bg, fg);
 		}
 		
 		
 		// Paint the character(s)
 		
 		if (c == '\t') {
-			int k = ((pos) / tabSize) * tabSize + tabSize;
+			int64_t k = ((pos) / tabSize) * tabSize + tabSize;
 			if (k > length + start) k = length + start;
 			if (displayTabs) {
 				tcw->SetColor(bg, 6);
@@ -668,27 +846,52 @@ void Editor::PaintLine(int line)
 				bytes++;
 			}
 			tcw->SetColor(bg, fg);
-			for (int i = pos; i < k; i++) {
+			for (int64_t i = pos; i < k; i++) {
 				tcw->PutChar(' ');
 				bytes++;
 			}
 			pos = k;
 		}
-		else if (c < ' ' || c >= 127) {
+		else if (c < ' ' || c == 127) {
 			tcw->SetColor(bg, 1);
 			tcw->PutChar('?');
 			bytes++;
 			pos++;
 		}
-		else {
+		else if (c < 128) {
 			tcw->SetColor(bg, fg);
 			tcw->PutChar(c);
 			bytes++;
 			pos++;
 		}
+		else {
+			uint32_t cp;
+			n = DecodeUTF8Sequence(p, end, cp);
+			int w = CodePointWidth(cp);
+			
+			if (IsUndisplayableCodePoint(cp)) {
+				tcw->SetColor(bg, 1);
+				tcw->PutChar('?');
+			}
+			else if (w == 0) {
+				tcw->PutCombining(cp);
+			}
+			else if (bytes + w > length) {
+				tcw->SetColor(bg, fg);
+				tcw->PutChar(' ');
+				w = 1;
+			}
+			else {
+				tcw->SetColor(bg, fg);
+				tcw->PutCodePoint(cp, w);
+			}
+			
+			bytes += w;
+			pos += w;
+		}
 
-		p++;
-		offset++;
+		p += n;
+		offset += n;
 	}
 	
 	
@@ -712,12 +915,31 @@ void Editor::Paint(void)
 {
 	Clear();
 	
+	
+	// Lay out the document again if the tab size changed, keeping the
+	// cursor and the selection at the same characters
+	
+	if (tabSize != DocumentLine::TabSize()) {
+		const char* p = selection ? doc->Line(selRow) : "";
+		size_t selOffset = DisplayColumnToOffset(p, strlen(p), tabSize, selCol);
+		
+		tabSize = DocumentLine::TabSize();
+		doc->UpdateLayout();
+		
+		col = actualCol = doc->CursorPosition(row, offsetWithinLine);
+		if (selection) selCol = doc->CursorPosition(selRow, selOffset);
+		
+		if (horizScroll != NULL) {
+			horizScroll->SetRange(0, doc->MaxDisplayLength());
+		}
+	}
+	
 
 	// Compute the bounds
 	
 	int nlines = Rows();
 	if (nlines + doc->PageStart() > doc->NumLines())
-		nlines = doc->NumLines() - doc->PageStart();
+		nlines = (int) (doc->NumLines() - doc->PageStart());
 	
 	
 	// Paint the lines
@@ -733,38 +955,10 @@ void Editor::Paint(void)
  */
 void Editor::UpdateActualCursorPosition(void)
 {
-	// Calculate the actual cursor position
+	// Calculate the actual cursor position, which is at the beginning of a
+	// tab or a wide character that spans across the desired column
 	
-	int pos = 0;
-	int length = Columns();
-	const char* p = doc->Line(row);
-	bool lastWasTab = false;
-	int preTabPos = 0;
-	offsetWithinLine = 0;
-	
-	while (*p != '\0' && *p != '\n' && *p != '\r' && pos < col) {
-		char c = *p;
-		
-		if (c == '\t') {
-			lastWasTab = true;
-			preTabPos = pos;
-			pos = (pos / tabSize) * tabSize + tabSize;
-		}
-		else {
-			lastWasTab = false;
-			pos++;
-		}
-		
-		p++;
-		offsetWithinLine++;
-	}
-	
-	if (lastWasTab && pos > col) {
-		pos = preTabPos;
-		offsetWithinLine--;
-	}
-	
-	actualCol = pos;
+	offsetWithinLine = doc->StringPosition(row, col, &actualCol);
 	
 	
 	// Deselect, if necessary
@@ -794,8 +988,8 @@ void Editor::UpdateCursor(bool scroll)
 	
 	// Calculate the actual cursor position
 	
-	int nr = row - doc->PageStart();
-	int nc = col - colStart;
+	int64_t nr = row - doc->PageStart();
+	int64_t nc = col - colStart;
 	
 	if (scroll) {
 		assert(nr >= 0 && nr <= Rows());
@@ -851,7 +1045,7 @@ void Editor::UpdateCursor(bool scroll)
 	// Update the screen
 	
 	if (nr >= 0 && nr < Rows() && nc >= 0 && nc < Columns()) {
-		MoveCursor(nr, nc);
+		MoveCursor((int) nr, (int) nc);
 	}
 	else {
 		HideCursor();
@@ -871,7 +1065,7 @@ void Editor::UpdateCursor(bool scroll)
  * @param newCol the new column
  * @param shift whether the Shift button was held
  */
-void Editor::MoveDocumentCursor(int newRow, int newCol, bool shift)
+void Editor::MoveDocumentCursor(int64_t newRow, int64_t newCol, bool shift)
 {
 	bool needsPaint = false;
 
@@ -899,7 +1093,7 @@ void Editor::MoveDocumentCursor(int newRow, int newCol, bool shift)
 	if (row < 0) row = 0;
 
 	col = newCol;
-	int len = doc->DisplayLength(row);
+	int64_t len = doc->DisplayLength(row);
 	if (col >= len) col = len;
 	if (col < 0) col = 0;
 	
@@ -1053,12 +1247,16 @@ void Editor::MoveCursorLeft(bool shift)
 		col = actualCol - 1;
 	}
 	
-	int idx = doc->StringPosition(row, actualCol);
+	int64_t idx = doc->StringPosition(row, actualCol);
 	const char* line = doc->Line(row);
 	if (idx > 0) {
 		if (line[idx - 1] == '\t') {
 			while (doc->StringPosition(row, col) >= idx) col--;
 		}
+		else if ((unsigned char) line[idx - 1] >= 0x80) {
+			col = doc->CursorPosition(row,
+					PreviousCharacterOffset(line, strlen(line), idx));
+		}
 	}
 	
 	if (col < colStart) {
@@ -1105,16 +1303,23 @@ void Editor::MoveCursorRight(bool shift)
 	// Cursor movement and scrolling logic
 	
 	col = actualCol + 1;
-	int len = doc->DisplayLength(row);
+	int64_t len = doc->DisplayLength(row);
 	//if (col > len) col = len;
 	
+	const char* str = doc->Line(row);
+	size_t offset = doc->StringPosition(row, actualCol);
+	if ((unsigned char) str[offset] >= 0x80) {
+		col = doc->CursorPosition(row,
+				NextCharacterOffset(str, strlen(str), offset));
+	}
+	
 	if (col > len && row < doc->NumLines() - 1) {
 		row++;
 		col = 0;
 		needsPaint = needsPaint || EnsureValidScroll();
 	}
 	
-	int idx = doc->StringPosition(row, actualCol);
+	int64_t idx = doc->StringPosition(row, actualCol);
 	const char* line = doc->Line(row);
 	if (line[idx] == '\t') {
 		if (line[idx + 1] == '\0' || line[idx + 1] == '\n' || line[idx + 1] == '\r') {
@@ -1188,7 +1393,7 @@ void Editor::MoveCursorBeginningWord(bool shift)
 	
 		const char* line = doc->Line(row);
 		col = actualCol - 1;
-		int idx = doc->StringPosition(row, col);
+		int64_t idx = doc->StringPosition(row, col);
 		
 		if (isspace(line[idx])) {
 			while (col > 0 && isspace(line[idx])) {
@@ -1255,7 +1460,7 @@ void Editor::MoveCursorEndWord(bool shift)
 	
 	// Cursor movement and scrolling logic
 	
-	int len = doc->DisplayLength(row);
+	int64_t len = doc->DisplayLength(row);
 	if (actualCol + 1 > len && row < doc->NumLines() - 1) {
 		row++;
 		col = 0;
@@ -1265,7 +1470,7 @@ void Editor::MoveCursorEndWord(bool shift)
 	
 		const char* line = doc->Line(row);
 		col = actualCol + 1;
-		int idx = doc->StringPosition(row, col);
+		int64_t idx = doc->StringPosition(row, col);
 		
 		if (isspace(line[idx])) {
 			while (isspace(line[idx])) {
@@ -1348,7 +1553,7 @@ void Editor::MoveCursorToTheBeginningOfTheLine(bool shift)
 	
 	// Determine the position of the first non-blank character of the line
 	
-	int firstNonBlank = 0;
+	int64_t firstNonBlank = 0;
 	const char* line = doc->Line(row);
 	for (const char* p = line; *p != '\0'; p++) {
 		if (*p == ' ') {
@@ -1445,8 +1650,8 @@ void Editor::MoveCursorPageUp(bool shift)
 	
 	// Set the new page start
 	
-	int p = doc->PageStart();
-	int d = Rows();
+	int64_t p = doc->PageStart();
+	int64_t d = Rows();
 
 	if (p == 0 && row == 0) {
 		MoveCursorVeryLeft();
@@ -1502,10 +1707,10 @@ void Editor::MoveCursorPageDown(bool shift)
 	
 	// Set the new page start
 	
-	int p = doc->PageStart();
-	int d = Rows();
+	int64_t p = doc->PageStart();
+	int64_t d = Rows();
 	
-	int m = doc->NumLines() - Rows();
+	int64_t m = doc->NumLines() - Rows();
 	if (p + d > m) d = m - p;
 
 	if (d == 0 && row == doc->NumLines() - 1) {
@@ -1545,6 +1750,8 @@ void Editor::MoveCursorPageDown(bool shift)
  */
 void Editor::InsertChar(char c)
 {
+	if (doc->ReadOnly()) return;
+	
 	bool white = isspace(c);
 	if (white ? (lastAction != EEAT_TypeWhitespace && lastAction != EEAT_Type)
 			: lastAction != EEAT_Type) doc->FinalizeEditAction();
@@ -1575,11 +1782,41 @@ void Editor::InsertChar(char c)
 }
 
 
+/**
+ * Collect a byte of a typed multi-byte UTF-8 character, and insert the
+ * character once it is complete
+ * 
+ * @param c the byte
+ */
+void Editor::InsertByte(char c)
+{
+	unsigned char b = c;
+	
+	if ((b & 0xC0) != 0x80) pendingInput.clear();
+	if (pendingInput.empty() && (b < 0xC2 || b > 0xF4)) return;
+	pendingInput += c;
+	
+	unsigned char lead = pendingInput[0];
+	size_t expected = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : 2;
+	if (pendingInput.length() < expected) return;
+	
+	uint32_t cp;
+	const char* s = pendingInput.c_str();
+	if (DecodeUTF8(s, s + pendingInput.length(), cp) == expected) {
+		Paste(s);
+	}
+	
+	pendingInput.clear();
+}
+
+
 /**
  * Insert a new line at the cursor position
  */
 void Editor::NewLine(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (!multiline) return;
 
 	if (lastAction != EEAT_Enter) doc->FinalizeEditAction();
@@ -1587,18 +1824,19 @@ void Editor::NewLine(void)
 	
 	std::string lineStr = doc->Line(row);
 	const char* line = lineStr.c_str();
-	int idx = doc->StringPosition(row, actualCol);
+	int64_t idx = doc->StringPosition(row, actualCol);
 	
 	EnsureValidScroll();
 	
 	
 	// Create the new line
 	
-	char* newline = (char*) alloca(strlen(line) + 4);
+	std::vector<char> newlineBuffer(strlen(line) + 4);
+	char* newline = &newlineBuffer[0];
 	*newline = '\0';
 	
-	int w = 0;
-	for (int i = 0; i < idx; i++) {
+	int64_t w = 0;
+	for (int64_t i = 0; i < idx; i++) {
 		if (isspace(line[i])) {
 			newline[i] = line[i];
 			newline[i + 1] = '\0';
@@ -1615,10 +1853,7 @@ void Editor::NewLine(void)
 	
 	// Replace the old line
 	
-	char* nl = (char*) alloca(idx + 4);
-	memcpy(nl, line, idx);
-	nl[idx] = '\0';
-	
+	std::string nl(line, idx);
 	doc->Replace(row, nl);
 	
 	
@@ -1644,6 +1879,8 @@ void Editor::NewLine(void)
  */
 void Editor::DeleteChar(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (lastAction != EEAT_Delete) doc->FinalizeEditAction();
 	
 	bool needsPaint = EnsureValidScroll();
@@ -1674,7 +1911,16 @@ void Editor::DeleteChar(void)
 		}
 	}
 	else {
-		doc->DeleteCharFromLine(row, doc->StringPosition(row, col));
+		int64_t idx = doc->StringPosition(row, col);
+		const char* line = doc->Line(row);
+		
+		if ((unsigned char) line[idx] >= 0x80) {
+			doc->DeleteString(row, idx, row,
+					NextCharacterOffset(line, strlen(line), idx));
+		}
+		else {
+			doc->DeleteCharFromLine(row, idx);
+		}
 		
 		if (needsPaint) Paint(); else PaintLine(row);
 	}
@@ -1689,6 +1935,8 @@ void Editor::DeleteChar(void)
  */
 void Editor::Backspace(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (lastAction != EEAT_Backspace) doc->FinalizeEditAction();
 	
 	bool needsPaint = EnsureValidScroll();
@@ -1728,13 +1976,20 @@ void Editor::Backspace(void)
 		col = col - 1;
 		
 		bool tab = false;
-		int idx = doc->StringPosition(row, actualCol);
+		int64_t idx = doc->StringPosition(row, actualCol);
 		const char* line = doc->Line(row);
 		if (idx > 0) {
 			if (line[idx - 1] == '\t') tab = true;
 		}
 		
-		doc->DeleteCharFromLine(row, doc->StringPosition(row, col));
+		if (idx > 0 && (unsigned char) line[idx - 1] >= 0x80) {
+			int64_t prev = PreviousCharacterOffset(line, strlen(line), idx);
+			col = doc->CursorPosition(row, prev);
+			doc->DeleteString(row, prev, row, idx);
+		}
+		else {
+			doc->DeleteCharFromLine(row, doc->StringPosition(row, col));
+		}
 		
 		if (tab) {
 			while (doc->StringPosition(row, col) >= idx) col--;
@@ -1753,10 +2008,12 @@ void Editor::Backspace(void)
  */
 void Editor::Indent(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (lastAction != EEAT_Indent) doc->FinalizeEditAction();
 
-	int fromRow = row;
-	int toRow = row;
+	int64_t fromRow = row;
+	int64_t toRow = row;
 	if (selection) {
 		if (selRow < row) {
 			fromRow = selRow;
@@ -1766,10 +2023,10 @@ void Editor::Indent(void)
 		}
 	}
 	
-	int idx = doc->StringPosition(row, actualCol);
-	int idxSel = selection ? doc->StringPosition(selRow, selCol) : 0;
+	int64_t idx = doc->StringPosition(row, actualCol);
+	int64_t idxSel = selection ? doc->StringPosition(selRow, selCol) : 0;
 
-	for (int r = fromRow; r <= toRow; r++) {
+	for (int64_t r = fromRow; r <= toRow; r++) {
 		doc->InsertCharToLine(r, '\t', 0);
 	}
 	
@@ -1791,10 +2048,12 @@ void Editor::Indent(void)
  */
 void Editor::Unindent(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (lastAction != EEAT_Indent) doc->FinalizeEditAction();
 
-	int fromRow = row;
-	int toRow = row;
+	int64_t fromRow = row;
+	int64_t toRow = row;
 	if (selection) {
 		if (selRow < row) {
 			fromRow = selRow;
@@ -1804,12 +2063,12 @@ void Editor::Unindent(void)
 		}
 	}
 	
-	int idx = doc->StringPosition(row, actualCol);
-	int idxSel = selection ? doc->StringPosition(selRow, selCol) : 0;
+	int64_t idx = doc->StringPosition(row, actualCol);
+	int64_t idxSel = selection ? doc->StringPosition(selRow, selCol) : 0;
 	bool updateRow = false;
 	bool updateSel = false;
 
-	for (int r = fromRow; r <= toRow; r++) {
+	for (int64_t r = fromRow; r <= toRow; r++) {
 		const char* l = doc->Line(r);
 		if (*l == '\t') {
 			doc->DeleteCharFromLine(r, 0);
@@ -1840,8 +2099,8 @@ void Editor::Copy(void)
 {
 	if (!selection) return;
 	
-	int selIdx = doc->StringPosition(selRow, selCol);
-	int idx = doc->StringPosition(row, actualCol);
+	int64_t selIdx = doc->StringPosition(selRow, selCol);
+	int64_t idx = doc->StringPosition(row, actualCol);
 	
 	std::string s = doc->Get(row, idx, selRow, selIdx).c_str();
 	wm.SetClipboard(s);
@@ -1853,6 +2112,8 @@ void Editor::Copy(void)
  */
 void Editor::Cut(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (!selection) return;
 	
 	EnsureValidScroll();
@@ -1874,7 +2135,35 @@ void Editor::Cut(void)
  */
 void Editor::Paste(void)
 {
-	if (wm.Clipboard()[0] == '\0') return;
+	Paste(wm.Clipboard());
+}
+
+
+/**
+ * Paste a string
+ *
+ * @param text the string to insert at the cursor location
+ */
+void Editor::Paste(const char* text)
+{
+	if (doc->ReadOnly()) return;
+	
+	if (text[0] == '\0') return;
+
+
+	// A single-line editor takes only the first line
+
+	std::string singleLine;
+	const char* str = text;
+
+	if (!multiline) {
+		const char* nl = std::strchr(text, '\n');
+		if (nl != NULL) {
+			singleLine = std::string(text, nl - text);
+			str = singleLine.c_str();
+			if (str[0] == '\0') return;
+		}
+	}
 	
 	doc->FinalizeEditAction();
 	
@@ -1886,20 +2175,19 @@ void Editor::Paste(void)
 	
 	// Paste
 	
-	const char* str = wm.Clipboard();
-	int pos = doc->StringPosition(row, actualCol);
+	int64_t pos = doc->StringPosition(row, actualCol);
 	doc->InsertString(row, pos, str);
 	
 	
 	// Update the cursor location
 	
-	int newlines = 0;
+	int64_t newlines = 0;
 	for (const char* c = str; *c != '\0'; c++) if (*c == '\n') newlines++;
 	row += newlines;
 	
 	const char* last = std::strrchr(str, '\n');
 	if (last == NULL) {
-		int idx = doc->StringPosition(row, actualCol);
+		int64_t idx = doc->StringPosition(row, actualCol);
 		const char* line = doc->Line(row);
 		std::string s = line;
 		DocumentLine l; l.SetText(s.substr(0, idx) + str);
@@ -1938,6 +2226,8 @@ void Editor::Paste(void)
  */
 void Editor::Undo(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	// Undo
 	
 	doc->FinalizeEditAction();
@@ -1969,6 +2259,8 @@ void Editor::Undo(void)
  */
 void Editor::Redo(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	// Redo
 	
 	doc->Redo();
@@ -2034,10 +2326,12 @@ void Editor::AfterEdit(void)
  */
 void Editor::DeleteSelection(void)
 {
+	if (doc->ReadOnly()) return;
+	
 	if (!selection) return;
 	
-	int selIdx = doc->StringPosition(selRow, selCol);
-	int idx = doc->StringPosition(row, actualCol);
+	int64_t selIdx = doc->StringPosition(selRow, selCol);
+	int64_t idx = doc->StringPosition(row, actualCol);
 	
 	doc->DeleteString(row, idx, selRow, selIdx);
 	
@@ -2077,7 +2371,7 @@ bool Editor::EnsureValidScroll(void)
 	}
 
 	if (doc->PageStart() > 0 && doc->NumLines() - doc->PageStart() < Rows()) {
-		int p = doc->NumLines() - Rows();
+		int64_t p = doc->NumLines() - Rows();
 		if (p < 0) p = 0;
 		doc->SetPageStart(p);
 		return true;
@@ -2111,6 +2405,11 @@ void Editor::OnKeyPressed(int key)
 		InsertChar((char) key);
 		return;
 	}
+	
+	if (key >= 0x80 && key <= 0xFF) {
+		InsertByte((char) key);
+		return;
+	}
 
 	if (key == KEY_ENTER || key == KEY_RETURN) {
 		if (multiline) {
@@ -2287,6 +2586,11 @@ void Editor::OnKeyPressed(int key)
 		Paste();
 		return;
 	}
+
+	if (key == KEY_PASTE) {
+		Paste(wm.PastedText());
+		return;
+	}
 	
 	if (key == KEY_CTRL('x')) {
 		Cut();
@@ -2348,7 +2652,7 @@ void Editor::OnMouseDoubleClick(int mouseRow, int mouseColumn, int button, bool
 	if (doc == NULL) return;
 	
 	if (button == 0 && !shift) {
-		int idx = doc->StringPosition(row, actualCol);
+		int64_t idx = doc->StringPosition(row, actualCol);
 		const char* line = doc->Line(row);
 		char c = line[idx];
 		
@@ -2362,16 +2666,16 @@ void Editor::OnMouseDoubleClick(int mouseRow, int mouseColumn, int button, bool
 		}
 		else if (isspace(c)) {
 			
-			int fromCol = col;
+			int64_t fromCol = col;
 			while (fromCol > 0) {
-				int i = doc->StringPosition(row, fromCol - 1);
+				int64_t i = doc->StringPosition(row, fromCol - 1);
 				if (!isspace(line[i])) break;
 				fromCol--;
 			}
 			
-			int toCol = col;
+			int64_t toCol = col;
 			while (true) {
-				int i = doc->StringPosition(row, toCol);
+				int64_t i = doc->StringPosition(row, toCol);
 				if (line[i] == '\0' || !isspace(line[i])) break;
 				toCol++;
 			}
@@ -2461,7 +2765,7 @@ void Editor::OnMouseDragFinish(const MouseDragEvent& event)
 		// If the selection created by drag ends up with cursor on the right,
 		// move the cursor one character to the right because it is exclusive
 		if (row > selRow || (row == selRow && col > selCol)) {
-			int len = doc->DisplayLength(row);
+			int64_t len = doc->DisplayLength(row);
 			if (col < len) MoveCursorRight(true);
 		}
 	}
@@ -2482,7 +2786,7 @@ void Editor::OnMouseWheel(int row, int column, int wheel)
 	
 	if (wheel < 0) {
 		if (doc->PageStart() > 0) {
-			int n = doc->PageStart() - wheelSpeed;
+			int64_t n = doc->PageStart() - wheelSpeed;
 			if (n < 0) n = 0;
 			doc->SetPageStart(n);
 			needsPaint = true;
@@ -2491,7 +2795,7 @@ void Editor::OnMouseWheel(int row, int column, int wheel)
 	
 	if (wheel > 0) {
 		if (doc->NumLines() - doc->PageStart() > Rows()) {
-			int n = doc->PageStart() + wheelSpeed;
+			int64_t n = doc->PageStart() + wheelSpeed;
 			if (doc->NumLines() - n <= Rows()) {
 				n = doc->NumLines() - Rows();
 				if (n < 0) n = 0;
@@ -2546,9 +2850,12 @@ bool Editor::FindNext(bool forward, bool keepIfOnMatch, bool wrap)
 {
 	if (highlightPattern == "") return false;
 
-	int r = row;
+	int64_t r = row;
 	const char* line = doc->Line(r);
-	int offset = offsetWithinLine;
+	int64_t offset = offsetWithinLine;
+
+	Operation op("Searching", doc->NumLines(), OPERATION_UNIT_LINES);
+	int64_t scanned = 0;
 
 	while (true) {
 		const char* s = NULL;
@@ -2568,9 +2875,10 @@ bool Editor::FindNext(bool forward, bool keepIfOnMatch, bool wrap)
 
 		if (s != NULL) {
 			offset = s - line;
-			int c = doc->CursorPosition(r, offset);
+			int64_t c = doc->CursorPosition(r, offset);
+			int64_t matchEnd = offset + (int64_t) highlightPattern.length();
 			bool currentMatch = r == row && offsetWithinLine >= offset
-				&& offsetWithinLine < offset + highlightPattern.length();
+				&& offsetWithinLine < matchEnd;
 
 			if (currentMatch) {
 				if (keepIfOnMatch) return true;
@@ -2613,6 +2921,9 @@ bool Editor::FindNext(bool forward, bool keepIfOnMatch, bool wrap)
 
 			if (row == r) return false;
 
+			op.SetDone(++scanned);
+			if ((scanned & 1023) == 0 && !op.Update(scanned)) return false;
+
 			line = doc->Line(r);
 
 			if (forward) {
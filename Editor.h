@@ -65,19 +65,19 @@ class Editor : public Component
 {
 	EditorDocument* doc;
 	bool multiline;
-	int colStart;
+	int64_t colStart;
 	
 	int tabSize;
 	bool displayTabs;
 	
-	int row;
-	int col;
-	int actualCol;
-	int offsetWithinLine;
+	int64_t row;
+	int64_t col;
+	int64_t actualCol;
+	int64_t offsetWithinLine;
 	int wheelSpeed;
 	
-	int selRow;
-	int selCol;
+	int64_t selRow;
+	int64_t selCol;
 	bool selection;
 	
 	bool overwriteMode;
@@ -89,6 +89,7 @@ class Editor : public Component
 	ScrollBar* vertScroll;
 
 	std::string highlightPattern;
+	std::string pendingInput;
 
 
 	/**
@@ -98,7 +99,7 @@ class Editor : public Component
 	 * @param newCol the new column
 	 * @param shift whether the Shift button was held
 	 */
-	void MoveDocumentCursor(int newRow, int newCol, bool shift = false);
+	void MoveDocumentCursor(int64_t newRow, int64_t newCol, bool shift = false);
 	
 	/**
 	 * Move the cursor up
@@ -194,6 +195,14 @@ class Editor : public Component
 	 */
 	void InsertChar(char c);
 	
+	/**
+	 * Collect a byte of a typed multi-byte UTF-8 character, and insert the
+	 * character once it is complete
+	 * 
+	 * @param c the byte
+	 */
+	void InsertByte(char c);
+	
 	/**
 	 * Insert a new line at the cursor position
 	 */
@@ -234,6 +243,13 @@ class Editor : public Component
 	 */
 	void Paste(void);
 	
+	/**
+	 * Paste a string
+	 *
+	 * @param text the string to insert at the cursor location
+	 */
+	void Paste(const char* text);
+	
 	/**
 	 * Perform an undo
 	 */
@@ -259,7 +275,7 @@ class Editor : public Component
 	 * 
 	 * @param line the line number
 	 */
-	void PaintLine(int line);
+	void PaintLine(int64_t line);
 	
 	/**
 	 * Scroll the window such that the cursor is visible
@@ -268,6 +284,27 @@ class Editor : public Component
 	 */
 	bool EnsureValidScroll(void);
 	
+	/**
+	 * Reset the cursor, the scrolling, and the scroll bars after a new
+	 * document was loaded
+	 */
+	void ResetView(void);
+	
+	/**
+	 * Set the document, and start listening to its changes
+	 * 
+	 * @param document the document (will be destroyed with the editor)
+	 */
+	void SetDocument(EditorDocument* document);
+	
+	/**
+	 * Handle lines that were changed from outside of the editor, such as
+	 * when they were appended or when the file was reloaded
+	 * 
+	 * @param firstLine the first line that changed
+	 */
+	void OnLinesChanged(int64_t firstLine);
+	
 
 protected:
 	
@@ -380,6 +417,41 @@ public:
 	 */
 	ReturnExt LoadFromFile(const char* file);
 
+	/**
+	 * Open a file read-only in the pager, which pages in the lines on demand
+	 * instead of loading the whole file to the memory
+	 *
+	 * @param file the file name
+	 * @param a ReturnExt
+	 */
+	ReturnExt OpenPager(const char* file);
+
+	/**
+	 * Read the document from a stream in the background, showing the lines
+	 * as they arrive
+	 *
+	 * @param fd the file descriptor, which will be closed when done
+	 * @param name the name of the stream
+	 * @param a ReturnExt
+	 */
+	ReturnExt LoadFromStream(int fd, const char* name);
+
+	/**
+	 * Load a file, and then keep appending the lines that are written to it
+	 *
+	 * @param file the file name
+	 * @param a ReturnExt
+	 */
+	ReturnExt Follow(const char* file);
+
+	/**
+	 * Turn a feature of the document on or off
+	 *
+	 * @param feature the feature
+	 * @param on true to turn it on
+	 */
+	void SetDocumentFeature(DocumentFeature feature, bool on);
+
 	/**
 	 * Save to file
 	 *
@@ -415,14 +487,14 @@ public:
 	 *
 	 * @return the logical row number
 	 */
-	inline int DocumentCursorRow(void) { return row; }
+	inline int64_t DocumentCursorRow(void) { return row; }
 	
 	/**
 	 * Get the logical cursor column (position) within the document
 	 *
 	 * @return the logical column number
 	 */
-	inline int DocumentCursorColumn(void) { return actualCol; }
+	inline int64_t DocumentCursorColumn(void) { return actualCol; }
 	
 	/**
 	 * Get the editor document
@@ -35,13 +35,28 @@
 #include "stdafx.h"
 #include "EditorWindow.h"
 
+#include <algorithm>
+#include <fcntl.h>
 #include <libgen.h>
+#include <sys/stat.h>
 
+#include "Compression.h"
 #include "DialogWindow.h"
+#include "FeaturePolicy.h"
 #include "FileDialog.h"
 #include "Manager.h"
+#include "MenuWindow.h"
 #include "ScrollBar.h"
 
+#define EWM_FEATURE		0x100		// Plus the DocumentFeature
+#define EWM_TAB_SIZE	0x200		// Plus the tab size
+
+/**
+ * The tab sizes offered in the feature menu
+ */
+static const int TAB_SIZES[] = { 2, 4, 8 };
+#define NUM_TAB_SIZES	((int) (sizeof(TAB_SIZES) / sizeof(TAB_SIZES[0])))
+
 
 /**
  * Create an instance of class EditorWindow
@@ -55,6 +70,7 @@ EditorWindow::EditorWindow(int row, int col, int rows, int cols)
 	: Window("Untitled", row, col, rows, cols, 4, 7)
 {
 	editor = NULL;
+	featureMenu = NULL;
 	
 	inactiveFrameColor = 6;
 
@@ -133,6 +149,36 @@ EditorWindow::EditorWindow(int row, int col, int rows, int cols)
  */
 EditorWindow::~EditorWindow(void)
 {
+	if (featureMenu != NULL) delete featureMenu;
+}
+
+
+/**
+ * Open a file, either by loading it, or in the pager if it is too large
+ * according to the FeaturePolicy
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt EditorWindow::Open(const char* file)
+{
+	// The pager shows the file as it is on the disk, so it cannot be used
+	// for compressed files
+
+	bool paged = false;
+
+	int fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd >= 0) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+			unsigned features = FeaturePolicy::Features(st.st_size);
+			paged = !(features & DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_FULL_LOAD))
+				&& !IsGzip(fd);
+		}
+		close(fd);
+	}
+
+	return paged ? OpenPager(file) : LoadFromFile(file);
 }
 
 
@@ -147,6 +193,43 @@ ReturnExt EditorWindow::LoadFromFile(const char* file)
 	ReturnExt r = editor->LoadFromFile(file);
 	if (!r) return r;
 
+	FileOpened(file);
+	Paint();
+	
+	return ReturnExt(true);
+}
+
+
+/**
+ * Open a file read-only in the pager, which pages in the lines on demand
+ * instead of loading the whole file to the memory
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt EditorWindow::OpenPager(const char* file)
+{
+	ReturnExt r = editor->OpenPager(file);
+	if (!r) return r;
+
+	FileOpened(file);
+	Paint();
+	
+	return ReturnExt(true);
+}
+
+
+/**
+ * Load a file, and then keep appending the lines that are written to it
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt EditorWindow::Follow(const char* file)
+{
+	ReturnExt r = editor->Follow(file);
+	if (!r) return r;
+
 	char* s = strdup(file);
 	char* b = basename(s);
 	SetTitle(b);
@@ -158,6 +241,143 @@ ReturnExt EditorWindow::LoadFromFile(const char* file)
 }
 
 
+/**
+ * Read the document from a stream in the background, showing the lines
+ * as they arrive
+ *
+ * @param fd the file descriptor, which will be closed when done
+ * @param name the name of the stream, which is used as the title
+ * @param a ReturnExt
+ */
+ReturnExt EditorWindow::LoadFromStream(int fd, const char* name)
+{
+	ReturnExt r = editor->LoadFromStream(fd, name);
+	if (!r) return r;
+
+	SetTitle(name);
+	Paint();
+	
+	return ReturnExt(true);
+}
+
+
+/**
+ * Set the title to the base name of the file, and tell the user about
+ * an unusual format and the features turned off for a large file
+ *
+ * @param file the file name
+ */
+void EditorWindow::FileOpened(const char* file)
+{
+	char* s = strdup(file);
+	char* b = basename(s);
+	SetTitle(b);
+
+
+	// The format is kept when saving, and the features can be turned back
+	// on from the feature menu
+
+	EditorDocument* doc = editor->Document();
+	std::string status = doc->Format().Description();
+	std::string features = FeaturePolicy::Description(doc->Features());
+
+	if (!features.empty()) {
+		if (!status.empty()) status += ", ";
+		status += features;
+		status += " - Ctrl+E to change";
+	}
+
+	if (!status.empty()) {
+		status = std::string(b) + ": " + status;
+		wm.SetStatus(status.c_str());
+	}
+
+	free(s);
+}
+
+
+/**
+ * Open the menu that turns the features of the document on and off
+ */
+void EditorWindow::OpenFeatureMenu(void)
+{
+	if (featureMenu == NULL) {
+		featureMenu = new MenuWindow(this);
+		for (int f = 0; f < DOCUMENT_FEATURE_COUNT; f++) {
+			featureMenu->Add(FeaturePolicy::Title((DocumentFeature) f), 0,
+					EWM_FEATURE + f);
+		}
+		featureMenu->AddSeparator();
+		for (int i = 0; i < NUM_TAB_SIZES; i++) {
+			featureMenu->Add("", 0, EWM_TAB_SIZE + TAB_SIZES[i]);
+		}
+	}
+
+
+	// Show which features are on
+
+	EditorDocument* doc = editor->Document();
+
+	for (int f = 0; f < DOCUMENT_FEATURE_COUNT; f++) {
+		DocumentFeature feature = (DocumentFeature) f;
+		std::string title = doc->HasFeature(feature) ? "[x] " : "[ ] ";
+		title += FeaturePolicy::Title(feature);
+		featureMenu->Replace(f, title.c_str(), 4, EWM_FEATURE + f);
+	}
+
+	for (int i = 0; i < NUM_TAB_SIZES; i++) {
+		char title[32];
+		snprintf(title, sizeof(title), "(%c) Tab size %d",
+				DocumentLine::TabSize() == TAB_SIZES[i] ? '*' : ' ',
+				TAB_SIZES[i]);
+		featureMenu->Replace(DOCUMENT_FEATURE_COUNT + 1 + i, title, 13,
+				EWM_TAB_SIZE + TAB_SIZES[i]);
+	}
+
+	if (doc->FileName() == NULL) {
+		featureMenu->Disable(DOCUMENT_FEATURE_FULL_LOAD);
+	}
+	else {
+		featureMenu->Enable(DOCUMENT_FEATURE_FULL_LOAD);
+	}
+
+	featureMenu->UpdateMenu();
+	featureMenu->Move(Row() + 1, Column() + 1);
+	wm.OpenMenu(featureMenu);
+}
+
+
+/**
+ * Turn a feature of the document on or off, opening the file again if
+ * it is to be switched between the pager and the editor
+ *
+ * @param feature the feature
+ */
+void EditorWindow::ToggleFeature(DocumentFeature feature)
+{
+	EditorDocument* doc = editor->Document();
+	bool on = !doc->HasFeature(feature);
+
+	if (feature != DOCUMENT_FEATURE_FULL_LOAD) {
+		editor->SetDocumentFeature(feature, on);
+		Paint();
+		return;
+	}
+
+	if (doc->FileName() == NULL) return;
+
+	if (!on && doc->Modified()) {
+		Dialogs::Error(this, "Save the changes before opening the file "
+				"in the pager");
+		return;
+	}
+
+	std::string file = doc->FileName();
+	ReturnExt r = on ? LoadFromFile(file.c_str()) : OpenPager(file.c_str());
+	if (!r && r.ErrorCode() != ECANCELED) Dialogs::Error(this, r);
+}
+
+
 /**
  * Paint the window status
  */
@@ -171,22 +391,41 @@ void EditorWindow::PaintEditorStatus(void)
 	UseFrameStyle();
 
 	
+	// Format the cursor location, and if it is too long, make room for it
+	// by shortening the horizontal scroll bar
+	
+	snprintf(buf, sizeof(buf), " %lld:%lld ",
+			(long long) editor->DocumentCursorRow(),
+			(long long) editor->DocumentCursorColumn());
+	
+	int start = std::max(5, 9 - digits(editor->DocumentCursorRow()));
+	int scrollStart = std::max(16, start + (int) strlen(buf) + 1);
+	
+	if (scrollStart != HorizScrollStart()) {
+		AddScrollBar(true, scrollStart, 3);
+		HorizScrollBar()->Paint();
+		UseFrameStyle();
+	}
+	
+	
 	// Clear the space
 	
-	tcw->OutHorizontalLine(r, 1, 14);
+	tcw->OutHorizontalLine(r, 1, scrollStart - 1);
 	
 	
 	// Print the cursor location
 	
-	snprintf(buf, sizeof(buf), " %d:%d ", editor->DocumentCursorRow(),
-			 editor->DocumentCursorColumn());
-	tcw->OutText(r, 9 - digits(editor->DocumentCursorRow()), buf);
+	tcw->OutText(r, start, buf);
 	
 	
 	// Print the flags
 	
 	if (editor->OverwriteMode()) tcw->OutChar(r, 2, 'O');
 	if (editor->Document()->Modified()) tcw->OutChar(r, 3, '*');
+	if (editor->Document()->ReadOnly()) tcw->OutChar(r, 3, 'R');
+	if (editor->Document()->Features() != DOCUMENT_FEATURES_ALL) {
+		tcw->OutChar(r, 4, 'L');
+	}
 }
 
 
@@ -242,6 +481,10 @@ void EditorWindow::OnKeyPressed(int key)
 		}
 	}
 
+	else if (key == KEY_CTRL('e')) {
+		OpenFeatureMenu();
+	}
+
 	else if (key == KEY_CTRL('s')) {
 
 		if (editor->Document()->FileName() == NULL) {
@@ -250,7 +493,16 @@ void EditorWindow::OnKeyPressed(int key)
 			Dialogs::Error(this, r.Message());
 		}
 		else {
-			ReturnExt r = editor->Document()->Save();
+
+			// Save in the background, so that the editing can continue
+
+			ReturnExt r = editor->Document()->SaveInBackground(
+					[this](const ReturnExt& r) {
+				if (!r && r.ErrorCode() != ECANCELED) {
+					Dialogs::Error(this, r.Message());
+				}
+				wm.Refresh();
+			});
 			if (!r) Dialogs::Error(this, r.Message());
 		}
 	}
@@ -311,6 +563,29 @@ void EditorWindow::OnValueChanged(Component* sender)
 }
 
 
+/**
+ * An event handler for exiting a window menu
+ *
+ * @param code the menu exit code
+ */
+void EditorWindow::OnWindowMenu(int code)
+{
+	if (code >= EWM_FEATURE && code < EWM_FEATURE + DOCUMENT_FEATURE_COUNT) {
+		ToggleFeature((DocumentFeature) (code - EWM_FEATURE));
+		wm.Refresh();
+		return;
+	}
+
+	if (code > EWM_TAB_SIZE && code <= EWM_TAB_SIZE + TAB_SIZES[NUM_TAB_SIZES - 1]) {
+		DocumentLine::SetTabSize(code - EWM_TAB_SIZE);
+		wm.Refresh();
+		return;
+	}
+
+	Window::OnWindowMenu(code);
+}
+
+
 /**
  * Paint the contents of the window
  */
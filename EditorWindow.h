@@ -43,6 +43,8 @@
 #include "Button.h"
 #include "CheckBox.h"
 
+class MenuWindow;
+
 
 /**
  * The text and source code editor
@@ -66,6 +68,30 @@ class EditorWindow : public Window, protected EventHandler
 	Button* searchNextButton;
 	Button* searchCloseButton;
 
+	MenuWindow* featureMenu;
+
+
+	/**
+	 * Set the title to the base name of the file, and tell the user about
+	 * an unusual format and the features turned off for a large file
+	 *
+	 * @param file the file name
+	 */
+	void FileOpened(const char* file);
+
+	/**
+	 * Open the menu that turns the features of the document on and off
+	 */
+	void OpenFeatureMenu(void);
+
+	/**
+	 * Turn a feature of the document on or off, opening the file again if
+	 * it is to be switched between the pager and the editor
+	 *
+	 * @param feature the feature
+	 */
+	void ToggleFeature(DocumentFeature feature);
+
 
 protected:
 	
@@ -95,6 +121,13 @@ protected:
 	 */
 	virtual void OnValueChanged(Component* sender);
 
+	/**
+	 * An event handler for exiting a window menu
+	 *
+	 * @param code the menu exit code
+	 */
+	virtual void OnWindowMenu(int code);
+
 
 
 public:
@@ -114,6 +147,15 @@ public:
 	 */
 	virtual ~EditorWindow(void);
 
+	/**
+	 * Open a file, either by loading it, or in the pager if it is too large
+	 * according to the FeaturePolicy
+	 *
+	 * @param file the file name
+	 * @param a ReturnExt
+	 */
+	ReturnExt Open(const char* file);
+
 	/**
 	 * Load from file, and set the associated document file name
 	 *
@@ -121,6 +163,33 @@ public:
 	 * @param a ReturnExt
 	 */
 	ReturnExt LoadFromFile(const char* file);
+
+	/**
+	 * Open a file read-only in the pager, which pages in the lines on demand
+	 * instead of loading the whole file to the memory
+	 *
+	 * @param file the file name
+	 * @param a ReturnExt
+	 */
+	ReturnExt OpenPager(const char* file);
+
+	/**
+	 * Read the document from a stream in the background, showing the lines
+	 * as they arrive
+	 *
+	 * @param fd the file descriptor, which will be closed when done
+	 * @param name the name of the stream, which is used as the title
+	 * @param a ReturnExt
+	 */
+	ReturnExt LoadFromStream(int fd, const char* name);
+
+	/**
+	 * Load a file, and then keep appending the lines that are written to it
+	 *
+	 * @param file the file name
+	 * @param a ReturnExt
+	 */
+	ReturnExt Follow(const char* file);
 	
 	/**
 	 * Paint the contents of the window
@@ -0,0 +1,188 @@
+/*
+ * FeaturePolicy.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "FeaturePolicy.h"
+
+
+/**
+ * The file sizes above which the features are turned off
+ */
+uint64_t FeaturePolicy::thresholds[DOCUMENT_FEATURE_COUNT] =
+{
+	APE_LARGE_FILE_SYNTAX,
+	APE_LARGE_FILE_MATCHES,
+	APE_LARGE_FILE_WIDTHS,
+	APE_LARGE_FILE_UNDO,
+	APE_LARGE_FILE_FULL_LOAD,
+};
+
+
+/**
+ * The names and the titles of the features
+ */
+static const struct {
+	const char* name;
+	const char* title;
+} FEATURE_NAMES[DOCUMENT_FEATURE_COUNT] =
+{
+	{"syntax"       , "Syntax highlighting"},
+	{"matches"      , "Match highlighting"},
+	{"widths"       , "Exact line widths"},
+	{"undo"         , "Full undo history"},
+	{"pager"        , "Whole file in memory"},
+};
+
+
+/**
+ * Get the features of a document loaded from a file of the given size
+ *
+ * @param size the file size in bytes
+ * @return the set of features
+ */
+unsigned FeaturePolicy::Features(uint64_t size)
+{
+	unsigned features = DOCUMENT_FEATURES_ALL;
+
+	for (int f = 0; f < DOCUMENT_FEATURE_COUNT; f++) {
+		if (size > thresholds[f]) features &= ~DOCUMENT_FEATURE_BIT(f);
+	}
+
+	return features;
+}
+
+
+/**
+ * Set the thresholds from a list such as "syntax=64,pager=none", with
+ * the sizes in megabytes
+ *
+ * @param spec the list
+ * @return true on success, false if it is not valid
+ */
+bool FeaturePolicy::Configure(const char* spec)
+{
+	uint64_t t[DOCUMENT_FEATURE_COUNT];
+	memcpy(t, thresholds, sizeof(t));
+
+	for (const char* p = spec; *p != '\0'; ) {
+
+		const char* end = strchr(p, ',');
+		if (end == NULL) end = p + strlen(p);
+
+		const char* eq = (const char*) memchr(p, '=', end - p);
+		if (eq == NULL) return false;
+
+
+		// Find the feature
+
+		int f = 0;
+		for (; f < DOCUMENT_FEATURE_COUNT; f++) {
+			const char* name = FEATURE_NAMES[f].name;
+			if (strlen(name) == (size_t) (eq - p)
+					&& strncmp(p, name, eq - p) == 0) break;
+		}
+		if (f >= DOCUMENT_FEATURE_COUNT) return false;
+
+
+		// Parse the size
+
+		std::string value(eq + 1, end - eq - 1);
+		if (value == "none") {
+			t[f] = UINT64_MAX;
+		}
+		else {
+			char* e;
+			unsigned long long mb = strtoull(value.c_str(), &e, 10);
+			if (value.empty() || *e != '\0' || mb >= UINT64_MAX >> 20) {
+				return false;
+			}
+			t[f] = mb << 20;
+		}
+
+		p = *end == ',' ? end + 1 : end;
+	}
+
+	memcpy(thresholds, t, sizeof(t));
+	return true;
+}
+
+
+/**
+ * Get the short name of a feature, which is used on the command line
+ *
+ * @param feature the feature
+ * @return the name
+ */
+const char* FeaturePolicy::Name(DocumentFeature feature)
+{
+	return FEATURE_NAMES[feature].name;
+}
+
+
+/**
+ * Get the title of a feature for the user interface
+ *
+ * @param feature the feature
+ * @return the title
+ */
+const char* FeaturePolicy::Title(DocumentFeature feature)
+{
+	return FEATURE_NAMES[feature].title;
+}
+
+
+/**
+ * Describe which features are turned off
+ *
+ * @param features the set of features
+ * @return the description, or an empty string if none are off
+ */
+std::string FeaturePolicy::Description(unsigned features)
+{
+	std::string s;
+
+	for (int f = 0; f < DOCUMENT_FEATURE_COUNT; f++) {
+		if ((features & DOCUMENT_FEATURE_BIT(f)) != 0) continue;
+
+		s += s.empty() ? "large file mode (off: " : ", ";
+
+		std::string title = FEATURE_NAMES[f].title;
+		title[0] = tolower(title[0]);
+		s += title;
+	}
+
+	if (!s.empty()) s += ")";
+	return s;
+}
@@ -0,0 +1,158 @@
+/*
+ * FeaturePolicy.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __FEATURE_POLICY_H
+#define __FEATURE_POLICY_H
+
+#include <stdint.h>
+#include <string>
+
+
+/**
+ * The default file sizes above which the features are turned off
+ */
+#define APE_LARGE_FILE_SYNTAX		(16ull * 1024 * 1024)
+#define APE_LARGE_FILE_MATCHES		(64ull * 1024 * 1024)
+#define APE_LARGE_FILE_WIDTHS		(256ull * 1024 * 1024)
+#define APE_LARGE_FILE_UNDO			(256ull * 1024 * 1024)
+#define APE_LARGE_FILE_FULL_LOAD	(1024ull * 1024 * 1024)
+
+/**
+ * The number of undo steps kept without the full undo history
+ */
+#define APE_LIMITED_UNDO_DEPTH		64
+
+
+/**
+ * The features of a document whose cost grows with its size, so that they
+ * can be turned off for large files
+ */
+enum DocumentFeature
+{
+	DOCUMENT_FEATURE_SYNTAX,		// Syntax highlighting
+	DOCUMENT_FEATURE_MATCHES,		// Highlighting the matches of the search
+	DOCUMENT_FEATURE_WIDTHS,		// Exact maximum line width after edits
+	DOCUMENT_FEATURE_UNDO,			// Unlimited undo history
+	DOCUMENT_FEATURE_FULL_LOAD,		// The whole file in memory, not the pager
+	DOCUMENT_FEATURE_COUNT
+};
+
+/**
+ * The bit of a feature in a set of features
+ */
+#define DOCUMENT_FEATURE_BIT(f)		(1u << (f))
+
+/**
+ * All features
+ */
+#define DOCUMENT_FEATURES_ALL		((1u << DOCUMENT_FEATURE_COUNT) - 1)
+
+
+/**
+ * The policy that picks the features of a document by the size of its file
+ *
+ * @author Peter Macko
+ */
+class FeaturePolicy
+{
+	static uint64_t thresholds[DOCUMENT_FEATURE_COUNT];
+
+
+public:
+
+	/**
+	 * Get the features of a document loaded from a file of the given size
+	 *
+	 * @param size the file size in bytes
+	 * @return the set of features
+	 */
+	static unsigned Features(uint64_t size);
+
+	/**
+	 * Get the file size above which a feature is turned off
+	 *
+	 * @param feature the feature
+	 * @return the size in bytes, or UINT64_MAX if it is never turned off
+	 */
+	static uint64_t Threshold(DocumentFeature feature)
+	{
+		return thresholds[feature];
+	}
+
+	/**
+	 * Set the file size above which a feature is turned off
+	 *
+	 * @param feature the feature
+	 * @param size the size in bytes, or UINT64_MAX to never turn it off
+	 */
+	static void SetThreshold(DocumentFeature feature, uint64_t size)
+	{
+		thresholds[feature] = size;
+	}
+
+	/**
+	 * Set the thresholds from a list such as "syntax=64,pager=none", with
+	 * the sizes in megabytes
+	 *
+	 * @param spec the list
+	 * @return true on success, false if it is not valid
+	 */
+	static bool Configure(const char* spec);
+
+	/**
+	 * Get the short name of a feature, which is used on the command line
+	 *
+	 * @param feature the feature
+	 * @return the name
+	 */
+	static const char* Name(DocumentFeature feature);
+
+	/**
+	 * Get the title of a feature for the user interface
+	 *
+	 * @param feature the feature
+	 * @return the title
+	 */
+	static const char* Title(DocumentFeature feature);
+
+	/**
+	 * Describe which features are turned off
+	 *
+	 * @param features the set of features
+	 * @return the description, or an empty string if none are off
+	 */
+	static std::string Description(unsigned features);
+};
+
+#endif
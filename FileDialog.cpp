@@ -74,26 +74,18 @@ FileDialog::~FileDialog(void)
 
 
 /**
- * Display and run the dialog window
+ * Display and run the dialog window. This returns immediately, and the
+ * handler is called from the main event loop once the dialog is closed.
  *
- * @return true on okay, false on cancel
+ * @param handler the handler that receives true on okay, false on cancel
  */
-bool FileDialog::Run(void)
+void FileDialog::Run(const std::function<void(bool)>& handler)
 {
 	returnValue = false;
-	wm.Add(this);
 
-	// TODO What if we have two dialogs at the same time??? I really need to
-	// handle this differently -- either have at most one outstanding Run(),
-	// I need to go multi-threaded, or I need to use continuations. That's a
-	// lot of work.
-
-	while (Mode() != WM_CLOSED) {
-		usleep(20 * 1000);
-		wm.ProcessMessages();
-	}
-
-	return returnValue;
+	Show([this, handler]() {
+		if (handler) handler(returnValue);
+	});
 }
 
 
@@ -85,11 +85,12 @@ public:
 	virtual ~FileDialog(void);
 
 	/**
-	 * Display and run the dialog window
+	 * Display and run the dialog window. This returns immediately, and the
+	 * handler is called from the main event loop once the dialog is closed.
 	 *
-	 * @return true on okay, false on cancel
+	 * @param handler the handler that receives true on okay, false on cancel
 	 */
-	bool Run(void);
+	void Run(const std::function<void(bool)>& handler);
 
 	/**
 	 * Get the path under the cursor
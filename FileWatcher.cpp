@@ -0,0 +1,361 @@
+/*
+ * FileWatcher.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stdafx.h"
+#include "FileWatcher.h"
+
+#include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <system_error>
+#include <unistd.h>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#endif
+
+#include "Manager.h"
+
+FileWatcher fileWatcher;
+
+
+/**
+ * Fill in a stamp from the file status
+ *
+ * @param stamp the stamp
+ * @param st the file status
+ */
+static void SetStamp(FileStamp& stamp, const struct stat& st)
+{
+	stamp.device = st.st_dev;
+	stamp.inode = st.st_ino;
+	stamp.size = st.st_size;
+
+#if defined(_MAC)
+	stamp.mtime = st.st_mtimespec.tv_sec * 1000000000ull
+		+ st.st_mtimespec.tv_nsec;
+#else
+	stamp.mtime = st.st_mtim.tv_sec * 1000000000ull + st.st_mtim.tv_nsec;
+#endif
+}
+
+
+/**
+ * Create an empty stamp, which does not match any file
+ */
+FileStamp::FileStamp(void)
+{
+	device = 0;
+	inode = 0;
+	size = 0;
+	mtime = 0;
+}
+
+
+/**
+ * Read the stamp of a file
+ *
+ * @param file the file name
+ * @return true on success, false on error (with errno set)
+ */
+bool FileStamp::Read(const char* file)
+{
+	struct stat st;
+	if (stat(file, &st) != 0) return false;
+
+	SetStamp(*this, st);
+	return true;
+}
+
+
+/**
+ * Read the stamp of an open file
+ *
+ * @param fd the file descriptor
+ * @return true on success, false on error (with errno set)
+ */
+bool FileStamp::Read(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0) return false;
+
+	SetStamp(*this, st);
+	return true;
+}
+
+
+/**
+ * Create an instance of class FileWatcher. The watcher thread does not
+ * start until the first file is added.
+ */
+FileWatcher::FileWatcher(void)
+{
+	nextId = 0;
+	inotifyFd = -1;
+	stop = false;
+	started = false;
+}
+
+
+/**
+ * Destroy the object, stopping the watcher thread
+ */
+FileWatcher::~FileWatcher(void)
+{
+	stop = true;
+	if (thread.joinable()) thread.join();
+
+	if (inotifyFd >= 0) close(inotifyFd);
+}
+
+
+/**
+ * Start watching a file
+ *
+ * @param file the file name
+ * @param handler the function to call on the main thread after the file
+ *                changes
+ * @return the watch ID, or -1 on error
+ */
+int FileWatcher::Add(const char* file, const std::function<void(void)>& handler)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+
+	// Start the watcher thread on the first use
+
+	if (!started) {
+		started = true;
+
+#if defined(__linux__)
+		inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+#endif
+
+		try {
+			thread = std::thread(&FileWatcher::Run, this);
+		}
+		catch (std::system_error&) {
+			return -1;
+		}
+	}
+	if (!thread.joinable()) return -1;
+
+
+	// Watch the directory, since the file itself can be replaced
+
+	Watch w;
+	w.path = file;
+	w.directory = -1;
+	w.handler = handler;
+	w.stamp.Read(file);
+
+	char* s = strdup(file);
+	w.name = basename(s);
+	free(s);
+
+#if defined(__linux__)
+	if (inotifyFd >= 0) {
+		s = strdup(file);
+		w.directory = inotify_add_watch(inotifyFd, dirname(s),
+				IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+		free(s);
+		if (w.directory >= 0) directories[w.directory]++;
+	}
+#endif
+
+	int id = nextId++;
+	watches[id] = w;
+
+	return id;
+}
+
+
+/**
+ * Stop watching a file. The handler is not called after this returns
+ * if this is called from the main thread.
+ *
+ * @param id the watch ID returned by Add(), or -1 for none
+ */
+void FileWatcher::Remove(int id)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::map<int, Watch>::iterator it = watches.find(id);
+	if (it == watches.end()) return;
+
+	int d = it->second.directory;
+	watches.erase(it);
+
+	if (d >= 0 && --directories[d] == 0) {
+		directories.erase(d);
+#if defined(__linux__)
+		inotify_rm_watch(inotifyFd, d);
+#endif
+	}
+}
+
+
+/**
+ * The main function of the watcher thread
+ */
+void FileWatcher::Run(void)
+{
+	double lastPoll = Time();
+
+	while (!stop) {
+
+
+		// Wait for the inotify events, waking up periodically to check
+		// whether to stop
+
+		if (inotifyFd >= 0) {
+			struct pollfd p;
+			p.fd = inotifyFd;
+			p.events = POLLIN;
+			p.revents = 0;
+
+			if (poll(&p, 1, 100) > 0) ReadEvents();
+		}
+		else {
+			usleep(100 * 1000);
+		}
+
+
+		// Check the other files periodically: all of them if inotify is not
+		// available, or those whose directories could not be watched, such
+		// as after reaching the limit on the number of watches
+
+		if (Time() - lastPoll >= APE_FILE_WATCHER_POLL_INTERVAL) {
+			PollFiles();
+			lastPoll = Time();
+		}
+	}
+}
+
+
+/**
+ * Read and dispatch the pending inotify events
+ */
+void FileWatcher::ReadEvents(void)
+{
+#if defined(__linux__)
+	char buffer[16 * 1024]
+		__attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+	ssize_t n;
+	while ((n = read(inotifyFd, buffer, sizeof(buffer))) > 0) {
+		std::vector<int> changed;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			for (char* p = buffer; p < buffer + n; ) {
+				struct inotify_event* e = (struct inotify_event*) p;
+				p += sizeof(struct inotify_event) + e->len;
+
+
+				// If events were lost, let all handlers check their files
+
+				bool overflow = (e->mask & IN_Q_OVERFLOW) != 0;
+				if (!overflow && e->len == 0) continue;
+
+				for (std::map<int, Watch>::iterator it = watches.begin();
+						it != watches.end(); it++) {
+					if (overflow || (it->second.directory == e->wd
+								&& it->second.name == e->name)) {
+						changed.push_back(it->first);
+					}
+				}
+			}
+		}
+
+		for (size_t i = 0; i < changed.size(); i++) Dispatch(changed[i]);
+	}
+#endif
+}
+
+
+/**
+ * Check the stamps of the watched files whose directories are not watched
+ * by inotify, and dispatch the changes
+ */
+void FileWatcher::PollFiles(void)
+{
+	std::vector<int> changed;
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		for (std::map<int, Watch>::iterator it = watches.begin();
+				it != watches.end(); it++) {
+			if (it->second.directory >= 0) continue;
+
+			FileStamp s;
+			if (!s.Read(it->second.path.c_str())) continue;
+
+			if (s != it->second.stamp) {
+				it->second.stamp = s;
+				changed.push_back(it->first);
+			}
+		}
+	}
+
+	for (size_t i = 0; i < changed.size(); i++) Dispatch(changed[i]);
+}
+
+
+/**
+ * Ask the main thread to call the handler of a watch, unless it gets
+ * removed in the meantime
+ *
+ * @param id the watch ID
+ */
+void FileWatcher::Dispatch(int id)
+{
+	wm.Post([this, id]() {
+		std::function<void(void)> handler;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			std::map<int, Watch>::iterator it = watches.find(id);
+			if (it == watches.end()) return;
+			handler = it->second.handler;
+		}
+
+		handler();
+	});
+}
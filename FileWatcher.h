@@ -0,0 +1,204 @@
+/*
+ * FileWatcher.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __FILE_WATCHER_H
+#define __FILE_WATCHER_H
+
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+
+
+/**
+ * How often to check the watched files if inotify is not available
+ */
+#define APE_FILE_WATCHER_POLL_INTERVAL	1.0	/* seconds */
+
+
+/**
+ * The identity and the version of a file on disk, which is used to tell
+ * whether the file changed since it was last read or written
+ */
+struct FileStamp
+{
+	uint64_t device;
+	uint64_t inode;
+	uint64_t size;
+	uint64_t mtime;		// In nanoseconds
+
+
+	/**
+	 * Create an empty stamp, which does not match any file
+	 */
+	FileStamp(void);
+
+	/**
+	 * Read the stamp of a file
+	 *
+	 * @param file the file name
+	 * @return true on success, false on error (with errno set)
+	 */
+	bool Read(const char* file);
+
+	/**
+	 * Read the stamp of an open file
+	 *
+	 * @param fd the file descriptor
+	 * @return true on success, false on error (with errno set)
+	 */
+	bool Read(int fd);
+
+	/**
+	 * Compare two stamps
+	 *
+	 * @param other the other stamp
+	 * @return true if they are the same
+	 */
+	inline bool operator==(const FileStamp& other) const
+	{
+		return device == other.device && inode == other.inode
+			&& size == other.size && mtime == other.mtime;
+	}
+
+	/**
+	 * Compare two stamps
+	 *
+	 * @param other the other stamp
+	 * @return true if they differ
+	 */
+	inline bool operator!=(const FileStamp& other) const
+	{
+		return !(*this == other);
+	}
+};
+
+
+/**
+ * A watcher of files that calls a handler on the main thread after a file
+ * is written or replaced. It uses a single inotify instance that watches
+ * the directories of the files, so that a file replaced by a rename, as
+ * most editors and tools save, is still recognized. Without inotify, it
+ * checks the stamps of the files periodically instead.
+ *
+ * @author Peter Macko
+ */
+class FileWatcher
+{
+	/**
+	 * A watched file
+	 */
+	struct Watch
+	{
+		std::string path;
+		std::string name;
+		int directory;		// The inotify watch descriptor, or -1
+		FileStamp stamp;	// The last known stamp when polling
+		std::function<void(void)> handler;
+	};
+
+	std::mutex mutex;
+	std::map<int, Watch> watches;
+	std::map<int, int> directories;		// Watch descriptor -> reference count
+	int nextId;
+
+	int inotifyFd;
+	std::thread thread;
+	std::atomic<bool> stop;
+	bool started;
+
+
+	/**
+	 * The main function of the watcher thread
+	 */
+	void Run(void);
+
+	/**
+	 * Read and dispatch the pending inotify events
+	 */
+	void ReadEvents(void);
+
+	/**
+	 * Check the stamps of the watched files whose directories are not
+	 * watched by inotify, and dispatch the changes
+	 */
+	void PollFiles(void);
+
+	/**
+	 * Ask the main thread to call the handler of a watch, unless it gets
+	 * removed in the meantime
+	 *
+	 * @param id the watch ID
+	 */
+	void Dispatch(int id);
+
+
+public:
+
+	/**
+	 * Create an instance of class FileWatcher. The watcher thread does not
+	 * start until the first file is added.
+	 */
+	FileWatcher(void);
+
+	/**
+	 * Destroy the object, stopping the watcher thread
+	 */
+	virtual ~FileWatcher(void);
+
+	/**
+	 * Start watching a file
+	 *
+	 * @param file the file name
+	 * @param handler the function to call on the main thread after the file
+	 *                changes
+	 * @return the watch ID, or -1 on error
+	 */
+	int Add(const char* file, const std::function<void(void)>& handler);
+
+	/**
+	 * Stop watching a file. The handler is not called after this returns
+	 * if this is called from the main thread.
+	 *
+	 * @param id the watch ID returned by Add(), or -1 for none
+	 */
+	void Remove(int id);
+};
+
+extern FileWatcher fileWatcher;
+
+#endif
@@ -0,0 +1,476 @@
+/*
+ * HeadlessBackend.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "HeadlessBackend.h"
+#include "UTF8.h"
+
+
+/**
+ * Create an instance of class HeadlessBackend
+ *
+ * @param rows the number of rows of the screen
+ * @param cols the number of columns of the screen
+ */
+HeadlessBackend::HeadlessBackend(int rows, int cols)
+{
+	this->rows = rows;
+	this->cols = cols;
+
+	bzero(&lastMouse, sizeof(lastMouse));
+	yield = false;
+
+	frame = NULL;
+	framesOutput = 0;
+	eventsProcessed = 0;
+	failures = 0;
+}
+
+
+/**
+ * Destroy the object
+ */
+HeadlessBackend::~HeadlessBackend(void)
+{
+	if (frame != NULL) delete frame;
+}
+
+
+/**
+ * Initialize the backend
+ *
+ * @param rows where to store the number of rows of the screen
+ * @param cols where to store the number of columns of the screen
+ */
+void HeadlessBackend::Initialize(int& rows, int& cols)
+{
+	rows = this->rows;
+	cols = this->cols;
+
+
+	// The line drawing characters are normally set up by curses from the
+	// terminal description, so without a terminal, map them to themselves
+	// in the alternate character set, which is what VT100 and its
+	// descendants use
+
+	for (int i = 0; i < 128; i++) {
+		if (acs_map[i] == 0) acs_map[i] = A_ALTCHARSET | i;
+	}
+}
+
+
+/**
+ * Shutdown the backend
+ */
+void HeadlessBackend::Shutdown(void)
+{
+}
+
+
+/**
+ * Process the inspection events at the front of the queue
+ *
+ * @return false if the script is waiting for the background work
+ */
+bool HeadlessBackend::ProcessInspections(void)
+{
+	while (!events.empty()) {
+		Event& e = events.front();
+
+		if (e.type == HET_Expect) {
+			std::string s = Text(e.row);
+			if (e.column > (int) s.length()
+					|| s.compare(e.column, e.text.length(), e.text) != 0) {
+				fprintf(stderr, "Expected \"%s\" at %d:%d, but found:\n%s\n",
+						e.text.c_str(), e.row, e.column, s.c_str());
+				failures++;
+			}
+		}
+		else if (e.type == HET_Dump) {
+			Dump(stdout);
+		}
+		else if (e.type == HET_Wait) {
+			if (idle && !idle()) return false;
+
+
+			// Let the main loop process the messages posted by the finished
+			// work before inspecting the screen again
+
+			events.pop_front();
+			yield = true;
+			return false;
+		}
+		else {
+			break;
+		}
+
+		events.pop_front();
+	}
+
+	return true;
+}
+
+
+/**
+ * Read the next key, if available. Only one event is returned per event
+ * loop iteration, so that each event results in its own frame.
+ *
+ * @return the key code, KEY_MOUSE for a mouse event, KEY_RESIZE if the
+ *         screen was resized, or ERR if there are no more events
+ */
+int HeadlessBackend::ReadKey(void)
+{
+	// Wait for the initial frame, and then return only one event per event
+	// loop iteration
+
+	if (yield || frame == NULL) {
+		yield = false;
+		return ERR;
+	}
+
+
+	// Inspect the frame that resulted from the previous events
+
+	if (!ProcessInspections()) return ERR;
+
+	if (events.empty()) {
+		if (onFinish) onFinish();
+		return ERR;
+	}
+
+
+	// Get the next input event
+
+	Event e = events.front();
+	events.pop_front();
+
+	eventsProcessed++;
+	yield = true;
+
+	switch (e.type) {
+
+		case HET_Mouse:
+			lastMouse = e.mouse;
+			return KEY_MOUSE;
+
+		case HET_Paste:
+			lastPaste = e.text;
+			return KEY_PASTE;
+
+		case HET_Resize:
+			rows = e.row;
+			cols = e.column;
+			return KEY_RESIZE;
+
+		default:
+			return e.key;
+	}
+}
+
+
+/**
+ * Read the mouse event after ReadKey() returned KEY_MOUSE
+ *
+ * @param event where to store the mouse event
+ * @return true on success
+ */
+bool HeadlessBackend::ReadMouse(MEVENT& event)
+{
+	event = lastMouse;
+	return true;
+}
+
+
+/**
+ * Read the pasted text after ReadKey() returned KEY_PASTE
+ *
+ * @param text where to store the text
+ * @return true on success
+ */
+bool HeadlessBackend::ReadPaste(std::string& text)
+{
+	text = lastPaste;
+	return true;
+}
+
+
+/**
+ * Discard all pending input
+ */
+void HeadlessBackend::DiscardInput(void)
+{
+	// Nothing to do: The scripted events are never stray input
+}
+
+
+/**
+ * Get the current size of the screen
+ *
+ * @param rows where to store the number of rows
+ * @param cols where to store the number of columns
+ * @return true if the size is known
+ */
+bool HeadlessBackend::QuerySize(int& rows, int& cols)
+{
+	rows = this->rows;
+	cols = this->cols;
+	return true;
+}
+
+
+/**
+ * Resize the screen
+ *
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+void HeadlessBackend::Resize(int rows, int cols)
+{
+	this->rows = rows;
+	this->cols = cols;
+}
+
+
+/**
+ * Output a frame
+ *
+ * @param frame the frame
+ */
+void HeadlessBackend::Output(const Frame* frame)
+{
+	if (this->frame != NULL) delete this->frame;
+
+	this->frame = new Frame(frame->screen);
+	this->frame->cursorRow = frame->cursorRow;
+	this->frame->cursorColumn = frame->cursorColumn;
+	this->frame->showCursor = frame->showCursor;
+	this->frame->time = frame->time;
+
+	framesOutput++;
+}
+
+
+/**
+ * Queue a key press
+ *
+ * @param key the key code
+ */
+void HeadlessBackend::PushKey(int key)
+{
+	Event e;
+	e.type = HET_Key;
+	e.key = key;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue typing a string
+ *
+ * @param text the text
+ */
+void HeadlessBackend::PushText(const char* text)
+{
+	for (const char* p = text; *p != '\0'; p++) {
+		PushKey(*p == '\n' ? KEY_RETURN : (unsigned char) *p);
+	}
+}
+
+
+/**
+ * Queue pasting a string into the terminal
+ *
+ * @param text the text
+ */
+void HeadlessBackend::PushPaste(const char* text)
+{
+	Event e;
+	e.type = HET_Paste;
+	e.key = KEY_PASTE;
+	e.text = text;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue a mouse event
+ *
+ * @param row the screen row
+ * @param column the screen column
+ * @param state the curses button state
+ */
+void HeadlessBackend::PushMouse(int row, int column, mmask_t state)
+{
+	Event e;
+	e.type = HET_Mouse;
+	e.key = KEY_MOUSE;
+	bzero(&e.mouse, sizeof(e.mouse));
+	e.mouse.y = row;
+	e.mouse.x = column;
+	e.mouse.bstate = state;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue resizing the screen
+ *
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+void HeadlessBackend::PushResize(int rows, int cols)
+{
+	Event e;
+	e.type = HET_Resize;
+	e.key = KEY_RESIZE;
+	e.row = rows;
+	e.column = cols;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue a check that the screen contains the given text at the given
+ * position at this point of the script
+ *
+ * @param row the row
+ * @param column the column
+ * @param text the expected text
+ */
+void HeadlessBackend::PushExpect(int row, int column, const char* text)
+{
+	Event e;
+	e.type = HET_Expect;
+	e.row = row;
+	e.column = column;
+	e.text = text;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue printing the screen at this point of the script
+ */
+void HeadlessBackend::PushDump(void)
+{
+	Event e;
+	e.type = HET_Dump;
+	events.push_back(e);
+}
+
+
+/**
+ * Queue waiting until the background work is done at this point of
+ * the script
+ */
+void HeadlessBackend::PushWait(void)
+{
+	Event e;
+	e.type = HET_Wait;
+	events.push_back(e);
+}
+
+
+/**
+ * Get the text of a row of the most recently output frame, with the line
+ * drawing characters replaced by their ASCII approximations
+ *
+ * @param row the row
+ * @return the text
+ */
+std::string HeadlessBackend::Text(int row)
+{
+	std::string s;
+	if (frame == NULL) return s;
+
+	const TerminalControlWindow* screen = frame->screen;
+	for (int c = 0; c < screen->Columns(); c++) {
+		int ch = screen->CharacterAt(row, c);
+		char x = ch & 0xff;
+
+		uint32_t combining;
+		uint32_t cp = screen->CodePointAt(row, c, &combining);
+
+		if (cp == TCW_CONTINUATION) {
+			if (c == 0 || CodePointWidth(screen->CodePointAt(row, c - 1)) != 2) {
+				s += ' ';
+			}
+			continue;
+		}
+
+		if ((cp >= 0x80 || combining != 0) && (ch & A_ALTCHARSET) == 0) {
+			AppendUTF8(s, cp);
+			if (combining != 0) AppendUTF8(s, combining);
+			continue;
+		}
+
+		if ((ch & A_ALTCHARSET) != 0) {
+			switch (x) {
+				case 'q': x = '-'; break;
+				case 'x': x = '|'; break;
+				case 'j': case 'k': case 'l': case 'm': case 'n':
+				case 't': case 'u': case 'v': case 'w': x = '+'; break;
+				case '+': x = '>'; break;
+				case ',': x = '<'; break;
+				case '-': x = '^'; break;
+				case '.': x = 'v'; break;
+				default : x = '#'; break;
+			}
+		}
+		else if (iscntrl(x)) {
+			x = '?';
+		}
+
+		s += x;
+	}
+
+	return s;
+}
+
+
+/**
+ * Print the most recently output frame
+ *
+ * @param f the output file
+ */
+void HeadlessBackend::Dump(FILE* f)
+{
+	if (frame == NULL) return;
+
+	for (int r = 0; r < frame->screen->Rows(); r++) {
+		fprintf(f, "%s\n", Text(r).c_str());
+	}
+}
+
@@ -0,0 +1,333 @@
+/*
+ * HeadlessBackend.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __HEADLESS_BACKEND_H
+#define __HEADLESS_BACKEND_H
+
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "TerminalBackend.h"
+
+
+/**
+ * The type of a scripted event
+ */
+typedef enum {
+	HET_Key,
+	HET_Mouse,
+	HET_Paste,
+	HET_Resize,
+	HET_Expect,
+	HET_Dump,
+	HET_Wait
+} HeadlessEventType;
+
+
+/**
+ * The terminal backend that keeps the composed frames in memory and reads
+ * the input from a scripted event queue, so that the window system can run
+ * without a terminal, for example in benchmarks
+ *
+ * @author Peter Macko
+ */
+class HeadlessBackend : public TerminalBackend
+{
+	/**
+	 * A scripted event
+	 */
+	struct Event
+	{
+		HeadlessEventType type;
+		int key;
+		MEVENT mouse;
+		int row;
+		int column;
+		std::string text;
+
+		/**
+		 * Create an empty event
+		 */
+		Event(void)
+		{
+			type = HET_Key;
+			key = ERR;
+			bzero(&mouse, sizeof(mouse));
+			row = 0;
+			column = 0;
+		}
+	};
+
+
+	int rows, cols;
+
+	std::deque<Event> events;
+	MEVENT lastMouse;
+	std::string lastPaste;
+	bool yield;
+	std::function<void(void)> onFinish;
+	std::function<bool(void)> idle;
+
+	Frame* frame;
+	unsigned long framesOutput;
+	unsigned long eventsProcessed;
+	unsigned long failures;
+
+
+	/**
+	 * Process the inspection events at the front of the queue
+	 *
+	 * @return false if the script is waiting for the background work
+	 */
+	bool ProcessInspections(void);
+
+
+public:
+
+	/**
+	 * Create an instance of class HeadlessBackend
+	 *
+	 * @param rows the number of rows of the screen
+	 * @param cols the number of columns of the screen
+	 */
+	HeadlessBackend(int rows = 24, int cols = 80);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~HeadlessBackend(void);
+
+	/**
+	 * Initialize the backend
+	 *
+	 * @param rows where to store the number of rows of the screen
+	 * @param cols where to store the number of columns of the screen
+	 */
+	virtual void Initialize(int& rows, int& cols);
+
+	/**
+	 * Shutdown the backend
+	 */
+	virtual void Shutdown(void);
+
+	/**
+	 * Determine whether the frames should be output from a dedicated render
+	 * thread, so that slow output does not delay processing the input
+	 *
+	 * @return true to use a render thread
+	 */
+	virtual bool RenderInBackground(void) { return false; }
+
+	/**
+	 * Read the next key, if available. Only one event is returned per event
+	 * loop iteration, so that each event results in its own frame.
+	 *
+	 * @return the key code, KEY_MOUSE for a mouse event, KEY_RESIZE if the
+	 *         screen was resized, or ERR if there are no more events
+	 */
+	virtual int ReadKey(void);
+
+	/**
+	 * Read the mouse event after ReadKey() returned KEY_MOUSE
+	 *
+	 * @param event where to store the mouse event
+	 * @return true on success
+	 */
+	virtual bool ReadMouse(MEVENT& event);
+
+	/**
+	 * Read the pasted text after ReadKey() returned KEY_PASTE
+	 *
+	 * @param text where to store the text
+	 * @return true on success
+	 */
+	virtual bool ReadPaste(std::string& text);
+
+	/**
+	 * Discard all pending input
+	 */
+	virtual void DiscardInput(void);
+
+	/**
+	 * Get the current size of the screen
+	 *
+	 * @param rows where to store the number of rows
+	 * @param cols where to store the number of columns
+	 * @return true if the size is known
+	 */
+	virtual bool QuerySize(int& rows, int& cols);
+
+	/**
+	 * Resize the screen
+	 *
+	 * @param rows the number of rows
+	 * @param cols the number of columns
+	 */
+	virtual void Resize(int rows, int cols);
+
+	/**
+	 * Output a frame
+	 *
+	 * @param frame the frame
+	 */
+	virtual void Output(const Frame* frame);
+
+	/**
+	 * Queue a key press
+	 *
+	 * @param key the key code
+	 */
+	void PushKey(int key);
+
+	/**
+	 * Queue typing a string
+	 *
+	 * @param text the text
+	 */
+	void PushText(const char* text);
+
+	/**
+	 * Queue pasting a string into the terminal
+	 *
+	 * @param text the text
+	 */
+	void PushPaste(const char* text);
+
+	/**
+	 * Queue a mouse event
+	 *
+	 * @param row the screen row
+	 * @param column the screen column
+	 * @param state the curses button state
+	 */
+	void PushMouse(int row, int column, mmask_t state);
+
+	/**
+	 * Queue resizing the screen
+	 *
+	 * @param rows the number of rows
+	 * @param cols the number of columns
+	 */
+	void PushResize(int rows, int cols);
+
+	/**
+	 * Queue a check that the screen contains the given text at the given
+	 * position at this point of the script
+	 *
+	 * @param row the row
+	 * @param column the column
+	 * @param text the expected text
+	 */
+	void PushExpect(int row, int column, const char* text);
+
+	/**
+	 * Queue printing the screen at this point of the script
+	 */
+	void PushDump(void);
+
+	/**
+	 * Queue waiting until the background work is done at this point of
+	 * the script
+	 */
+	void PushWait(void);
+
+	/**
+	 * Set the function to call once all scripted events have been processed
+	 *
+	 * @param f the function
+	 */
+	inline void SetOnFinish(const std::function<void(void)>& f) { onFinish = f; }
+
+	/**
+	 * Set the function that checks whether the background work is done
+	 *
+	 * @param f the function
+	 */
+	inline void SetIdleCheck(const std::function<bool(void)>& f) { idle = f; }
+
+	/**
+	 * Get the number of events that are still in the queue
+	 *
+	 * @return the number of pending events
+	 */
+	inline size_t PendingEvents(void) { return events.size(); }
+
+	/**
+	 * Get the number of processed input events
+	 *
+	 * @return the number of events
+	 */
+	inline unsigned long EventsProcessed(void) { return eventsProcessed; }
+
+	/**
+	 * Get the number of output frames
+	 *
+	 * @return the number of frames
+	 */
+	inline unsigned long FramesOutput(void) { return framesOutput; }
+
+	/**
+	 * Get the number of failed checks
+	 *
+	 * @return the number of failures
+	 */
+	inline unsigned long Failures(void) { return failures; }
+
+	/**
+	 * Get the most recently output frame
+	 *
+	 * @return the frame, or NULL if none
+	 */
+	inline const Frame* LastFrame(void) { return frame; }
+
+	/**
+	 * Get the text of a row of the most recently output frame, with the
+	 * line drawing characters replaced by their ASCII approximations
+	 *
+	 * @param row the row
+	 * @return the text
+	 */
+	std::string Text(int row);
+
+	/**
+	 * Print the most recently output frame
+	 *
+	 * @param f the output file
+	 */
+	void Dump(FILE* f);
+};
+
+#endif
@@ -0,0 +1,316 @@
+/*
+ * HexDocument.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "HexDocument.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Document.h"
+
+
+/**
+ * Create an instance of class HexDocument
+ */
+HexDocument::HexDocument(void)
+{
+	fd = -1;
+	fileSize = 0;
+	map = NULL;
+	readOnly = true;
+}
+
+
+/**
+ * Destroy the object
+ */
+HexDocument::~HexDocument(void)
+{
+	if (map != NULL) munmap((void*) map, fileSize);
+	if (fd >= 0) close(fd);
+}
+
+
+/**
+ * Open a file, for writing if possible
+ *
+ * @param file the file name
+ * @return a ReturnExt
+ */
+ReturnExt HexDocument::Open(const char* file)
+{
+	if (fd >= 0) return ReturnExt(false, "A file is already open");
+
+	readOnly = false;
+	fd = open(file, O_RDWR | O_CLOEXEC);
+	if (fd < 0 && (errno == EACCES || errno == EROFS)) {
+		readOnly = true;
+		fd = open(file, O_RDONLY | O_CLOEXEC);
+	}
+	if (fd < 0) {
+		return ReturnExt(false, "Cannot open the file", errno);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		int e = errno;
+		close(fd);
+		fd = -1;
+		return ReturnExt(false, "Only regular files can be edited as binary",
+				e == 0 ? EINVAL : e);
+	}
+
+	fileSize = st.st_size;
+
+
+	// Map the file if possible; otherwise we fall back to pread. The mapping
+	// is shared, so that it reflects the patches after they are saved.
+
+	if (fileSize > 0 && fileSize == (size_t) fileSize) {
+		void* m = mmap(NULL, fileSize, PROT_READ, MAP_SHARED, fd, 0);
+		if (m != MAP_FAILED) map = (const char*) m;
+	}
+
+	fileName = file;
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Save the overwritten bytes to the file in place
+ *
+ * @return a ReturnExt
+ */
+ReturnExt HexDocument::Save(void)
+{
+	if (readOnly) return ReturnExt(false, "The file is read-only", EACCES);
+	if (patches.empty()) return ReturnExt(true);
+
+
+	// The offsets would not mean the same thing if the file was resized
+
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		return ReturnExt(false, "Cannot get the file size", errno);
+	}
+	if ((uint64_t) st.st_size != fileSize) {
+		return ReturnExt(false, "The file was resized on disk", EINVAL);
+	}
+
+
+	// Write each run of consecutive patched bytes at once
+
+	std::vector<unsigned char> run;
+	auto i = patches.begin();
+
+	while (i != patches.end()) {
+		uint64_t start = i->first;
+		run.clear();
+		while (i != patches.end() && i->first == start + run.size()) {
+			run.push_back(i->second);
+			i++;
+		}
+
+		size_t done = 0;
+		while (done < run.size()) {
+			ssize_t n = pwrite(fd, &run[done], run.size() - done, start + done);
+			if (n < 0) {
+				if (errno == EINTR) continue;
+				return ReturnExt(false, "Error while writing", errno);
+			}
+			done += n;
+		}
+	}
+
+
+	// Flush the data according to the durability setting of the editor
+
+	bool ok = true;
+	SaveDurability durability = EditorDocument::Durability();
+
+	if (durability == SAVE_DURABILITY_FULL) {
+		ok = fsync(fd) == 0;
+	}
+	else if (durability == SAVE_DURABILITY_DATA) {
+#if defined(_MAC)
+		ok = fsync(fd) == 0;
+#else
+		ok = fdatasync(fd) == 0;
+#endif
+	}
+
+	if (!ok) return ReturnExt(false, "Error while writing", errno);
+
+	patches.clear();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Read a range of the file as it is on the disk
+ *
+ * @param offset the file offset
+ * @param buffer the buffer
+ * @param length the number of bytes
+ * @return the number of bytes read
+ */
+size_t HexDocument::ReadOriginal(uint64_t offset, unsigned char* buffer,
+		size_t length)
+{
+	if (offset >= fileSize) return 0;
+	if (length > fileSize - offset) length = fileSize - offset;
+
+	size_t done = 0;
+
+
+	// Another process can truncate the file, and reading the mapping past
+	// its new end would raise SIGBUS, so copy only the part that is still
+	// in the file, and read the rest through pread, which then stops at
+	// the end of the file
+
+	if (map != NULL) {
+		struct stat st;
+		if (fstat(fd, &st) == 0 && (uint64_t) st.st_size > offset) {
+			done = std::min<uint64_t>(length, st.st_size - offset);
+			memcpy(buffer, map + offset, done);
+		}
+	}
+
+	while (done < length) {
+		ssize_t n = pread(fd, buffer + done, length - done, offset + done);
+		if (n < 0 && errno == EINTR) continue;
+		if (n <= 0) break;
+		done += n;
+	}
+
+	return done;
+}
+
+
+/**
+ * Read a range of the document, including the overwritten bytes
+ *
+ * @param offset the file offset
+ * @param buffer the buffer
+ * @param length the number of bytes
+ * @return the number of bytes read, which is less than the length only
+ *         at the end of the file or on error
+ */
+size_t HexDocument::Read(uint64_t offset, unsigned char* buffer, size_t length)
+{
+	size_t n = ReadOriginal(offset, buffer, length);
+
+	for (auto i = patches.lower_bound(offset);
+			i != patches.end() && i->first < offset + n; i++) {
+		buffer[i->first - offset] = i->second;
+	}
+
+	return n;
+}
+
+
+/**
+ * Return a byte of the document
+ *
+ * @param offset the file offset, which must be less than the size
+ * @return the byte
+ */
+unsigned char HexDocument::Byte(uint64_t offset)
+{
+	unsigned char c = 0;
+	Read(offset, &c, 1);
+	return c;
+}
+
+
+/**
+ * Set a byte, patching it only if it differs from the file on the disk
+ *
+ * @param offset the file offset
+ * @param value the new value
+ */
+void HexDocument::Patch(uint64_t offset, unsigned char value)
+{
+	unsigned char original = 0;
+	ReadOriginal(offset, &original, 1);
+
+	if (value == original) {
+		patches.erase(offset);
+	}
+	else {
+		patches[offset] = value;
+	}
+}
+
+
+/**
+ * Overwrite a byte
+ *
+ * @param offset the file offset, which must be less than the size
+ * @param value the new value
+ */
+void HexDocument::SetByte(uint64_t offset, unsigned char value)
+{
+	assert(offset < fileSize);
+
+	Edit e;
+	e.offset = offset;
+	e.value = Byte(offset);
+	undo.push_back(e);
+
+	Patch(offset, value);
+}
+
+
+/**
+ * Undo the last overwrite
+ *
+ * @return the offset of the byte, or -1 if there is nothing to undo
+ */
+int64_t HexDocument::Undo(void)
+{
+	if (undo.empty()) return -1;
+
+	Edit e = undo.back();
+	undo.pop_back();
+	Patch(e.offset, e.value);
+
+	return e.offset;
+}
@@ -0,0 +1,204 @@
+/*
+ * HexDocument.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __HEX_DOCUMENT_H
+#define __HEX_DOCUMENT_H
+
+#include <map>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * The number of bytes shown in a row of the hex editor
+ */
+#define APE_HEX_BYTES_PER_ROW		16
+
+
+/**
+ * A binary file that is viewed and edited byte by byte. The file is accessed
+ * through mmap, or through pread if it cannot be mapped, so that opening it
+ * and seeking to any offset take constant time regardless of its size. The
+ * overwritten bytes are kept in a sparse patch map, and saving writes only
+ * them back to the file in place.
+ *
+ * @author Peter Macko
+ */
+class HexDocument
+{
+	/**
+	 * An overwritten byte, for undo
+	 */
+	struct Edit
+	{
+		uint64_t offset;
+		unsigned char value;	// The previous value
+	};
+
+	int fd;
+	uint64_t fileSize;
+	const char* map;
+	std::string fileName;
+	bool readOnly;
+
+	std::map<uint64_t, unsigned char> patches;
+	std::vector<Edit> undo;
+
+
+	/**
+	 * Read a range of the file as it is on the disk
+	 *
+	 * @param offset the file offset
+	 * @param buffer the buffer
+	 * @param length the number of bytes
+	 * @return the number of bytes read
+	 */
+	size_t ReadOriginal(uint64_t offset, unsigned char* buffer, size_t length);
+
+	/**
+	 * Set a byte, patching it only if it differs from the file on the disk
+	 *
+	 * @param offset the file offset
+	 * @param value the new value
+	 */
+	void Patch(uint64_t offset, unsigned char value);
+
+
+public:
+
+	/**
+	 * Create an instance of class HexDocument
+	 */
+	HexDocument(void);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~HexDocument(void);
+
+	/**
+	 * Open a file, for writing if possible
+	 *
+	 * @param file the file name
+	 * @return a ReturnExt
+	 */
+	ReturnExt Open(const char* file);
+
+	/**
+	 * Save the overwritten bytes to the file in place
+	 *
+	 * @return a ReturnExt
+	 */
+	ReturnExt Save(void);
+
+	/**
+	 * Return the file name
+	 *
+	 * @return the file name, or NULL if no file is open
+	 */
+	inline const char* FileName(void) {
+		const char* s = fileName.c_str();
+		return *s == '\0' ? NULL : s;
+	}
+
+	/**
+	 * Return the size of the file
+	 *
+	 * @return the number of bytes
+	 */
+	inline uint64_t Size(void) { return fileSize; }
+
+	/**
+	 * Determine whether the file cannot be written
+	 *
+	 * @return true if it is read-only
+	 */
+	inline bool ReadOnly(void) { return readOnly; }
+
+	/**
+	 * Determine whether there are unsaved changes
+	 *
+	 * @return true if any bytes are overwritten
+	 */
+	inline bool Modified(void) { return !patches.empty(); }
+
+	/**
+	 * Determine whether a byte is overwritten
+	 *
+	 * @param offset the file offset
+	 * @return true if it differs from the file on the disk
+	 */
+	inline bool Patched(uint64_t offset)
+	{
+		return patches.find(offset) != patches.end();
+	}
+
+	/**
+	 * Read a range of the document, including the overwritten bytes
+	 *
+	 * @param offset the file offset
+	 * @param buffer the buffer
+	 * @param length the number of bytes
+	 * @return the number of bytes read, which is less than the length only
+	 *         at the end of the file or on error
+	 */
+	size_t Read(uint64_t offset, unsigned char* buffer, size_t length);
+
+	/**
+	 * Return a byte of the document
+	 *
+	 * @param offset the file offset, which must be less than the size
+	 * @return the byte
+	 */
+	unsigned char Byte(uint64_t offset);
+
+	/**
+	 * Overwrite a byte
+	 *
+	 * @param offset the file offset, which must be less than the size
+	 * @param value the new value
+	 */
+	void SetByte(uint64_t offset, unsigned char value);
+
+	/**
+	 * Undo the last overwrite
+	 *
+	 * @return the offset of the byte, or -1 if there is nothing to undo
+	 */
+	int64_t Undo(void);
+};
+
+#endif
@@ -0,0 +1,560 @@
+/*
+ * HexEditor.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "HexEditor.h"
+
+#include <algorithm>
+
+#include "Container.h"
+#include "Manager.h"
+#include "Window.h"
+
+
+/**
+ * Create an instance of class HexEditor
+ *
+ * @param parent the parent container
+ * @param row the initial row
+ * @param col the initial column
+ * @param rows the number of rows
+ * @param cols the number of columns
+ * @param anchor set the anchor
+ */
+HexEditor::HexEditor(Container* parent, int row, int col, int rows, int cols,
+		int anchor)
+	: Component(parent, true, row, col, rows, cols, anchor)
+{
+	doc = new HexDocument();
+
+	bg = 6;
+	fg = 0;
+
+	wheelSpeed = 3;
+	SetMinSize(2, 10);
+
+	cursor = 0;
+	lowNibble = false;
+	textPane = false;
+	topRow = 0;
+
+	vertScroll = NULL;
+
+	UpdateCursor();
+}
+
+
+/**
+ * Destroy the object
+ */
+HexEditor::~HexEditor(void)
+{
+	if (doc != NULL) delete doc;
+}
+
+
+/**
+ * Open a file
+ *
+ * @param file the file name
+ * @return a ReturnExt
+ */
+ReturnExt HexEditor::Open(const char* file)
+{
+	HexDocument* d = new HexDocument();
+	ReturnExt r = d->Open(file);
+	if (!r) {
+		delete d;
+		return r;
+	}
+
+	delete doc;
+	doc = d;
+
+	cursor = 0;
+	lowNibble = false;
+	topRow = 0;
+
+	if (vertScroll != NULL) vertScroll->SetRange(0, NumRows() - 1);
+
+	Paint();
+	UpdateCursor();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Set the scroll bar
+ *
+ * @param vert the vertical scroll bar
+ */
+void HexEditor::SetScrollBar(ScrollBar* vert)
+{
+	vertScroll = vert;
+
+	if (vertScroll != NULL) {
+		vertScroll->SetRange(0, NumRows() - 1);
+		vertScroll->SetPosition(topRow, Rows());
+	}
+}
+
+
+/**
+ * Return the number of rows in the document
+ *
+ * @return the number of rows, which is at least 1
+ */
+int64_t HexEditor::NumRows(void)
+{
+	int64_t n = (doc->Size() + APE_HEX_BYTES_PER_ROW - 1) / APE_HEX_BYTES_PER_ROW;
+	return n == 0 ? 1 : n;
+}
+
+
+/**
+ * Return the number of hex digits of the offset at the start of a row
+ *
+ * @return the number of digits
+ */
+int HexEditor::AddressDigits(void)
+{
+	return std::max(8, digits((int64_t) doc->Size(), 16));
+}
+
+
+/**
+ * Return the column of a byte within a row
+ *
+ * @param index the index of the byte in the row
+ * @param text whether to return the column of the character instead of
+ *             the hex value
+ * @return the column
+ */
+int HexEditor::ByteColumn(int index, bool text)
+{
+	// The address, two spaces, the hex values in two groups separated by an
+	// extra space, two spaces, and the characters
+
+	int hex = AddressDigits() + 2;
+	if (text) return hex + 3 * APE_HEX_BYTES_PER_ROW + 2 + index;
+
+	return hex + 3 * index + (index >= APE_HEX_BYTES_PER_ROW / 2 ? 1 : 0);
+}
+
+
+/**
+ * Paint a row
+ *
+ * @param row the row number
+ */
+void HexEditor::PaintRow(int64_t row)
+{
+	static const char* HEX = "0123456789abcdef";
+
+	int ncols = Columns();
+	uint64_t start = row * APE_HEX_BYTES_PER_ROW;
+
+	unsigned char data[APE_HEX_BYTES_PER_ROW];
+	int n = (int) doc->Read(start, data, APE_HEX_BYTES_PER_ROW);
+
+
+	// Lay out the row with the colors, and then paint as much of it as fits
+
+	int width = ByteColumn(APE_HEX_BYTES_PER_ROW, true);
+	std::vector<char> chars(width, ' ');
+	std::vector<short> colors(width, (short) (BGColor() * 8 + FGColor()));
+
+	int digits = AddressDigits();
+	for (int i = 0; i < digits; i++) {
+		chars[i] = HEX[(start >> (4 * (digits - 1 - i))) & 0xf];
+		colors[i] = BGColor() * 8 + 4;
+	}
+
+	for (int i = 0; i < n; i++) {
+		unsigned char c = data[i];
+		int h = ByteColumn(i, false);
+		int t = ByteColumn(i, true);
+
+		chars[h] = HEX[c >> 4];
+		chars[h + 1] = HEX[c & 0xf];
+		chars[t] = c >= ' ' && c < 127 ? c : '.';
+
+		int fg = doc->Patched(start + i) ? 1 : FGColor();
+		colors[h] = colors[h + 1] = BGColor() * 8 + fg;
+		colors[t] = BGColor() * 8 + (c >= ' ' && c < 127 ? fg : 4);
+
+
+		// Show the cursor in the pane that does not have the terminal cursor
+
+		if (start + i == cursor) {
+			int other = textPane ? h : t;
+			colors[other] = 7 * 8 + 4;
+			if (textPane) colors[h + 1] = 7 * 8 + 4;
+		}
+	}
+
+	tcw->SetCursor((int) (row - topRow), 0);
+	for (int i = 0; i < ncols; i++) {
+		if (i < width) {
+			tcw->SetColor(colors[i] / 8, colors[i] % 8);
+			tcw->PutChar(chars[i]);
+		}
+		else {
+			tcw->SetColor(BGColor(), FGColor());
+			tcw->PutChar(' ');
+		}
+	}
+}
+
+
+/**
+ * Paint the contents of the component
+ */
+void HexEditor::Paint(void)
+{
+	Clear();
+
+	int64_t nrows = std::min((int64_t) Rows(), NumRows() - topRow);
+	for (int64_t r = 0; r < nrows; r++) {
+		PaintRow(topRow + r);
+	}
+}
+
+
+/**
+ * Update the cursor location and refresh
+ *
+ * @param scroll whether to scroll to make the cursor visible
+ */
+void HexEditor::UpdateCursor(bool scroll)
+{
+	int64_t row = cursor / APE_HEX_BYTES_PER_ROW;
+	int index = cursor % APE_HEX_BYTES_PER_ROW;
+
+
+	// Scroll, if necessary
+
+	if (scroll) {
+		int64_t t = topRow;
+		if (row < topRow) t = row;
+		if (row - topRow >= Rows()) t = row - Rows() + 1;
+		if (t != topRow) {
+			topRow = t;
+			Paint();
+		}
+	}
+
+	if (vertScroll != NULL) {
+		vertScroll->SetPosition(topRow, Rows());
+	}
+
+
+	// Update the screen
+
+	int64_t nr = row - topRow;
+	int nc = textPane ? ByteColumn(index, true)
+		: ByteColumn(index, false) + (lowNibble ? 1 : 0);
+
+	if (nr >= 0 && nr < Rows() && nc < Columns()) {
+		Component::MoveCursor((int) nr, nc);
+	}
+	else {
+		HideCursor();
+	}
+
+	ParentWindow()->Refresh();
+}
+
+
+/**
+ * Move the cursor to a byte
+ *
+ * @param offset the offset of the byte
+ */
+void HexEditor::MoveToByte(int64_t offset)
+{
+	int64_t last = doc->Size() == 0 ? 0 : doc->Size() - 1;
+	if (offset < 0) offset = 0;
+	if (offset > last) offset = last;
+
+	int64_t oldRow = cursor / APE_HEX_BYTES_PER_ROW;
+	cursor = offset;
+	lowNibble = false;
+
+
+	// Repaint the rows with the old and the new cursor, unless we scroll
+
+	int64_t row = cursor / APE_HEX_BYTES_PER_ROW;
+	if (row >= topRow && row < topRow + Rows()) {
+		if (oldRow >= topRow && oldRow < topRow + Rows()) PaintRow(oldRow);
+		PaintRow(row);
+	}
+
+	UpdateCursor();
+}
+
+
+/**
+ * Move the cursor to an offset, which takes constant time
+ *
+ * @param offset the offset, which is limited to the last byte
+ */
+void HexEditor::Seek(uint64_t offset)
+{
+	MoveToByte(offset > (uint64_t) INT64_MAX ? INT64_MAX : (int64_t) offset);
+}
+
+
+/**
+ * Overwrite the byte at the cursor
+ *
+ * @param value the new value
+ * @param advance whether to move to the next byte
+ */
+void HexEditor::Overwrite(unsigned char value, bool advance)
+{
+	doc->SetByte(cursor, value);
+
+	if (advance && cursor + 1 < doc->Size()) {
+		MoveToByte(cursor + 1);
+	}
+	else {
+		PaintRow(cursor / APE_HEX_BYTES_PER_ROW);
+		UpdateCursor();
+	}
+}
+
+
+/**
+ * Handle a key that types into the hex or the text pane
+ *
+ * @param key the key code
+ * @return true if it was handled
+ */
+bool HexEditor::Type(int key)
+{
+	if (key < 0x20 || key > 0x7E) return false;
+
+	if (doc->Size() == 0 || doc->ReadOnly()) {
+		wm.SetStatus(doc->Size() == 0 ? "The file is empty"
+				: "The file is read-only");
+		return true;
+	}
+
+	if (textPane) {
+		Overwrite((unsigned char) key, true);
+		return true;
+	}
+
+
+	// Set one hex digit, moving to the next byte after the low one
+
+	int digit;
+	if (key >= '0' && key <= '9') digit = key - '0';
+	else if (key >= 'a' && key <= 'f') digit = key - 'a' + 10;
+	else if (key >= 'A' && key <= 'F') digit = key - 'A' + 10;
+	else return true;
+
+	unsigned char c = doc->Byte(cursor);
+	if (lowNibble) {
+		Overwrite((c & 0xf0) | digit, true);
+	}
+	else {
+		Overwrite((c & 0x0f) | (digit << 4), false);
+		lowNibble = true;
+		UpdateCursor();
+	}
+
+	return true;
+}
+
+
+/**
+ * An event handler for pressing a key
+ *
+ * @param key the key code
+ */
+void HexEditor::OnKeyPressed(int key)
+{
+	int64_t page = Rows() * (int64_t) APE_HEX_BYTES_PER_ROW;
+	int64_t rowStart = cursor - cursor % APE_HEX_BYTES_PER_ROW;
+
+	if (Type(key)) return;
+
+	switch (key) {
+
+		case '\t':
+			textPane = !textPane;
+			lowNibble = false;
+			PaintRow(cursor / APE_HEX_BYTES_PER_ROW);
+			UpdateCursor();
+			break;
+
+		case KEY_LEFT:
+			if (lowNibble) {
+				lowNibble = false;
+				UpdateCursor();
+			}
+			else {
+				MoveToByte(cursor - 1);
+			}
+			break;
+
+		case KEY_RIGHT:
+			MoveToByte(cursor + 1);
+			break;
+
+		case KEY_UP:
+			if (cursor >= APE_HEX_BYTES_PER_ROW) {
+				MoveToByte(cursor - APE_HEX_BYTES_PER_ROW);
+			}
+			break;
+
+		case KEY_DOWN:
+			if (rowStart + APE_HEX_BYTES_PER_ROW < (int64_t) doc->Size()) {
+				MoveToByte(cursor + APE_HEX_BYTES_PER_ROW);
+			}
+			break;
+
+		case KEY_HOME:
+			MoveToByte(rowStart);
+			break;
+
+		case KEY_END:
+			MoveToByte(rowStart + APE_HEX_BYTES_PER_ROW - 1);
+			break;
+
+		case KEY_PPAGE:
+		case KEY_ALT_UP:
+			if (topRow > 0) {
+				topRow = std::max((int64_t) 0, topRow - Rows());
+				Paint();
+			}
+			MoveToByte(cursor >= (uint64_t) page ? cursor - page
+					: cursor % APE_HEX_BYTES_PER_ROW);
+			break;
+
+		case KEY_NPAGE:
+		case KEY_ALT_DOWN:
+			if (topRow + Rows() < NumRows()) {
+				topRow = std::min(topRow + Rows(), NumRows() - Rows());
+				Paint();
+			}
+			MoveToByte(cursor + page);
+			break;
+
+		case KEY_CTRL('z'):
+			{
+				int64_t offset = doc->Undo();
+				if (offset >= 0) {
+					PaintRow(cursor / APE_HEX_BYTES_PER_ROW);
+					MoveToByte(offset);
+				}
+			}
+			break;
+
+		default:
+			Component::OnKeyPressed(key);
+	}
+}
+
+
+/**
+ * An event handler for mouse press
+ *
+ * @param row the row
+ * @param column the column
+ * @param button the button
+ * @param shift whether shift was pressed
+ */
+void HexEditor::OnMousePress(int row, int column, int button,
+		bool /* shift */)
+{
+	if (button != 0) return;
+
+	for (int i = 0; i < APE_HEX_BYTES_PER_ROW; i++) {
+		int h = ByteColumn(i, false);
+		int t = ByteColumn(i, true);
+		if (column != h && column != h + 1 && column != t) continue;
+
+		int64_t offset = (topRow + row) * APE_HEX_BYTES_PER_ROW + i;
+		textPane = column == t;
+		MoveToByte(offset);
+
+		if (column == h + 1 && cursor == (uint64_t) offset) {
+			lowNibble = true;
+			UpdateCursor();
+		}
+		return;
+	}
+}
+
+
+/**
+ * An event handler for mouse wheel
+ *
+ * @param row the row
+ * @param column the column
+ * @param wheel the wheel direction
+ */
+void HexEditor::OnMouseWheel(int /* row */, int /* column */, int wheel)
+{
+	int64_t t = topRow + (wheel < 0 ? -wheelSpeed : wheelSpeed);
+	t = std::min(t, NumRows() - Rows());
+	t = std::max(t, (int64_t) 0);
+
+	if (t != topRow) {
+		topRow = t;
+		Paint();
+	}
+
+	UpdateCursor(false /* scroll */);
+}
+
+
+/**
+ * An event handler for resizing the component
+ *
+ * @param oldRows the old number of rows
+ * @param oldCols the old number of columns
+ * @param newRows the new number of rows
+ * @param newCols the new number of columns
+ */
+void HexEditor::OnResize(int oldRows, int oldCols, int newRows, int newCols)
+{
+	Component::OnResize(oldRows, oldCols, newRows, newCols);
+	UpdateCursor();
+}
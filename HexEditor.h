@@ -0,0 +1,226 @@
+/*
+ * HexEditor.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __HEX_EDITOR_H
+#define __HEX_EDITOR_H
+
+#include "Component.h"
+#include "HexDocument.h"
+#include "ScrollBar.h"
+
+
+/**
+ * The hex editor, which shows a fixed number of bytes per row, both in hex
+ * and as characters, and overwrites them in place
+ *
+ * @author Peter Macko
+ */
+class HexEditor : public Component
+{
+	HexDocument* doc;
+
+	uint64_t cursor;
+	bool lowNibble;
+	bool textPane;
+	int64_t topRow;
+	int wheelSpeed;
+
+	ScrollBar* vertScroll;
+
+
+	/**
+	 * Return the number of rows in the document
+	 *
+	 * @return the number of rows, which is at least 1
+	 */
+	int64_t NumRows(void);
+
+	/**
+	 * Return the number of hex digits of the offset at the start of a row
+	 *
+	 * @return the number of digits
+	 */
+	int AddressDigits(void);
+
+	/**
+	 * Return the column of a byte within a row
+	 *
+	 * @param index the index of the byte in the row
+	 * @param text whether to return the column of the character instead of
+	 *             the hex value
+	 * @return the column
+	 */
+	int ByteColumn(int index, bool text);
+
+	/**
+	 * Paint a row
+	 *
+	 * @param row the row number
+	 */
+	void PaintRow(int64_t row);
+
+	/**
+	 * Move the cursor to a byte
+	 *
+	 * @param offset the offset of the byte
+	 */
+	void MoveToByte(int64_t offset);
+
+	/**
+	 * Update the cursor location and refresh
+	 *
+	 * @param scroll whether to scroll to make the cursor visible
+	 */
+	void UpdateCursor(bool scroll = true);
+
+	/**
+	 * Overwrite the byte at the cursor
+	 *
+	 * @param value the new value
+	 * @param advance whether to move to the next byte
+	 */
+	void Overwrite(unsigned char value, bool advance);
+
+	/**
+	 * Handle a key that types into the hex or the text pane
+	 *
+	 * @param key the key code
+	 * @return true if it was handled
+	 */
+	bool Type(int key);
+
+
+protected:
+
+	/**
+	 * An event handler for pressing a key
+	 *
+	 * @param key the key code
+	 */
+	virtual void OnKeyPressed(int key);
+
+	/**
+	 * An event handler for mouse press
+	 *
+	 * @param row the row
+	 * @param column the column
+	 * @param button the button
+	 * @param shift whether shift was pressed
+	 */
+	virtual void OnMousePress(int row, int column, int button, bool shift);
+
+	/**
+	 * An event handler for mouse wheel
+	 *
+	 * @param row the row
+	 * @param column the column
+	 * @param wheel the wheel direction
+	 */
+	virtual void OnMouseWheel(int row, int column, int wheel);
+
+	/**
+	 * An event handler for resizing the component
+	 *
+	 * @param oldRows the old number of rows
+	 * @param oldCols the old number of columns
+	 * @param newRows the new number of rows
+	 * @param newCols the new number of columns
+	 */
+	virtual void OnResize(int oldRows, int oldCols, int newRows, int newCols);
+
+
+public:
+
+	/**
+	 * Create an instance of class HexEditor
+	 *
+	 * @param parent the parent container
+	 * @param row the initial row
+	 * @param col the initial column
+	 * @param rows the number of rows
+	 * @param cols the number of columns
+	 * @param anchor set the anchor
+	 */
+	HexEditor(Container* parent, int row = 0, int col = 0, int rows = 1,
+			int cols = 16, int anchor = ANCHOR_LEFT | ANCHOR_TOP);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~HexEditor(void);
+
+	/**
+	 * Open a file
+	 *
+	 * @param file the file name
+	 * @return a ReturnExt
+	 */
+	ReturnExt Open(const char* file);
+
+	/**
+	 * Paint the contents of the component
+	 */
+	virtual void Paint(void);
+
+	/**
+	 * Set the scroll bar
+	 *
+	 * @param vert the vertical scroll bar
+	 */
+	void SetScrollBar(ScrollBar* vert);
+
+	/**
+	 * Move the cursor to an offset, which takes constant time
+	 *
+	 * @param offset the offset, which is limited to the last byte
+	 */
+	void Seek(uint64_t offset);
+
+	/**
+	 * Return the offset of the byte at the cursor
+	 *
+	 * @return the offset
+	 */
+	inline uint64_t CursorOffset(void) { return cursor; }
+
+	/**
+	 * Return the document
+	 *
+	 * @return the document
+	 */
+	inline HexDocument* Document(void) { return doc; }
+};
+
+#endif
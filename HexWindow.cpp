@@ -0,0 +1,257 @@
+/*
+ * HexWindow.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "HexWindow.h"
+
+#include <libgen.h>
+
+#include "DialogWindow.h"
+#include "Label.h"
+#include "Manager.h"
+#include "ScrollBar.h"
+
+
+/**
+ * Create an instance of class HexWindow
+ *
+ * @param row the initial row
+ * @param col the initial column
+ * @param rows the number of rows
+ * @param cols the number of columns
+ */
+HexWindow::HexWindow(int row, int col, int rows, int cols)
+	: Window("Untitled", row, col, rows, cols, 4, 7)
+{
+	editor = NULL;
+
+	inactiveFrameColor = 6;
+
+
+	// Add the scroll bar
+
+	AddScrollBar(false, 2, 2);
+
+	VertScrollBar()->SetBGColor(6);
+	VertScrollBar()->SetFGColor(4);
+
+
+	// Add the split pane
+
+	splitPane = new SplitPane(this, SPLITPANE_HORIZONTAL, 0, 0, ClientRows(),
+			ClientColumns());
+	splitPane->SetSplit(ClientRows() - 3);
+	splitPane->SetMainComponent(SPLITPANE_COMPONENT_FIRST);
+	splitPane->SetOneComponentMode(SPLITPANE_COMPONENT_FIRST);
+
+
+	// Add the editor
+
+	editor = new HexEditor(splitPane, 0, 0, splitPane->Rows(),
+			splitPane->Columns(), ANCHOR_ALL);
+	editor->SetScrollBar(VertScrollBar());
+
+
+	// Add the tools pane with the offset to go to
+
+	toolContainer = new Container(splitPane);
+	toolContainer->SetCapturesFocus(true);
+
+	Label* offsetLabel = new Label(toolContainer, "Go to:", 0, 1, 1, 8);
+	offsetLabel->SetAlignment(ALIGN_RIGHT);
+
+	int e = offsetLabel->Column() + offsetLabel->Columns() + 1;
+	offsetEditor = new Editor(toolContainer, false, offsetLabel->Row(), e, 1,
+			toolContainer->ClientColumns() - e - 1,
+			ANCHOR_LEFT | ANCHOR_TOP | ANCHOR_RIGHT);
+	offsetEditor->RegisterEventHandler(this);
+
+	toolContainer->SetMinSize(2, 30);
+}
+
+
+/**
+ * Destroy the object
+ */
+HexWindow::~HexWindow(void)
+{
+}
+
+
+/**
+ * Open a file
+ *
+ * @param file the file name
+ * @param a ReturnExt
+ */
+ReturnExt HexWindow::Open(const char* file)
+{
+	ReturnExt r = editor->Open(file);
+	if (!r) return r;
+
+	char* s = strdup(file);
+	char* b = basename(s);
+	SetTitle(b);
+	free(s);
+
+	Paint();
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Paint the window status
+ */
+void HexWindow::PaintHexStatus(void)
+{
+	char buf[64];
+	int r = Rows() - 1;
+
+	if (editor == NULL) return;
+
+	UseFrameStyle();
+
+
+	// Print the offset of the cursor in hex
+
+	snprintf(buf, sizeof(buf), " 0x%llx ",
+			(unsigned long long) editor->CursorOffset());
+
+	tcw->OutHorizontalLine(r, 1, Columns() - 2);
+	tcw->OutText(r, 5, buf);
+
+
+	// Print the flags
+
+	HexDocument* doc = editor->Document();
+	if (doc->Modified()) tcw->OutChar(r, 3, '*');
+	if (doc->ReadOnly()) tcw->OutChar(r, 3, 'R');
+}
+
+
+/**
+ * An event handler for pressing a key
+ *
+ * @param key the key code
+ */
+void HexWindow::OnKeyPressed(int key)
+{
+	if (key == KEY_ESC) {
+
+		if (splitPane->OneComponentMode() == SPLITPANE_COMPONENT_NONE) {
+			splitPane->SetOneComponentMode(SPLITPANE_COMPONENT_FIRST);
+			editor->Focus();
+		}
+	}
+
+	else if (key == KEY_CTRL('g')) {
+
+		// Open the offset editor
+
+		splitPane->SetOneComponentMode(SPLITPANE_COMPONENT_NONE);
+		offsetEditor->Focus();
+		offsetEditor->SelectAll();
+	}
+
+	else if (key == KEY_CTRL('s')) {
+
+		ReturnExt r = editor->Document()->Save();
+		if (!r) Dialogs::Error(this, r);
+		Paint();
+	}
+
+	else {
+
+		Window::OnKeyPressed(key);
+	}
+}
+
+
+/**
+ * An event handler for an action
+ *
+ * @param sender the sender
+ */
+void HexWindow::OnAction(Component* sender)
+{
+	if (sender == offsetEditor) {
+
+		// Go to the offset, which is in hex if it starts with 0x
+
+		const char* s = offsetEditor->Document()->Line(0);
+		bool hex = s[0] == '0' && (s[1] == 'x' || s[1] == 'X');
+
+		char* end = NULL;
+		errno = 0;
+		unsigned long long offset = strtoull(hex ? s + 2 : s, &end, hex ? 16 : 10);
+
+		if (*s == '\0' || *s == '-' || *end != '\0' || errno != 0) {
+			wm.SetStatus("Enter the offset as a decimal or a 0x hex number");
+			return;
+		}
+
+		splitPane->SetOneComponentMode(SPLITPANE_COMPONENT_FIRST);
+		editor->Focus();
+		editor->Seek(offset);
+	}
+}
+
+
+/**
+ * Paint the contents of the window
+ */
+void HexWindow::Paint(void)
+{
+	if (!Visible()) return;
+
+	Container::Paint();
+
+
+	// Paint the status
+
+	PaintHexStatus();
+}
+
+
+/**
+ * Refresh the component
+ */
+void HexWindow::Refresh(void)
+{
+	PaintHexStatus();
+
+	Component::Refresh();
+}
@@ -60,9 +60,9 @@ Histogram::~Histogram(void)
  * @param key the key value
  * @return the associated value
  */
-int Histogram::Get(int key)
+int64_t Histogram::Get(int64_t key)
 {
-	std::map<int, int>::iterator i = m.find(key);
+	std::map<int64_t, int64_t>::iterator i = m.find(key);
 	return i == m.end() ? 0 : i->second;
 }
 
@@ -73,10 +73,10 @@ int Histogram::Get(int key)
  * @param key the key value
  * @param value the new value
  */
-void Histogram::Set(int key, int value)
+void Histogram::Set(int64_t key, int64_t value)
 {
 	if (value == 0) {
-		std::map<int, int>::iterator i = m.find(key);
+		std::map<int64_t, int64_t>::iterator i = m.find(key);
 		if (i != m.end()) m.erase(i);
 	}
 	else {
@@ -90,9 +90,9 @@ void Histogram::Set(int key, int value)
  * 
  * @param key the key value
  */
-void Histogram::Increment(int key)
+void Histogram::Increment(int64_t key)
 {
-	std::map<int, int>::iterator i = m.find(key);
+	std::map<int64_t, int64_t>::iterator i = m.find(key);
 	if (i == m.end()) {
 		m[key] = 1;
 	}
@@ -107,19 +107,19 @@ void Histogram::Increment(int key)
  * 
  * @param key the key value
  */
-void Histogram::Decrement(int key)
+void Histogram::Decrement(int64_t key)
 {
-	std::map<int, int>::iterator i = m.find(key);
+	std::map<int64_t, int64_t>::iterator i = m.find(key);
 	if (i == m.end()) {
 		m[key] = -1;
 	}
 	else {
-		int v = i->second;
+		int64_t v = i->second;
 		if (v == 1) {
 			m.erase(i);
 		}
 		else {
-			i->second = v + 1;
+			i->second = v - 1;
 		}
 	}
 }
@@ -139,9 +139,9 @@ void Histogram::Clear(void)
  * 
  * @return the smallest key
  */
-int Histogram::MinKey(void)
+int64_t Histogram::MinKey(void)
 {
-	std::map<int, int>::iterator i = m.begin();
+	std::map<int64_t, int64_t>::iterator i = m.begin();
 	return i == m.end() ? 0 : i->first;
 }
 
@@ -151,8 +151,8 @@ int Histogram::MinKey(void)
  * 
  * @return the largest key
  */
-int Histogram::MaxKey(void)
+int64_t Histogram::MaxKey(void)
 {
-	std::map<int, int>::reverse_iterator i = m.rbegin();
+	std::map<int64_t, int64_t>::reverse_iterator i = m.rbegin();
 	return i == m.rend() ? 0 : i->first;
 }
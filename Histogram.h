@@ -36,6 +36,7 @@
 #define __HISTOGRAM_H
 
 #include <map>
+#include <stdint.h>
 
 
 /**
@@ -45,7 +46,7 @@
  */
 class Histogram
 {
-	std::map<int, int> m;
+	std::map<int64_t, int64_t> m;
 
 public:
 	
@@ -65,7 +66,7 @@ public:
 	 * @param key the key value
 	 * @return the associated value
 	 */
-	int Get(int key);
+	int64_t Get(int64_t key);
 	
 	/**
 	 * Set the value
@@ -73,7 +74,7 @@ public:
 	 * @param key the key value
 	 * @param value the new value
 	 */
-	void Set(int key, int value);
+	void Set(int64_t key, int64_t value);
 	
 	/**
 	 * Increment a value
@@ -81,7 +82,7 @@ public:
 	 * @param key the key value
 	 * @return the new value
 	 */
-	void Increment(int key);
+	void Increment(int64_t key);
 	
 	/**
 	 * Decrement a value
@@ -89,7 +90,7 @@ public:
 	 * @param key the key value
 	 * @return the new value
 	 */
-	void Decrement(int key);
+	void Decrement(int64_t key);
 	
 	/**
 	 * Clear the histogram
@@ -101,14 +102,14 @@ public:
 	 * 
 	 * @return the smallest key
 	 */
-	int MinKey(void);
+	int64_t MinKey(void);
 	
 	/**
 	 * Get the largest key
 	 * 
 	 * @return the largest key
 	 */
-	int MaxKey(void);
+	int64_t MaxKey(void);
 };
 
 #endif
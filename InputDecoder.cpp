@@ -0,0 +1,678 @@
+/*
+ * InputDecoder.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "InputDecoder.h"
+
+
+/**
+ * The sequence that terminates the bracketed paste
+ */
+#define PASTE_END			"\033[201~"
+#define PASTE_END_LENGTH	6
+
+
+/**
+ * Create a node
+ */
+InputDecoder::Node::Node(void)
+{
+	action = IDA_None;
+	key = ERR;
+	numChildren = 0;
+	for (int i = 0; i < 128; i++) children[i] = NULL;
+}
+
+
+/**
+ * Destroy the node and its children
+ */
+InputDecoder::Node::~Node(void)
+{
+	for (int i = 0; i < 128; i++) {
+		if (children[i] != NULL) delete children[i];
+	}
+}
+
+
+/**
+ * Apply the modifier reported by the terminal to a key code
+ *
+ * @param key the key code
+ * @param modifier the modifier parameter (1 + the bit mask of Shift = 1,
+ *                 Alt = 2, Ctrl = 4, Meta = 8)
+ * @return the modified key code, or the original key code if the combination
+ *         does not have a key code of its own
+ */
+static int ApplyModifier(int key, int modifier)
+{
+	int mask = modifier - 1;
+	bool shift = (mask & 1) != 0;
+	bool alt = (mask & (2 | 8)) != 0;
+	bool ctrl = (mask & 4) != 0;
+
+	if (ctrl) return key;
+
+	if (shift && alt) {
+		switch (key) {
+			case KEY_UP   : return KEY_SHIFT_ALT_UP;
+			case KEY_DOWN : return KEY_SHIFT_ALT_DOWN;
+			case KEY_LEFT : return KEY_SHIFT_ALT_LEFT;
+			case KEY_RIGHT: return KEY_SHIFT_ALT_RIGHT;
+			case KEY_HOME : return KEY_SHIFT_ALT_HOME;
+			case KEY_END  : return KEY_SHIFT_ALT_END;
+		}
+	}
+	else if (shift) {
+		switch (key) {
+			case KEY_UP   : return KEY_SHIFT_UP;
+			case KEY_DOWN : return KEY_SHIFT_DOWN;
+			case KEY_LEFT : return KEY_SHIFT_LEFT;
+			case KEY_RIGHT: return KEY_SHIFT_RIGHT;
+			case KEY_HOME : return KEY_SHIFT_HOME;
+			case KEY_END  : return KEY_SHIFT_END;
+		}
+	}
+	else if (alt) {
+		switch (key) {
+			case KEY_UP   : return KEY_ALT_UP;
+			case KEY_DOWN : return KEY_ALT_DOWN;
+			case KEY_LEFT : return KEY_ALT_LEFT;
+			case KEY_RIGHT: return KEY_ALT_RIGHT;
+		}
+	}
+
+	return key;
+}
+
+
+/**
+ * Create an instance of class InputDecoder
+ */
+InputDecoder::InputDecoder(void)
+{
+	root = new Node();
+	escapeTimeout = APE_ESCAPE_TIMEOUT;
+	pasting = false;
+	mouseButtons = 0;
+	memset(&mouse, 0, sizeof(mouse));
+
+
+	// The cursor keys, which are sent as either CSI or SS3 sequences
+	// depending on the keypad mode, and which can carry a modifier
+
+	static const struct { char final; int key; } CURSOR_KEYS[] = {
+		{ 'A', KEY_UP    }, { 'B', KEY_DOWN  },
+		{ 'C', KEY_RIGHT }, { 'D', KEY_LEFT  },
+		{ 'H', KEY_HOME  }, { 'F', KEY_END   },
+		{ 'P', KEY_F(1)  }, { 'Q', KEY_F(2)  },
+		{ 'R', KEY_F(3)  }, { 'S', KEY_F(4)  },
+		{ 0, 0 }
+	};
+
+	for (int i = 0; CURSOR_KEYS[i].final != 0; i++) {
+		char plain[8], modified[16];
+		char f = CURSOR_KEYS[i].final;
+		int key = CURSOR_KEYS[i].key;
+
+		snprintf(plain, sizeof(plain), "\033[%c", f);
+		snprintf(modified, sizeof(modified), "\033[1;%%d%c", f);
+		AddModified(plain, modified, key);
+
+		snprintf(plain, sizeof(plain), "\033O%c", f);
+		snprintf(modified, sizeof(modified), "\033O%%d%c", f);
+		AddModified(plain, modified, key);
+
+		if (f >= 'A' && f <= 'D') {
+			snprintf(plain, sizeof(plain), "\033\033[%c", f);
+			Add(plain, IDA_Key, ApplyModifier(key, 3));
+			snprintf(plain, sizeof(plain), "\033\033O%c", f);
+			Add(plain, IDA_Key, ApplyModifier(key, 3));
+			snprintf(plain, sizeof(plain), "\033[%c", f - 'A' + 'a');
+			Add(plain, IDA_Key, ApplyModifier(key, 2));
+		}
+	}
+
+
+	// The editing and function keys sent as "CSI number ~"
+
+	static const struct { int code; int key; } TILDE_KEYS[] = {
+		{  1, KEY_HOME  }, {  2, KEY_IC    }, {  3, KEY_DC    },
+		{  4, KEY_END   }, {  5, KEY_PPAGE }, {  6, KEY_NPAGE },
+		{  7, KEY_HOME  }, {  8, KEY_END   },
+		{ 11, KEY_F(1)  }, { 12, KEY_F(2)  }, { 13, KEY_F(3)  },
+		{ 14, KEY_F(4)  }, { 15, KEY_F(5)  }, { 17, KEY_F(6)  },
+		{ 18, KEY_F(7)  }, { 19, KEY_F(8)  }, { 20, KEY_F(9)  },
+		{ 21, KEY_F(10) }, { 23, KEY_F(11) }, { 24, KEY_F(12) },
+		{ 0, 0 }
+	};
+
+	for (int i = 0; TILDE_KEYS[i].code != 0; i++) {
+		char plain[16], modified[16];
+		snprintf(plain, sizeof(plain), "\033[%d~", TILDE_KEYS[i].code);
+		snprintf(modified, sizeof(modified), "\033[%d;%%d~",
+				TILDE_KEYS[i].code);
+		AddModified(plain, modified, TILDE_KEYS[i].key);
+	}
+
+
+	// Other keys
+
+	Add("\033[Z", IDA_Key, KEY_BTAB);
+	Add("\033OM", IDA_Key, KEY_ENTER);
+
+
+	// Mouse events and bracketed paste
+
+	Add("\033[<", IDA_MouseSGR);
+	Add("\033[M", IDA_MouseX10);
+	Add("\033[200~", IDA_PasteBegin);
+}
+
+
+/**
+ * Destroy the object
+ */
+InputDecoder::~InputDecoder(void)
+{
+	delete root;
+}
+
+
+/**
+ * Add a sequence to the trie
+ *
+ * @param sequence the sequence
+ * @param action the action
+ * @param key the key code
+ */
+void InputDecoder::Add(const char* sequence, Action action, int key)
+{
+	Node* node = root;
+
+	for (const char* p = sequence; *p != '\0'; p++) {
+		unsigned char c = (unsigned char) *p;
+		assert(c < 128);
+
+		if (node->children[c] == NULL) {
+			node->children[c] = new Node();
+			node->numChildren++;
+		}
+		node = node->children[c];
+	}
+
+	node->action = action;
+	node->key = key;
+}
+
+
+/**
+ * Add the sequence for a key together with its variants for all
+ * supported modifier combinations
+ *
+ * @param sequence the sequence without a modifier
+ * @param modifiedFormat the printf format of the sequence with the
+ *                       modifier parameter
+ * @param key the key code
+ */
+void InputDecoder::AddModified(const char* sequence,
+		const char* modifiedFormat, int key)
+{
+	char buf[32];
+
+	Add(sequence, IDA_Key, key);
+
+	for (int m = 2; m <= 16; m++) {
+		snprintf(buf, sizeof(buf), modifiedFormat, m);
+		Add(buf, IDA_Key, ApplyModifier(key, m));
+	}
+}
+
+
+/**
+ * Add the input bytes to the buffer
+ *
+ * @param data the data
+ * @param length the number of bytes
+ * @param time the time at which the bytes were read
+ */
+void InputDecoder::Feed(const char* data, size_t length, double time)
+{
+	for (size_t i = 0; i < length; i++) {
+		buffer.push_back((unsigned char) data[i]);
+		times.push_back(time);
+	}
+}
+
+
+/**
+ * Discard all buffered input, including an incomplete paste
+ */
+void InputDecoder::Reset(void)
+{
+	buffer.clear();
+	times.clear();
+	pasting = false;
+	paste = "";
+}
+
+
+/**
+ * Remove the given number of bytes from the front of the buffer
+ *
+ * @param n the number of bytes
+ */
+void InputDecoder::Consume(size_t n)
+{
+	if (n > buffer.size()) n = buffer.size();
+	buffer.erase(buffer.begin(), buffer.begin() + n);
+	times.erase(times.begin(), times.begin() + n);
+}
+
+
+/**
+ * Decode the next key
+ *
+ * @param now the current time
+ * @return the key code, KEY_MOUSE for a mouse event, KEY_PASTE for pasted
+ *         text, or ERR if there is no complete key in the buffer
+ */
+int InputDecoder::Next(double now)
+{
+	while (true) {
+
+		if (pasting) return ContinuePaste();
+		if (buffer.empty()) return ERR;
+
+
+		// Regular characters
+
+		unsigned char c = buffer.front();
+
+		if (c != KEY_ESC) {
+			Consume(1);
+			if (c == 127) return KEY_BACKSPACE;
+			if (c == '\r') return KEY_RETURN;
+			return c;
+		}
+
+
+		// A lone ESC is the Escape key. Decide based on when the next byte
+		// arrived, not on when we got around to reading it, so that a slow
+		// event loop does not turn escape sequences into Escape presses.
+
+		if (buffer.size() == 1) {
+			if (now - times[0] < escapeTimeout) return ERR;
+			Consume(1);
+			return KEY_ESC;
+		}
+
+		if (times[1] - times[0] >= escapeTimeout) {
+			Consume(1);
+			return KEY_ESC;
+		}
+
+
+		// Find the sequence in the trie
+
+		Node* node = root;
+		size_t length = 0;
+
+		while (length < buffer.size() && node->action == IDA_None) {
+			unsigned char b = buffer[length];
+			if (b >= 128 || node->children[b] == NULL) break;
+			node = node->children[b];
+			length++;
+		}
+
+		if (node->action == IDA_None) {
+
+			// Wait for the rest of a sequence that is known so far
+
+			if (length == buffer.size() && node->numChildren > 0
+					&& now - times[0] < APE_SEQUENCE_TIMEOUT) {
+				return ERR;
+			}
+
+
+			// ESC followed by a regular character is Alt+character. The
+			// bytes of a non-ASCII character are passed on without Alt,
+			// since they make up the character only together.
+
+			c = buffer[1];
+			if (c != '[' && c != 'O' && c != ']' && c != 'P') {
+				Consume(2);
+				if (c == KEY_ESC) return KEY_ESC;
+				if (c >= 128) return c;
+				if (c == 127) return KEY_ALT(KEY_BACKSPACE);
+				if (c == '\r') return KEY_ALT(KEY_RETURN);
+				return KEY_ALT(c);
+			}
+
+
+			// Unknown escape sequence
+
+			if (!SkipUnknownSequence(now)) return ERR;
+			continue;
+		}
+
+
+		// Handle the recognized sequence
+
+		int r;
+
+		switch (node->action) {
+
+			case IDA_Key:
+				Consume(length);
+				return node->key;
+
+			case IDA_PasteBegin:
+				Consume(length);
+				pasting = true;
+				paste = "";
+				break;
+
+			case IDA_MouseSGR:
+				r = DecodeMouseSGR(length, now);
+				if (r != 0) return r;
+				break;
+
+			case IDA_MouseX10:
+				r = DecodeMouseX10(length);
+				if (r != ERR) return r;
+				if (now - times[0] < APE_SEQUENCE_TIMEOUT) return ERR;
+				Consume(buffer.size());
+				break;
+
+			default:
+				assert(0);
+				Consume(length);
+		}
+	}
+}
+
+
+/**
+ * Skip an unrecognized escape sequence at the front of the buffer
+ *
+ * @param now the current time
+ * @return true if skipped, false if the sequence is incomplete
+ */
+bool InputDecoder::SkipUnknownSequence(double now)
+{
+	assert(buffer.size() >= 2 && buffer[0] == KEY_ESC);
+	bool timedOut = now - times[0] >= APE_SEQUENCE_TIMEOUT;
+	unsigned char c = buffer[1];
+
+
+	// CSI: parameter and intermediate bytes followed by a final byte
+
+	if (c == '[') {
+		for (size_t i = 2; i < buffer.size(); i++) {
+			unsigned char b = buffer[i];
+			if (b >= 0x40 && b <= 0x7e) {
+				Consume(i + 1);
+				return true;
+			}
+			if (b < 0x20 || b > 0x3f) {
+				Consume(i);
+				return true;
+			}
+		}
+	}
+
+
+	// SS3: a single character
+
+	else if (c == 'O') {
+		if (buffer.size() >= 3) {
+			Consume(3);
+			return true;
+		}
+	}
+
+
+	// OSC and DCS: a string terminated by BEL or ST
+
+	else {
+		for (size_t i = 2; i < buffer.size(); i++) {
+			if (buffer[i] == '\a') {
+				Consume(i + 1);
+				return true;
+			}
+			if (buffer[i] == KEY_ESC && i + 1 < buffer.size()
+					&& buffer[i + 1] == '\\') {
+				Consume(i + 2);
+				return true;
+			}
+		}
+	}
+
+
+	// The sequence is incomplete
+
+	if (!timedOut) return false;
+	Consume(buffer.size());
+	return true;
+}
+
+
+/**
+ * Continue reading pasted text
+ *
+ * @return KEY_PASTE if the paste is complete, or ERR
+ */
+int InputDecoder::ContinuePaste(void)
+{
+	while (!buffer.empty()) {
+
+		if (buffer.front() == KEY_ESC) {
+			size_t k = 0;
+			while (k < PASTE_END_LENGTH && k < buffer.size()
+					&& buffer[k] == (unsigned char) PASTE_END[k]) k++;
+
+			if (k == PASTE_END_LENGTH) {
+				Consume(PASTE_END_LENGTH);
+				pasting = false;
+
+
+				// Normalize the line endings
+
+				pastedText = "";
+				pastedText.reserve(paste.length());
+				for (size_t i = 0; i < paste.length(); i++) {
+					if (paste[i] == '\r') {
+						pastedText += '\n';
+						if (i + 1 < paste.length() && paste[i + 1] == '\n') i++;
+					}
+					else {
+						pastedText += paste[i];
+					}
+				}
+
+				paste = "";
+				return KEY_PASTE;
+			}
+
+			if (k == buffer.size()) return ERR;
+		}
+
+		paste += (char) buffer.front();
+		Consume(1);
+	}
+
+	return ERR;
+}
+
+
+/**
+ * Decode an SGR (1006) mouse event at the front of the buffer
+ *
+ * @param start the position of the parameters
+ * @param now the current time
+ * @return KEY_MOUSE, ERR if incomplete, or 0 if invalid
+ */
+int InputDecoder::DecodeMouseSGR(size_t start, double now)
+{
+	int params[3] = { 0, 0, 0 };
+	int n = 0;
+	size_t i;
+
+	for (i = start; i < buffer.size(); i++) {
+		unsigned char c = buffer[i];
+		if (c >= '0' && c <= '9') {
+			if (n < 3) params[n] = params[n] * 10 + (c - '0');
+		}
+		else if (c == ';') {
+			n++;
+		}
+		else if (c == 'M' || c == 'm') {
+			break;
+		}
+		else {
+			Consume(i);
+			return 0;
+		}
+	}
+
+	if (i == buffer.size()) {
+		if (now - times[0] < APE_SEQUENCE_TIMEOUT) return ERR;
+		Consume(i);
+		return 0;
+	}
+
+	bool release = buffer[i] == 'm';
+	Consume(i + 1);
+	if (n != 2) return 0;
+
+	memset(&mouse, 0, sizeof(mouse));
+	mouse.x = params[1] - 1;
+	mouse.y = params[2] - 1;
+	mouse.bstate = TranslateMouseButton(params[0], release);
+
+	return KEY_MOUSE;
+}
+
+
+/**
+ * Decode a legacy X10 mouse event at the front of the buffer
+ *
+ * @param start the position of the parameters
+ * @return KEY_MOUSE, or ERR if incomplete
+ */
+int InputDecoder::DecodeMouseX10(size_t start)
+{
+	if (buffer.size() < start + 3) return ERR;
+
+	int code = buffer[start] - 32;
+	int x = buffer[start + 1] - 33;
+	int y = buffer[start + 2] - 33;
+	Consume(start + 3);
+
+	memset(&mouse, 0, sizeof(mouse));
+	mouse.x = x;
+	mouse.y = y;
+	mouse.bstate = TranslateMouseButton(code, false);
+
+	return KEY_MOUSE;
+}
+
+
+/**
+ * Translate the button code reported by the terminal to the curses
+ * mouse event state
+ *
+ * @param code the button code
+ * @param release true if this is a release event
+ * @return the curses button state
+ */
+mmask_t InputDecoder::TranslateMouseButton(int code, bool release)
+{
+	mmask_t state = 0;
+	int button = code & 3;
+
+	if (code & 64) {
+
+		// The mouse wheel, which reports only presses
+
+		if (button == 0) state = BUTTON4_PRESSED;
+#ifdef BUTTON5_PRESSED
+		else if (button == 1) state = BUTTON5_PRESSED;
+#endif
+		else state = REPORT_MOUSE_POSITION;
+	}
+
+	else if (release) {
+
+		// SGR reports which button was released
+
+		state = NCURSES_MOUSE_MASK(button + 1, NCURSES_BUTTON_RELEASED);
+		mouseButtons &= ~NCURSES_MOUSE_MASK(button + 1,
+				NCURSES_BUTTON_PRESSED);
+	}
+
+	else if (button == 3) {
+
+		// Motion without a button, or an X10 release, which does not say
+		// which button was released
+
+		if ((code & 32) == 0) {
+			for (int b = 1; b <= 3; b++) {
+				if (mouseButtons & NCURSES_MOUSE_MASK(b,
+							NCURSES_BUTTON_PRESSED)) {
+					state |= NCURSES_MOUSE_MASK(b, NCURSES_BUTTON_RELEASED);
+				}
+			}
+			mouseButtons = 0;
+		}
+
+		if (state == 0) state = REPORT_MOUSE_POSITION;
+	}
+
+	else {
+
+		// A press, or a drag with the button held down
+
+		state = NCURSES_MOUSE_MASK(button + 1, NCURSES_BUTTON_PRESSED);
+		mouseButtons |= state;
+	}
+
+	if (code & 4 ) state |= BUTTON_SHIFT;
+	if (code & 8 ) state |= BUTTON_ALT;
+	if (code & 16) state |= BUTTON_CTRL;
+
+	return state;
+}
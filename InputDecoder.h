@@ -0,0 +1,251 @@
+/*
+ * InputDecoder.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __INPUT_DECODER_H
+#define __INPUT_DECODER_H
+
+#include <curses.h>
+#include <deque>
+#include <string>
+
+
+/**
+ * The default time after which a lone ESC is reported as the Escape key,
+ * unless more bytes follow. This is the default ESCDELAY of curses, since
+ * a shorter time splits the escape sequences that arrive over a congested
+ * connection.
+ */
+#define APE_ESCAPE_TIMEOUT	0.025	/* seconds */
+
+/**
+ * The time after which an incomplete escape sequence is abandoned
+ */
+#define APE_SEQUENCE_TIMEOUT	0.500	/* seconds */
+
+
+/**
+ * Decoder of the terminal input, which translates the raw bytes into key
+ * codes, mouse events, and pasted text
+ *
+ * @author Peter Macko
+ */
+class InputDecoder
+{
+	/**
+	 * The action associated with a node of the trie
+	 */
+	typedef enum {
+		IDA_None,
+		IDA_Key,
+		IDA_MouseSGR,
+		IDA_MouseX10,
+		IDA_PasteBegin
+	} Action;
+
+
+	/**
+	 * A node of the escape sequence trie
+	 */
+	struct Node
+	{
+		Action action;
+		int key;
+		Node* children[128];
+		int numChildren;
+
+
+		/**
+		 * Create a node
+		 */
+		Node(void);
+
+		/**
+		 * Destroy the node and its children
+		 */
+		~Node(void);
+	};
+
+
+	Node* root;
+
+	std::deque<unsigned char> buffer;
+	std::deque<double> times;
+
+	double escapeTimeout;
+
+	bool pasting;
+	std::string paste;
+	std::string pastedText;
+
+	MEVENT mouse;
+	mmask_t mouseButtons;
+
+
+	/**
+	 * Add a sequence to the trie
+	 *
+	 * @param sequence the sequence
+	 * @param action the action
+	 * @param key the key code
+	 */
+	void Add(const char* sequence, Action action, int key = ERR);
+
+	/**
+	 * Add the sequence for a key together with its variants for all
+	 * supported modifier combinations
+	 *
+	 * @param sequence the sequence without a modifier
+	 * @param modifiedFormat the printf format of the sequence with the
+	 *                       modifier parameter
+	 * @param key the key code
+	 */
+	void AddModified(const char* sequence, const char* modifiedFormat,
+			int key);
+
+	/**
+	 * Remove the given number of bytes from the front of the buffer
+	 *
+	 * @param n the number of bytes
+	 */
+	void Consume(size_t n);
+
+	/**
+	 * Continue reading pasted text
+	 *
+	 * @return KEY_PASTE if the paste is complete, or ERR
+	 */
+	int ContinuePaste(void);
+
+	/**
+	 * Decode an SGR (1006) mouse event at the front of the buffer
+	 *
+	 * @param start the position of the parameters
+	 * @param now the current time
+	 * @return KEY_MOUSE, ERR if incomplete, or 0 if invalid
+	 */
+	int DecodeMouseSGR(size_t start, double now);
+
+	/**
+	 * Decode a legacy X10 mouse event at the front of the buffer
+	 *
+	 * @param start the position of the parameters
+	 * @return KEY_MOUSE, or ERR if incomplete
+	 */
+	int DecodeMouseX10(size_t start);
+
+	/**
+	 * Translate the button code reported by the terminal to the curses
+	 * mouse event state
+	 *
+	 * @param code the button code
+	 * @param release true if this is a release event
+	 * @return the curses button state
+	 */
+	mmask_t TranslateMouseButton(int code, bool release);
+
+	/**
+	 * Skip an unrecognized escape sequence at the front of the buffer
+	 *
+	 * @param now the current time
+	 * @return true if skipped, false if the sequence is incomplete
+	 */
+	bool SkipUnknownSequence(double now);
+
+
+public:
+
+	/**
+	 * Create an instance of class InputDecoder
+	 */
+	InputDecoder(void);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~InputDecoder(void);
+
+	/**
+	 * Set the time after which a lone ESC is reported as the Escape key
+	 *
+	 * @param timeout the timeout in seconds
+	 */
+	inline void SetEscapeTimeout(double timeout) { escapeTimeout = timeout; }
+
+	/**
+	 * Add the input bytes to the buffer
+	 *
+	 * @param data the data
+	 * @param length the number of bytes
+	 * @param time the time at which the bytes were read
+	 */
+	void Feed(const char* data, size_t length, double time);
+
+	/**
+	 * Discard all buffered input, including an incomplete paste
+	 */
+	void Reset(void);
+
+	/**
+	 * Decode the next key
+	 *
+	 * @param now the current time
+	 * @return the key code, KEY_MOUSE for a mouse event, KEY_PASTE for pasted
+	 *         text, or ERR if there is no complete key in the buffer
+	 */
+	int Next(double now);
+
+	/**
+	 * Determine whether there is buffered input that has not been decoded
+	 * yet, such as an incomplete escape sequence
+	 *
+	 * @return true if there is pending input
+	 */
+	inline bool Pending(void) { return !buffer.empty() || pasting; }
+
+	/**
+	 * Get the most recent mouse event
+	 *
+	 * @return the mouse event
+	 */
+	inline const MEVENT& Mouse(void) { return mouse; }
+
+	/**
+	 * Get the most recently pasted text
+	 *
+	 * @return the text
+	 */
+	inline const std::string& PastedText(void) { return pastedText; }
+};
+
+#endif
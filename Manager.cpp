@@ -35,29 +35,17 @@
 #include "stdafx.h"
 #include "Manager.h"
 
-#include <sys/ioctl.h>
-#include <csignal>
-
-#ifdef _MAC
-#include <util.h>
-#endif
-
+#include "CursesBackend.h"
 #include "DialogWindow.h"
 #include "EditorWindow.h"
 #include "FileDialog.h"
+#include "Operation.h"
 
-Manager wm;
-
+#define APE_OUTPUT_QUEUE_THRESHOLD	1024	/* bytes */
+#define APE_OUTPUT_BLOCKED_THRESHOLD	0.020	/* seconds */
+#define APE_TASK_TIME_BUDGET	0.008	/* seconds per event loop iteration */
 
-/**
- * Handle the SIGWINCH signal
- *
- * @param sig the signal code
- */
-void SigWinChHandler(int sig)
-{
-	ungetch(KEY_RESIZE);
-}
+Manager wm;
 
 
 /**
@@ -67,6 +55,25 @@ Manager::Manager(void)
 {
 	initialized = false;
 
+	backend = NULL;
+
+	framePending = false;
+	cursorPending = false;
+	tasksPending = false;
+	currentDeferred = false;
+
+	framesRendered = 0;
+	framesSkipped = 0;
+	outputQueue = 0;
+	outputBlockedTime = 0;
+	outputBlockedUntil = 0;
+	frameLatency = 0;
+	inputTime = 0;
+	renderStatsVisible = false;
+
+	nextFrame = NULL;
+	renderThreadStop = false;
+
 	processMessagesDepth = 0;
 	openDialog = NULL;
 
@@ -95,65 +102,33 @@ Manager::~Manager(void)
 
 /**
  * Initialize
+ *
+ * @param backend the terminal backend (will be destroyed by the window
+ *                manager), or NULL to use curses
  */
-void Manager::Initialize(void)
+void Manager::Initialize(TerminalBackend* backend)
 {
 	if (initialized) return;
 	initialized = true;
 
 
-	// Configure the Curses
-	
-	if (getenv("ESCDELAY") == NULL) {
-		// Set the delay after ESC to 25ms (this is apparently the VIM default)
-		setenv("ESCDELAY", "25", 1);
-	}
-
-	
-	// Initialize the Curses
-
-	initscr();
-	noecho();
-
-
-	// Initialize keyboard
-
-	raw();
-	keypad(stdscr, TRUE);
-	nodelay(stdscr, TRUE);
-	
-	
-	// Initialize mouse
-	
-	mousemask(ALL_MOUSE_EVENTS | REPORT_MOUSE_POSITION, NULL);
-	mouseinterval(0 /* ms */);
-	printf("\033[?1002h\n");  // Configure the terminal to report mouse movements
-
-
-	// Get the screen size
-
-	getmaxyx(stdscr, rows, cols);
-
-
-	// Initialize colors
+	// Initialize the terminal
 
-	if (has_colors()) {
-		start_color();
-		for (int i = 0; i < 8; i++) for (int j = 0; j < 8; j++) {
-			init_pair(j*8+7-i, i, j);
-		}
-	}
+	this->backend = backend == NULL ? new CursesBackend() : backend;
+	this->backend->Initialize(rows, cols);
 
 
 	// Initialize the main window
 
-	win = newwin(rows, cols, 0, 0);
 	tcw = new TerminalControlWindow(rows, cols);
 
 
-	// Initialize signals
+	// Start the render thread, which owns the terminal output from now on
 
-	signal(SIGWINCH, SigWinChHandler);
+	renderThreadStop = false;
+	if (this->backend->RenderInBackground()) {
+		renderThread = std::thread(&Manager::RenderThreadMain, this);
+	}
 
 
 	// Initialize the internal state
@@ -171,17 +146,28 @@ void Manager::Shutdown(void)
 	if (!initialized) return;
 	initialized = false;
 
-	signal(SIGWINCH, SIG_DFL);
+	// Stop the render thread
+
+	{
+		std::lock_guard<std::mutex> lock(renderWaitMutex);
+		renderThreadStop = true;
+	}
+	renderWait.notify_one();
+	if (renderThread.joinable()) renderThread.join();
+
+	delete nextFrame.exchange(NULL);
+
+
+	// Destroy the windows and shut down the terminal
 
 	for (int i = 0; i < windows.size(); i++) delete windows[i];
 	for (int i = 0; i < zombies.size(); i++) delete zombies[i];
 
 	delete tcw;
-	delwin(win);
 
-	printf("\033[?1003l\n");  // Configure the terminal to stop reporting mouse movements
-
-	endwin();
+	backend->Shutdown();
+	delete backend;
+	backend = NULL;
 }
 
 
@@ -211,6 +197,31 @@ void Manager::PaintStatus(void)
 	tcw->OutHorizontalLine(rows - 1, 0, cols, ' ');
 	
 	tcw->OutText(rows - 1, 1, status.c_str());
+
+
+	// Print the render statistics in the debug view
+
+	if (renderStatsVisible) {
+		char buf[192];
+		snprintf(buf, sizeof(buf),
+				" frames %lu  skipped %lu  queue %d  blocked %.0f ms  latency %.1f ms ",
+				framesRendered.load(), framesSkipped.load(), outputQueue.load(),
+				outputBlockedTime * 1000, frameLatency * 1000);
+
+		const std::deque<OperationRecord>& ops = Operation::History();
+		if (!ops.empty()) {
+			char t[64];
+			size_t l = strlen(buf);
+			snprintf(buf + l, sizeof(buf) - l, " last op %s/s ",
+					Operation::Format(t, sizeof(t), ops.back().Throughput(),
+						ops.back().unit));
+		}
+
+		int c = cols - (int) strlen(buf) - 1;
+		if (c < 1) c = 1;
+		tcw->SetColor(0, 7);
+		tcw->OutText(rows - 1, c, buf);
+	}
 }
 
 
@@ -234,13 +245,13 @@ void Manager::Paint(void)
 
 	if (!validsize) {
 
-		wmove(win, 0, 0);
-		wattrset(win, COLOR_PAIR(1 * 8 + 0) | A_BOLD);
-		for (int i = 0; i < rows * cols; i++) waddch(win, ' ');
+		tcw->SetColor(1, 7);
+		tcw->SetAttribute(A_BOLD, true);
+		tcw->Clear();
 
 		const char* complaint = "The terminal is too small.";
 		int c = (cols - std::strlen(complaint)) / 2; if (c < 0) c = 0;
-		mvwaddstr(win, rows / 2, c, complaint);
+		tcw->OutText(rows / 2, c, complaint);
 
 		return;
 	}
@@ -312,6 +323,8 @@ void Manager::Close(Window* w)
 
 		Window* l = windows.empty() ? NULL : windows[windows.size() - 1];
 		if (l != NULL) l->NotifyActive();
+
+		w->OnClose();
 	}
 
 	Refresh();
@@ -428,56 +441,182 @@ std::vector<Window*>::iterator Manager::Find(Window* w)
 
 
 /**
- * Repaint the screen
+ * Repaint the screen. The frame is composed and sent to the terminal only
+ * once at the end of the current event loop iteration, so that multiple
+ * refresh requests result in a single screen update.
  */
 void Manager::Refresh(void)
 {
-	// Check whether the terminal has a valid size
+	framePending = true;
+}
 
-	if (!validsize) {
-		wrefresh(win);
-		move(rows - 1, cols - 1);
-		curs_set(FALSE);
+
+/**
+ * Update the cursor position (at the end of the event loop iteration)
+ */
+void Manager::UpdateCursor(void)
+{
+	cursorPending = true;
+}
+
+
+/**
+ * Determine where the cursor should be
+ *
+ * @param row where to store the screen row
+ * @param column where to store the screen column
+ * @return true if the cursor should be visible
+ */
+bool Manager::CursorLocation(int& row, int& column)
+{
+	row = rows - 1;
+	column = cols - 1;
+
+	Window* w = Top();
+	if (w == NULL || !w->CursorVisible()) return false;
+
+	if (w->CursorRow() >= w->Rows() - 1
+			|| w->CursorColumn() >= w->Columns() - 1) {
+		return false;
+	}
+
+	row = w->ScreenRow() + w->ClientRow() + w->CursorRow();
+	column = w->ScreenColumn() + w->ClientColumn() + w->CursorColumn();
+	return true;
+}
+
+
+/**
+ * Determine whether the terminal is behind with processing the output, in
+ * which case the next frame should be skipped
+ *
+ * @return true if the terminal output is backlogged
+ */
+bool Manager::OutputBacklogged(void)
+{
+	// Check how much of the previous output is still waiting in the tty
+	// buffers, which is the case for example over a congested SSH link
+
+	outputQueue = backend->OutputQueue();
+	if (outputQueue > APE_OUTPUT_QUEUE_THRESHOLD) return true;
+
+
+	// If the previous write blocked for a while, the terminal could not keep
+	// up, so give it at least the same amount of time to catch up
+
+	return Time() < outputBlockedUntil;
+}
+
+
+/**
+ * Compose the pending frame, if any, and pass it to the render thread
+ */
+void Manager::RenderFrame(void)
+{
+	if (!framePending && !cursorPending) return;
+
+	bool paint = framePending;
+	framePending = false;
+	cursorPending = false;
+
+
+	// Compose the frame (for cursor-only updates, the screen buffer already
+	// contains the most recently painted state)
+
+	if (paint || !validsize) Paint();
+
+	Frame* f = new Frame(tcw);
+	f->showCursor = validsize && CursorLocation(f->cursorRow, f->cursorColumn);
+
+	if (inputTime > 0) {
+		frameLatency = f->time - inputTime;
+		inputTime = 0;
+	}
+
+
+	// Unless the backend is to be used synchronously, hand off the frame
+	// through the single-slot exchange: If the render thread has not picked
+	// up the previous frame yet, because the terminal is behind, replace it,
+	// so that only the latest state gets rendered
+
+	if (!backend->RenderInBackground()) {
+		OutputFrame(f);
+		delete f;
 		return;
 	}
 
+	Frame* old = nextFrame.exchange(f);
+	if (old != NULL) {
+		delete old;
+		framesSkipped++;
+	}
 
-	// Paint
-	
-	Paint();
-	tcw->Paint(win);
-	wrefresh(win);
+	{
+		std::lock_guard<std::mutex> lock(renderWaitMutex);
+	}
+	renderWait.notify_one();
+}
+
+
+/**
+ * Output a frame to the terminal (called from the render thread, if used)
+ *
+ * @param frame the frame
+ */
+void Manager::OutputFrame(const Frame* frame)
+{
+	std::lock_guard<std::mutex> lock(terminalMutex);
+
+	double t = Time();
+	backend->Output(frame);
+
+	framesRendered++;
 
 
-	// Update the cursor location
+	// Measure how long the output blocked
 
-	UpdateCursor();
+	outputBlockedTime = Time() - t;
+	if (outputBlockedTime > APE_OUTPUT_BLOCKED_THRESHOLD) {
+		outputBlockedUntil = Time() + outputBlockedTime;
+	}
 }
 
 
 /**
- * Update the cursor position
+ * The main loop of the render thread
  */
-void Manager::UpdateCursor(void)
+void Manager::RenderThreadMain(void)
 {
-	Window* w = Top();
-	if (w != NULL) {
-		if (w->CursorVisible()) {
-			if (w->CursorRow() >= w->Rows() - 1
-					|| w->CursorColumn() >= w->Columns() - 1) {
-				move(rows - 1, cols - 1);
-				curs_set(FALSE);
-			}
-			else {
-                move(w->ScreenRow() + w->ClientRow() + w->CursorRow(),
-                     w->ScreenColumn() + w->ClientColumn() + w->CursorColumn());
-                curs_set(TRUE);
-			}
+	while (true) {
+
+		// Wait for a frame
+
+		{
+			std::unique_lock<std::mutex> lock(renderWaitMutex);
+			renderWait.wait(lock, [this] {
+				return nextFrame.load() != NULL || renderThreadStop;
+			});
 		}
-		else {
-			move(rows - 1, cols - 1);
-			curs_set(FALSE);
+
+		if (renderThreadStop) break;
+
+
+		// If the terminal is behind, give it time to catch up. The main
+		// thread keeps replacing the pending frame in the meantime.
+
+		if (OutputBacklogged()) {
+			usleep(5 * 1000);
+			continue;
 		}
+
+
+		// Output the most recent frame
+
+		Frame* f = nextFrame.exchange(NULL);
+		if (f == NULL) continue;
+
+		OutputFrame(f);
+		delete f;
 	}
 }
 
@@ -581,30 +720,22 @@ void Manager::TerminalResized(void)
 
 	// Get the screen size
 
-	struct winsize size;
-	size.ws_row = size.ws_col = 0;
-
-	ioctl(0, TIOCGWINSZ, &size);
-	if (size.ws_row && size.ws_col) {
-		rows = size.ws_row;
-		cols = size.ws_col;
-	}
-
-
-	// Resize the terminal
+	backend->QuerySize(rows, cols);
 
-	resizeterm(rows, cols);
 
+	// Nothing to do if the size did not change. This is important, because
+	// curses can report another KEY_RESIZE after resizeterm(), which would
+	// otherwise result in an endless loop.
 
-	// Calculate the deltas
+	if (rows == o_rows && cols == o_cols) return;
 
-	int drows = rows - o_rows;
-	int dcols = cols - o_cols;
 
+	// Resize the terminal
 
-	// Resize the main window
+	std::unique_lock<std::mutex> lock(terminalMutex);
+	backend->Resize(rows, cols);
+	lock.unlock();
 
-	wresize(win, rows, cols);
 	tcw->Resize(rows, cols);
 
 
@@ -658,106 +789,9 @@ void Manager::ProcessMessages(void)
 	int key;
 	processMessagesDepth++;
 
-	while ((key = getch()) != ERR) {
-
-
-		// Translate the Shift-Arrow key combinations
-
-		if (key == KEY_SR) key = KEY_SHIFT_UP;
-		else if (key == KEY_SF) key = KEY_SHIFT_DOWN;
-		else if (key == 519)  key = KEY_SHIFT_UP;
-		else if (key == 512) key = KEY_SHIFT_DOWN;
-
-		if (key == KEY_SLEFT ) key = KEY_SHIFT_LEFT;
-		if (key == KEY_SRIGHT) key = KEY_SHIFT_RIGHT;
-		if (key == KEY_SHOME ) key = KEY_SHIFT_HOME;
-		if (key == KEY_SEND  ) key = KEY_SHIFT_END;
-
-
-		// Translate other escape sequences
-
-		if (key == KEY_ESC) {
-			key = getch();
-			
-			//log(LL_DEBUG, "> %c %d", key, key);
-			//key = getch(); log(LL_DEBUG, "- %c %d", key, key);
-			//key = getch(); log(LL_DEBUG, "- %c %d", key, key);
-			//key = getch(); log(LL_DEBUG, "- %c %d", key, key);continue;
-			
-			if (key == ERR) key = KEY_ESC;
-
-			else if (key == 'O') {
-				key = getch();
-				if (key == '2') {
-					key = getch();
-					switch (key) {
-						case 'A': key = KEY_SHIFT_UP; break;
-						case 'B': key = KEY_SHIFT_DOWN; break;
-						case 'C': key = KEY_SHIFT_RIGHT; break;
-						case 'D': key = KEY_SHIFT_LEFT; break;
-						case 'H': key = KEY_SHIFT_HOME; break;
-						case 'F': key = KEY_SHIFT_END; break;
-					}
-				}
-				else {
-					switch (key) {
-						case 'A': key = KEY_UP; break;
-						case 'B': key = KEY_DOWN; break;
-						case 'C': key = KEY_RIGHT; break;
-						case 'D': key = KEY_LEFT; break;
-					}
-				}
-			}
-
-			else if (key == '[') {
-				key = getch();
-				if (key == '1') {
-					key = getch();
-					
-					switch (key) {
-						case '~': key = KEY_HOME; break;
-					}
-
-					if (key == ';') {
-						key = getch();
-						if (key == '1') {
-							key = getch();
-							if (key == '0') {
-								key = getch();
-								switch (key) {
-									case 'A': key = KEY_SHIFT_ALT_UP; break;
-									case 'B': key = KEY_SHIFT_ALT_DOWN; break;
-									case 'C': key = KEY_SHIFT_ALT_RIGHT; break;
-									case 'D': key = KEY_SHIFT_ALT_LEFT; break;
-									case 'H': key = KEY_SHIFT_ALT_HOME; break;
-									case 'F': key = KEY_SHIFT_ALT_END; break;
-								}
-							}
-						}
-					}
-				}
-			
-				else if (key == '4') {
-					key = getch();
-					switch (key) {
-						case '~': key = KEY_END; break;
-					}
-				}
-			}
+	while ((key = ReadKey()) != ERR) {
 
-			else if (key == KEY_ESC) {
-				key = getch();
-				if (key == '[') {
-					key = getch();
-					switch (key) {
-						case 'A': key = KEY_ALT_UP; break;
-						case 'B': key = KEY_ALT_DOWN; break;
-						case 'C': key = KEY_ALT_RIGHT; break;
-						case 'D': key = KEY_ALT_LEFT; break;
-					}
-				}
-			}
-		}
+		if (inputTime == 0) inputTime = Time();
 
 
 		// Handle special events
@@ -772,7 +806,7 @@ void Manager::ProcessMessages(void)
 		
 		if (key == KEY_MOUSE) {
 			MEVENT event;
-			if (getmouse(&event) != OK) {
+			if (!ReadMouse(event)) {
 				log(LL_WARNING, "Error in getmouse()");
 			}
 			else {
@@ -1067,6 +1101,16 @@ void Manager::ProcessMessages(void)
 		}
 
 
+		// Handle text pasted into the terminal
+
+		if (key == KEY_PASTE) {
+			if (!ReadPaste(pastedText)) {
+				log(LL_WARNING, "Error reading the pasted text");
+				continue;
+			}
+		}
+
+
 		// Keyboard events
 
 		if (key != ERR) {
@@ -1077,7 +1121,10 @@ void Manager::ProcessMessages(void)
 				if (key == KEY_CTRL('c') || key == KEY_CTRL('q') || key == KEY_ESC) std::exit(1);
 			}
 
-			if (key == KEY_CTRL('q')) std::exit(0);
+			if (key == KEY_CTRL('q')) {
+				EditorDocument::WaitForBackgroundSaves();
+				std::exit(0);
+			}
 
 			if (key == KEY_F(2) || key == KEY_CTRL('w')) {
 				Window* w = Top();
@@ -1098,6 +1145,11 @@ void Manager::ProcessMessages(void)
 				}
 			}
 
+			else if (key == KEY_F(11)) {
+				renderStatsVisible = !renderStatsVisible;
+				Refresh();
+			}
+
 			/*else if (key == KEY_F(12)) {
 				if (windowSwitcher == NULL) {
 					windowSwitcher = new WindowSwitcher(true);
@@ -1120,19 +1172,21 @@ void Manager::ProcessMessages(void)
 				else {
 					FileDialog* d = new FileDialog(NULL, FILE_DIALOG_OPEN, "Open");
 					openDialog = d;
-					if (d->Run()) {
+					d->Run([this, d](bool ok) {
+						openDialog = NULL;
+						if (!ok) return;
+
 						// TODO Window placement
 						EditorWindow* w = new EditorWindow(1, 1, 20, 64);
-						ReturnExt r = w->LoadFromFile(d->Path().c_str());
+						ReturnExt r = w->Open(d->Path().c_str());
 						if (!r) {
 							w->Close();
-							Dialogs::Error(NULL, r);
+							if (r.ErrorCode() != ECANCELED) Dialogs::Error(NULL, r);
 						}
 						else {
 							wm.Add(w);
 						}
-					}
-					openDialog = NULL;
+					});
 				}
 			}
 
@@ -1151,6 +1205,12 @@ void Manager::ProcessMessages(void)
 	}
 
 
+	// Run the tasks posted by the other threads, but leave enough time to
+	// keep the user interface responsive
+
+	tasksPending = tasks.RunPending(APE_TASK_TIME_BUDGET);
+
+
 	// Time step
 
 	if (Top() != NULL) {
@@ -1158,12 +1218,141 @@ void Manager::ProcessMessages(void)
 	}
 
 
+	// Output a single frame for all events processed in this iteration
+
+	RenderFrame();
+
+
 	// Finish
 	
 	processMessagesDepth--;
 }
 
 
+/**
+ * Discard all pending input
+ */
+void Manager::DiscardInput(void)
+{
+	backend->DiscardInput();
+}
+
+
+/**
+ * Read the next key, either one deferred during a long operation, or
+ * from the terminal
+ *
+ * @return the key code, or ERR if there are no more events
+ */
+int Manager::ReadKey(void)
+{
+	if (!deferredEvents.empty()) {
+		currentEvent = std::move(deferredEvents.front());
+		currentDeferred = true;
+		deferredEvents.pop_front();
+		return currentEvent.key;
+	}
+
+	currentDeferred = false;
+	return backend->ReadKey();
+}
+
+
+/**
+ * Read the mouse event after ReadKey() returned KEY_MOUSE
+ *
+ * @param event where to store the mouse event
+ * @return true on success
+ */
+bool Manager::ReadMouse(MEVENT& event)
+{
+	if (currentDeferred) {
+		event = currentEvent.mouse;
+		return true;
+	}
+
+	return backend->ReadMouse(event);
+}
+
+
+/**
+ * Read the pasted text after ReadKey() returned KEY_PASTE
+ *
+ * @param text where to store the text
+ * @return true on success
+ */
+bool Manager::ReadPaste(std::string& text)
+{
+	if (currentDeferred) {
+		text = currentEvent.text;
+		return true;
+	}
+
+	return backend->ReadPaste(text);
+}
+
+
+/**
+ * Check whether the user asked to interrupt a long operation that runs
+ * on the user interface thread, by pressing Ctrl+C or Esc. The other
+ * keys, the mouse events, and the pasted text are deferred until the next
+ * ProcessMessages().
+ *
+ * @return true if the user asked to interrupt the operation
+ */
+bool Manager::PollInterrupt(void)
+{
+	if (!initialized) return false;
+
+	int key;
+	while ((key = backend->ReadKey()) != ERR) {
+
+		if (key == KEY_CTRL('c') || key == KEY_ESC) return true;
+
+		DeferredEvent e = DeferredEvent();
+		e.key = key;
+
+		if (key == KEY_MOUSE) {
+			if (!backend->ReadMouse(e.mouse)) continue;
+		}
+		else if (key == KEY_PASTE) {
+			if (!backend->ReadPaste(e.text)) continue;
+		}
+
+		deferredEvents.push_back(std::move(e));
+	}
+
+	return false;
+}
+
+
+/**
+ * Output a frame right away, such as to show progress from within a long
+ * operation that runs on the user interface thread
+ */
+void Manager::Flush(void)
+{
+	if (!initialized) return;
+
+	Refresh();
+	RenderFrame();
+}
+
+
+/**
+ * Wait until there is something for ProcessMessages() to do: input,
+ * posted tasks, or the timeout
+ *
+ * @param timeout the maximum time to wait in seconds
+ */
+void Manager::WaitForEvents(double timeout)
+{
+	if (tasksPending || !deferredEvents.empty()) return;
+
+	backend->WaitForInput(tasks.FileDescriptor(), timeout);
+}
+
+
 /**
  * Set the contents of the status bar
  *
@@ -35,9 +35,16 @@
 #ifndef __MANAGER_H
 #define __MANAGER_H
 
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
 #include <vector>
 
 #include "MenuWindow.h"
+#include "TaskQueue.h"
+#include "TerminalBackend.h"
 #include "Window.h"
 #include "WindowSwitcher.h"
 
@@ -61,11 +68,48 @@ class Manager
 	std::vector<MenuWindow*> menuWindows;
 	WindowSwitcher* windowSwitcher;
 
-	WINDOW* win;
+	TerminalBackend* backend;
 	TerminalControlWindow* tcw;
+
+	TaskQueue tasks;
+	bool tasksPending;
+
+	/**
+	 * An input event deferred during a long operation
+	 */
+	struct DeferredEvent
+	{
+		int key;
+		MEVENT mouse;		// The mouse event for KEY_MOUSE
+		std::string text;	// The pasted text for KEY_PASTE
+	};
+
+	std::deque<DeferredEvent> deferredEvents;
+	DeferredEvent currentEvent;
+	bool currentDeferred;
+
+	bool framePending;
+	bool cursorPending;
+
+	std::thread renderThread;
+	std::mutex terminalMutex;
+	std::mutex renderWaitMutex;
+	std::condition_variable renderWait;
+	std::atomic<Frame*> nextFrame;
+	std::atomic<bool> renderThreadStop;
+
+	std::atomic<unsigned long> framesRendered;
+	std::atomic<unsigned long> framesSkipped;
+	std::atomic<int> outputQueue;
+	std::atomic<double> outputBlockedTime;
+	double outputBlockedUntil;
+	std::atomic<double> frameLatency;
+	double inputTime;
+	bool renderStatsVisible;
 	
 	std::string status;
 	std::string clipboard;
+	std::string pastedText;
 
 	int processMessagesDepth;
 	Window* openDialog;
@@ -116,6 +160,64 @@ class Manager
 	 */
 	void PaintMenuBar(void);
 
+	/**
+	 * Determine where the cursor should be
+	 *
+	 * @param row where to store the screen row
+	 * @param column where to store the screen column
+	 * @return true if the cursor should be visible
+	 */
+	bool CursorLocation(int& row, int& column);
+
+	/**
+	 * Determine whether the terminal is behind with processing the output,
+	 * in which case the next frame should be skipped
+	 *
+	 * @return true if the terminal output is backlogged
+	 */
+	bool OutputBacklogged(void);
+
+	/**
+	 * Compose the pending frame, if any, and pass it to the render thread
+	 */
+	void RenderFrame(void);
+
+	/**
+	 * Read the next key, either one deferred during a long operation, or
+	 * from the terminal
+	 *
+	 * @return the key code, or ERR if there are no more events
+	 */
+	int ReadKey(void);
+
+	/**
+	 * Read the mouse event after ReadKey() returned KEY_MOUSE
+	 *
+	 * @param event where to store the mouse event
+	 * @return true on success
+	 */
+	bool ReadMouse(MEVENT& event);
+
+	/**
+	 * Read the pasted text after ReadKey() returned KEY_PASTE
+	 *
+	 * @param text where to store the text
+	 * @return true on success
+	 */
+	bool ReadPaste(std::string& text);
+
+	/**
+	 * Output a frame to the terminal (called from the render thread, if used)
+	 *
+	 * @param frame the frame
+	 */
+	void OutputFrame(const Frame* frame);
+
+	/**
+	 * The main loop of the render thread
+	 */
+	void RenderThreadMain(void);
+
 
 protected:
 
@@ -139,8 +241,11 @@ public:
 
 	/**
 	 * Initialize
+	 *
+	 * @param backend the terminal backend (will be destroyed by the window
+	 *                manager), or NULL to use curses
 	 */
-	void Initialize(void);
+	void Initialize(TerminalBackend* backend = NULL);
 
 	/**
 	 * Shutdown
@@ -213,15 +318,40 @@ public:
 	void CloseTopMenu(int code = -1);
 
 	/**
-	 * Repaint the screen
+	 * Repaint the screen. The frame is composed and sent to the terminal
+	 * only once at the end of the current event loop iteration, so that
+	 * multiple refresh requests result in a single screen update.
 	 */
 	void Refresh(void);
 
 	/**
-	 * Update the cursor position
+	 * Update the cursor position (at the end of the event loop iteration)
 	 */
 	void UpdateCursor(void);
 
+	/**
+	 * Get the time between reading the most recent input and handing off
+	 * the resulting frame to the render thread
+	 *
+	 * @return the latency in seconds
+	 */
+	inline double FrameLatency(void) { return frameLatency; }
+
+	/**
+	 * Get the number of frames sent to the terminal
+	 *
+	 * @return the number of rendered frames
+	 */
+	inline unsigned long FramesRendered(void) { return framesRendered; }
+
+	/**
+	 * Get the number of frames that were skipped, because the terminal was
+	 * behind with processing the output
+	 *
+	 * @return the number of skipped frames
+	 */
+	inline unsigned long FramesSkipped(void) { return framesSkipped; }
+
 	/**
 	 * Raise a window to the top
 	 *
@@ -254,11 +384,49 @@ public:
 	void ProcessMessages(void);
 
 	/**
-	 * Return the screen
+	 * Return the terminal backend
+	 *
+	 * @return the backend
+	 */
+	inline TerminalBackend* Backend(void) { return backend; }
+
+	/**
+	 * Discard all pending input
+	 */
+	void DiscardInput(void);
+
+	/**
+	 * Check whether the user asked to interrupt a long operation that runs
+	 * on the user interface thread, by pressing Ctrl+C or Esc. The other
+	 * keys, the mouse events, and the pasted text are deferred until
+	 * the next ProcessMessages().
+	 *
+	 * @return true if the user asked to interrupt the operation
+	 */
+	bool PollInterrupt(void);
+
+	/**
+	 * Output a frame right away, such as to show progress from within a long
+	 * operation that runs on the user interface thread
+	 */
+	void Flush(void);
+
+	/**
+	 * Wait until there is something for ProcessMessages() to do: input,
+	 * posted tasks, or the timeout
 	 *
-	 * @return the screen handle
+	 * @param timeout the maximum time to wait in seconds
 	 */
-	inline WINDOW* Screen(void) { return win; }
+	void WaitForEvents(double timeout);
+
+	/**
+	 * Post a task to run on the user interface thread as a part of the
+	 * event loop. This can be called from any thread, and it is the only
+	 * way for the other threads to interact with the user interface.
+	 *
+	 * @param task the task
+	 */
+	inline void Post(const std::function<void(void)>& task) { tasks.Post(task); }
 	
 	/**
 	 * Set the contents of the status bar
@@ -287,6 +455,14 @@ public:
 	 * @param s the new contents of the clipboard
 	 */
 	inline void SetClipboard(const std::string& s) { clipboard = s; }
+
+	/**
+	 * Get the text from the most recent paste from the terminal, which is
+	 * valid while KEY_PASTE is being handled
+	 *
+	 * @return the pasted text
+	 */
+	inline const char* PastedText(void) { return pastedText.c_str(); }
 };
 
 extern Manager wm;
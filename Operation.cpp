@@ -0,0 +1,341 @@
+/*
+ * Operation.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "Operation.h"
+
+#include "Manager.h"
+
+std::deque<OperationRecord> Operation::history;
+
+
+/**
+ * Create an instance of class Operation
+ *
+ * @param description the description, such as "Loading file.txt"
+ * @param total the total amount of work, or 0 if unknown
+ * @param unit the unit of work
+ */
+Operation::Operation(const char* description, uint64_t total,
+		OperationUnit unit)
+{
+	this->description = description;
+	this->unit = unit;
+	this->total = total;
+	done = 0;
+
+	startTime = Time();
+	lastUpdate = startTime;
+	shown = false;
+	cancelled = false;
+	finished = false;
+}
+
+
+/**
+ * Destroy the object, finishing the operation if needed
+ */
+Operation::~Operation(void)
+{
+	Finish();
+}
+
+
+/**
+ * Format an amount of work for display
+ *
+ * @param buf the output buffer
+ * @param size the size of the buffer
+ * @param amount the amount of work
+ * @param unit the unit
+ * @return buf
+ */
+char* Operation::Format(char* buf, size_t size, double amount,
+		OperationUnit unit)
+{
+	if (unit == OPERATION_UNIT_LINES) {
+		snprintf(buf, size, "%.0lf lines", amount);
+	}
+	else if (amount >= 1024.0 * 1024 * 1024) {
+		snprintf(buf, size, "%.1lf GB", amount / (1024.0 * 1024 * 1024));
+	}
+	else if (amount >= 1024.0 * 1024) {
+		snprintf(buf, size, "%.1lf MB", amount / (1024.0 * 1024));
+	}
+	else if (amount >= 1024.0) {
+		snprintf(buf, size, "%.1lf KB", amount / 1024.0);
+	}
+	else {
+		snprintf(buf, size, "%.0lf bytes", amount);
+	}
+
+	return buf;
+}
+
+
+/**
+ * Show the progress in the status bar
+ */
+void Operation::ShowProgress(void)
+{
+	char buf[256];
+	char amount[64];
+
+	if (total > 0) {
+		int percent = (int) (done * 100.0 / total);
+		if (percent > 100) percent = 100;
+		snprintf(buf, sizeof(buf), "%s: %d%%  (Ctrl+C to cancel)",
+				description.c_str(), percent);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%s: %s  (Ctrl+C to cancel)",
+				description.c_str(), Format(amount, sizeof(amount), done, unit));
+	}
+
+	wm.SetStatus(buf);
+	wm.Flush();
+	shown = true;
+}
+
+
+/**
+ * Report the progress, and check whether the user cancelled the
+ * operation
+ *
+ * @param done the amount of work done so far
+ * @return true to continue, false if the operation was cancelled
+ */
+bool Operation::Update(uint64_t done)
+{
+	this->done = done;
+	if (cancelled) return false;
+
+	double now = Time();
+	if (now - lastUpdate < APE_OPERATION_PROGRESS_INTERVAL) return true;
+	lastUpdate = now;
+
+	if (wm.PollInterrupt()) {
+		cancelled = true;
+		return false;
+	}
+
+	if (now - startTime >= APE_OPERATION_PROGRESS_DELAY) ShowProgress();
+
+	return true;
+}
+
+
+/**
+ * Finish the operation, and record its throughput
+ */
+void Operation::Finish(void)
+{
+	if (finished) return;
+	finished = true;
+
+
+	// Record the operation
+
+	OperationRecord r;
+	r.description = description;
+	r.unit = unit;
+	r.amount = done;
+	r.time = Time() - startTime;
+	r.cancelled = cancelled;
+
+	Record(r);
+
+
+	// Report the result if the progress was shown
+
+	if (shown) {
+		char buf[256];
+		wm.SetStatus(FormatResult(buf, sizeof(buf), r));
+		wm.Refresh();
+	}
+}
+
+
+/**
+ * Add the record of a finished operation to the history. This must be
+ * called from the main thread.
+ *
+ * @param record the record
+ */
+void Operation::Record(const OperationRecord& record)
+{
+	history.push_back(record);
+	while (history.size() > APE_OPERATION_HISTORY) history.pop_front();
+}
+
+
+/**
+ * Format the result of a finished operation for the status bar
+ *
+ * @param buf the output buffer
+ * @param size the size of the buffer
+ * @param record the record of the operation
+ * @return buf
+ */
+char* Operation::FormatResult(char* buf, size_t size,
+		const OperationRecord& record)
+{
+	char amount[64];
+	char throughput[64];
+
+	if (record.cancelled) {
+		snprintf(buf, size, "%s: cancelled", record.description.c_str());
+	}
+	else {
+		snprintf(buf, size, "%s: %s in %.2lf s (%s/s)",
+				record.description.c_str(),
+				Format(amount, sizeof(amount), record.amount, record.unit),
+				record.time,
+				Format(throughput, sizeof(throughput), record.Throughput(),
+					record.unit));
+	}
+
+	return buf;
+}
+
+
+/**
+ * Create an instance of class BackgroundOperation
+ *
+ * @param description the description, such as "Saving file.txt"
+ * @param total the total amount of work, or 0 if unknown
+ * @param unit the unit of work
+ * @param token the cancellation token
+ */
+BackgroundOperation::BackgroundOperation(const char* description,
+		uint64_t total, OperationUnit unit, const CancellationToken& token)
+	: token(token)
+{
+	this->description = description;
+	this->unit = unit;
+	this->total = total;
+	done = 0;
+
+	startTime = Time();
+	lastUpdate = startTime;
+	shown = false;
+	cancelled = false;
+	finished = false;
+}
+
+
+/**
+ * Destroy the object, finishing the operation if needed
+ */
+BackgroundOperation::~BackgroundOperation(void)
+{
+	Finish();
+}
+
+
+/**
+ * Report the progress, and check whether the operation was cancelled
+ *
+ * @param done the amount of work done so far
+ * @return true to continue, false if the operation was cancelled
+ */
+bool BackgroundOperation::Update(uint64_t done)
+{
+	this->done = done;
+	if (cancelled) return false;
+
+	if (token.Cancelled()) {
+		cancelled = true;
+		return false;
+	}
+
+	double now = Time();
+	if (now - lastUpdate < APE_OPERATION_PROGRESS_INTERVAL) return true;
+	lastUpdate = now;
+
+	if (now - startTime < APE_OPERATION_PROGRESS_DELAY) return true;
+
+
+	// Show the progress on the main thread
+
+	char buf[256];
+	char amount[64];
+
+	if (total > 0) {
+		int percent = (int) (done * 100.0 / total);
+		if (percent > 100) percent = 100;
+		snprintf(buf, sizeof(buf), "%s: %d%%", description.c_str(), percent);
+	}
+	else {
+		snprintf(buf, sizeof(buf), "%s: %s", description.c_str(),
+				Operation::Format(amount, sizeof(amount), done, unit));
+	}
+
+	std::string status = buf;
+	wm.Post([status]() {
+		wm.SetStatus(status.c_str());
+		wm.Refresh();
+	});
+	shown = true;
+
+	return true;
+}
+
+
+/**
+ * Finish the operation, and record its throughput on the main thread
+ */
+void BackgroundOperation::Finish(void)
+{
+	if (finished) return;
+	finished = true;
+
+	OperationRecord r;
+	r.description = description;
+	r.unit = unit;
+	r.amount = done;
+	r.time = Time() - startTime;
+	r.cancelled = cancelled;
+
+	bool shown = this->shown;
+	wm.Post([r, shown]() {
+		Operation::Record(r);
+		if (shown) {
+			char buf[256];
+			wm.SetStatus(Operation::FormatResult(buf, sizeof(buf), r));
+			wm.Refresh();
+		}
+	});
+}
@@ -0,0 +1,289 @@
+/*
+ * Operation.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __OPERATION_H
+#define __OPERATION_H
+
+#include <deque>
+#include <string>
+
+#include <stdint.h>
+
+#include "ThreadPool.h"
+
+
+/**
+ * The time after which the progress of an operation appears in the status
+ * bar, and the interval between the updates
+ */
+#define APE_OPERATION_PROGRESS_DELAY	0.200	/* seconds */
+#define APE_OPERATION_PROGRESS_INTERVAL	0.100	/* seconds */
+
+/**
+ * The number of finished operations to remember
+ */
+#define APE_OPERATION_HISTORY	16
+
+
+/**
+ * The units of work of an operation
+ */
+enum OperationUnit
+{
+	OPERATION_UNIT_BYTES,
+	OPERATION_UNIT_LINES,
+};
+
+
+/**
+ * The record of a finished operation
+ */
+struct OperationRecord
+{
+	std::string description;
+	OperationUnit unit;
+	uint64_t amount;
+	double time;
+	bool cancelled;
+
+
+	/**
+	 * Get the throughput
+	 *
+	 * @return the number of units per second
+	 */
+	inline double Throughput(void) const
+	{
+		return time > 0 ? amount / time : 0;
+	}
+};
+
+
+/**
+ * A long-running operation on the user interface thread. The operation
+ * reports its progress in the status bar, and the user can cancel it by
+ * pressing Ctrl+C or Esc. The operation should check Update() periodically
+ * and stop if it returns false, leaving the document unchanged.
+ *
+ * @author Peter Macko
+ */
+class Operation
+{
+	static std::deque<OperationRecord> history;
+
+	std::string description;
+	OperationUnit unit;
+	uint64_t total;
+	uint64_t done;
+
+	double startTime;
+	double lastUpdate;
+	bool shown;
+	bool cancelled;
+	bool finished;
+
+
+	/**
+	 * Show the progress in the status bar
+	 */
+	void ShowProgress(void);
+
+
+public:
+
+	/**
+	 * Create an instance of class Operation
+	 *
+	 * @param description the description, such as "Loading file.txt"
+	 * @param total the total amount of work, or 0 if unknown
+	 * @param unit the unit of work
+	 */
+	Operation(const char* description, uint64_t total,
+			OperationUnit unit = OPERATION_UNIT_BYTES);
+
+	/**
+	 * Destroy the object, finishing the operation if needed
+	 */
+	virtual ~Operation(void);
+
+	/**
+	 * Report the progress, and check whether the user cancelled the
+	 * operation
+	 *
+	 * @param done the amount of work done so far
+	 * @return true to continue, false if the operation was cancelled
+	 */
+	bool Update(uint64_t done);
+
+	/**
+	 * Set the amount of work done so far without checking for cancellation,
+	 * for the work done between the calls to Update()
+	 *
+	 * @param done the amount of work done so far
+	 */
+	inline void SetDone(uint64_t done) { this->done = done; }
+
+	/**
+	 * Finish the operation, and record its throughput
+	 */
+	void Finish(void);
+
+	/**
+	 * Determine whether the operation was cancelled
+	 *
+	 * @return true if it was cancelled
+	 */
+	inline bool Cancelled(void) { return cancelled; }
+
+	/**
+	 * Get the records of the recently finished operations, the most recent
+	 * last
+	 *
+	 * @return the records
+	 */
+	static const std::deque<OperationRecord>& History(void) { return history; }
+
+	/**
+	 * Add the record of a finished operation to the history. This must be
+	 * called from the main thread.
+	 *
+	 * @param record the record
+	 */
+	static void Record(const OperationRecord& record);
+
+	/**
+	 * Format the result of a finished operation for the status bar
+	 *
+	 * @param buf the output buffer
+	 * @param size the size of the buffer
+	 * @param record the record of the operation
+	 * @return buf
+	 */
+	static char* FormatResult(char* buf, size_t size,
+			const OperationRecord& record);
+
+	/**
+	 * Format an amount of work for display
+	 *
+	 * @param buf the output buffer
+	 * @param size the size of the buffer
+	 * @param amount the amount of work
+	 * @param unit the unit
+	 * @return buf
+	 */
+	static char* Format(char* buf, size_t size, double amount,
+			OperationUnit unit);
+};
+
+
+
+/**
+ * A long-running operation on a worker thread. The progress is shown in the
+ * status bar by posting updates to the main thread, and the operation can be
+ * cancelled using its cancellation token. The object itself should be used
+ * only by the thread that runs the operation.
+ *
+ * @author Peter Macko
+ */
+class BackgroundOperation
+{
+	std::string description;
+	OperationUnit unit;
+	uint64_t total;
+	uint64_t done;
+	CancellationToken token;
+
+	double startTime;
+	double lastUpdate;
+	bool shown;
+	bool cancelled;
+	bool finished;
+
+
+public:
+
+	/**
+	 * Create an instance of class BackgroundOperation
+	 *
+	 * @param description the description, such as "Saving file.txt"
+	 * @param total the total amount of work, or 0 if unknown
+	 * @param unit the unit of work
+	 * @param token the cancellation token
+	 */
+	BackgroundOperation(const char* description, uint64_t total,
+			OperationUnit unit = OPERATION_UNIT_BYTES,
+			const CancellationToken& token = CancellationToken());
+
+	/**
+	 * Destroy the object, finishing the operation if needed
+	 */
+	virtual ~BackgroundOperation(void);
+
+	/**
+	 * Set the total amount of work, if it was not known at the beginning
+	 *
+	 * @param total the total amount of work
+	 */
+	inline void SetTotal(uint64_t total) { this->total = total; }
+
+	/**
+	 * Report the progress, and check whether the operation was cancelled
+	 *
+	 * @param done the amount of work done so far
+	 * @return true to continue, false if the operation was cancelled
+	 */
+	bool Update(uint64_t done);
+
+	/**
+	 * Set the amount of work done so far without checking for cancellation
+	 *
+	 * @param done the amount of work done so far
+	 */
+	inline void SetDone(uint64_t done) { this->done = done; }
+
+	/**
+	 * Finish the operation, and record its throughput on the main thread
+	 */
+	void Finish(void);
+
+	/**
+	 * Determine whether the operation was cancelled
+	 *
+	 * @return true if it was cancelled
+	 */
+	inline bool Cancelled(void) { return cancelled; }
+};
+
+#endif
@@ -0,0 +1,447 @@
+/*
+ * Pager.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stdafx.h"
+#include "Pager.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "Manager.h"
+#include "Operation.h"
+
+
+/**
+ * Create an instance of class PagerDocument
+ */
+PagerDocument::PagerDocument(void)
+{
+	fd = -1;
+	fileSize = 0;
+	map = NULL;
+
+	blockOffsets.push_back(0);
+	scanned = 0;
+	numLines = 1;
+	indexed = true;
+	notifiedLines = 1;
+
+	maxDisplayLength = 0;
+
+	SetFeatures(DOCUMENT_FEATURES_ALL
+			& ~DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_FULL_LOAD));
+}
+
+
+/**
+ * Destroy the object
+ */
+PagerDocument::~PagerDocument(void)
+{
+	// Stop the indexer, and wait for it to finish, since it uses the file
+
+	if (indexer) {
+		indexer->token.Cancel();
+		std::unique_lock<std::mutex> lock(indexer->mutex);
+		indexer->done.wait(lock, [this]() { return !indexer->running; });
+		indexer->document = NULL;
+	}
+
+	if (map != NULL) munmap((void*) map, fileSize);
+	if (fd >= 0) close(fd);
+}
+
+
+/**
+ * Open a file, and start indexing it in the background
+ *
+ * @param file the file name
+ * @return a ReturnExt
+ */
+ReturnExt PagerDocument::Open(const char* file)
+{
+	if (fd >= 0) return ReturnExt(false, "A file is already open");
+
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return ReturnExt(false, "Cannot open the file", errno);
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+		int e = errno;
+		close(fd);
+		fd = -1;
+		return ReturnExt(false, "Only regular files can be paged",
+				e == 0 ? EINVAL : e);
+	}
+
+	fileSize = st.st_size;
+	SetFeatures(FeaturePolicy::Features(fileSize)
+			& ~DOCUMENT_FEATURE_BIT(DOCUMENT_FEATURE_FULL_LOAD));
+
+
+	// Map the file if possible; otherwise we fall back to pread
+
+	if (fileSize > 0 && fileSize == (size_t) fileSize) {
+		void* m = mmap(NULL, fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (m != MAP_FAILED) map = (const char*) m;
+	}
+
+	SetFileName(file);
+
+
+	// Start indexing the file in the background
+
+	if (fileSize == 0) return ReturnExt(true);
+
+	indexed = false;
+	indexer = std::make_shared<Indexer>();
+	indexer->document = this;
+	indexer->running = true;
+
+	std::shared_ptr<Indexer> state = indexer;
+	pool.Submit([this, state]() {
+		BuildIndex();
+
+		std::lock_guard<std::mutex> lock(state->mutex);
+		state->running = false;
+		state->done.notify_all();
+	}, TASK_PRIORITY_BACKGROUND);
+
+	return ReturnExt(true);
+}
+
+
+/**
+ * Get a range of the file
+ *
+ * @param offset the file offset
+ * @param length the maximum number of bytes
+ * @param buffer the buffer to read to if the file is not mapped
+ * @param data where to store the pointer to the data
+ * @return the number of bytes available, or 0 on error or end of file
+ */
+size_t PagerDocument::Fetch(uint64_t offset, size_t length, char* buffer,
+		const char** data)
+{
+	if (offset >= fileSize) return 0;
+	if (length > fileSize - offset) length = fileSize - offset;
+
+	if (map != NULL) {
+		*data = map + offset;
+		return length;
+	}
+
+	ssize_t n;
+	do {
+		n = pread(fd, buffer, length, offset);
+	}
+	while (n < 0 && errno == EINTR);
+
+	*data = buffer;
+	return n < 0 ? 0 : (size_t) n;
+}
+
+
+/**
+ * Build the sparse line index (runs on a worker thread)
+ */
+void PagerDocument::BuildIndex(void)
+{
+	const char* file = FileName();
+	const char* base = strrchr(file, '/');
+	std::string description = "Indexing ";
+	description += base == NULL ? file : base + 1;
+
+	BackgroundOperation op(description.c_str(), fileSize,
+			OPERATION_UNIT_BYTES, indexer->token);
+
+	std::vector<char> buffer(map == NULL ? APE_PAGER_READ_SIZE : 0);
+	std::vector<uint64_t> newOffsets;
+	std::shared_ptr<Indexer> state = indexer;
+
+	uint64_t pos = 0;
+	int64_t count = 0;
+	double lastNotify = Time();
+
+	while (pos < fileSize) {
+
+		const char* data;
+		size_t n = Fetch(pos, APE_PAGER_READ_SIZE, buffer.data(), &data);
+		if (n == 0) break;
+
+
+		// Find the line breaks, remembering the offset of every line that
+		// starts a new block
+
+		const char* p = data;
+		const char* end = data + n;
+
+		while ((p = (const char*) memchr(p, '\n', end - p)) != NULL) {
+			p++;
+			count++;
+			if (count % APE_PAGER_BLOCK_LINES == 0) {
+				newOffsets.push_back(pos + (p - data));
+			}
+		}
+
+
+		// Release the scanned pages from the mapping, so that the memory
+		// use stays bounded
+
+		if (map != NULL) {
+			uintptr_t page = sysconf(_SC_PAGESIZE);
+			uintptr_t a = (uintptr_t) data & ~(page - 1);
+			uintptr_t b = (uintptr_t) end & ~(page - 1);
+			if (b > a) madvise((void*) a, b - a, MADV_DONTNEED);
+		}
+
+		pos += n;
+
+
+		// Publish the progress
+
+		{
+			std::lock_guard<std::mutex> lock(indexMutex);
+			blockOffsets.insert(blockOffsets.end(), newOffsets.begin(),
+					newOffsets.end());
+			scanned = pos;
+		}
+
+		newOffsets.clear();
+		numLines = count + 1;
+
+		if (!op.Update(pos)) break;
+
+		double now = Time();
+		if (now - lastNotify >= APE_OPERATION_PROGRESS_INTERVAL) {
+			lastNotify = now;
+			wm.Post([state]() {
+				if (state->document != NULL) state->document->NotifyIndexed();
+			});
+		}
+	}
+
+	op.Finish();
+	indexed = pos >= fileSize;
+
+	wm.Post([state]() {
+		if (state->document != NULL) state->document->NotifyIndexed();
+	});
+}
+
+
+/**
+ * Notify the handler about the lines that were indexed since the last
+ * notification (runs on the main thread)
+ */
+void PagerDocument::NotifyIndexed(void)
+{
+	int64_t old = notifiedLines;
+	notifiedLines = numLines;
+
+	if (notifiedLines != old) NotifyChanged(old);
+}
+
+
+/**
+ * Get a block of decoded lines, loading it if it is not in the cache
+ *
+ * @param block the block number
+ * @return the block
+ */
+PagerDocument::Block& PagerDocument::LoadBlock(int64_t block)
+{
+	// Find the range of the block; the last block keeps growing while the
+	// file is being indexed
+
+	uint64_t start, end;
+	bool last;
+
+	{
+		std::lock_guard<std::mutex> lock(indexMutex);
+		start = blockOffsets[block];
+		last = block + 1 >= (int64_t) blockOffsets.size();
+		end = last ? (indexed ? fileSize : scanned) : blockOffsets[block + 1];
+	}
+
+
+	// Use the cached block if it is still up to date
+
+	std::unordered_map<int64_t, std::list<Block>::iterator>::iterator it
+		= cacheIndex.find(block);
+	if (it != cacheIndex.end()) {
+		if (it->second->end == end) {
+			cache.splice(cache.begin(), cache, it->second);
+			return cache.front();
+		}
+
+		cache.erase(it->second);
+		cacheIndex.erase(it);
+	}
+
+
+	// Decode the lines
+
+	cache.push_front(Block());
+	Block& b = cache.front();
+	b.index = block;
+	b.end = end;
+	b.lines.reserve(APE_PAGER_BLOCK_LINES);
+	cacheIndex[block] = cache.begin();
+
+	std::vector<char> buffer(map == NULL ? APE_PAGER_READ_SIZE : 0);
+	TextArena arena;
+	std::string text;
+	uint64_t pos = start;
+
+	while (pos < end) {
+		const char* data;
+		size_t n = Fetch(pos, std::min<uint64_t>(end - pos, APE_PAGER_READ_SIZE),
+				buffer.data(), &data);
+		if (n == 0) break;
+
+		const char* p = data;
+		const char* e = data + n;
+
+		while (p < e) {
+			const char* nl = (const char*) memchr(p, '\n', e - p);
+			const char* q = nl == NULL ? e : nl;
+
+			size_t room = APE_PAGER_MAX_LINE_LENGTH - std::min<size_t>(
+					text.length(), APE_PAGER_MAX_LINE_LENGTH);
+			text.append(p, std::min<size_t>(q - p, room));
+			if (nl == NULL) break;
+
+			text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+
+			DocumentLine l;
+			l.SetText(arena, text.data(), text.length());
+			b.lines.push_back(std::move(l));
+
+			text.clear();
+			p = nl + 1;
+		}
+
+		pos += n;
+	}
+
+	if (last) {
+		text.erase(std::remove(text.begin(), text.end(), '\r'), text.end());
+
+		DocumentLine l;
+		l.SetText(arena, text.data(), text.length());
+		b.lines.push_back(std::move(l));
+	}
+
+	for (size_t i = 0; i < b.lines.size(); i++) {
+		if (b.lines[i].DisplayLength() > maxDisplayLength) {
+			maxDisplayLength = b.lines[i].DisplayLength();
+		}
+	}
+
+
+	// Evict the least recently used blocks
+
+	while (cache.size() > APE_PAGER_CACHED_BLOCKS) {
+		cacheIndex.erase(cache.back().index);
+		cache.pop_back();
+	}
+
+	return b;
+}
+
+
+/**
+ * Return a line
+ *
+ * @param line the line number
+ * @return the line string
+ */
+const char* PagerDocument::Line(int64_t line)
+{
+	DocumentLine* l = LineObject(line);
+	return l == NULL ? "" : l->Text();
+}
+
+
+/**
+ * Return the line object, which remains valid until its block is evicted
+ * from the cache
+ *
+ * @param line the line number
+ * @return the line
+ */
+DocumentLine* PagerDocument::LineObject(int64_t line)
+{
+	if (line < 0 || line >= numLines) return NULL;
+
+	Block& b = LoadBlock(line / APE_PAGER_BLOCK_LINES);
+	size_t i = line % APE_PAGER_BLOCK_LINES;
+
+	return i < b.lines.size() ? &b.lines[i] : &emptyLine;
+}
+
+
+/**
+ * Forget the decoded lines if the tab size changed since the last time
+ *
+ * @return true if the display lengths changed
+ */
+bool PagerDocument::UpdateLayout(void)
+{
+	if (!EditorDocument::UpdateLayout()) return false;
+
+	cache.clear();
+	cacheIndex.clear();
+	maxDisplayLength = 0;
+
+	return true;
+}
+
+
+/**
+ * Return the display length of a line
+ *
+ * @param line the line number
+ * @return the display length
+ */
+int64_t PagerDocument::DisplayLength(int64_t line)
+{
+	DocumentLine* l = LineObject(line);
+	return l == NULL ? 0 : l->DisplayLength();
+}
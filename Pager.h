@@ -0,0 +1,238 @@
+/*
+ * Pager.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __PAGER_H
+#define __PAGER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Document.h"
+#include "ThreadPool.h"
+
+
+/**
+ * The number of lines per entry of the sparse line index, which is also the
+ * number of lines that are decoded and cached together
+ */
+#define APE_PAGER_BLOCK_LINES		1024
+
+/**
+ * The maximum number of decoded blocks to keep in memory
+ */
+#define APE_PAGER_CACHED_BLOCKS		64
+
+/**
+ * The maximum number of bytes kept from a single line; the rest of a longer
+ * line is not shown
+ */
+#define APE_PAGER_MAX_LINE_LENGTH	(1024 * 1024)
+
+/**
+ * The number of bytes to scan or read at once
+ */
+#define APE_PAGER_READ_SIZE			(4 * 1024 * 1024)
+
+
+/**
+ * A read-only document that pages in the lines of a file on demand, so that
+ * files much larger than the memory can be viewed. It keeps only a sparse
+ * index of line offsets, which is built in the background, and an LRU cache
+ * of the recently used blocks of decoded lines. The file is accessed through
+ * mmap, or through pread if it cannot be mapped.
+ *
+ * @author Peter Macko
+ */
+class PagerDocument : public EditorDocument
+{
+	/**
+	 * A block of decoded lines
+	 */
+	struct Block
+	{
+		int64_t index;
+		uint64_t end;
+		std::vector<DocumentLine> lines;
+	};
+
+	/**
+	 * The state shared with the indexer that runs in the background
+	 */
+	struct Indexer
+	{
+		PagerDocument* document;
+		CancellationToken token;
+		std::mutex mutex;
+		std::condition_variable done;
+		bool running;
+	};
+
+	int fd;
+	uint64_t fileSize;
+	const char* map;
+
+	std::mutex indexMutex;
+	std::vector<uint64_t> blockOffsets;
+	uint64_t scanned;
+	std::atomic<int64_t> numLines;
+	std::atomic<bool> indexed;
+	int64_t notifiedLines;
+
+	std::shared_ptr<Indexer> indexer;
+
+	std::list<Block> cache;
+	std::unordered_map<int64_t, std::list<Block>::iterator> cacheIndex;
+	int64_t maxDisplayLength;
+	DocumentLine emptyLine;
+
+
+	/**
+	 * Get a range of the file
+	 *
+	 * @param offset the file offset
+	 * @param length the maximum number of bytes
+	 * @param buffer the buffer to read to if the file is not mapped
+	 * @param data where to store the pointer to the data
+	 * @return the number of bytes available, or 0 on error or end of file
+	 */
+	size_t Fetch(uint64_t offset, size_t length, char* buffer,
+			const char** data);
+
+	/**
+	 * Build the sparse line index (runs on a worker thread)
+	 */
+	void BuildIndex(void);
+
+	/**
+	 * Notify the handler about the lines that were indexed since the last
+	 * notification (runs on the main thread)
+	 */
+	void NotifyIndexed(void);
+
+	/**
+	 * Get a block of decoded lines, loading it if it is not in the cache
+	 *
+	 * @param block the block number
+	 * @return the block
+	 */
+	Block& LoadBlock(int64_t block);
+
+
+public:
+
+	/**
+	 * Create an instance of class PagerDocument
+	 */
+	PagerDocument(void);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~PagerDocument(void);
+
+	/**
+	 * Open a file, and start indexing it in the background
+	 *
+	 * @param file the file name
+	 * @return a ReturnExt
+	 */
+	ReturnExt Open(const char* file);
+
+	/**
+	 * Determine whether the whole file has been indexed
+	 *
+	 * @return true if the index is complete
+	 */
+	inline bool Indexed(void) { return indexed; }
+
+	/**
+	 * Get the number of lines (grows while the file is being indexed)
+	 *
+	 * @return the number of lines
+	 */
+	virtual int64_t NumLines(void) { return numLines; }
+
+	/**
+	 * Return a line
+	 *
+	 * @param line the line number
+	 * @return the line string
+	 */
+	virtual const char* Line(int64_t line);
+
+	/**
+	 * Return the line object, which remains valid until its block is evicted
+	 * from the cache
+	 *
+	 * @param line the line number
+	 * @return the line
+	 */
+	virtual DocumentLine* LineObject(int64_t line);
+
+	/**
+	 * Return the display length of a line
+	 *
+	 * @param line the line number
+	 * @return the display length
+	 */
+	virtual int64_t DisplayLength(int64_t line);
+
+	/**
+	 * Forget the decoded lines if the tab size changed since the last time
+	 *
+	 * @return true if the display lengths changed
+	 */
+	virtual bool UpdateLayout(void);
+
+	/**
+	 * Return the maximum display length of the lines seen so far
+	 *
+	 * @return the maximum display length
+	 */
+	virtual int64_t MaxDisplayLength(void) { return maxDisplayLength; }
+
+	/**
+	 * Determine whether the document is read-only
+	 *
+	 * @return true
+	 */
+	virtual bool ReadOnly(void) { return true; }
+};
+
+#endif
@@ -75,10 +75,10 @@ ParserRule::~ParserRule()
  * @param pos the position (character index) in the line
  * @return true if it matches
  */
-bool ParserRule::Matches(const char* line, unsigned pos)
+bool ParserRule::Matches(const char* line, size_t pos)
 {
 	if (mustStartLine) {
-		for (unsigned i = 0; i < pos; i++) {
+		for (size_t i = 0; i < pos; i++) {
 			if (!isspace(line[i])) return false;
 		}
 	}
@@ -151,7 +151,7 @@ void ParserEnvironment::AddRule(ParserRule* rule)
 {
 	rule->referenceCount++;
 	
-	char firstLetter = rule->Token()[0];
+	unsigned char firstLetter = rule->Token()[0];
 	if (firstLetter >= 127) firstLetter = 127;
 	
 	std::vector<ParserRule*>*& bucket = ruleTable[firstLetter];
@@ -167,9 +167,9 @@ void ParserEnvironment::AddRule(ParserRule* rule)
  * @param pos the position (character index) in the line
  * @return the matching rule, or NULL if none
  */
-ParserRule* ParserEnvironment::FindMatchingRule(const char* line, unsigned pos)
+ParserRule* ParserEnvironment::FindMatchingRule(const char* line, size_t pos)
 {
-	char c = line[pos];
+	unsigned char c = line[pos];
 	if (c >= 127) c = 127;
 	
 	std::vector<ParserRule*>*& bucket = ruleTable[c];
@@ -275,8 +275,8 @@ void Parser::AddEnvironment(ParserEnvironment* environment)
  * @param newLine where to write the new line number
  * @param newOffset where to write the new offset
  */
-void Parser::Parse(DocumentLineCollection& lines, unsigned line, unsigned offset,
-                   unsigned& newLine, unsigned& newOffset)
+void Parser::Parse(DocumentLineCollection& lines, int64_t line, size_t offset,
+                   int64_t& newLine, size_t& newOffset)
 {
 	Parse(lines[line], line == 0 ? NULL : &lines[line-1]);
 	newLine = line + 1;
@@ -296,19 +296,23 @@ void Parser::Parse(DocumentLine& line, const DocumentLine* previous)
 	
 	ParserState initial;
 	
-	if (previous == NULL || previous->parserStates.empty()) {
+	if (previous == NULL || previous->ParserStates().empty()) {
 		initial.environmentStack.push_back(globalEnvironment);
 	}
 	else {
-		initial = previous->parserStates[previous->parserStates.size()-1].second;
+		initial = previous->ParserStates().back().second;
 	}
 	
-	line.parserStates.clear();
-	line.initialParserState = initial;
+	DocumentLine::Extras& x = line.MutableExtras();
+	x.parserStates.clear();
+	x.initialParserState = initial;
+	
+	const char* str = line.Text();
+	size_t length = line.Length();
 	
 	ParserState current = initial;
 	
-	for (unsigned i = 0; i <= line.str.length(); i++) {
+	for (size_t i = 0; i <= length; i++) {
 	
 		// Some rules might need to be applied multiple times
 		
@@ -318,7 +322,7 @@ void Parser::Parse(DocumentLine& line, const DocumentLine* previous)
 		while (!done) {
 			done = true;
 			
-			ParserRule* r = current.Environment()->FindMatchingRule(line.str.c_str(), i);
+			ParserRule* r = current.Environment()->FindMatchingRule(str, i);
 			if (r == NULL) break;
 
 
@@ -331,7 +335,7 @@ void Parser::Parse(DocumentLine& line, const DocumentLine* previous)
 			
 			if (open != NULL) {
 				current.environmentStack.push_back(open);
-				line.parserStates.push_back(std::pair<unsigned, ParserState>(i, current));
+				x.parserStates.push_back(std::pair<size_t, ParserState>(i, current));
 			}
 			
 			if (close)  {
@@ -346,7 +350,7 @@ void Parser::Parse(DocumentLine& line, const DocumentLine* previous)
 					current.environmentStack.push_back(globalEnvironment);
 				}
 				
-				line.parserStates.push_back(std::pair<unsigned, ParserState>(i, current));
+				x.parserStates.push_back(std::pair<size_t, ParserState>(i, current));
 			}
 			
 			
@@ -359,13 +363,13 @@ void Parser::Parse(DocumentLine& line, const DocumentLine* previous)
 			
 			// Look for more rules if we are at the end of the line
 			
-			if (i == line.str.length() && (open != NULL || close)) {
+			if (i == length && (open != NULL || close)) {
 				done = false;
 			}
 		}
 		
 		if (i == 0 && !applied) {
-			line.parserStates.push_back(std::pair<unsigned, ParserState>(i, current));
+			x.parserStates.push_back(std::pair<size_t, ParserState>(i, current));
 		}
 	}
 	
@@ -105,7 +105,7 @@ public:
 	 * @param pos the position (character index) in the line
 	 * @return true if it matches
 	 */
-	virtual bool Matches(const char* line, unsigned pos);
+	virtual bool Matches(const char* line, size_t pos);
 	 
 	/**
 	 * Get the token
@@ -248,7 +248,7 @@ public:
 	 * @param pos the position (character index) in the line
 	 * @return the matching rule, or NULL if none
 	 */
-	ParserRule* FindMatchingRule(const char* line, unsigned pos);
+	ParserRule* FindMatchingRule(const char* line, size_t pos);
 };
 
 
@@ -355,8 +355,8 @@ public:
 	 * @param newLine where to write the new line number
 	 * @param newOffset where to write the new offset
 	 */
-	void Parse(DocumentLineCollection& lines, unsigned line, unsigned offset,
-	           unsigned& newLine, unsigned& newOffset);
+	void Parse(DocumentLineCollection& lines, int64_t line, size_t offset,
+	           int64_t& newLine, size_t& newOffset);
 	
 	/**
 	 * Parse the next line
@@ -81,7 +81,7 @@ ScrollBar::~ScrollBar(void)
  * @param _min the minimum
  * @param _max the maximum
  */
-void ScrollBar::SetRange(int _min, int _max)
+void ScrollBar::SetRange(int64_t _min, int64_t _max)
 {
 	min = _min;
 	max = _max;
@@ -125,13 +125,18 @@ void ScrollBar::Paint(void)
 	TerminalControlWindow* tcw = component->TcwBuffer();
 
 
-	// Calculate the bar position and size
+	// Calculate the bar position and size in floating point, since the
+	// range can be much larger than the length of the bar
 	
-	int bsize = (int)(((length - 2) * psize) / (double) (max - min + 1) + 0.4999);
+	double range = (double) (max - min + 1);
+	
+	int bsize = (int)(((length - 2) * (double) psize) / range + 0.4999);
 	if (bsize > (length - 2)) bsize = length - 2;
 	if (bsize <= 0) bsize = 1;
 	
-	int bpos = (int)(((length - 2) * pos) / (double) (max - min + 1) + 0.4999);
+	int bpos = (int)(((length - 2) * (double) (pos - min)) / range + 0.4999);
+	if (bpos > length - 2 - bsize) bpos = length - 2 - bsize;
+	if (bpos < 0) bpos = 0;
 	
 	
 	// Paint the scroll bar
@@ -170,7 +175,7 @@ void ScrollBar::Paint(void)
  * 
  * @param _pos the new position
  */
-void ScrollBar::SetPosition(int _pos)
+void ScrollBar::SetPosition(int64_t _pos)
 {
 	pos = _pos;
 	
@@ -187,7 +192,7 @@ void ScrollBar::SetPosition(int _pos)
  * @param _pos the new position
  * @param size the new size
  */
-void ScrollBar::SetPosition(int _pos, int size)
+void ScrollBar::SetPosition(int64_t _pos, int64_t size)
 {
 	pos = _pos;
 	psize = size;
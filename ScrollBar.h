@@ -35,6 +35,8 @@
 #ifndef __SCROLL_BAR_H
 #define __SCROLL_BAR_H
 
+#include <stdint.h>
+
 class Component;
 
 
@@ -48,8 +50,8 @@ class ScrollBar
 	Component* component;
 	bool horiz;
 	
-	int min, max;
-	int pos, psize;
+	int64_t min, max;
+	int64_t pos, psize;
 	
 	int row, col, length;
 	
@@ -78,7 +80,7 @@ public:
 	 * @param min the minimum
 	 * @param max the maximum
 	 */
-	void SetRange(int min, int max);
+	void SetRange(int64_t min, int64_t max);
 	
 	/**
 	 * Set the location of the scrollbar
@@ -100,7 +102,7 @@ public:
 	 * 
 	 * @param pos the new position
 	 */
-	void SetPosition(int pos);
+	void SetPosition(int64_t pos);
 	
 	/**
 	 * Set the position and the position bar size, and then repaint the bar
@@ -108,7 +110,7 @@ public:
 	 * @param pos the new position
 	 * @param size the new size
 	 */
-	void SetPosition(int pos, int size);
+	void SetPosition(int64_t pos, int64_t size);
 	
 	/**
 	 * Paint the scroll bar
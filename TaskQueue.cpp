@@ -0,0 +1,224 @@
+/*
+ * TaskQueue.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "TaskQueue.h"
+
+#include <fcntl.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+
+/**
+ * Create an instance of class TaskQueue
+ */
+TaskQueue::TaskQueue(void)
+{
+	stub.next = NULL;
+	head = &stub;
+	tail = &stub;
+
+	signaled = false;
+	posted = 0;
+	executed = 0;
+
+
+	// Create the wake-up file descriptor: an eventfd where available, and a
+	// non-blocking pipe otherwise
+
+#if defined(__linux__)
+	readFd = writeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#else
+	int fds[2];
+	if (pipe(fds) == 0) {
+		readFd = fds[0];
+		writeFd = fds[1];
+		fcntl(readFd, F_SETFL, O_NONBLOCK);
+		fcntl(writeFd, F_SETFL, O_NONBLOCK);
+		fcntl(readFd, F_SETFD, FD_CLOEXEC);
+		fcntl(writeFd, F_SETFD, FD_CLOEXEC);
+	}
+	else {
+		readFd = writeFd = -1;
+	}
+#endif
+}
+
+
+/**
+ * Destroy the object, discarding the tasks that did not run
+ */
+TaskQueue::~TaskQueue(void)
+{
+	Node* n;
+	while ((n = Pop()) != NULL) delete n;
+
+	if (readFd >= 0) close(readFd);
+	if (writeFd >= 0 && writeFd != readFd) close(writeFd);
+}
+
+
+/**
+ * Append a node to the queue
+ *
+ * @param node the node
+ */
+void TaskQueue::Push(Node* node)
+{
+	node->next.store(NULL, std::memory_order_relaxed);
+	Node* prev = head.exchange(node, std::memory_order_acq_rel);
+	prev->next.store(node, std::memory_order_release);
+}
+
+
+/**
+ * Remove the next node from the queue
+ *
+ * @return the node, or NULL if there is no node ready to be removed
+ */
+TaskQueue::Node* TaskQueue::Pop(void)
+{
+	Node* t = tail;
+	Node* next = t->next.load(std::memory_order_acquire);
+
+
+	// Skip the stub node
+
+	if (t == &stub) {
+		if (next == NULL) return NULL;
+		tail = next;
+		t = next;
+		next = next->next.load(std::memory_order_acquire);
+	}
+
+	if (next != NULL) {
+		tail = next;
+		return t;
+	}
+
+
+	// This is the last node. If a producer is in the middle of appending
+	// another node, try again later.
+
+	if (t != head.load(std::memory_order_acquire)) return NULL;
+
+
+	// Otherwise put the stub back behind it, so that the last node can be
+	// removed
+
+	Push(&stub);
+
+	next = t->next.load(std::memory_order_acquire);
+	if (next != NULL) {
+		tail = next;
+		return t;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * Post a task. This can be called from any thread.
+ *
+ * @param task the task
+ */
+void TaskQueue::Post(const std::function<void(void)>& task)
+{
+	Node* n = new Node();
+	n->task = task;
+
+	Push(n);
+	posted++;
+
+
+	// Wake up the consumer, but write to the file descriptor only once
+	// until the consumer gets to run the tasks
+
+	if (!signaled.exchange(true) && writeFd >= 0) {
+		uint64_t one = 1;
+		ssize_t r = write(writeFd, &one, sizeof(one));
+		(void) r;
+	}
+}
+
+
+/**
+ * Run the pending tasks until the queue is empty or the time budget is
+ * exhausted. This must be called only from the consumer thread.
+ *
+ * @param budget the time budget in seconds
+ * @return true if there are more tasks to run
+ */
+bool TaskQueue::RunPending(double budget)
+{
+	// Reset the wake-up signal before looking at the queue, so that a task
+	// posted after this point signals again
+
+	if (signaled.exchange(false) && readFd >= 0) {
+		uint64_t value;
+		while (read(readFd, &value, sizeof(value)) > 0);
+	}
+
+
+	// Run the tasks
+
+	double start = Time();
+	Node* n;
+
+	while ((n = Pop()) != NULL) {
+		n->task();
+		delete n;
+		executed++;
+
+		if (Time() - start >= budget) break;
+	}
+
+	return !Empty();
+}
+
+
+/**
+ * Determine whether the queue is empty. This must be called only from
+ * the consumer thread.
+ *
+ * @return true if there are no pending tasks
+ */
+bool TaskQueue::Empty(void)
+{
+	return tail == &stub && head.load(std::memory_order_acquire) == &stub;
+}
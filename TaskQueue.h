@@ -0,0 +1,149 @@
+/*
+ * TaskQueue.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __TASK_QUEUE_H
+#define __TASK_QUEUE_H
+
+#include <atomic>
+#include <functional>
+
+
+/**
+ * A lock-free multiple-producer, single-consumer queue of tasks, which lets
+ * any thread hand work over to the thread that owns the queue. The queue is
+ * paired with a file descriptor that becomes readable when tasks are
+ * posted, so that the consumer can wait for the tasks together with other
+ * events.
+ *
+ * @author Peter Macko
+ */
+class TaskQueue
+{
+	/**
+	 * A node of the queue
+	 */
+	struct Node
+	{
+		std::function<void(void)> task;
+		std::atomic<Node*> next;
+	};
+
+
+	std::atomic<Node*> head;
+	Node* tail;
+	Node stub;
+
+	int readFd;
+	int writeFd;
+	std::atomic<bool> signaled;
+
+	std::atomic<unsigned long> posted;
+	unsigned long executed;
+
+
+	/**
+	 * Append a node to the queue
+	 *
+	 * @param node the node
+	 */
+	void Push(Node* node);
+
+	/**
+	 * Remove the next node from the queue
+	 *
+	 * @return the node, or NULL if there is no node ready to be removed
+	 */
+	Node* Pop(void);
+
+
+public:
+
+	/**
+	 * Create an instance of class TaskQueue
+	 */
+	TaskQueue(void);
+
+	/**
+	 * Destroy the object, discarding the tasks that did not run
+	 */
+	virtual ~TaskQueue(void);
+
+	/**
+	 * Post a task. This can be called from any thread.
+	 *
+	 * @param task the task
+	 */
+	void Post(const std::function<void(void)>& task);
+
+	/**
+	 * Run the pending tasks until the queue is empty or the time budget is
+	 * exhausted. This must be called only from the consumer thread.
+	 *
+	 * @param budget the time budget in seconds
+	 * @return true if there are more tasks to run
+	 */
+	bool RunPending(double budget);
+
+	/**
+	 * Determine whether the queue is empty. This must be called only from
+	 * the consumer thread.
+	 *
+	 * @return true if there are no pending tasks
+	 */
+	bool Empty(void);
+
+	/**
+	 * Get the file descriptor that becomes readable when a task is posted
+	 *
+	 * @return the file descriptor
+	 */
+	inline int FileDescriptor(void) { return readFd; }
+
+	/**
+	 * Get the number of tasks posted so far
+	 *
+	 * @return the number of tasks
+	 */
+	inline unsigned long Posted(void) { return posted; }
+
+	/**
+	 * Get the number of tasks executed so far
+	 *
+	 * @return the number of tasks
+	 */
+	inline unsigned long Executed(void) { return executed; }
+};
+
+#endif
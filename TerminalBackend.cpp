@@ -0,0 +1,124 @@
+/*
+ * TerminalBackend.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "TerminalBackend.h"
+
+
+/**
+ * Create a frame
+ *
+ * @param screen the screen contents to copy
+ */
+Frame::Frame(const TerminalControlWindow* screen)
+{
+	this->screen = new TerminalControlWindow(*screen);
+	cursorRow = 0;
+	cursorColumn = 0;
+	showCursor = false;
+	time = Time();
+}
+
+
+/**
+ * Destroy the frame
+ */
+Frame::~Frame(void)
+{
+	delete screen;
+}
+
+
+/**
+ * Create an instance of class TerminalBackend
+ */
+TerminalBackend::TerminalBackend(void)
+{
+}
+
+
+/**
+ * Destroy the object
+ */
+TerminalBackend::~TerminalBackend(void)
+{
+}
+
+
+/**
+ * Read the pasted text after ReadKey() returned KEY_PASTE
+ *
+ * @param text where to store the text
+ * @return true on success
+ */
+bool TerminalBackend::ReadPaste(std::string& /* text */)
+{
+	return false;
+}
+
+
+/**
+ * Discard all pending input
+ */
+void TerminalBackend::DiscardInput(void)
+{
+	while (ReadKey() != ERR);
+}
+
+
+/**
+ * Wait until there is input to read, the given file descriptor becomes
+ * readable, or the timeout expires
+ *
+ * @param fd the additional file descriptor to wait for, or -1
+ * @param timeout the timeout in seconds
+ */
+void TerminalBackend::WaitForInput(int /* fd */, double /* timeout */)
+{
+	// By default, do not wait at all
+}
+
+
+/**
+ * Get the number of bytes of the previous output that the terminal has not
+ * yet processed
+ *
+ * @return the number of bytes, or 0 if unknown
+ */
+int TerminalBackend::OutputQueue(void)
+{
+	return 0;
+}
+
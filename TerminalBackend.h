@@ -0,0 +1,183 @@
+/*
+ * TerminalBackend.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __TERMINAL_BACKEND_H
+#define __TERMINAL_BACKEND_H
+
+#include <string>
+
+#include "TerminalControl.h"
+
+
+/**
+ * An immutable snapshot of the screen, passed to the terminal backend
+ */
+struct Frame
+{
+	TerminalControlWindow* screen;
+	int cursorRow;
+	int cursorColumn;
+	bool showCursor;
+	double time;
+
+
+	/**
+	 * Create a frame
+	 *
+	 * @param screen the screen contents to copy
+	 */
+	Frame(const TerminalControlWindow* screen);
+
+	/**
+	 * Destroy the frame
+	 */
+	~Frame(void);
+};
+
+
+/**
+ * The terminal backend, which provides the input events and displays the
+ * composed frames
+ *
+ * @author Peter Macko
+ */
+class TerminalBackend
+{
+
+public:
+
+	/**
+	 * Create an instance of class TerminalBackend
+	 */
+	TerminalBackend(void);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~TerminalBackend(void);
+
+	/**
+	 * Initialize the backend
+	 *
+	 * @param rows where to store the number of rows of the screen
+	 * @param cols where to store the number of columns of the screen
+	 */
+	virtual void Initialize(int& rows, int& cols) = 0;
+
+	/**
+	 * Shutdown the backend
+	 */
+	virtual void Shutdown(void) = 0;
+
+	/**
+	 * Determine whether the frames should be output from a dedicated render
+	 * thread, so that slow output does not delay processing the input
+	 *
+	 * @return true to use a render thread
+	 */
+	virtual bool RenderInBackground(void) = 0;
+
+	/**
+	 * Read the next key, if available
+	 *
+	 * @return the key code, KEY_MOUSE for a mouse event, KEY_RESIZE if the
+	 *         screen was resized, or ERR if there are no more events
+	 */
+	virtual int ReadKey(void) = 0;
+
+	/**
+	 * Read the mouse event after ReadKey() returned KEY_MOUSE
+	 *
+	 * @param event where to store the mouse event
+	 * @return true on success
+	 */
+	virtual bool ReadMouse(MEVENT& event) = 0;
+
+	/**
+	 * Read the pasted text after ReadKey() returned KEY_PASTE
+	 *
+	 * @param text where to store the text
+	 * @return true on success
+	 */
+	virtual bool ReadPaste(std::string& text);
+
+	/**
+	 * Discard all pending input
+	 */
+	virtual void DiscardInput(void);
+
+	/**
+	 * Wait until there is input to read, the given file descriptor becomes
+	 * readable, or the timeout expires
+	 *
+	 * @param fd the additional file descriptor to wait for, or -1
+	 * @param timeout the timeout in seconds
+	 */
+	virtual void WaitForInput(int fd, double timeout);
+
+	/**
+	 * Get the current size of the screen
+	 *
+	 * @param rows where to store the number of rows
+	 * @param cols where to store the number of columns
+	 * @return true if the size is known
+	 */
+	virtual bool QuerySize(int& rows, int& cols) = 0;
+
+	/**
+	 * Resize the screen
+	 *
+	 * @param rows the number of rows
+	 * @param cols the number of columns
+	 */
+	virtual void Resize(int rows, int cols) = 0;
+
+	/**
+	 * Output a frame
+	 *
+	 * @param frame the frame
+	 */
+	virtual void Output(const Frame* frame) = 0;
+
+	/**
+	 * Get the number of bytes of the previous output that the terminal has
+	 * not yet processed
+	 *
+	 * @return the number of bytes, or 0 if unknown
+	 */
+	virtual int OutputQueue(void);
+};
+
+#endif
@@ -34,6 +34,7 @@
 
 #include "stdafx.h"
 #include "TerminalControl.h"
+#include "UTF8.h"
 
 
 /**
@@ -113,6 +114,25 @@ TerminalControlWindow::TerminalControlWindow(int rows, int cols)
 }
 
 
+/**
+ * Create a copy of a window
+ *
+ * @param other the other window
+ */
+TerminalControlWindow::TerminalControlWindow(const TerminalControlWindow& other)
+{
+	visible = other.visible;
+	prototype = other.prototype;
+
+	for (size_t r = 0; r < other.lines.size(); r++) {
+		lines.push_back(new Line(*other.lines[r]));
+	}
+
+	posRow = other.posRow;
+	posCol = other.posCol;
+}
+
+
 /**
  * Destroy the window
  */
@@ -175,16 +195,89 @@ void TerminalControlWindow::Paint(WINDOW* win, int row, int col)
 			if (c + col >= winCols) break;
 			Character& ch = line[c];
 
-			char cc = ch.character;
-			if (iscntrl(cc)) cc = '?';
-
 			wattrset(win, ch.attributes);
-			waddch(win, cc);
+
+			if (ch.character < 0x80 && ch.combining == 0) {
+				char cc = ch.character;
+				if (iscntrl(cc)) cc = '?';
+				waddch(win, cc);
+				continue;
+			}
+
+
+			// A wide character is drawn only if its right half is still
+			// there, and the rest is left blank
+
+			int width = ch.character == TCW_CONTINUATION ? 0
+				: CodePointWidth(ch.character);
+			if (width == 2 && (c + 1 >= line.Length() || c + col + 1 >= winCols
+						|| line[c + 1].character != TCW_CONTINUATION)) {
+				width = 0;
+			}
+
+			if (width == 0) {
+				waddch(win, ' ');
+			}
+			else {
+				wchar_t s[3] = { (wchar_t) ch.character,
+					(wchar_t) ch.combining, L'\0' };
+				cchar_t cc;
+				setcchar(&cc, s, 0, 0, NULL);
+				wadd_wch(win, &cc);
+				c += width - 1;
+			}
+
+
+			// Resynchronize in case that the terminal disagrees about the
+			// width of the character
+
+			wmove(win, r + row, c + col + 1);
 		}
 	}
 }
 
 
+/**
+ * Get the character at the given position, including its attributes
+ *
+ * @param row the row
+ * @param col the column
+ * @return the character combined with its attributes, or 0 if out of range
+ */
+int TerminalControlWindow::CharacterAt(int row, int col) const
+{
+	if (row < 0 || row >= (int) lines.size()) return 0;
+
+	const Line& line = *lines[row];
+	if (col < 0 || col >= line.Length()) return 0;
+
+	return (line[col].character & 0xff) | line[col].attributes;
+}
+
+
+/**
+ * Get the code point at the given position
+ *
+ * @param row the row
+ * @param col the column
+ * @param combining the combining mark drawn over it, or 0 (output, optional)
+ * @return the code point, TCW_CONTINUATION for the right half of a wide
+ *         character, or 0 if out of range
+ */
+uint32_t TerminalControlWindow::CodePointAt(int row, int col,
+		uint32_t* combining) const
+{
+	if (combining != NULL) *combining = 0;
+	if (row < 0 || row >= (int) lines.size()) return 0;
+
+	const Line& line = *lines[row];
+	if (col < 0 || col >= line.Length()) return 0;
+
+	if (combining != NULL) *combining = line[col].combining;
+	return line[col].character;
+}
+
+
 /**
  * Clear
  */
@@ -251,43 +344,77 @@ int TerminalControlWindow::OutChar(int row, int col, int c)
 
 
 /**
- * Write the text onto the buffer (does not wrap)
+ * Write the UTF-8 text onto the buffer (does not wrap)
  *
  * @param row the row
  * @param col the column
  * @param str the string
- * @return the number of characters written
+ * @return the number of columns written
  */
 int TerminalControlWindow::OutText(int row, int col, const char* str)
 {
 	int n = 0;
 	if (row < 0 || row >= (int) lines.size()) return n;
 
-	int l = strlen(str);
-	if (col < 0) {
-		if (col + l >= 0) {
-			str += -col;
-			l += col;
-			col = 0;
+	Line& line = *lines[row];
+	int length = line.Length();
+
+	const char* p = str;
+	const char* end = str + strlen(str);
+	Character c = prototype;
+
+	while (p < end && col < length) {
+		unsigned char b = *p;
+
+		if (b < 0x80) {
+			if (col >= 0) {
+				c.character = b;
+				line[col] = c;
+				n++;
+			}
+			col++;
+			p++;
+			continue;
 		}
-		else {
-			return n;
+
+
+		// Decode a multi-byte character
+
+		uint32_t cp;
+		p += DecodeUTF8Sequence(p, end, cp);
+		int w = CodePointWidth(cp);
+		if (IsUndisplayableCodePoint(cp)) cp = '?';
+
+		if (w == 0) {
+			if (col > 0 && line[col - 1].character != TCW_CONTINUATION) {
+				line[col - 1].combining = cp;
+			}
+			continue;
 		}
-	}
 
-	Line& line = *lines[row];
-	int length = line.Length();
 
-	if (col >= length) return n;
-	if (col + l > length) {
-		l = length - col;
-	}
+		// Blank out a wide character that does not fit
 
-	Character c = prototype;
-	for (int i = 0; i < l; i++) {
-		c.character = str[i];
-		line[col + i] = c;
+		if (col < 0 || col + w > length) {
+			c.character = ' ';
+			for (int i = 0; i < w; i++, col++) {
+				if (col >= 0 && col < length) {
+					line[col] = c;
+					n++;
+				}
+			}
+			continue;
+		}
+
+		c.character = cp;
+		line[col++] = c;
 		n++;
+
+		if (w == 2) {
+			c.character = TCW_CONTINUATION;
+			line[col++] = c;
+			n++;
+		}
 	}
 
 	return n;
@@ -538,10 +665,58 @@ int TerminalControlWindow::PutChar(int c)
 
 
 /**
- * Write the text onto the buffer (does not wrap)
+ * Write a code point onto the buffer (does not wrap)
+ *
+ * @param cp the code point
+ * @param width the display width, 1 or 2
+ * @return the number of columns written
+ */
+int TerminalControlWindow::PutCodePoint(uint32_t cp, int width)
+{
+	if (posRow < 0 || posRow >= (int) lines.size()) return 0;
+	Line& line = *lines[posRow];
+
+	Character ch = prototype;
+	ch.character = cp;
+
+	int n = 0;
+	for (int i = 0; i < width; i++, posCol++) {
+		if (posCol >= 0 && posCol < line.Length()) {
+			line[posCol] = ch;
+			n++;
+		}
+		ch.character = TCW_CONTINUATION;
+	}
+
+	return n;
+}
+
+
+/**
+ * Add a combining mark to the character before the cursor; only one mark per
+ * character is kept
+ *
+ * @param cp the code point of the combining mark
+ */
+void TerminalControlWindow::PutCombining(uint32_t cp)
+{
+	if (posRow < 0 || posRow >= (int) lines.size()) return;
+	Line& line = *lines[posRow];
+
+	int c = posCol - 1;
+	if (c >= 0 && c < line.Length()
+			&& line[c].character == TCW_CONTINUATION) c--;
+	if (c < 0 || c >= line.Length()) return;
+
+	if (line[c].combining == 0) line[c].combining = cp;
+}
+
+
+/**
+ * Write the UTF-8 text onto the buffer (does not wrap)
  *
  * @param str the string
- * @return the number of characters written
+ * @return the number of columns written
  */
 int TerminalControlWindow::PutText(const char* str)
 {
@@ -36,9 +36,17 @@
 #define __TERMINAL_CONTROL_H
 
 #include <curses.h>
+#include <stdint.h>
 #include <vector>
 
 
+/**
+ * The character stored in the cell covered by the right half of a wide
+ * character
+ */
+#define TCW_CONTINUATION	0xFFFFFFFFu
+
+
 /**
  * Terminal control window
  *
@@ -47,11 +55,13 @@
 class TerminalControlWindow
 {
 	/**
-	 * A character
+	 * A character, which is either a code point, or an ASCII or line drawing
+	 * character combined with A_ALTCHARSET
 	 */
 	struct Character
 	{
-		char character;
+		uint32_t character;
+		uint32_t combining;
 		int attributes;
 	};
 
@@ -139,6 +149,13 @@ public:
 	 */
 	TerminalControlWindow(int rows, int cols);
 
+	/**
+	 * Create a copy of a window
+	 *
+	 * @param other the other window
+	 */
+	TerminalControlWindow(const TerminalControlWindow& other);
+
 	/**
 	 * Destroy the window
 	 */
@@ -151,6 +168,41 @@ public:
 	 */
 	inline bool Visible() { return visible; }
 
+	/**
+	 * Get the number of rows
+	 *
+	 * @return the number of rows
+	 */
+	inline int Rows() const { return lines.size(); }
+
+	/**
+	 * Get the number of columns
+	 *
+	 * @return the number of columns
+	 */
+	inline int Columns() const { return lines.empty() ? 0 : lines[0]->Length(); }
+
+	/**
+	 * Get the character at the given position, including its attributes
+	 *
+	 * @param row the row
+	 * @param col the column
+	 * @return the character combined with its attributes, or 0 if out of range
+	 */
+	int CharacterAt(int row, int col) const;
+
+	/**
+	 * Get the code point at the given position
+	 *
+	 * @param row the row
+	 * @param col the column
+	 * @param combining the combining mark drawn over it, or 0 (output,
+	 *                  optional)
+	 * @return the code point, TCW_CONTINUATION for the right half of a wide
+	 *         character, or 0 if out of range
+	 */
+	uint32_t CodePointAt(int row, int col, uint32_t* combining = NULL) const;
+
 	/**
 	 * Resize
 	 *
@@ -200,12 +252,12 @@ public:
 	int OutChar(int row, int col, int c);
 
 	/**
-	 * Write the text onto the buffer (does not wrap)
+	 * Write the UTF-8 text onto the buffer (does not wrap)
 	 *
 	 * @param row the row
 	 * @param col the column
 	 * @param str the string
-	 * @return the number of characters written
+	 * @return the number of columns written
 	 */
 	int OutText(int row, int col, const char* str);
 
@@ -285,10 +337,27 @@ public:
 	int PutChar(int c);
 
 	/**
-	 * Write the text onto the buffer (does not wrap)
+	 * Write a code point onto the buffer (does not wrap)
+	 *
+	 * @param cp the code point
+	 * @param width the display width, 1 or 2
+	 * @return the number of columns written
+	 */
+	int PutCodePoint(uint32_t cp, int width);
+
+	/**
+	 * Add a combining mark to the character before the cursor; only one mark
+	 * per character is kept
+	 *
+	 * @param cp the code point of the combining mark
+	 */
+	void PutCombining(uint32_t cp);
+
+	/**
+	 * Write the UTF-8 text onto the buffer (does not wrap)
 	 *
 	 * @param str the string
-	 * @return the number of characters written
+	 * @return the number of columns written
 	 */
 	int PutText(const char* str);
 };
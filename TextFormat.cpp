@@ -0,0 +1,667 @@
+/*
+ * TextFormat.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "stdafx.h"
+#include "TextFormat.h"
+
+#include <algorithm>
+#include <strings.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+TextEncoding TextDecoder::defaultEncoding = TEXT_ENCODING_AUTO;
+
+
+/**
+ * Create the default format for new files
+ */
+TextFormat::TextFormat(void)
+{
+	lineEnding = LINE_ENDING_LF;
+	bom = false;
+	utf8 = true;
+	binary = false;
+	strayCRs = 0;
+	gzip = false;
+	trailingGarbage = 0;
+	encoding = TEXT_ENCODING_UTF8;
+}
+
+
+/**
+ * Describe how the format differs from the default
+ *
+ * @return the description, or an empty string if it is the default
+ */
+std::string TextFormat::Description(void) const
+{
+	std::string s;
+
+	if (gzip) {
+		s = "gzip-compressed";
+	}
+
+	if (binary) {
+		if (!s.empty()) s += ", ";
+		s += "binary (contains NUL bytes)";
+	}
+	else if (encoding != TEXT_ENCODING_UTF8) {
+		if (!s.empty()) s += ", ";
+		s += encoding == TEXT_ENCODING_LATIN1 ? "Latin-1" : EncodingName(encoding);
+		if (bom) s += " with BOM";
+	}
+	else if (!utf8) {
+		if (!s.empty()) s += ", ";
+		s += "not valid UTF-8";
+	}
+	else if (bom) {
+		if (!s.empty()) s += ", ";
+		s += "UTF-8 with BOM";
+	}
+
+	if (lineEnding != LINE_ENDING_LF) {
+		if (!s.empty()) s += ", ";
+		s += lineEnding == LINE_ENDING_CRLF ? "CRLF" : "mixed LF and CRLF";
+		s += " line endings";
+	}
+
+	if (strayCRs > 0) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%llu stray CR%s removed",
+				(unsigned long long) strayCRs, strayCRs == 1 ? "" : "s");
+		if (!s.empty()) s += ", ";
+		s += buf;
+	}
+
+	if (trailingGarbage > 0) {
+		char buf[64];
+		snprintf(buf, sizeof(buf), "%llu byte%s of trailing garbage ignored",
+				(unsigned long long) trailingGarbage,
+				trailingGarbage == 1 ? "" : "s");
+		if (!s.empty()) s += ", ";
+		s += buf;
+	}
+
+	return s;
+}
+
+
+/**
+ * Return the name of an encoding as understood by iconv
+ *
+ * @param encoding the encoding other than TEXT_ENCODING_AUTO
+ * @return the name
+ */
+const char* TextFormat::EncodingName(TextEncoding encoding)
+{
+	switch (encoding) {
+		case TEXT_ENCODING_LATIN1 : return "ISO-8859-1";
+		case TEXT_ENCODING_UTF16LE: return "UTF-16LE";
+		case TEXT_ENCODING_UTF16BE: return "UTF-16BE";
+		default                   : return "UTF-8";
+	}
+}
+
+
+/**
+ * Parse the name of an encoding, such as "latin1" or "utf-16le"
+ *
+ * @param name the name, which can also be "auto"
+ * @param encoding where to store the encoding
+ * @return true on success, false if it is not known
+ */
+bool TextFormat::ParseEncoding(const char* name, TextEncoding& encoding)
+{
+	static const struct {
+		const char* name;
+		TextEncoding encoding;
+	} NAMES[] = {
+		{ "auto"      , TEXT_ENCODING_AUTO    },
+		{ "utf-8"     , TEXT_ENCODING_UTF8    },
+		{ "utf8"      , TEXT_ENCODING_UTF8    },
+		{ "latin-1"   , TEXT_ENCODING_LATIN1  },
+		{ "latin1"    , TEXT_ENCODING_LATIN1  },
+		{ "iso-8859-1", TEXT_ENCODING_LATIN1  },
+		{ "utf-16le"  , TEXT_ENCODING_UTF16LE },
+		{ "utf16le"   , TEXT_ENCODING_UTF16LE },
+		{ "utf-16be"  , TEXT_ENCODING_UTF16BE },
+		{ "utf16be"   , TEXT_ENCODING_UTF16BE },
+	};
+
+	for (size_t i = 0; i < sizeof(NAMES) / sizeof(NAMES[0]); i++) {
+		if (strcasecmp(name, NAMES[i].name) == 0) {
+			encoding = NAMES[i].encoding;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * Detect the encoding of a file from the beginning of its contents, by its
+ * BOM, by the zero bytes of mostly ASCII UTF-16 text, or by not being valid
+ * UTF-8. Files with zero bytes that do not look like UTF-16 are treated as
+ * binary, and are kept as raw bytes.
+ *
+ * @param data the beginning of the contents
+ * @param length the number of bytes
+ * @return the encoding
+ */
+TextEncoding DetectEncoding(const char* data, size_t length)
+{
+	const unsigned char* p = (const unsigned char*) data;
+
+	if (length >= 2 && p[0] == 0xFF && p[1] == 0xFE) return TEXT_ENCODING_UTF16LE;
+	if (length >= 2 && p[0] == 0xFE && p[1] == 0xFF) return TEXT_ENCODING_UTF16BE;
+
+
+	// In UTF-16 text that is mostly ASCII, nearly every other byte is zero,
+	// while the bytes in between are not
+
+	size_t n = std::min(length, (size_t) APE_ENCODING_SAMPLE);
+	size_t pairs = n / 2;
+	size_t evenZeros = 0;
+	size_t oddZeros = 0;
+
+	for (size_t i = 0; i + 1 < n; i += 2) {
+		if (p[i] == 0) evenZeros++;
+		if (p[i + 1] == 0) oddZeros++;
+	}
+
+	if (pairs >= 2) {
+		if (evenZeros == 0 && oddZeros * 10 >= pairs * 9) {
+			return TEXT_ENCODING_UTF16LE;
+		}
+		if (oddZeros == 0 && evenZeros * 10 >= pairs * 9) {
+			return TEXT_ENCODING_UTF16BE;
+		}
+	}
+
+	if (memchr(data, '\0', n) != NULL) return TEXT_ENCODING_UTF8;
+
+
+	// Text that is not valid UTF-8 is most likely in a single-byte encoding
+
+	TextScanner scanner;
+	scanner.Scan(data, n);
+
+	return scanner.ValidUTF8() ? TEXT_ENCODING_UTF8 : TEXT_ENCODING_LATIN1;
+}
+
+
+/**
+ * Create an instance of class TextConverter
+ *
+ * @param from the source encoding
+ * @param to the target encoding
+ */
+TextConverter::TextConverter(TextEncoding from, TextEncoding to)
+{
+	cd = iconv_open(TextFormat::EncodingName(to),
+			TextFormat::EncodingName(from));
+}
+
+
+/**
+ * Destroy the object
+ */
+TextConverter::~TextConverter(void)
+{
+	if (cd != (iconv_t) -1) iconv_close(cd);
+}
+
+
+/**
+ * Convert as much of the input as possible
+ *
+ * @param in the input, which is advanced past the converted bytes
+ * @param inLeft the number of input bytes, which is updated
+ * @param out the string to append to
+ * @return 0 on success, or the iconv error code
+ */
+int TextConverter::Run(const char*& in, size_t& inLeft, std::string& out)
+{
+	if (cd == (iconv_t) -1) return EINVAL;
+
+	while (inLeft > 0) {
+
+		// No conversion between these encodings more than doubles the size
+
+		size_t used = out.size();
+		out.resize(used + 2 * inLeft + 16);
+
+		char* o = &out[used];
+		size_t outLeft = out.size() - used;
+		size_t r = iconv(cd, (char**) &in, &inLeft, &o, &outLeft);
+		out.resize(out.size() - outLeft);
+
+		if (r == (size_t) -1 && errno != E2BIG) return errno;
+	}
+
+	return 0;
+}
+
+
+/**
+ * Convert the next part of the contents
+ *
+ * @param data the data
+ * @param length the number of bytes
+ * @param out the string to append the converted text to
+ * @return true on success, false if the data cannot be converted
+ */
+bool TextConverter::Convert(const char* data, size_t length, std::string& out)
+{
+	// Complete the character split at the end of the previous block one
+	// byte at a time, so that the block itself does not need to be copied
+
+	while (!pending.empty() && length > 0) {
+		pending += *data++;
+		length--;
+
+		const char* in = pending.data();
+		size_t inLeft = pending.length();
+		int e = Run(in, inLeft, out);
+
+		if (e == 0) {
+			pending.clear();
+		}
+		else if (e != EINVAL || pending.length() >= 4) {
+			return false;
+		}
+	}
+
+	int e = Run(data, length, out);
+	if (e == EINVAL) {
+		pending.assign(data, length);
+		return true;
+	}
+
+	return e == 0;
+}
+
+
+/**
+ * Create an instance of class TextScanner
+ */
+TextScanner::TextScanner(void)
+{
+	bytes = 0;
+	lfs = 0;
+	crs = 0;
+	crlfs = 0;
+	nuls = 0;
+
+	lastCR = false;
+
+	utf8 = true;
+	utf8Pending = 0;
+	utf8Low = 0x80;
+	utf8High = 0xBF;
+}
+
+
+/**
+ * Scan the next part of the contents
+ *
+ * @param data the data
+ * @param length the number of bytes
+ */
+void TextScanner::Scan(const char* data, size_t length)
+{
+	const unsigned char* p = (const unsigned char*) data;
+	const unsigned char* end = p + length;
+
+
+	// Remember the first bytes for the BOM
+
+	for (; bytes < sizeof(head) && p < end; p++, bytes++) {
+		head[bytes] = *p;
+		ScanBytes(p, 1);
+	}
+
+	bytes += end - p;
+
+#if defined(__SSE2__)
+
+	const __m128i lf = _mm_set1_epi8('\n');
+	const __m128i cr = _mm_set1_epi8('\r');
+	const __m128i zero = _mm_setzero_si128();
+
+	for (; p + 16 <= end; p += 16) {
+		__m128i v = _mm_loadu_si128((const __m128i*) p);
+
+		unsigned lfMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, lf));
+		unsigned crMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, cr));
+		unsigned nulMask = _mm_movemask_epi8(_mm_cmpeq_epi8(v, zero));
+		unsigned highMask = _mm_movemask_epi8(v);
+
+
+		// Most blocks of a text file are plain ASCII without a line end
+
+		if ((lfMask | crMask | nulMask | highMask) == 0 && utf8Pending == 0) {
+			lastCR = false;
+			continue;
+		}
+
+		lfs += __builtin_popcount(lfMask);
+		crs += __builtin_popcount(crMask);
+		nuls += __builtin_popcount(nulMask);
+		crlfs += __builtin_popcount(((crMask << 1) | (lastCR ? 1 : 0)) & lfMask);
+		lastCR = (crMask & 0x8000) != 0;
+
+		if (utf8 && (highMask != 0 || utf8Pending != 0)) ValidateUTF8(p, 16);
+	}
+
+#endif
+
+	if (p < end) ScanBytes(p, end - p);
+}
+
+
+/**
+ * Scan a block of data one byte at a time
+ *
+ * @param p the data
+ * @param length the number of bytes
+ */
+void TextScanner::ScanBytes(const unsigned char* p, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = p[i];
+
+		if (c == '\n') {
+			lfs++;
+			if (lastCR) crlfs++;
+		}
+		else if (c == '\r') {
+			crs++;
+		}
+		else if (c == '\0') {
+			nuls++;
+		}
+
+		lastCR = c == '\r';
+	}
+
+	if (utf8) ValidateUTF8(p, length);
+}
+
+
+/**
+ * Validate a block of data as a continuation of a UTF-8 stream
+ *
+ * @param p the data
+ * @param length the number of bytes
+ */
+void TextScanner::ValidateUTF8(const unsigned char* p, size_t length)
+{
+	for (size_t i = 0; i < length; i++) {
+		unsigned char c = p[i];
+
+
+		// A continuation byte, which has a narrower range right after some
+		// lead bytes to exclude the overlong forms and the surrogates
+
+		if (utf8Pending > 0) {
+			if (c < utf8Low || c > utf8High) {
+				utf8 = false;
+				return;
+			}
+
+			utf8Pending--;
+			utf8Low = 0x80;
+			utf8High = 0xBF;
+			continue;
+		}
+
+
+		// A lead byte
+
+		if (c < 0x80) continue;
+
+		if (c >= 0xC2 && c <= 0xDF) {
+			utf8Pending = 1;
+		}
+		else if (c == 0xE0) {
+			utf8Pending = 2;
+			utf8Low = 0xA0;
+		}
+		else if (c == 0xED) {
+			utf8Pending = 2;
+			utf8High = 0x9F;
+		}
+		else if (c >= 0xE1 && c <= 0xEF) {
+			utf8Pending = 2;
+		}
+		else if (c == 0xF0) {
+			utf8Pending = 3;
+			utf8Low = 0x90;
+		}
+		else if (c >= 0xF1 && c <= 0xF3) {
+			utf8Pending = 3;
+		}
+		else if (c == 0xF4) {
+			utf8Pending = 3;
+			utf8High = 0x8F;
+		}
+		else {
+			utf8 = false;
+			return;
+		}
+	}
+}
+
+
+/**
+ * Get the format of the contents scanned so far
+ *
+ * @return the format
+ */
+TextFormat TextScanner::Format(void) const
+{
+	TextFormat f;
+
+	if (crlfs == 0) {
+		f.lineEnding = LINE_ENDING_LF;
+	}
+	else if (crlfs == lfs) {
+		f.lineEnding = LINE_ENDING_CRLF;
+	}
+	else {
+		f.lineEnding = LINE_ENDING_MIXED;
+	}
+
+	f.bom = bytes >= 3 && head[0] == 0xEF && head[1] == 0xBB && head[2] == 0xBF;
+	f.utf8 = utf8 && utf8Pending == 0;
+	f.binary = nuls > 0;
+	f.strayCRs = crs - crlfs;
+
+	return f;
+}
+
+
+/**
+ * Create an instance of class TextDecoder
+ *
+ * @param emit the function to call with each line, which can take
+ *             the contents of the string
+ */
+TextDecoder::TextDecoder(const std::function<void(std::string&)>& emit)
+	: emit(emit)
+{
+	encoding = defaultEncoding;
+	converter = NULL;
+	failed = false;
+}
+
+
+/**
+ * Destroy the object
+ */
+TextDecoder::~TextDecoder(void)
+{
+	if (converter != NULL) delete converter;
+}
+
+
+/**
+ * Decode the next part of the contents
+ *
+ * @param data the data
+ * @param length the number of bytes
+ * @return true on success, false if it cannot be converted to UTF-8
+ */
+bool TextDecoder::Decode(const char* data, size_t length)
+{
+	if (failed) return false;
+
+	if (encoding == TEXT_ENCODING_AUTO) {
+		encoding = DetectEncoding(data, length);
+	}
+
+	if (encoding == TEXT_ENCODING_UTF8) {
+		Split(data, length);
+		return true;
+	}
+
+
+	// Convert the block, reusing the buffer for the next one
+
+	if (converter == NULL) {
+		converter = new TextConverter(encoding, TEXT_ENCODING_UTF8);
+	}
+
+	converted.clear();
+	if (!converter->Convert(data, length, converted)) {
+		failed = true;
+		return false;
+	}
+
+	Split(converted.data(), converted.length());
+	return true;
+}
+
+
+/**
+ * Split the next part of the UTF-8 contents to lines
+ *
+ * @param data the data
+ * @param length the number of bytes
+ */
+void TextDecoder::Split(const char* data, size_t length)
+{
+	scanner.Scan(data, length);
+
+	const char* p = data;
+	const char* end = data + length;
+
+	while (p < end) {
+		const char* nl = (const char*) memchr(p, '\n', end - p);
+		if (nl == NULL) {
+			partial.append(p, end - p);
+			break;
+		}
+
+		partial.append(p, nl - p);
+		Emit(partial, true);
+
+		partial.clear();
+		p = nl + 1;
+	}
+}
+
+
+/**
+ * Finish decoding, passing the last line to the handler
+ *
+ * @return the format of the contents
+ */
+TextFormat TextDecoder::Finish(void)
+{
+	Emit(partial, false);
+	partial.clear();
+
+	if (converter != NULL && !converter->Complete()) failed = true;
+
+	TextFormat f = scanner.Format();
+	if (encoding != TEXT_ENCODING_AUTO) f.encoding = encoding;
+
+	return f;
+}
+
+
+/**
+ * Return a description of the conversion error
+ *
+ * @return the error message
+ */
+std::string TextDecoder::Error(void) const
+{
+	std::string s = "The file is not valid ";
+	s += TextFormat::EncodingName(encoding);
+	s += "; use --encoding to open it in another encoding";
+	return s;
+}
+
+
+/**
+ * Pass a complete line to the handler
+ *
+ * @param line the line, without the LF
+ * @param newline whether the line was terminated by LF
+ */
+void TextDecoder::Emit(std::string& line, bool newline)
+{
+	if (crlf.empty() && line.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+		line.erase(0, 3);
+	}
+
+	bool cr = newline && !line.empty() && line[line.length() - 1] == '\r';
+	if (cr) line.erase(line.length() - 1);
+	crlf.push_back(cr);
+
+
+	// The editor cannot display a CR in the middle of a line
+
+	if (memchr(line.data(), '\r', line.length()) != NULL) {
+		line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+	}
+
+	emit(line);
+}
@@ -0,0 +1,388 @@
+/*
+ * TextFormat.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef __TEXT_FORMAT_H
+#define __TEXT_FORMAT_H
+
+#include <functional>
+#include <iconv.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * The line endings of a text file
+ */
+enum LineEnding
+{
+	LINE_ENDING_LF,			// Unix
+	LINE_ENDING_CRLF,		// DOS and Windows
+	LINE_ENDING_MIXED,		// Both, with the CR kept at the end of CRLF lines
+};
+
+
+/**
+ * The number of bytes at the start of a file that are examined to detect
+ * its encoding
+ */
+#define APE_ENCODING_SAMPLE		(64 * 1024)
+
+
+/**
+ * The character encoding of a text file
+ */
+enum TextEncoding
+{
+	TEXT_ENCODING_AUTO,			// Detect it when loading
+	TEXT_ENCODING_UTF8,			// UTF-8, or the raw bytes if it is not valid
+	TEXT_ENCODING_LATIN1,		// ISO-8859-1
+	TEXT_ENCODING_UTF16LE,
+	TEXT_ENCODING_UTF16BE,
+};
+
+
+/**
+ * The format of a text file, which is detected when it is loaded, and then
+ * used to save it back byte by byte
+ */
+struct TextFormat
+{
+	LineEnding lineEnding;
+	bool bom;				// Starts with the UTF-8 byte order mark
+	bool utf8;				// Valid UTF-8, which includes plain ASCII
+	bool binary;			// Probably binary, since it contains NUL bytes
+	uint64_t strayCRs;		// CRs not followed by LF, which were removed
+	bool gzip;				// Compressed with gzip
+	uint64_t trailingGarbage;	// Bytes after the gzip data, which were ignored
+	TextEncoding encoding;	// Converted to and from UTF-8 if not UTF-8
+
+
+	/**
+	 * Create the default format for new files
+	 */
+	TextFormat(void);
+
+	/**
+	 * Get the line separator to write between the lines
+	 *
+	 * @return the line separator
+	 */
+	inline const char* Newline(void) const
+	{
+		return lineEnding == LINE_ENDING_CRLF ? "\r\n" : "\n";
+	}
+
+	/**
+	 * Describe how the format differs from the default
+	 *
+	 * @return the description, or an empty string if it is the default
+	 */
+	std::string Description(void) const;
+
+	/**
+	 * Return the name of an encoding as understood by iconv
+	 *
+	 * @param encoding the encoding other than TEXT_ENCODING_AUTO
+	 * @return the name
+	 */
+	static const char* EncodingName(TextEncoding encoding);
+
+	/**
+	 * Parse the name of an encoding, such as "latin1" or "utf-16le"
+	 *
+	 * @param name the name, which can also be "auto"
+	 * @param encoding where to store the encoding
+	 * @return true on success, false if it is not known
+	 */
+	static bool ParseEncoding(const char* name, TextEncoding& encoding);
+};
+
+
+/**
+ * Detect the encoding of a file from the beginning of its contents, by its
+ * BOM, by the zero bytes of mostly ASCII UTF-16 text, or by not being valid
+ * UTF-8. Files with zero bytes that do not look like UTF-16 are treated as
+ * binary, and are kept as raw bytes.
+ *
+ * @param data the beginning of the contents
+ * @param length the number of bytes
+ * @return the encoding
+ */
+TextEncoding DetectEncoding(const char* data, size_t length);
+
+
+/**
+ * A streaming conversion between two encodings through iconv, which carries
+ * a character split between two blocks over to the next block
+ *
+ * @author Peter Macko
+ */
+class TextConverter
+{
+	iconv_t cd;
+	std::string pending;
+
+
+	/**
+	 * Convert as much of the input as possible
+	 *
+	 * @param in the input, which is advanced past the converted bytes
+	 * @param inLeft the number of input bytes, which is updated
+	 * @param out the string to append to
+	 * @return 0 on success, or the iconv error code
+	 */
+	int Run(const char*& in, size_t& inLeft, std::string& out);
+
+
+public:
+
+	/**
+	 * Create an instance of class TextConverter
+	 *
+	 * @param from the source encoding
+	 * @param to the target encoding
+	 */
+	TextConverter(TextEncoding from, TextEncoding to);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~TextConverter(void);
+
+	/**
+	 * Convert the next part of the contents
+	 *
+	 * @param data the data
+	 * @param length the number of bytes
+	 * @param out the string to append the converted text to
+	 * @return true on success, false if the data cannot be converted
+	 */
+	bool Convert(const char* data, size_t length, std::string& out);
+
+	/**
+	 * Determine whether the contents ended with a complete character
+	 *
+	 * @return true if there is no incomplete character left
+	 */
+	inline bool Complete(void) const { return pending.empty(); }
+};
+
+
+/**
+ * A one-pass scanner of the contents of a file, which classifies the line
+ * endings, checks whether the contents are valid UTF-8, and counts the NUL
+ * bytes. It processes 16 bytes at a time with SSE2 where available, falling
+ * back to per-byte processing only for the blocks that contain non-ASCII
+ * characters.
+ *
+ * @author Peter Macko
+ */
+class TextScanner
+{
+	uint64_t bytes;
+	uint64_t lfs;
+	uint64_t crs;
+	uint64_t crlfs;
+	uint64_t nuls;
+
+	unsigned char head[3];
+	bool lastCR;
+
+	bool utf8;
+	int utf8Pending;		// The number of continuation bytes expected
+	unsigned char utf8Low;	// The range of the next continuation byte
+	unsigned char utf8High;
+
+
+	/**
+	 * Scan a block of data one byte at a time
+	 *
+	 * @param p the data
+	 * @param length the number of bytes
+	 */
+	void ScanBytes(const unsigned char* p, size_t length);
+
+	/**
+	 * Validate a block of data as a continuation of a UTF-8 stream
+	 *
+	 * @param p the data
+	 * @param length the number of bytes
+	 */
+	void ValidateUTF8(const unsigned char* p, size_t length);
+
+
+public:
+
+	/**
+	 * Create an instance of class TextScanner
+	 */
+	TextScanner(void);
+
+	/**
+	 * Scan the next part of the contents
+	 *
+	 * @param data the data
+	 * @param length the number of bytes
+	 */
+	void Scan(const char* data, size_t length);
+
+	/**
+	 * Get the format of the contents scanned so far
+	 *
+	 * @return the format
+	 */
+	TextFormat Format(void) const;
+
+	/**
+	 * Determine whether the contents scanned so far have no invalid UTF-8
+	 * sequence, allowing an incomplete last character
+	 *
+	 * @return true if they can be UTF-8
+	 */
+	inline bool ValidUTF8(void) const { return utf8; }
+};
+
+
+/**
+ * A decoder of the contents of a text file to lines. The BOM and the CR of
+ * the CRLF line endings are removed from the lines, so that they can be
+ * written back according to the TextFormat. If the file turns out to have
+ * mixed line endings, the caller should put the CR back to the lines for
+ * which EndsWithCR() is true. A file in another encoding is converted to
+ * UTF-8 one block at a time, as the lines are split.
+ *
+ * @author Peter Macko
+ */
+class TextDecoder
+{
+	static TextEncoding defaultEncoding;
+
+	TextScanner scanner;
+	TextEncoding encoding;
+	TextConverter* converter;
+	std::string converted;
+	bool failed;
+
+	std::function<void(std::string&)> emit;
+	std::string partial;
+	std::vector<bool> crlf;
+
+
+	/**
+	 * Pass a complete line to the handler
+	 *
+	 * @param line the line, without the LF
+	 * @param newline whether the line was terminated by LF
+	 */
+	void Emit(std::string& line, bool newline);
+
+	/**
+	 * Split the next part of the UTF-8 contents to lines
+	 *
+	 * @param data the data
+	 * @param length the number of bytes
+	 */
+	void Split(const char* data, size_t length);
+
+
+public:
+
+	/**
+	 * Create an instance of class TextDecoder
+	 *
+	 * @param emit the function to call with each line, which can take
+	 *             the contents of the string
+	 */
+	TextDecoder(const std::function<void(std::string&)>& emit);
+
+	/**
+	 * Destroy the object
+	 */
+	virtual ~TextDecoder(void);
+
+	/**
+	 * Decode the next part of the contents
+	 *
+	 * @param data the data
+	 * @param length the number of bytes
+	 * @return true on success, false if it cannot be converted to UTF-8
+	 */
+	bool Decode(const char* data, size_t length);
+
+	/**
+	 * Finish decoding, passing the last line to the handler
+	 *
+	 * @return the format of the contents
+	 */
+	TextFormat Finish(void);
+
+	/**
+	 * Determine whether the contents could not be converted to UTF-8, which
+	 * is also checked at the end by Finish()
+	 *
+	 * @return true if the conversion failed
+	 */
+	inline bool Failed(void) const { return failed; }
+
+	/**
+	 * Return a description of the conversion error
+	 *
+	 * @return the error message
+	 */
+	std::string Error(void) const;
+
+	/**
+	 * Set the encoding of the files, which is detected by default
+	 *
+	 * @param encoding the encoding, or TEXT_ENCODING_AUTO to detect it
+	 */
+	static void SetEncoding(TextEncoding encoding)
+	{
+		defaultEncoding = encoding;
+	}
+
+	/**
+	 * Determine whether a line was terminated by CRLF
+	 *
+	 * @param line the line number
+	 * @return true if it was terminated by CRLF
+	 */
+	inline bool EndsWithCR(size_t line) const
+	{
+		return line < crlf.size() && crlf[line];
+	}
+};
+
+#endif
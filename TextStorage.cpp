@@ -0,0 +1,131 @@
+/*
+ * TextStorage.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "TextStorage.h"
+
+#include <algorithm>
+#include <new>
+
+
+/**
+ * Allocate a block with a single reference
+ *
+ * @param size the number of bytes
+ * @return the block
+ */
+TextBlock* TextBlock::Create(size_t size)
+{
+	void* p = malloc(sizeof(TextBlock) + size);
+	if (p == NULL) throw std::bad_alloc();
+	return new (p) TextBlock();
+}
+
+
+/**
+ * Remove a reference, freeing the block when it was the last one
+ */
+void TextBlock::Release(void)
+{
+	if (references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		this->~TextBlock();
+		free(this);
+	}
+}
+
+
+/**
+ * Create an instance of class TextArena
+ */
+TextArena::TextArena(void)
+{
+	block = NULL;
+	used = 0;
+	capacity = 0;
+}
+
+
+/**
+ * Destroy the object (the blocks live on in the lines that use them)
+ */
+TextArena::~TextArena(void)
+{
+	if (block != NULL) block->Release();
+}
+
+
+/**
+ * Copy a string into a block, followed by a NUL
+ *
+ * @param text the text
+ * @param length the length of the text
+ * @param offset where to store the offset of the text within the block
+ * @return the block, with a reference that the caller now owns
+ */
+TextBlock* TextArena::Add(const char* text, size_t length, uint32_t& offset)
+{
+	// Give long lines blocks of their own, so that they do not waste the
+	// rest of the current block
+
+	if (length >= APE_TEXT_BLOCK_SIZE / 4) {
+		TextBlock* b = TextBlock::Create(length + 1);
+		memcpy(b->Data(), text, length);
+		b->Data()[length] = '\0';
+		offset = 0;
+		return b;
+	}
+
+
+	// Start with small blocks, so that short files do not take a whole block
+
+	if (block == NULL || used + length + 1 > capacity) {
+		size_t size = std::min<size_t>(std::max<size_t>(capacity * 2,
+					APE_TEXT_MIN_BLOCK_SIZE), APE_TEXT_BLOCK_SIZE);
+		if (size < length + 1) size = length + 1;
+
+		if (block != NULL) block->Release();
+		block = TextBlock::Create(size);
+		used = 0;
+		capacity = size;
+	}
+
+	memcpy(block->Data() + used, text, length);
+	block->Data()[used + length] = '\0';
+	offset = (uint32_t) used;
+	used += length + 1;
+
+	block->Retain();
+	return block;
+}
@@ -0,0 +1,141 @@
+/*
+ * TextStorage.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __TEXT_STORAGE_H
+#define __TEXT_STORAGE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/**
+ * The sizes of the blocks that the text of a loaded file is packed into
+ */
+#define APE_TEXT_MIN_BLOCK_SIZE		4096
+#define APE_TEXT_BLOCK_SIZE			(1024 * 1024)
+
+
+/**
+ * A reference-counted block of immutable text, which holds the
+ * NUL-terminated text of one or more lines
+ *
+ * @author Peter Macko
+ */
+class TextBlock
+{
+	std::atomic<size_t> references;
+
+
+	/**
+	 * Create an instance of class TextBlock
+	 */
+	TextBlock(void) : references(1) {}
+
+	TextBlock(const TextBlock& other) = delete;
+	TextBlock& operator=(const TextBlock& other) = delete;
+
+
+public:
+
+	/**
+	 * Allocate a block with a single reference
+	 *
+	 * @param size the number of bytes
+	 * @return the block
+	 */
+	static TextBlock* Create(size_t size);
+
+	/**
+	 * Get the contents of the block, which follow the header
+	 *
+	 * @return the pointer to the first byte
+	 */
+	inline char* Data(void) { return reinterpret_cast<char*>(this + 1); }
+
+	/**
+	 * Add a reference
+	 */
+	inline void Retain(void)
+	{
+		references.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	/**
+	 * Remove a reference, freeing the block when it was the last one
+	 */
+	void Release(void);
+};
+
+
+/**
+ * Packs the text of many lines into shared blocks, so that each line costs
+ * only a block reference and an offset instead of an allocation of its own.
+ * An arena must be used only from one thread at a time, but the blocks can
+ * be shared between threads.
+ *
+ * @author Peter Macko
+ */
+class TextArena
+{
+	TextBlock* block;
+	size_t used;
+	size_t capacity;
+
+
+public:
+
+	/**
+	 * Create an instance of class TextArena
+	 */
+	TextArena(void);
+
+	/**
+	 * Destroy the object (the blocks live on in the lines that use them)
+	 */
+	virtual ~TextArena(void);
+
+	/**
+	 * Copy a string into a block, followed by a NUL
+	 *
+	 * @param text the text
+	 * @param length the length of the text
+	 * @param offset where to store the offset of the text within the block
+	 * @return the block, with a reference that the caller now owns
+	 */
+	TextBlock* Add(const char* text, size_t length, uint32_t& offset);
+};
+
+#endif
@@ -0,0 +1,434 @@
+/*
+ * ThreadPool.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool pool;
+
+
+/**
+ * The pool and the worker index of the current thread
+ */
+static thread_local ThreadPool* currentPool = NULL;
+static thread_local int currentWorker = -1;
+
+
+/**
+ * Create an instance of class ThreadPool. The worker threads do not
+ * start until Start() is called or the first task is submitted.
+ */
+ThreadPool::ThreadPool(void)
+{
+	started = false;
+	startTime = 0;
+	pending = 0;
+	stop = false;
+	nextWorker = 0;
+
+	submitted = 0;
+	executed = 0;
+	stolen = 0;
+	cancelled = 0;
+}
+
+
+/**
+ * Destroy the object, stopping the workers and discarding the tasks
+ * that did not run
+ */
+ThreadPool::~ThreadPool(void)
+{
+	Shutdown();
+}
+
+
+/**
+ * Start the worker threads. This has no effect if they already started.
+ *
+ * @param numWorkers the number of workers, or 0 to use one worker for
+ *                   each processor
+ */
+void ThreadPool::Start(int numWorkers)
+{
+	std::lock_guard<std::mutex> lock(startMutex);
+	if (started) return;
+
+	if (numWorkers <= 0) numWorkers = std::thread::hardware_concurrency();
+	if (numWorkers <= 0) numWorkers = 1;
+
+
+	// Create all workers before starting any threads, since the workers
+	// steal from each other
+
+	for (int i = 0; i < numWorkers; i++) {
+		Worker* w = new Worker();
+		w->busyMicroseconds = 0;
+		workers.push_back(w);
+	}
+
+	stop = false;
+	startTime = Time();
+
+	for (int i = 0; i < numWorkers; i++) {
+		workers[i]->thread = std::thread(&ThreadPool::WorkerMain, this, i);
+	}
+
+	started = true;
+}
+
+
+/**
+ * Stop the worker threads after they finish their current tasks
+ */
+void ThreadPool::Shutdown(void)
+{
+	std::lock_guard<std::mutex> lock(startMutex);
+	if (!started) return;
+
+	{
+		std::lock_guard<std::mutex> sleepLock(sleepMutex);
+		stop = true;
+	}
+	wake.notify_all();
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		if (workers[i]->thread.joinable()) workers[i]->thread.join();
+		delete workers[i];
+	}
+
+	workers.clear();
+	pending = 0;
+	started = false;
+}
+
+
+/**
+ * Get the index of the current worker thread
+ *
+ * @return the index, or -1 if the current thread is not a worker
+ */
+int ThreadPool::CurrentWorker(void)
+{
+	return currentPool == this ? currentWorker : -1;
+}
+
+
+/**
+ * The main function of a worker thread
+ *
+ * @param index the worker index
+ */
+void ThreadPool::WorkerMain(int index)
+{
+	currentPool = this;
+	currentWorker = index;
+
+	while (true) {
+
+		Task task;
+		if (Take(index, task)) {
+			Run(index, task);
+			continue;
+		}
+
+
+		// Sleep until there is more work
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this]() { return stop || pending > 0; });
+		if (stop) break;
+	}
+}
+
+
+/**
+ * Take the next task to run
+ *
+ * @param index the index of the current worker, or -1 if the current
+ *              thread is not a worker
+ * @param task where to store the task
+ * @return true if a task was found
+ */
+bool ThreadPool::Take(int index, Task& task)
+{
+	if (pending <= 0) return false;
+
+	int n = (int) workers.size();
+
+	for (int p = 0; p < TASK_PRIORITY_COUNT; p++) {
+
+		// Take the newest task from the own deque, which is likely to still
+		// have its data in the cache
+
+		if (index >= 0) {
+			Worker* w = workers[index];
+			std::lock_guard<std::mutex> lock(w->mutex);
+			if (!w->tasks[p].empty()) {
+				task = w->tasks[p].back();
+				w->tasks[p].pop_back();
+				pending--;
+				return true;
+			}
+		}
+
+
+		// Steal the oldest task from another worker
+
+		int start = index >= 0 ? index + 1 : 0;
+		for (int i = 0; i < n; i++) {
+			int victim = (start + i) % n;
+			if (victim == index) continue;
+
+			Worker* w = workers[victim];
+			std::lock_guard<std::mutex> lock(w->mutex);
+			if (!w->tasks[p].empty()) {
+				task = w->tasks[p].front();
+				w->tasks[p].pop_front();
+				pending--;
+				if (index >= 0) stolen++;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * Run a task
+ *
+ * @param index the index of the current worker, or -1
+ * @param task the task
+ */
+void ThreadPool::Run(int index, Task& task)
+{
+	if (task.token.Cancelled()) {
+		cancelled++;
+		return;
+	}
+
+	double start = Time();
+	task.run();
+	executed++;
+
+	if (index >= 0) {
+		workers[index]->busyMicroseconds
+			+= (unsigned long long) ((Time() - start) * 1000000);
+	}
+}
+
+
+/**
+ * Submit a task. This can be called from any thread, including from
+ * the tasks themselves.
+ *
+ * @param task the task
+ * @param priority the priority
+ * @param token the cancellation token; the task does not run if it is
+ *              cancelled before it starts
+ */
+void ThreadPool::Submit(const std::function<void(void)>& task,
+		TaskPriority priority, const CancellationToken& token)
+{
+	if (!started) Start();
+
+	Task t;
+	t.run = task;
+	t.token = token;
+
+
+	// Workers push to their own deques, the other threads distribute the
+	// tasks round-robin
+
+	int index = CurrentWorker();
+	if (index < 0) index = nextWorker++ % workers.size();
+
+	{
+		Worker* w = workers[index];
+		std::lock_guard<std::mutex> lock(w->mutex);
+		w->tasks[priority].push_back(t);
+	}
+
+	submitted++;
+
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		pending++;
+	}
+	wake.notify_one();
+}
+
+
+/**
+ * Run a function over a range of indices in parallel, and wait for it
+ * to finish. The calling thread runs the chunks too, but not any other
+ * tasks of the pool.
+ *
+ * @param begin the first index
+ * @param end the index after the last
+ * @param grain the number of indices per task
+ * @param body the function, which receives a subrange [begin, end)
+ * @param priority the priority
+ * @param token the cancellation token
+ * @param progress the progress callback called from the calling
+ *                 thread, or NULL
+ * @return true if completed, false if cancelled
+ */
+bool ThreadPool::ParallelFor(size_t begin, size_t end, size_t grain,
+		const std::function<void(size_t, size_t)>& body,
+		TaskPriority priority, const CancellationToken& token,
+		const ProgressCallback& progress)
+{
+	if (begin >= end) return !token.Cancelled();
+	if (grain == 0) grain = 1;
+
+	size_t chunks = (end - begin + grain - 1) / grain;
+
+
+	// Run small ranges directly
+
+	if (chunks == 1) {
+		if (token.Cancelled()) return false;
+		body(begin, end);
+		if (progress) progress(1);
+		return !token.Cancelled();
+	}
+
+
+	// The chunks are claimed from a counter shared with the helper tasks,
+	// so that the calling thread runs only the chunks of this call, and
+	// never an unrelated task of the pool. The state outlives the call,
+	// since a helper task can start after all chunks are done.
+
+	struct State
+	{
+		std::function<void(size_t, size_t)> body;
+		CancellationToken token;
+		std::atomic<size_t> next;
+		std::mutex mutex;
+		std::condition_variable done;
+		size_t completed;
+	};
+
+	std::shared_ptr<State> state = std::make_shared<State>();
+	state->body = body;
+	state->token = token;
+	state->next = 0;
+	state->completed = 0;
+
+	std::function<bool(void)> runChunk = [state, begin, end, grain, chunks]() {
+		size_t c = state->next++;
+		if (c >= chunks) return false;
+
+		size_t b = begin + c * grain;
+		size_t e = end - b > grain ? b + grain : end;
+		if (!state->token.Cancelled()) state->body(b, e);
+
+		{
+			std::lock_guard<std::mutex> lock(state->mutex);
+			state->completed++;
+		}
+		state->done.notify_one();
+		return true;
+	};
+
+	if (!started) Start();
+
+	size_t helpers = std::min(chunks - 1, workers.size());
+	for (size_t i = 0; i < helpers; i++) {
+		Submit([runChunk]() {
+			while (runChunk()) {}
+		}, priority);
+	}
+
+
+	// Run the chunks on the calling thread too, and then wait for the
+	// helpers to finish theirs
+
+	size_t lastReported = 0;
+
+	while (true) {
+		bool ran = runChunk();
+
+		size_t c;
+		{
+			std::unique_lock<std::mutex> lock(state->mutex);
+			if (!ran && state->completed < chunks
+					&& state->completed == lastReported) {
+				state->done.wait(lock);
+			}
+			c = state->completed;
+		}
+
+		if (progress && c != lastReported) {
+			progress(c / (double) chunks);
+		}
+		lastReported = c;
+
+		if (c == chunks) break;
+	}
+
+	return !token.Cancelled();
+}
+
+
+/**
+ * Get the statistics
+ *
+ * @return the statistics
+ */
+ThreadPoolStatistics ThreadPool::Statistics(void)
+{
+	std::lock_guard<std::mutex> lock(startMutex);
+
+	ThreadPoolStatistics s;
+	s.workers = (int) workers.size();
+	s.submitted = submitted;
+	s.executed = executed;
+	s.stolen = stolen;
+	s.cancelled = cancelled;
+	s.busyTime = 0;
+	s.elapsedTime = started ? Time() - startTime : 0;
+
+	for (size_t i = 0; i < workers.size(); i++) {
+		s.busyTime += workers[i]->busyMicroseconds / 1000000.0;
+	}
+
+	return s;
+}
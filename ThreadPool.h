@@ -0,0 +1,289 @@
+/*
+ * ThreadPool.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __THREAD_POOL_H
+#define __THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+/**
+ * Task priorities
+ */
+enum TaskPriority
+{
+	TASK_PRIORITY_INTERACTIVE = 0,
+	TASK_PRIORITY_BACKGROUND = 1,
+};
+
+#define TASK_PRIORITY_COUNT		2
+
+
+/**
+ * A callback that reports the progress of an operation
+ *
+ * @param fraction the completed fraction, between 0 and 1
+ */
+typedef std::function<void(double)> ProgressCallback;
+
+
+/**
+ * A cancellation token. The copies of a token share the same state, so
+ * that an operation can be cancelled through any of them.
+ *
+ * @author Peter Macko
+ */
+class CancellationToken
+{
+	std::shared_ptr<std::atomic<bool>> cancelled;
+
+
+public:
+
+	/**
+	 * Create a new cancellation token
+	 */
+	CancellationToken(void) : cancelled(new std::atomic<bool>(false)) {}
+
+	/**
+	 * Request the cancellation
+	 */
+	inline void Cancel(void) { *cancelled = true; }
+
+	/**
+	 * Determine whether the cancellation was requested
+	 *
+	 * @return true if cancelled
+	 */
+	inline bool Cancelled(void) const { return *cancelled; }
+};
+
+
+/**
+ * The thread pool statistics
+ */
+struct ThreadPoolStatistics
+{
+	int workers;
+	unsigned long submitted;
+	unsigned long executed;
+	unsigned long stolen;
+	unsigned long cancelled;
+	double busyTime;
+	double elapsedTime;
+
+
+	/**
+	 * Get the fraction of the worker time spent running tasks
+	 *
+	 * @return the utilization, between 0 and 1
+	 */
+	inline double Utilization(void) const
+	{
+		if (workers <= 0 || elapsedTime <= 0) return 0;
+		return busyTime / (workers * elapsedTime);
+	}
+};
+
+
+/**
+ * A work-stealing thread pool. Each worker has its own deques of tasks (one
+ * per priority): it takes the most recently added tasks from its own deques,
+ * and when they run out, it steals the oldest tasks from the other workers.
+ * Interactive tasks always run before the background tasks.
+ *
+ * @author Peter Macko
+ */
+class ThreadPool
+{
+	/**
+	 * A task
+	 */
+	struct Task
+	{
+		std::function<void(void)> run;
+		CancellationToken token;
+	};
+
+
+	/**
+	 * A worker
+	 */
+	struct Worker
+	{
+		std::mutex mutex;
+		std::deque<Task> tasks[TASK_PRIORITY_COUNT];
+		std::thread thread;
+		std::atomic<unsigned long long> busyMicroseconds;
+	};
+
+
+	std::vector<Worker*> workers;
+	std::mutex startMutex;
+	std::atomic<bool> started;
+	double startTime;
+
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> pending;
+	bool stop;
+
+	std::atomic<unsigned> nextWorker;
+
+	std::atomic<unsigned long> submitted;
+	std::atomic<unsigned long> executed;
+	std::atomic<unsigned long> stolen;
+	std::atomic<unsigned long> cancelled;
+
+
+	/**
+	 * The main function of a worker thread
+	 *
+	 * @param index the worker index
+	 */
+	void WorkerMain(int index);
+
+	/**
+	 * Take the next task to run
+	 *
+	 * @param index the index of the current worker, or -1 if the current
+	 *              thread is not a worker
+	 * @param task where to store the task
+	 * @return true if a task was found
+	 */
+	bool Take(int index, Task& task);
+
+	/**
+	 * Run a task
+	 *
+	 * @param index the index of the current worker, or -1
+	 * @param task the task
+	 */
+	void Run(int index, Task& task);
+
+	/**
+	 * Get the index of the current worker thread
+	 *
+	 * @return the index, or -1 if the current thread is not a worker
+	 */
+	int CurrentWorker(void);
+
+
+public:
+
+	/**
+	 * Create an instance of class ThreadPool. The worker threads do not
+	 * start until Start() is called or the first task is submitted.
+	 */
+	ThreadPool(void);
+
+	/**
+	 * Destroy the object, stopping the workers and discarding the tasks
+	 * that did not run
+	 */
+	virtual ~ThreadPool(void);
+
+	/**
+	 * Start the worker threads. This has no effect if they already started.
+	 *
+	 * @param numWorkers the number of workers, or 0 to use one worker for
+	 *                   each processor
+	 */
+	void Start(int numWorkers = 0);
+
+	/**
+	 * Stop the worker threads after they finish their current tasks
+	 */
+	void Shutdown(void);
+
+	/**
+	 * Get the number of workers
+	 *
+	 * @return the number of workers, or 0 if not started
+	 */
+	inline int Workers(void) { return (int) workers.size(); }
+
+	/**
+	 * Submit a task. This can be called from any thread, including from
+	 * the tasks themselves.
+	 *
+	 * @param task the task
+	 * @param priority the priority
+	 * @param token the cancellation token; the task does not run if it is
+	 *              cancelled before it starts
+	 */
+	void Submit(const std::function<void(void)>& task,
+			TaskPriority priority = TASK_PRIORITY_BACKGROUND,
+			const CancellationToken& token = CancellationToken());
+
+	/**
+	 * Run a function over a range of indices in parallel, and wait for it
+	 * to finish. The calling thread runs the chunks too, but not any other
+	 * tasks of the pool.
+	 *
+	 * @param begin the first index
+	 * @param end the index after the last
+	 * @param grain the number of indices per task
+	 * @param body the function, which receives a subrange [begin, end)
+	 * @param priority the priority
+	 * @param token the cancellation token
+	 * @param progress the progress callback called from the calling
+	 *                 thread, or NULL
+	 * @return true if completed, false if cancelled
+	 */
+	bool ParallelFor(size_t begin, size_t end, size_t grain,
+			const std::function<void(size_t, size_t)>& body,
+			TaskPriority priority = TASK_PRIORITY_INTERACTIVE,
+			const CancellationToken& token = CancellationToken(),
+			const ProgressCallback& progress = NULL);
+
+	/**
+	 * Get the statistics
+	 *
+	 * @return the statistics
+	 */
+	ThreadPoolStatistics Statistics(void);
+};
+
+extern ThreadPool pool;
+
+#endif
@@ -0,0 +1,271 @@
+/*
+ * UTF8.h
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#ifndef __UTF8_H
+#define __UTF8_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+/**
+ * The code point returned for a byte that does not start a valid UTF-8
+ * sequence; such bytes are displayed one column wide
+ */
+#define APE_INVALID_CODE_POINT		0xFFFFFFFFu
+
+
+/**
+ * Decode a multi-byte UTF-8 sequence
+ *
+ * @param p the first byte of the sequence
+ * @param end the end of the string
+ * @param cp the code point, or APE_INVALID_CODE_POINT if the sequence is not
+ *           valid (output)
+ * @return the number of bytes consumed, which is 1 for an invalid byte
+ */
+size_t DecodeUTF8Sequence(const char* p, const char* end, uint32_t& cp);
+
+
+/**
+ * Decode the UTF-8 character at the given position
+ *
+ * @param p the character
+ * @param end the end of the string
+ * @param cp the code point, or APE_INVALID_CODE_POINT if it is not valid
+ *           (output)
+ * @return the number of bytes consumed
+ */
+inline size_t DecodeUTF8(const char* p, const char* end, uint32_t& cp)
+{
+	if ((unsigned char) *p < 0x80) {
+		cp = (unsigned char) *p;
+		return 1;
+	}
+
+	return DecodeUTF8Sequence(p, end, cp);
+}
+
+
+/**
+ * Look up the display width of a code point in the tables of the combining
+ * marks and of the East Asian wide and fullwidth characters
+ *
+ * @param cp the code point
+ * @return the width: 0, 1, or 2
+ */
+int CodePointWidthFromTable(uint32_t cp);
+
+
+/**
+ * Get the display width of a code point, not counting tabs. Control
+ * characters and invalid bytes are displayed as a single '?'.
+ *
+ * @param cp the code point
+ * @return the width: 0, 1, or 2
+ */
+inline int CodePointWidth(uint32_t cp)
+{
+	if (cp < 0x300 || cp == APE_INVALID_CODE_POINT) return 1;
+	return CodePointWidthFromTable(cp);
+}
+
+
+/**
+ * Return true if the code point should be displayed as '?'
+ *
+ * @param cp the code point
+ * @return true if it is a control character or an invalid byte
+ */
+inline bool IsUndisplayableCodePoint(uint32_t cp)
+{
+	return cp < 0x20 || (cp >= 0x7f && cp < 0xa0)
+		|| cp == APE_INVALID_CODE_POINT;
+}
+
+
+/**
+ * Get the length of the run of plain ASCII characters at the beginning of
+ * the string, which are the characters that are exactly one byte and one
+ * column each, i.e. everything in 0x0e-0x7f. It checks 16 bytes at a time
+ * with SSE2 where available.
+ *
+ * @param p the string
+ * @param length the maximum number of bytes to examine
+ * @return the number of bytes in the run
+ */
+size_t PlainASCIIPrefix(const char* p, size_t length);
+
+
+/**
+ * Get the display width of a line, up to its first line terminator
+ *
+ * @param str the string
+ * @param length the length of the string
+ * @param tabSize the tab size
+ * @return the number of columns
+ */
+int64_t DisplayWidth(const char* str, size_t length, int tabSize);
+
+
+/**
+ * Find the offset of the character at the given display column. A character
+ * that spans across the column, such as a tab or a wide character, is not
+ * skipped, while the zero-width characters at the column are.
+ *
+ * @param str the string
+ * @param length the length of the string
+ * @param tabSize the tab size
+ * @param column the display column
+ * @param actual the display column at the returned offset (output, optional)
+ * @return the byte offset
+ */
+size_t DisplayColumnToOffset(const char* str, size_t length, int tabSize,
+		int64_t column, int64_t* actual = NULL);
+
+
+/**
+ * Find the display column of the given byte offset
+ *
+ * @param str the string
+ * @param length the length of the string
+ * @param tabSize the tab size
+ * @param offset the byte offset
+ * @return the display column
+ */
+int64_t OffsetToDisplayColumn(const char* str, size_t length, int tabSize,
+		size_t offset);
+
+
+/**
+ * Find the offset of the next character, skipping the combining marks that
+ * belong to the character at the given offset
+ *
+ * @param str the string
+ * @param length the length of the string
+ * @param offset the byte offset
+ * @return the offset of the next character, or the offset if at the end
+ */
+size_t NextCharacterOffset(const char* str, size_t length, size_t offset);
+
+
+/**
+ * Find the offset of the previous character, including its combining marks
+ *
+ * @param str the string
+ * @param length the length of the string
+ * @param offset the byte offset
+ * @return the offset of the previous character, or 0 if at the beginning
+ */
+size_t PreviousCharacterOffset(const char* str, size_t length, size_t offset);
+
+
+/**
+ * Append a code point to a string as UTF-8
+ *
+ * @param s the string
+ * @param cp the code point
+ */
+void AppendUTF8(std::string& s, uint32_t cp);
+
+
+/**
+ * A map between the byte offsets and the display columns of a line with tabs
+ * or multi-byte characters. It records only these characters, since all other
+ * bytes are one column each, so that a conversion is a binary search instead
+ * of a walk over the whole line.
+ *
+ * @author Peter Macko
+ */
+class ColumnMap
+{
+	/**
+	 * A tab or a multi-byte character
+	 */
+	struct Entry
+	{
+		size_t offset;
+		int64_t column;
+		uint32_t bytes;
+		uint32_t width;
+	};
+
+	std::vector<Entry> entries;
+	size_t length;
+	int64_t width;
+
+
+public:
+
+	/**
+	 * Build the map of a line
+	 *
+	 * @param str the string
+	 * @param length the length of the string
+	 * @param tabSize the tab size
+	 */
+	ColumnMap(const char* str, size_t length, int tabSize);
+
+	/**
+	 * Get the display width of the line
+	 *
+	 * @return the number of columns
+	 */
+	inline int64_t Width(void) const { return width; }
+
+	/**
+	 * Find the offset of the character at the given display column, with
+	 * the same semantics as DisplayColumnToOffset()
+	 *
+	 * @param column the display column
+	 * @param actual the display column at the returned offset (output,
+	 *               optional)
+	 * @return the byte offset
+	 */
+	size_t ColumnToOffset(int64_t column, int64_t* actual = NULL) const;
+
+	/**
+	 * Find the display column of the given byte offset, with the same
+	 * semantics as OffsetToDisplayColumn()
+	 *
+	 * @param offset the byte offset
+	 * @return the display column
+	 */
+	int64_t OffsetToColumn(size_t offset) const;
+};
+
+#endif
@@ -476,6 +476,15 @@ void Window::OnWindowMenu(int code)
 }
 
 
+/**
+ * An event handler for closing the window, called by the window manager
+ * after the window has been removed from the screen
+ */
+void Window::OnClose(void)
+{
+}
+
+
 /**
  * An event handler for mouse press
  *
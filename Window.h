@@ -154,6 +154,12 @@ protected:
 	 * @param code the menu exit code
 	 */
 	virtual void OnWindowMenu(int code);
+
+	/**
+	 * An event handler for closing the window, called by the window manager
+	 * after the window has been removed from the screen
+	 */
+	virtual void OnClose(void);
 	
 	/**
 	 * An event handler for mouse press
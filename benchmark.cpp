@@ -0,0 +1,691 @@
+/*
+ * benchmark.cpp
+ *
+ * Copyright (c) 2015, Peter Macko
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ * 
+ * 1. Redistributions of source code must retain the above copyright notice, 
+ * this list of conditions and the following disclaimer.
+ * 
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ * this list of conditions and the following disclaimer in the documentation
+ * and/or other materials provided with the distribution.
+ * 
+ * 3. Neither the name of the copyright holder nor the names of its
+ * contributors may be used to endorse or promote products derived from this
+ * software without specific prior written permission.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF
+ * THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+
+#include "stdafx.h"
+
+#include <cerrno>
+#include <climits>
+#include <functional>
+#include <getopt.h>
+#include <libgen.h>
+#include <stdint.h>
+
+#include "EditorWindow.h"
+#include "HeadlessBackend.h"
+#include "Manager.h"
+#include "ThreadPool.h"
+
+
+/**
+ * Short command-line arguments
+ */
+static const char* SHORT_OPTIONS = "c:dg:hj:n:pr:";
+
+
+/**
+ * The smallest screen that fits a maximized editor window with its frame
+ * and the status line
+ */
+static const int MIN_ROWS = 7;
+static const int MIN_COLUMNS = 28;
+
+
+/**
+ * Long command-line arguments
+ */
+static struct option LONG_OPTIONS[] =
+{
+	{"columns"      , required_argument, 0, 'c'},
+	{"dump"         , no_argument,       0, 'd'},
+	{"corpus"       , required_argument, 0, 'g'},
+	{"help"         , no_argument,       0, 'h'},
+	{"jobs"         , required_argument, 0, 'j'},
+	{"repeat"       , required_argument, 0, 'n'},
+	{"pager"        , no_argument,       0, 'p'},
+	{"rows"         , required_argument, 0, 'r'},
+	{0, 0, 0, 0}
+};
+
+
+/**
+ * The names of the keys that can be used in the script
+ */
+static struct {
+	const char* name;
+	int key;
+} KEY_NAMES[] =
+{
+	{"up"           , KEY_UP},
+	{"down"         , KEY_DOWN},
+	{"left"         , KEY_LEFT},
+	{"right"        , KEY_RIGHT},
+	{"home"         , KEY_HOME},
+	{"end"          , KEY_END},
+	{"pgup"         , KEY_PPAGE},
+	{"pgdn"         , KEY_NPAGE},
+	{"shift-up"     , KEY_SHIFT_UP},
+	{"shift-down"   , KEY_SHIFT_DOWN},
+	{"shift-left"   , KEY_SHIFT_LEFT},
+	{"shift-right"  , KEY_SHIFT_RIGHT},
+	{"shift-home"   , KEY_SHIFT_HOME},
+	{"shift-end"    , KEY_SHIFT_END},
+	{"alt-up"       , KEY_ALT_UP},
+	{"alt-down"     , KEY_ALT_DOWN},
+	{"alt-left"     , KEY_ALT_LEFT},
+	{"alt-right"    , KEY_ALT_RIGHT},
+	{"enter"        , KEY_RETURN},
+	{"tab"          , '\t'},
+	{"backtab"      , KEY_BTAB},
+	{"backspace"    , KEY_BACKSPACE},
+	{"delete"       , KEY_DC},
+	{"esc"          , KEY_ESC},
+	{NULL, 0}
+};
+
+
+/**
+ * Print the usage information
+ *
+ * @param arg0 the first element in the argv array
+ */
+static void usage(const char* arg0) {
+
+	char* s = strdup(arg0);
+	char* p = basename(s);
+	fprintf(stderr, "Usage: %s [OPTIONS] SCRIPT [FILE [FILE...]]\n", p);
+	fprintf(stderr, "       %s --corpus DIR\n\n", p);
+	free(s);
+	
+	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -c, --columns N       Set the number of screen columns (default: 80, "
+			"minimum: %d)\n", MIN_COLUMNS);
+	fprintf(stderr, "  -d, --dump            Print the final screen\n");
+	fprintf(stderr, "  -g, --corpus DIR      Write the boundary test corpus to DIR and exit\n");
+	fprintf(stderr, "  -h, --help            Show this usage information and exit\n");
+	fprintf(stderr, "  -j, --jobs N          Set the number of worker threads (default: one per CPU)\n");
+	fprintf(stderr, "  -n, --repeat N        Run the script N times\n");
+	fprintf(stderr, "  -p, --pager           Open the files read-only in the pager\n");
+	fprintf(stderr, "  -r, --rows N          Set the number of screen rows (default: 24, "
+			"minimum: %d)\n", MIN_ROWS);
+	fprintf(stderr, "\nScript commands (one per line, # starts a comment):\n");
+	fprintf(stderr, "  type TEXT             Type the text (supports \\n, \\t, \\e, \\\\)\n");
+	fprintf(stderr, "  paste TEXT            Paste the text into the terminal (same escapes)\n");
+	fprintf(stderr, "  key NAME [COUNT]      Press a key, such as down, pgdn, ctrl-s, f2\n");
+	fprintf(stderr, "  click ROW COL [BTN]   Click a mouse button\n");
+	fprintf(stderr, "  wheel ROW COL up|down Scroll the mouse wheel\n");
+	fprintf(stderr, "  resize ROWS COLS      Resize the screen\n");
+	fprintf(stderr, "  expect ROW COL TEXT   Check the screen contents\n");
+	fprintf(stderr, "  dump                  Print the screen\n");
+	fprintf(stderr, "  wait                  Wait until the background work is done\n");
+}
+
+
+/**
+ * Parse a decimal integer that makes up the entire string
+ *
+ * @param str the string
+ * @param value the output value
+ * @return true if the string is a valid number that fits into an int
+ */
+static bool parse_int(const char* str, int& value)
+{
+	char* end;
+	errno = 0;
+	long l = strtol(str, &end, 10);
+	if (end == str || *end != '\0' || errno != 0
+			|| l < INT_MIN || l > INT_MAX) return false;
+	value = (int) l;
+	return true;
+}
+
+
+/**
+ * Parse a key name
+ *
+ * @param name the key name
+ * @return the key code, or ERR if not recognized
+ */
+static int parse_key(const char* name)
+{
+	for (int i = 0; KEY_NAMES[i].name != NULL; i++) {
+		if (strcmp(name, KEY_NAMES[i].name) == 0) return KEY_NAMES[i].key;
+	}
+
+	if (strncmp(name, "ctrl-", 5) == 0 && islower(name[5]) && name[6] == '\0') {
+		return KEY_CTRL(name[5]);
+	}
+
+	if (strncmp(name, "alt-", 4) == 0 && isprint(name[4]) && name[5] == '\0') {
+		return KEY_ALT((unsigned char) name[4]);
+	}
+
+	if (name[0] == 'f' && isdigit(name[1])) {
+		int n = atoi(name + 1);
+		if (n >= 1 && n <= 12) return KEY_F(n);
+	}
+
+	if (name[0] != '\0' && name[1] == '\0') return (unsigned char) name[0];
+
+	return ERR;
+}
+
+
+/**
+ * Expand the escape sequences in a string
+ *
+ * @param str the string
+ * @return the expanded string
+ */
+static std::string unescape(const char* str)
+{
+	std::string s;
+
+	for (const char* p = str; *p != '\0'; p++) {
+		if (*p != '\\' || p[1] == '\0') {
+			s += *p;
+			continue;
+		}
+
+		switch (*(++p)) {
+			case 'n': s += '\n'; break;
+			case 't': s += '\t'; break;
+			case 'e': s += (char) KEY_ESC; break;
+			default : s += *p; break;
+		}
+	}
+
+	return s;
+}
+
+
+/**
+ * Load the script and queue its events
+ *
+ * @param backend the headless backend
+ * @param file the script file name
+ * @return true on success
+ */
+static bool load_script(HeadlessBackend* backend, const char* file)
+{
+	FILE* f = fopen(file, "r");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot open %s: %s\n", file, strerror(errno));
+		return false;
+	}
+
+	char buf[4096];
+	int line = 0;
+	bool ok = true;
+
+	while (fgets(buf, sizeof(buf), f) != NULL) {
+		line++;
+
+		size_t l = strlen(buf);
+		if (l > 0 && buf[l-1] == '\n') buf[--l] = '\0';
+
+		char* p = buf;
+		while (isspace(*p)) p++;
+		if (*p == '\0' || *p == '#') continue;
+
+		char command[32];
+		int n = 0;
+		if (sscanf(p, "%31s %n", command, &n) != 1) continue;
+		const char* args = p + n;
+
+		char name[64];
+		int row, column, count;
+
+		if (strcmp(command, "type") == 0) {
+			backend->PushText(unescape(args).c_str());
+		}
+
+		else if (strcmp(command, "paste") == 0) {
+			backend->PushPaste(unescape(args).c_str());
+		}
+		else if (strcmp(command, "key") == 0) {
+			count = 1;
+			int key = ERR;
+			if (sscanf(args, "%63s %d", name, &count) >= 1) key = parse_key(name);
+			if (key == ERR) {
+				fprintf(stderr, "%s:%d: Invalid key\n", file, line);
+				ok = false;
+				break;
+			}
+			for (int i = 0; i < count; i++) backend->PushKey(key);
+		}
+		else if (strcmp(command, "click") == 0) {
+			int button = 1;
+			if (sscanf(args, "%d %d %d", &row, &column, &button) < 2
+					|| button < 1 || button > 3) {
+				fprintf(stderr, "%s:%d: Invalid click\n", file, line);
+				ok = false;
+				break;
+			}
+			backend->PushMouse(row, column,
+					NCURSES_MOUSE_MASK(button, NCURSES_BUTTON_PRESSED));
+			backend->PushMouse(row, column,
+					NCURSES_MOUSE_MASK(button, NCURSES_BUTTON_RELEASED));
+		}
+		else if (strcmp(command, "wheel") == 0) {
+			if (sscanf(args, "%d %d %63s", &row, &column, name) != 3) {
+				fprintf(stderr, "%s:%d: Invalid wheel event\n", file, line);
+				ok = false;
+				break;
+			}
+#ifdef BUTTON5_PRESSED
+			backend->PushMouse(row, column, strcmp(name, "up") == 0
+					? BUTTON4_PRESSED : BUTTON5_PRESSED);
+#else
+			backend->PushMouse(row, column, BUTTON4_PRESSED);
+#endif
+		}
+		else if (strcmp(command, "resize") == 0) {
+			if (sscanf(args, "%d %d", &row, &column) != 2) {
+				fprintf(stderr, "%s:%d: Invalid size\n", file, line);
+				ok = false;
+				break;
+			}
+			backend->PushResize(row, column);
+		}
+		else if (strcmp(command, "expect") == 0) {
+			n = 0;
+			if (sscanf(args, "%d %d %n", &row, &column, &n) != 2 || n == 0) {
+				fprintf(stderr, "%s:%d: Invalid expectation\n", file, line);
+				ok = false;
+				break;
+			}
+			backend->PushExpect(row, column, unescape(args + n).c_str());
+		}
+		else if (strcmp(command, "dump") == 0) {
+			backend->PushDump();
+		}
+		else if (strcmp(command, "wait") == 0) {
+			backend->PushWait();
+		}
+		else {
+			fprintf(stderr, "%s:%d: Unknown command \"%s\"\n", file, line,
+					command);
+			ok = false;
+			break;
+		}
+	}
+
+	fclose(f);
+	return ok;
+}
+
+
+/**
+ * Write a file of the boundary test corpus
+ *
+ * @param dir the directory
+ * @param name the file name
+ * @param write the function that writes the contents
+ * @return true on success
+ */
+static bool write_corpus_file(const char* dir, const char* name,
+		const std::function<bool(FILE*)>& write)
+{
+	std::string path = dir;
+	path += "/";
+	path += name;
+
+	FILE* f = fopen(path.c_str(), "w");
+	if (f == NULL) {
+		fprintf(stderr, "Cannot create %s: %s\n", path.c_str(), strerror(errno));
+		return false;
+	}
+
+	bool ok = write(f);
+	if (fclose(f) != 0) ok = false;
+
+	if (!ok) {
+		fprintf(stderr, "Cannot write %s: %s\n", path.c_str(), strerror(errno));
+	}
+
+	return ok;
+}
+
+
+/**
+ * Write the same byte many times
+ *
+ * @param f the file
+ * @param c the byte
+ * @param count the number of times
+ * @return true on success
+ */
+static bool write_repeated(FILE* f, char c, uint64_t count)
+{
+	char buf[1 << 16];
+	memset(buf, c, sizeof(buf));
+
+	while (count > 0) {
+		size_t n = count < sizeof(buf) ? (size_t) count : sizeof(buf);
+		if (fwrite(buf, 1, n, f) != n) return false;
+		count -= n;
+	}
+
+	return true;
+}
+
+
+/**
+ * Write the boundary test corpus, which consists of pairs of a text file and
+ * a script that checks how the editor handles it. The last two files cross
+ * the 32-bit limits of the column and line numbers, so they take a few GB of
+ * disk space, and they should be run as "ape-benchmark long-line.script
+ * long-line.txt" and "ape-benchmark --pager many-lines.script many-lines.txt"
+ *
+ * @param dir the directory
+ * @return true on success
+ */
+static bool write_corpus(const char* dir)
+{
+	const uint64_t limit = (uint64_t) 1 << 31;
+	bool ok = true;
+
+
+	// An empty file, in which no cursor movement goes anywhere
+
+	ok = ok && write_corpus_file(dir, "empty.txt", [](FILE*) {
+		return true;
+	});
+	ok = ok && write_corpus_file(dir, "empty.script", [](FILE* f) {
+		fprintf(f, "key end\nkey down\nkey pgdn\nkey right\n");
+		fprintf(f, "key backspace\nkey delete\n");
+		fprintf(f, "expect 22 9 0:0 -\n");
+		return true;
+	});
+
+
+	// A file without the final newline
+
+	ok = ok && write_corpus_file(dir, "no-final-newline.txt", [](FILE* f) {
+		fprintf(f, "first\nlast");
+		return true;
+	});
+	ok = ok && write_corpus_file(dir, "no-final-newline.script", [](FILE* f) {
+		fprintf(f, "key down 2\nkey end\nexpect 22 9 1:4 -\n");
+		fprintf(f, "type !\nexpect 3 1 last!\n");
+		return true;
+	});
+
+
+	// Lines around the edges of the chunks of the line store
+
+	ok = ok && write_corpus_file(dir, "chunk-edges.txt", [](FILE* f) {
+		for (int i = 0; i <= 2 * 512; i++) fprintf(f, "line %d\n", i);
+		return true;
+	});
+	ok = ok && write_corpus_file(dir, "chunk-edges.script", [](FILE* f) {
+		fprintf(f, "key pgdn 25\nkey down 11\nkey end\nkey right\n");
+		fprintf(f, "expect 22 7 512:0 -\n");
+		fprintf(f, "key backspace\nexpect 22 7 511:8 -\n");
+		fprintf(f, "expect 13 1 line 511line 512\n");
+		fprintf(f, "key enter\nkey pgdn 25\nkey down 12\n");
+		fprintf(f, "expect 22 6 1024:0 -\nexpect 21 1 line 1024\n");
+		fprintf(f, "key down\nexpect 22 6 1025:0 -\n");
+		fprintf(f, "key pgup 52\nexpect 22 9 0:0 -\n");
+		return true;
+	});
+
+
+	// Tabs that end right before, at, and after a tab stop
+
+	ok = ok && write_corpus_file(dir, "tab-stops.txt", [](FILE* f) {
+		fprintf(f, "\tx\nabc\tx\nabcd\tx\nabcde\tx\n");
+		return true;
+	});
+	ok = ok && write_corpus_file(dir, "tab-stops.script", [](FILE* f) {
+		fprintf(f, "expect 2 5 x\nexpect 3 5 x\nexpect 4 9 x\nexpect 5 9 x\n");
+		fprintf(f, "key down 3\nkey end\nexpect 22 9 3:9 -\n");
+		return true;
+	});
+
+
+	// A file with a BOM and more lines than are saved by one writev() call,
+	// which is saved by the script
+
+	ok = ok && write_corpus_file(dir, "bom-save.txt", [](FILE* f) {
+		fputs("\xEF\xBB\xBF", f);
+		for (int i = 0; i < 600; i++) fprintf(f, "line %d\n", i);
+		return true;
+	});
+	ok = ok && write_corpus_file(dir, "bom-save.script", [](FILE* f) {
+		fprintf(f, "type X\nexpect 22 3 *\n");
+		fprintf(f, "key ctrl-s\nwait\nexpect 22 3 -\n");
+		fprintf(f, "expect 23 1 bom-save.txt: UTF-8 with BOM\n");
+		return true;
+	});
+
+
+	// A line longer than 2^31 characters
+
+	ok = ok && write_corpus_file(dir, "long-line.txt", [limit](FILE* f) {
+		return write_repeated(f, 'x', limit + 64) && fputs("\nend\n", f) >= 0;
+	});
+	ok = ok && write_corpus_file(dir, "long-line.script", [](FILE* f) {
+		fprintf(f, "key end\nexpect 22 9 0:2147483712 -\n");
+		fprintf(f, "key down\nexpect 22 9 1:3 -\n");
+		fprintf(f, "key up\nkey end\nkey left\n");
+		fprintf(f, "expect 22 9 0:2147483711 -\n");
+		return true;
+	});
+
+
+	// More than 2^31 lines, which can be opened only in the pager
+
+	ok = ok && write_corpus_file(dir, "many-lines.txt", [limit](FILE* f) {
+		return fputs("first\n", f) >= 0 && write_repeated(f, '\n', limit)
+			&& fputs("last\n", f) >= 0;
+	});
+	ok = ok && write_corpus_file(dir, "many-lines.script", [](FILE* f) {
+		fprintf(f, "wait\nexpect 2 1 first\nkey ctrl-a\n");
+		fprintf(f, "expect 22 0 +--R 2147483650:0 -\n");
+		fprintf(f, "key up\nexpect 20 1 last\nexpect 22 5 2147483649:0 -\n");
+		fprintf(f, "key up 2\nkey pgup\nexpect 22 5 2147483627:0 -\n");
+		return true;
+	});
+
+	return ok;
+}
+
+
+/**
+ * The entry point to the benchmark, which runs the window system with the
+ * headless terminal backend driven by a script
+ *
+ * @param argc the number of command-line arguments
+ * @param argv the command-line arguments
+ * @return the exit code
+ */
+int main(int argc, char * const argv[])
+{
+	int rows = 24;
+	int cols = 80;
+	int repeat = 1;
+	int jobs = 0;
+	bool dump = false;
+	bool pager = false;
+
+
+	// Parse the command-line arguments
+
+	while (true) {
+		int option_index = 0;
+		int c = getopt_long(argc, argv, SHORT_OPTIONS, LONG_OPTIONS,
+				&option_index);
+		if (c == -1) break;
+
+		switch (c) {
+
+			case 'c':
+				if (!parse_int(optarg, cols) || cols < MIN_COLUMNS) {
+					fprintf(stderr, "Invalid number of columns: %s (the minimum "
+							"is %d)\n", optarg, MIN_COLUMNS);
+					return 1;
+				}
+				break;
+
+			case 'd':
+				dump = true;
+				break;
+
+			case 'g':
+				return write_corpus(optarg) ? 0 : 1;
+
+			case 'h':
+				usage(argv[0]);
+				return 0;
+
+			case 'j':
+				jobs = atoi(optarg);
+				break;
+
+			case 'n':
+				repeat = atoi(optarg);
+				break;
+
+			case 'p':
+				pager = true;
+				break;
+
+			case 'r':
+				if (!parse_int(optarg, rows) || rows < MIN_ROWS) {
+					fprintf(stderr, "Invalid number of rows: %s (the minimum "
+							"is %d)\n", optarg, MIN_ROWS);
+					return 1;
+				}
+				break;
+
+			case '?':
+			case ':':
+				return 1;
+
+			default:
+				abort();
+		}
+	}
+
+	if (optind >= argc || repeat <= 0 || jobs < 0) {
+		usage(argv[0]);
+		return 1;
+	}
+
+
+	HeadlessBackend* backend = new HeadlessBackend(rows, cols);
+
+
+	// Initialize and open the files
+
+	pool.Start(jobs);
+	wm.Initialize(backend);
+
+	if (optind + 1 >= argc) {
+		EditorWindow* w = new EditorWindow(2, 1, wm.Rows()-4, wm.Columns()-2);
+		w->Maximize();
+		wm.Add(w);
+	}
+	else {
+		for (int i = optind + 1; i < argc; i++) {
+			EditorWindow* w = new EditorWindow(2, 1, wm.Rows()-4, wm.Columns()-2);
+			ReturnExt r = pager ? w->OpenPager(argv[i])
+				: w->LoadFromFile(argv[i]);
+			if (!r) {
+				fprintf(stderr, "Cannot load %s: %s\n", argv[i], r.Message());
+				return 1;
+			}
+			w->Maximize();
+			wm.Add(w);
+		}
+	}
+
+
+	// Load the script only now, since loading the files polls the input
+	// for Ctrl+C, which would consume the scripted events
+
+	for (int i = 0; i < repeat; i++) {
+		if (!load_script(backend, argv[optind])) return 1;
+	}
+
+
+	// Run the script, and report the results once all events have been
+	// processed
+
+	double start = Time();
+
+	backend->SetOnFinish([backend, start, dump] {
+
+		double t = Time() - start;
+		unsigned long events = backend->EventsProcessed();
+		unsigned long frames = backend->FramesOutput();
+
+		if (dump) backend->Dump(stdout);
+
+		printf("Events    : %lu\n", events);
+		printf("Frames    : %lu\n", frames);
+		printf("Time      : %.3lf s\n", t);
+		printf("Throughput: %.1lf events/s\n", t > 0 ? events / t : 0);
+		printf("Per frame : %.3lf ms\n", frames > 0 ? 1000 * t / frames : 0);
+
+		ThreadPoolStatistics s = pool.Statistics();
+		printf("Workers   : %d (%lu tasks, %lu stolen, %.1lf%% utilization)\n",
+				s.workers, s.executed, s.stolen, 100 * s.Utilization());
+
+		if (backend->Failures() > 0) {
+			printf("Failures  : %lu\n", backend->Failures());
+		}
+
+		std::exit(backend->Failures() > 0 ? 1 : 0);
+	});
+
+	backend->SetIdleCheck([] {
+		ThreadPoolStatistics s = pool.Statistics();
+		return s.executed + s.cancelled >= s.submitted;
+	});
+
+	// Output the initial frame right away, so that the script does not
+	// start with the frame left over from loading the files
+
+	wm.Flush();
+
+	for (;;) {
+		wm.ProcessMessages();
+	}
+
+	return 0;
+}
+
@@ -0,0 +1,235 @@
+.PHONY: all
+all: build/ASCIITable.o build/Button.o build/CheckBox.o build/ColorTable.o build/Component.o build/Compression.o build/Container.o build/CursesBackend.o build/DialogWindow.o build/Diff.o build/Document.o build/EditAction.o build/Editor.o build/EditorWindow.o build/FeaturePolicy.o build/FileDialog.o build/FileList.o build/FileWatcher.o build/HeadlessBackend.o build/HexDocument.o build/HexEditor.o build/HexWindow.o build/Histogram.o build/InputDecoder.o build/Label.o build/List.o build/Manager.o build/MenuWindow.o build/Operation.o build/Pager.o build/Parser.o build/ScrollBar.o build/SplitPane.o build/TaskQueue.o build/TerminalBackend.o build/TerminalControl.o build/TextFormat.o build/TextStorage.o build/ThreadPool.o build/UTF8.o build/Window.o build/WindowSwitcher.o build/benchmark.o build/main.o build/util.o
+
+build/ASCIITable.o: ASCIITable.cpp stdafx.h util.h ASCIITable.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Button.o: Button.cpp stdafx.h util.h Button.h Component.h Events.h \
+ Mouse.h TerminalControl.h Container.h Window.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/CheckBox.o: CheckBox.cpp stdafx.h util.h CheckBox.h Component.h Events.h \
+ Mouse.h TerminalControl.h Container.h Window.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/ColorTable.o: ColorTable.cpp stdafx.h util.h ColorTable.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Component.o: Component.cpp stdafx.h util.h Component.h Events.h Mouse.h \
+ TerminalControl.h Container.h Manager.h MenuWindow.h Window.h \
+ TaskQueue.h TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h \
+ Label.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Compression.o: Compression.cpp stdafx.h util.h Compression.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Container.o: Container.cpp stdafx.h util.h Container.h Component.h \
+ Events.h Mouse.h TerminalControl.h Manager.h MenuWindow.h Window.h \
+ TaskQueue.h TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h \
+ Label.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/CursesBackend.o: CursesBackend.cpp stdafx.h util.h CursesBackend.h \
+ InputDecoder.h TerminalBackend.h TerminalControl.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/DialogWindow.o: DialogWindow.cpp stdafx.h util.h DialogWindow.h Button.h \
+ Component.h Events.h Mouse.h TerminalControl.h Label.h Window.h \
+ Container.h Manager.h MenuWindow.h TaskQueue.h TerminalBackend.h \
+ WindowSwitcher.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Diff.o: Diff.cpp stdafx.h util.h Diff.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Document.o: Document.cpp stdafx.h util.h Document.h Diff.h EditAction.h \
+ FeaturePolicy.h FileWatcher.h Histogram.h Parser.h TextFormat.h \
+ TextStorage.h ThreadPool.h UTF8.h Compression.h Manager.h MenuWindow.h \
+ Window.h Container.h Component.h Events.h Mouse.h TerminalControl.h \
+ TaskQueue.h TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h \
+ Label.h List.h ScrollBar.h Operation.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/EditAction.o: EditAction.cpp stdafx.h util.h EditAction.h Document.h \
+ Diff.h FeaturePolicy.h FileWatcher.h Histogram.h Parser.h TextFormat.h \
+ TextStorage.h ThreadPool.h UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Editor.o: Editor.cpp stdafx.h util.h Editor.h Component.h Events.h \
+ Mouse.h TerminalControl.h Document.h Diff.h EditAction.h FeaturePolicy.h \
+ FileWatcher.h Histogram.h Parser.h TextFormat.h TextStorage.h \
+ ThreadPool.h UTF8.h ScrollBar.h Container.h Manager.h MenuWindow.h \
+ Window.h TaskQueue.h TerminalBackend.h WindowSwitcher.h DialogWindow.h \
+ Button.h Label.h List.h Operation.h Pager.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/EditorWindow.o: EditorWindow.cpp stdafx.h util.h EditorWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h Editor.h \
+ Document.h Diff.h EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h \
+ Parser.h TextFormat.h TextStorage.h ThreadPool.h UTF8.h ScrollBar.h \
+ Label.h SplitPane.h Button.h CheckBox.h Compression.h DialogWindow.h \
+ FileDialog.h FileList.h List.h Manager.h MenuWindow.h TaskQueue.h \
+ TerminalBackend.h WindowSwitcher.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/FeaturePolicy.o: FeaturePolicy.cpp stdafx.h util.h FeaturePolicy.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/FileDialog.o: FileDialog.cpp stdafx.h util.h FileDialog.h DialogWindow.h \
+ Button.h Component.h Events.h Mouse.h TerminalControl.h Label.h Window.h \
+ Container.h FileList.h List.h ScrollBar.h Manager.h MenuWindow.h \
+ TaskQueue.h TerminalBackend.h WindowSwitcher.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/FileList.o: FileList.cpp stdafx.h util.h FileList.h List.h Component.h \
+ Events.h Mouse.h TerminalControl.h ScrollBar.h DialogWindow.h Button.h \
+ Label.h Window.h Container.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/FileWatcher.o: FileWatcher.cpp stdafx.h util.h FileWatcher.h Manager.h \
+ MenuWindow.h Window.h Container.h Component.h Events.h Mouse.h \
+ TerminalControl.h TaskQueue.h TerminalBackend.h WindowSwitcher.h \
+ DialogWindow.h Button.h Label.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/HeadlessBackend.o: HeadlessBackend.cpp stdafx.h util.h HeadlessBackend.h \
+ TerminalBackend.h TerminalControl.h UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/HexDocument.o: HexDocument.cpp stdafx.h util.h HexDocument.h Document.h \
+ Diff.h EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h Parser.h \
+ TextFormat.h TextStorage.h ThreadPool.h UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/HexEditor.o: HexEditor.cpp stdafx.h util.h HexEditor.h Component.h \
+ Events.h Mouse.h TerminalControl.h HexDocument.h ScrollBar.h Container.h \
+ Manager.h MenuWindow.h Window.h TaskQueue.h TerminalBackend.h \
+ WindowSwitcher.h DialogWindow.h Button.h Label.h List.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/HexWindow.o: HexWindow.cpp stdafx.h util.h HexWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h Editor.h \
+ Document.h Diff.h EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h \
+ Parser.h TextFormat.h TextStorage.h ThreadPool.h UTF8.h ScrollBar.h \
+ HexEditor.h HexDocument.h SplitPane.h DialogWindow.h Button.h Label.h \
+ Manager.h MenuWindow.h TaskQueue.h TerminalBackend.h WindowSwitcher.h \
+ List.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Histogram.o: Histogram.cpp stdafx.h util.h Histogram.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/InputDecoder.o: InputDecoder.cpp stdafx.h util.h InputDecoder.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Label.o: Label.cpp stdafx.h util.h Label.h Component.h Events.h Mouse.h \
+ TerminalControl.h Container.h Window.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/List.o: List.cpp stdafx.h util.h List.h Component.h Events.h Mouse.h \
+ TerminalControl.h ScrollBar.h Container.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Manager.o: Manager.cpp stdafx.h util.h Manager.h MenuWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h TaskQueue.h \
+ TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h Label.h \
+ List.h ScrollBar.h CursesBackend.h InputDecoder.h EditorWindow.h \
+ Editor.h Document.h Diff.h EditAction.h FeaturePolicy.h FileWatcher.h \
+ Histogram.h Parser.h TextFormat.h TextStorage.h ThreadPool.h UTF8.h \
+ SplitPane.h CheckBox.h FileDialog.h FileList.h Operation.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/MenuWindow.o: MenuWindow.cpp stdafx.h util.h MenuWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h Manager.h \
+ TaskQueue.h TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h \
+ Label.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Operation.o: Operation.cpp stdafx.h util.h Operation.h ThreadPool.h \
+ Manager.h MenuWindow.h Window.h Container.h Component.h Events.h Mouse.h \
+ TerminalControl.h TaskQueue.h TerminalBackend.h WindowSwitcher.h \
+ DialogWindow.h Button.h Label.h List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Pager.o: Pager.cpp stdafx.h util.h Pager.h Document.h Diff.h EditAction.h \
+ FeaturePolicy.h FileWatcher.h Histogram.h Parser.h TextFormat.h \
+ TextStorage.h ThreadPool.h UTF8.h Manager.h MenuWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h TaskQueue.h \
+ TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h Label.h \
+ List.h ScrollBar.h Operation.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Parser.o: Parser.cpp stdafx.h util.h Parser.h Document.h Diff.h \
+ EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h TextFormat.h \
+ TextStorage.h ThreadPool.h UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/ScrollBar.o: ScrollBar.cpp stdafx.h util.h ScrollBar.h Component.h \
+ Events.h Mouse.h TerminalControl.h Manager.h MenuWindow.h Window.h \
+ Container.h TaskQueue.h TerminalBackend.h WindowSwitcher.h \
+ DialogWindow.h Button.h Label.h List.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/SplitPane.o: SplitPane.cpp stdafx.h util.h SplitPane.h Container.h \
+ Component.h Events.h Mouse.h TerminalControl.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/TaskQueue.o: TaskQueue.cpp stdafx.h util.h TaskQueue.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/TerminalBackend.o: TerminalBackend.cpp stdafx.h util.h TerminalBackend.h \
+ TerminalControl.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/TerminalControl.o: TerminalControl.cpp stdafx.h util.h TerminalControl.h \
+ UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/TextFormat.o: TextFormat.cpp stdafx.h util.h TextFormat.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/TextStorage.o: TextStorage.cpp stdafx.h util.h TextStorage.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/ThreadPool.o: ThreadPool.cpp stdafx.h util.h ThreadPool.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/UTF8.o: UTF8.cpp stdafx.h util.h UTF8.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/Window.o: Window.cpp stdafx.h util.h Window.h Container.h Component.h \
+ Events.h Mouse.h TerminalControl.h Manager.h MenuWindow.h TaskQueue.h \
+ TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h Label.h \
+ List.h ScrollBar.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/WindowSwitcher.o: WindowSwitcher.cpp stdafx.h util.h WindowSwitcher.h \
+ DialogWindow.h Button.h Component.h Events.h Mouse.h TerminalControl.h \
+ Label.h Window.h Container.h List.h ScrollBar.h Manager.h MenuWindow.h \
+ TaskQueue.h TerminalBackend.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/benchmark.o: benchmark.cpp stdafx.h util.h EditorWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h Editor.h \
+ Document.h Diff.h EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h \
+ Parser.h TextFormat.h TextStorage.h ThreadPool.h UTF8.h ScrollBar.h \
+ Label.h SplitPane.h Button.h CheckBox.h HeadlessBackend.h \
+ TerminalBackend.h Manager.h MenuWindow.h TaskQueue.h WindowSwitcher.h \
+ DialogWindow.h List.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/main.o: main.cpp stdafx.h util.h Manager.h MenuWindow.h Window.h \
+ Container.h Component.h Events.h Mouse.h TerminalControl.h TaskQueue.h \
+ TerminalBackend.h WindowSwitcher.h DialogWindow.h Button.h Label.h \
+ List.h ScrollBar.h ColorTable.h ASCIITable.h EditorWindow.h Editor.h \
+ Document.h Diff.h EditAction.h FeaturePolicy.h FileWatcher.h Histogram.h \
+ Parser.h TextFormat.h TextStorage.h ThreadPool.h UTF8.h SplitPane.h \
+ CheckBox.h HexWindow.h HexEditor.h HexDocument.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
+build/util.o: util.cpp stdafx.h util.h
+	g++ -c --std=c++11 -ggdb -D_DEBUG -o $@ $<
+
@@ -35,6 +35,7 @@
 #include "stdafx.h"
 
 #include <csignal>
+#include <fcntl.h>
 #include <getopt.h>
 #include <libgen.h>
 #include <unistd.h>
@@ -44,6 +45,11 @@
 #include "ASCIITable.h"
 #include "MenuWindow.h"
 #include "EditorWindow.h"
+#include "FeaturePolicy.h"
+#include "HexWindow.h"
+#include "ThreadPool.h"
+
+#define APE_IDLE_TIMEOUT	0.100	/* seconds */
 
 
 /**
@@ -58,7 +64,7 @@ static void sigint(int sig)
 /**
  * Short command-line arguments
  */
-static const char* SHORT_OPTIONS = "h";
+static const char* SHORT_OPTIONS = "d:e:fhj:l:m:pt:x";
 
 
 /**
@@ -66,7 +72,16 @@ static const char* SHORT_OPTIONS = "h";
  */
 static struct option LONG_OPTIONS[] =
 {
+	{"durability"   , required_argument, 0, 'd'},
+	{"encoding"     , required_argument, 0, 'e'},
+	{"follow"       , no_argument,       0, 'f'},
 	{"help"         , no_argument,       0, 'h'},
+	{"jobs"         , required_argument, 0, 'j'},
+	{"large-file"   , required_argument, 0, 'l'},
+	{"stream-limit" , required_argument, 0, 'm'},
+	{"pager"        , no_argument,       0, 'p'},
+	{"tab-size"     , required_argument, 0, 't'},
+	{"hex"          , no_argument,       0, 'x'},
 	{0, 0, 0, 0}
 };
 
@@ -81,10 +96,26 @@ static void usage(const char* arg0) {
 	char* s = strdup(arg0);
 	char* p = basename(s);
 	fprintf(stderr, "Usage: %s [OPTIONS] [FILE [FILE...]]\n\n", p);
+	fprintf(stderr, "Use - as the file name to read the standard input.\n\n");
 	free(s);
 	
 	fprintf(stderr, "Options:\n");
+	fprintf(stderr, "  -d, --durability MODE Set how saved files are flushed to the disk:\n");
+	fprintf(stderr, "                        none, data (default), or full\n");
+	fprintf(stderr, "  -e, --encoding NAME   Set the encoding of the files: auto (default), utf-8,\n");
+	fprintf(stderr, "                        latin-1, utf-16le, or utf-16be\n");
+	fprintf(stderr, "  -f, --follow          Keep appending the lines written to the files\n");
 	fprintf(stderr, "  -h, --help            Show this usage information and exit\n");
+	fprintf(stderr, "  -j, --jobs N          Set the number of worker threads (default: one per CPU)\n");
+	fprintf(stderr, "  -l, --large-file SPEC Set the file sizes in megabytes above which features\n");
+	fprintf(stderr, "                        are turned off, e.g. syntax=64,pager=none\n");
+	fprintf(stderr, "  -m, --stream-limit MB Stop reading the standard input after this many\n");
+	fprintf(stderr, "                        megabytes, leaving the document read-only\n");
+	fprintf(stderr, "                        (default: %llu)\n",
+			APE_STREAM_DEFAULT_LIMIT / (1024 * 1024));
+	fprintf(stderr, "  -p, --pager           Open the files read-only, paging them in on demand\n");
+	fprintf(stderr, "  -t, --tab-size N      Set the number of columns per tab stop (default: 4)\n");
+	fprintf(stderr, "  -x, --hex             Open the files as binary in the hex editor\n");
 }
 
 
@@ -97,6 +128,12 @@ static void usage(const char* arg0) {
  */
 int main(int argc, char * const argv[])
 {
+	int jobs = 0;
+	bool pager = false;
+	bool hex = false;
+	bool follow = false;
+
+
 	// Parse the command-line arguments
 
 	while (true) {
@@ -107,10 +144,80 @@ int main(int argc, char * const argv[])
 
 		switch (c) {
 
+			case 'd':
+				if (strcmp(optarg, "none") == 0) {
+					EditorDocument::SetDurability(SAVE_DURABILITY_NONE);
+				}
+				else if (strcmp(optarg, "data") == 0) {
+					EditorDocument::SetDurability(SAVE_DURABILITY_DATA);
+				}
+				else if (strcmp(optarg, "full") == 0) {
+					EditorDocument::SetDurability(SAVE_DURABILITY_FULL);
+				}
+				else {
+					fprintf(stderr, "Invalid durability mode: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'e':
+				{
+					TextEncoding encoding;
+					if (!TextFormat::ParseEncoding(optarg, encoding)) {
+						fprintf(stderr, "Invalid encoding: %s\n", optarg);
+						return 1;
+					}
+					TextDecoder::SetEncoding(encoding);
+				}
+				break;
+
+			case 'f':
+				follow = true;
+				break;
+
 			case 'h':
 				usage(argv[0]);
 				return 0;
 
+			case 'j':
+				jobs = atoi(optarg);
+				if (jobs <= 0) {
+					fprintf(stderr, "Invalid number of jobs: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'l':
+				if (!FeaturePolicy::Configure(optarg)) {
+					fprintf(stderr, "Invalid large file thresholds: %s\n", optarg);
+					return 1;
+				}
+				break;
+
+			case 'm':
+				if (atoll(optarg) <= 0) {
+					fprintf(stderr, "Invalid stream limit: %s\n", optarg);
+					return 1;
+				}
+				EditorDocument::SetStreamLimit(atoll(optarg) * 1024 * 1024);
+				break;
+
+			case 'p':
+				pager = true;
+				break;
+
+			case 't':
+				if (atoi(optarg) <= 0) {
+					fprintf(stderr, "Invalid tab size: %s\n", optarg);
+					return 1;
+				}
+				DocumentLine::SetTabSize(atoi(optarg));
+				break;
+
+			case 'x':
+				hex = true;
+				break;
+
 			case '?':
 			case ':':
 				return 1;
@@ -121,12 +228,46 @@ int main(int argc, char * const argv[])
 	}
 
 
+	// If the standard input is to be read as a document, move it out of
+	// the way and attach the terminal in its place
+
+	int streamFd = -1;
+
+	for (int i = optind; i < argc; i++) {
+		if (strcmp(argv[i], "-") != 0) continue;
+
+		if (streamFd >= 0) {
+			fprintf(stderr, "The standard input can be read only once\n");
+			return 1;
+		}
+
+		if (isatty(0)) {
+			fprintf(stderr, "The standard input is a terminal\n");
+			return 1;
+		}
+
+		int tty = open("/dev/tty", O_RDWR);
+		if (tty < 0) {
+			perror("Cannot open the terminal");
+			return 1;
+		}
+
+		streamFd = dup(0);
+		if (streamFd < 0 || dup2(tty, 0) < 0) {
+			perror("Cannot redirect the standard input");
+			return 1;
+		}
+		close(tty);
+	}
+
+
 	// Set up the signal handlers and initialize
 
 	signal(SIGINT, sigint);
 	signal(SIGSEGV, sigint);
 	signal(SIGABRT, sigint);
 
+	pool.Start(jobs);
 	wm.Initialize();
 
 
@@ -154,8 +295,28 @@ int main(int argc, char * const argv[])
 				cols -= 2;
 			}
 
-			EditorWindow* w = new EditorWindow(r, c, rows, cols);
-			w->LoadFromFile(argv[i]);
+			Window* w;
+			if (hex && strcmp(argv[i], "-") != 0) {
+				HexWindow* h = new HexWindow(r, c, rows, cols);
+				h->Open(argv[i]);
+				w = h;
+			}
+			else {
+				EditorWindow* e = new EditorWindow(r, c, rows, cols);
+				if (strcmp(argv[i], "-") == 0) {
+					e->LoadFromStream(streamFd, "stdin");
+				}
+				else if (follow) {
+					e->Follow(argv[i]);
+				}
+				else if (pager) {
+					e->OpenPager(argv[i]);
+				}
+				else {
+					e->Open(argv[i]);
+				}
+				w = e;
+			}
 
 			if (n == 1) {
 				w->Maximize();
@@ -168,12 +329,12 @@ int main(int argc, char * const argv[])
 
 	// Main loop
 
-	while (getch() != ERR);
+	wm.DiscardInput();
 	wm.Refresh();
 
 	for (;;) {
-		usleep(5 * 1000);
 		wm.ProcessMessages();
+		wm.WaitForEvents(APE_IDLE_TIMEOUT);
 	}
 
 	sigint(0);
@@ -46,7 +46,11 @@ PROG_SOURCES := $(sort $(PROG_SOURCES))
 PROG_OBJECTS := $(patsubst %.c,%.o,$(patsubst %.cpp,%.o,$(PROG_SOURCES)))
 PROG_OBJECTS := $(patsubst %,$(BUILD_DIR)/%,$(sort $(PROG_OBJECTS)))
 
-ALL_SOURCES := $(sort $(PROG_SOURCES) $(SOURCES))
+BENCHMARK_SOURCES := $(sort $(BENCHMARK_SOURCES)) 
+BENCHMARK_OBJECTS := $(patsubst %.c,%.o,$(patsubst %.cpp,%.o,$(BENCHMARK_SOURCES)))
+BENCHMARK_OBJECTS := $(patsubst %,$(BUILD_DIR)/%,$(sort $(BENCHMARK_OBJECTS)))
+
+ALL_SOURCES := $(sort $(PROG_SOURCES) $(BENCHMARK_SOURCES) $(SOURCES))
 ALL_OBJECTS := $(patsubst %.c,%.o,$(patsubst %.cpp,%.o,$(ALL_SOURCES)))
 ALL_OBJECTS := $(patsubst %,$(BUILD_DIR)/%,$(sort $(ALL_OBJECTS)))
 
@@ -59,6 +63,10 @@ ALL_OBJECTS := $(patsubst %,$(BUILD_DIR)/%,$(sort $(ALL_OBJECTS)))
 
 all: $(BUILD_DIR)/$(TARGET)
 
+ifdef BENCHMARK_TARGET
+all: $(BUILD_DIR)/$(BENCHMARK_TARGET)
+endif
+
 target: $(BUILD_DIR)/$(TARGET)
 
 targetclean:
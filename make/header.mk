@@ -50,7 +50,15 @@ SHELL := /bin/bash
 
 LIB_INCLUDE_FLAGS := $(TERM_INCLUDE_FLAGS)
 LIB_LINKER_FLAGS := -L/usr/lib $(TERM_LINKER_FLAGS)
-LIB_LIBRARIES := $(TERM_LIBRARIES) -lcurses -lpanel
+# The wide-character curses, which is a separate library except on Mac OS X
+
+ifeq ($(shell uname -s),Darwin)
+CURSES_LIBRARIES := -lcurses -lpanel
+else
+CURSES_LIBRARIES := -lncursesw -lpanelw
+endif
+
+LIB_LIBRARIES := $(TERM_LIBRARIES) $(CURSES_LIBRARIES) -lpthread -lz
 
 
 #
@@ -43,3 +43,8 @@ gdb: all
 
 $(BUILD_DIR)/$(TARGET): $(BUILD_DIR) $(OBJECTS) $(PROG_OBJECTS)
 	$(LINK) -o $@ $(OBJECTS) $(PROG_OBJECTS) $(LIBRARIES)
+
+ifdef BENCHMARK_TARGET
+$(BUILD_DIR)/$(BENCHMARK_TARGET): $(BUILD_DIR) $(OBJECTS) $(BENCHMARK_OBJECTS)
+	$(LINK) -o $@ $(OBJECTS) $(BENCHMARK_OBJECTS) $(LIBRARIES)
+endif
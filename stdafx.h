@@ -47,6 +47,10 @@
 #include <exception>
 #include <string>
 
+// Use the wide-character curses API to output the non-ASCII characters
+
+#define NCURSES_WIDECHAR 1
+
 #include <curses.h>
 #include <panel.h>
 
@@ -63,6 +67,7 @@
 #endif
 
 #define KEY_CTRL(x) ((x) == ' ' ? 0 : (x) - 'a' + 1)
+#define KEY_ALT(x) ((x) | KEY_ALT_MASK)
 
 #define KEY_ESC				27
 #define KEY_RETURN			10
@@ -82,4 +87,6 @@
 #define KEY_SHIFT_ALT_RIGHT	1024
 #define KEY_SHIFT_ALT_HOME	1025
 #define KEY_SHIFT_ALT_END	1026
+#define KEY_PASTE			1101
+#define KEY_ALT_MASK		0x10000
 
@@ -102,10 +102,10 @@ double seconds(struct timeval& tim)
  * @param base the base
  * @return the number of digits
  */
-int digits(int num, int base)
+int digits(int64_t num, int base)
 {
 	int d = 1;
-	for (int n = num; n >= base; n /= base) d++;
+	for (int64_t n = num; n >= base; n /= base) d++;
 	return d;
 }
 
@@ -35,6 +35,8 @@
 #ifndef __UTIL_H
 #define __UTIL_H
 
+#include <stdint.h>
+
 struct timeval;
 
 
@@ -207,7 +209,7 @@ double seconds(struct timeval& tim);
  * @param base the base
  * @return the number of digits
  */
-int digits(int num, int base = 10);
+int digits(int64_t num, int base = 10);
 
 /**
  * Add a message to a log